@@ -17,9 +17,124 @@
     along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "rzip.h"
+#include "cfg/option.h"
 #include <zlib.h>
+#include <zstd.h>
+#ifndef TARGET_NO_OPENMP
+#include <omp.h>
+#endif
 
 const u8 RZipHeader[8] = { '#', 'R', 'Z', 'I', 'P', 'v', 1, '#' };
+constexpr u32 RZipVersion = 2;
+// Zlib files are written in the version 1 format
+constexpr u32 RZipZlibVersion = 1;
+// Version 2: the chunk is stored uncompressed
+constexpr u32 StoredChunk = 0x80000000;
+// Number of chunks compressed or uncompressed in parallel
+constexpr u32 ChunkBatch = 8;
+constexpr u32 MaxChunkSize = 16 * 1024 * 1024;
+
+static u32 maxCompressedSize(RZipFile::Codec codec, u32 size)
+{
+	switch (codec)
+	{
+	case RZipFile::Codec::Zstd:
+		return (u32)ZSTD_compressBound(size);
+	default:
+		// compression output buffer must be 0.1% larger + 12 bytes
+		return size + size / 1000 + 12;
+	}
+}
+
+// Returns false on error. Otherwise dstSize is set to the compressed size.
+static bool compressChunk(RZipFile::Codec codec, const u8 *src, u32 size, u8 *dst, u32& dstSize)
+{
+	switch (codec)
+	{
+	case RZipFile::Codec::Zstd:
+		{
+			size_t rc = ZSTD_compress(dst, dstSize, src, size, 1);
+			if (ZSTD_isError(rc))
+			{
+				WARN_LOG(SAVESTATE, "Compression error: %s", ZSTD_getErrorName(rc));
+				return false;
+			}
+			dstSize = (u32)rc;
+			return true;
+		}
+	case RZipFile::Codec::Zlib:
+		{
+			uLongf zippedSize = dstSize;
+			int rc = compress2(dst, &zippedSize, src, size, Z_BEST_SPEED);
+			if (rc != Z_OK)
+			{
+				WARN_LOG(SAVESTATE, "Compression error: %d", rc);
+				return false;
+			}
+			dstSize = (u32)zippedSize;
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+// dstSize is the size of the destination buffer on input and the uncompressed size on output.
+static bool uncompressChunk(RZipFile::Codec codec, const u8 *src, u32 size, u8 *dst, u32& dstSize)
+{
+	switch (codec)
+	{
+	case RZipFile::Codec::Zstd:
+		{
+			size_t rc = ZSTD_decompress(dst, dstSize, src, size);
+			if (ZSTD_isError(rc))
+				return false;
+			dstSize = (u32)rc;
+			return true;
+		}
+	case RZipFile::Codec::Zlib:
+		{
+			uLongf tl = dstSize;
+			if (uncompress(dst, &tl, src, size) != Z_OK)
+				return false;
+			dstSize = (u32)tl;
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+template<typename Func>
+static void forEachChunk(u32 count, Func func)
+{
+#ifndef TARGET_NO_OPENMP
+	int tcount = std::min((int)count, omp_get_num_procs());
+#pragma omp parallel for num_threads(tcount)
+#endif
+	for (int i = 0; i < (int)count; i++)
+		func(i);
+}
+
+// Version 1 zlib files can be loaded by older versions and by the libretro core.
+// zstd is built on all platforms so that version 2 files can be loaded by any newer build.
+RZipFile::Codec RZipFile::defaultCodec()
+{
+	return config::ZstdSavestates ? Codec::Zstd : Codec::Zlib;
+}
+
+bool RZipFile::isSupported(Codec codec)
+{
+	switch (codec)
+	{
+	case Codec::Zlib:
+		return true;
+	case Codec::Zstd:
+		return true;
+	default:
+		return false;
+	}
+}
 
 bool RZipFile::Open(const std::string& path, bool write)
 {
@@ -32,22 +147,44 @@ bool RZipFile::Open(const std::string& path, bool write)
 	{
 		u8 header[sizeof(RZipHeader)];
 		if (std::fread(header, sizeof(header), 1, file) != 1
-			|| memcmp(header, RZipHeader, sizeof(header))
+			|| memcmp(header, RZipHeader, 6) || header[7] != RZipHeader[7]
+			|| header[6] == 0 || header[6] > RZipVersion
 			|| std::fread(&maxChunkSize, sizeof(maxChunkSize), 1, file) != 1
-			|| std::fread(&size, sizeof(size), 1, file) != 1)
+			|| std::fread(&size, sizeof(size), 1, file) != 1
+			|| maxChunkSize == 0 || maxChunkSize > MaxChunkSize)
 		{
 			Close();
 			return false;
 		}
-		// savestates created on 32-bit platforms used to have a 32-bit size
-		if (size >> 32 != 0)
+		version = header[6];
+		if (version == 1)
 		{
-			size &= 0xffffffff;
-			std::fseek(file, -4, SEEK_CUR);
+			codec = Codec::Zlib;
+			// savestates created on 32-bit platforms used to have a 32-bit size
+			if (size >> 32 != 0)
+			{
+				size &= 0xffffffff;
+				std::fseek(file, -4, SEEK_CUR);
+			}
 		}
-		chunk = new u8[maxChunkSize];
+		else
+		{
+			if (std::fread(&codec, sizeof(codec), 1, file) != 1)
+			{
+				Close();
+				return false;
+			}
+			if (!isSupported(codec))
+			{
+				WARN_LOG(SAVESTATE, "%s: unsupported codec %d", path.c_str(), (int)codec);
+				Close();
+				return false;
+			}
+		}
+		chunkSizes.clear();
+		chunkSlot = 0;
 		chunkIndex = 0;
-		chunkSize = 0;
+		eof = false;
 	}
 
 	return true;
@@ -59,12 +196,88 @@ void RZipFile::Close()
 	{
 		std::fclose(file);
 		file = nullptr;
-		if (chunk != nullptr)
+		chunks = std::vector<u8>();
+		zipped = std::vector<u8>();
+		chunkSizes.clear();
+	}
+}
+
+// Read the next batch of compressed chunks and uncompress them in parallel
+bool RZipFile::readChunks()
+{
+	chunkSizes.clear();
+	chunkSlot = 0;
+	chunkIndex = 0;
+	if (eof)
+		return false;
+
+	const u32 maxZippedSize = maxCompressedSize(codec, maxChunkSize);
+	u32 zippedSizes[ChunkBatch];
+	size_t zippedOffsets[ChunkBatch];
+	u32 count = 0;
+	size_t total = 0;
+	while (count < ChunkBatch)
+	{
+		u32 zippedSize;
+		if (std::fread(&zippedSize, sizeof(zippedSize), 1, file) != 1)
+		{
+			eof = true;
+			break;
+		}
+		if (zippedSize == 0)
+			continue;
+		u32 dataSize = version >= 2 ? zippedSize & ~StoredChunk : zippedSize;
+		if (dataSize > maxZippedSize)
+		{
+			eof = true;
+			break;
+		}
+		if (zipped.size() < total + dataSize)
+			zipped.resize(total + dataSize);
+		if (std::fread(&zipped[total], dataSize, 1, file) != 1)
 		{
-			delete [] chunk;
-			chunk = nullptr;
+			eof = true;
+			break;
 		}
+		zippedSizes[count] = zippedSize;
+		zippedOffsets[count] = total;
+		total += dataSize;
+		count++;
 	}
+	if (count == 0)
+		return false;
+
+	if (chunks.size() < (size_t)ChunkBatch * maxChunkSize)
+		chunks.resize((size_t)ChunkBatch * maxChunkSize);
+	chunkSizes.resize(count);
+	forEachChunk(count, [&](int i) {
+		u8 *dst = &chunks[(size_t)i * maxChunkSize];
+		const u8 *src = &zipped[zippedOffsets[i]];
+		u32 chunkSize = maxChunkSize;
+		if (version >= 2 && (zippedSizes[i] & StoredChunk) != 0)
+		{
+			chunkSize = zippedSizes[i] & ~StoredChunk;
+			if (chunkSize <= maxChunkSize)
+				memcpy(dst, src, chunkSize);
+			else
+				chunkSize = 0;
+		}
+		else if (!uncompressChunk(codec, src, zippedSizes[i], dst, chunkSize))
+		{
+			chunkSize = 0;
+		}
+		chunkSizes[i] = chunkSize;
+	});
+	// Stop at the first invalid chunk
+	for (u32 i = 0; i < count; i++)
+		if (chunkSizes[i] == 0)
+		{
+			chunkSizes.resize(i);
+			eof = true;
+			break;
+		}
+
+	return !chunkSizes.empty();
 }
 
 size_t RZipFile::Read(void *data, size_t length)
@@ -75,35 +288,18 @@ size_t RZipFile::Read(void *data, size_t length)
 	size_t rv = 0;
 	while (rv < length)
 	{
-		if (chunkIndex == chunkSize)
-		{
-			chunkSize = 0;
-			chunkIndex = 0;
-			u32 zippedSize;
-			if (std::fread(&zippedSize, sizeof(zippedSize), 1, file) != 1)
-				break;
-			if (zippedSize == 0)
-				continue;
-			u8 *zipped = new u8[zippedSize];
-			if (std::fread(zipped, zippedSize, 1, file) != 1)
-			{
-				delete [] zipped;
-				break;
-			}
-			uLongf tl = maxChunkSize;
-			if (uncompress(chunk, &tl, zipped, zippedSize) != Z_OK)
-			{
-				delete [] zipped;
-				break;
-			}
-			delete [] zipped;
-			chunkSize = (u32)tl;
-		}
-		u32 l = std::min(chunkSize - chunkIndex, (u32)length);
-		memcpy(p, chunk + chunkIndex, l);
+		if (chunkSlot == chunkSizes.size() && !readChunks())
+			break;
+		u32 l = (u32)std::min<size_t>(chunkSizes[chunkSlot] - chunkIndex, length - rv);
+		memcpy(p, &chunks[(size_t)chunkSlot * maxChunkSize + chunkIndex], l);
 		p += l;
 		chunkIndex += l;
 		rv += l;
+		if (chunkIndex == chunkSizes[chunkSlot])
+		{
+			chunkSlot++;
+			chunkIndex = 0;
+		}
 	}
 
 	return rv;
@@ -113,39 +309,54 @@ size_t RZipFile::Write(const void *data, size_t length)
 {
 	verify(file != nullptr);
 	verify(std::ftell(file) == 0);
+	verify(isSupported(codec));
 
 	maxChunkSize = 1024 * 1024;
 	size = length;
-	if (std::fwrite(RZipHeader, sizeof(RZipHeader), 1, file) != 1
+	version = codec == Codec::Zlib ? RZipZlibVersion : RZipVersion;
+	u8 header[sizeof(RZipHeader)];
+	memcpy(header, RZipHeader, sizeof(header));
+	header[6] = version;
+	if (std::fwrite(header, sizeof(header), 1, file) != 1
 		|| std::fwrite(&maxChunkSize, sizeof(maxChunkSize), 1, file) != 1
-		|| std::fwrite(&size, sizeof(size), 1, file) != 1)
+		|| std::fwrite(&size, sizeof(size), 1, file) != 1
+		|| (version >= 2 && std::fwrite(&codec, sizeof(codec), 1, file) != 1))
 		return 0;
 	const u8 *p = (const u8 *)data;
-	// compression output buffer must be 0.1% larger + 12 bytes
-	uLongf maxZippedSize = maxChunkSize + maxChunkSize / 1000 + 12;
-	u8 *zipped = new u8[maxZippedSize];
+	const u32 maxZippedSize = maxCompressedSize(codec, maxChunkSize);
+	zipped.resize((size_t)ChunkBatch * maxZippedSize);
 	size_t rv = 0;
 	while (rv < length)
 	{
-		uLongf zippedSize = maxZippedSize;
-		uLongf uncompressedSize = std::min(maxChunkSize, (u32)(length - rv));
-		u32 rc = compress(zipped, &zippedSize, p, uncompressedSize);
-		if (rc != Z_OK)
-		{
-			WARN_LOG(SAVESTATE, "Compression error: %d", rc);
-			break;
-		}
-		u32 sz = (u32)zippedSize;
-		if (std::fwrite(&sz, sizeof(sz), 1, file) != 1
-			|| std::fwrite(zipped, zippedSize, 1, file) != 1)
+		const u32 count = (u32)std::min<size_t>(ChunkBatch, (length - rv + maxChunkSize - 1) / maxChunkSize);
+		u32 zippedSizes[ChunkBatch];
+		forEachChunk(count, [&](int i) {
+			size_t offset = rv + (size_t)i * maxChunkSize;
+			u32 chunkSize = (u32)std::min<size_t>(maxChunkSize, length - offset);
+			u8 *dst = &zipped[(size_t)i * maxZippedSize];
+			u32 zippedSize = maxZippedSize;
+			if (!compressChunk(codec, p + offset, chunkSize, dst, zippedSize))
+			{
+				zippedSize = 0;
+			}
+			else if (version >= 2 && zippedSize >= chunkSize)
+			{
+				memcpy(dst, p + offset, chunkSize);
+				zippedSize = chunkSize | StoredChunk;
+			}
+			zippedSizes[i] = zippedSize;
+		});
+		for (u32 i = 0; i < count; i++)
 		{
-			rv = 0;
-			break;
+			if (zippedSizes[i] == 0)
+				return rv;
+			u32 dataSize = zippedSizes[i] & ~StoredChunk;
+			if (std::fwrite(&zippedSizes[i], sizeof(u32), 1, file) != 1
+				|| std::fwrite(&zipped[(size_t)i * maxZippedSize], dataSize, 1, file) != 1)
+				return 0;
+			rv += std::min<size_t>(maxChunkSize, length - rv);
 		}
-		p += uncompressedSize;
-		rv += uncompressedSize;
 	}
-	delete [] zipped;
-	
+
 	return rv;
 }
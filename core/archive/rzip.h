@@ -16,15 +16,28 @@
     You should have received a copy of the GNU General Public License
     along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
 */
-// Implementation of the RZIP stream format as defined by libretro
+// Implementation of the RZIP stream format
+// Version 1 is the format defined by libretro:
 // https://github.com/libretro/libretro-common/blob/master/include/streams/rzip_stream.h
+// It is used by default, so that savestates can be read by older versions and by the libretro core.
+//
+// Version 2 is specific to Flycast and is only written when zstd savestates are enabled.
+// It adds a codec field after the header, and chunks with bit 31 of their size set are stored uncompressed.
+//
+// Chunks are compressed and uncompressed in parallel with both versions.
 
 #pragma once
 #include "types.h"
+#include <vector>
 
 class RZipFile
 {
 public:
+	enum class Codec : u32 {
+		Zlib,
+		Zstd,
+	};
+
 	~RZipFile() { Close(); }
 
 	bool Open(const std::string& path, bool write);
@@ -34,11 +47,23 @@ public:
 	size_t Write(const void *data, size_t length);
 	FILE *rawFile() const { return file; }
 
+	// Codec used to write new files
+	static Codec defaultCodec();
+	static bool isSupported(Codec codec);
+	Codec codec = defaultCodec();
+
 private:
+	bool readChunks();
+
 	FILE *file = nullptr;
 	u64 size = 0;
+	u32 version = 0;
 	u32 maxChunkSize = 0;
-	u8 *chunk = nullptr;
-	u32 chunkSize = 0;
+	// Uncompressed chunks, each one in a slot of maxChunkSize bytes
+	std::vector<u8> chunks;
+	std::vector<u32> chunkSizes;
+	u32 chunkSlot = 0;
 	u32 chunkIndex = 0;
+	std::vector<u8> zipped;
+	bool eof = false;
 };
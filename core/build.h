@@ -120,6 +120,8 @@
 #define FAST_MMU
 #define USE_WINCE_HACK
 #endif
+// Count and log the MMU address translations
+//#define MMU_STATS
 
 #define DC_PLATFORM_MASK        7
 #define DC_PLATFORM_DREAMCAST   0   /* Works, for the most part */
@@ -8,6 +8,7 @@
 
 #include "cfg/cfg.h"
 #include "stdclass.h"
+#include "hw/pvr/ta_capture.h"
 
 static int setconfig(char *arg[], int cl)
 {
@@ -68,12 +69,37 @@ static int showhelp()
 	printf("-config	section:key=value     add a virtual config value;\n");
 	printf("                              virtual config values won't be saved to the .cfg file\n");
 	printf("                              unless a different value is written to them\n");
+	printf("-tacapture FILE [FRAMES]      capture the display lists of the rendered frames to FILE\n");
+	printf("-tareplay FILE [LOOPS]        replay a display list capture without rendering and\n");
+	printf("                              print timings\n");
 	printf("-help                         display this help\n");
 
 	exit(0);
 	return 0;
 }
 
+// Optional numeric argument following an option
+static int numericArg(char **&arg, int& cl, int defaultValue)
+{
+	if (cl < 1 || !isdigit((unsigned char)arg[1][0]))
+		return defaultValue;
+	arg++;
+	cl--;
+	return atoi(*arg);
+}
+
+static void tareplay(const char *path, int loops)
+{
+	tacapture::ReplayStats stats;
+	bool success = tacapture::replay(path, loops, stats);
+	if (success)
+		stats.print();
+	else
+		fprintf(stderr, "Cannot replay %s\n", path);
+
+	exit(success ? 0 : 1);
+}
+
 bool ParseCommandLine(int argc,char* argv[])
 {
 	settings.content.path.clear();
@@ -91,6 +117,34 @@ bool ParseCommandLine(int argc,char* argv[])
 			cl-=as;
 			arg+=as;
 		}
+		else if (stricmp(*arg, "-tacapture") == 0 || stricmp(*arg, "--tacapture") == 0)
+		{
+			if (cl < 1)
+			{
+				WARN_LOG(COMMON, "-tacapture: missing file name");
+			}
+			else
+			{
+				arg++;
+				cl--;
+				const char *path = *arg;
+				tacapture::start(path, numericArg(arg, cl, 0));
+			}
+		}
+		else if (stricmp(*arg, "-tareplay") == 0 || stricmp(*arg, "--tareplay") == 0)
+		{
+			if (cl < 1)
+			{
+				WARN_LOG(COMMON, "-tareplay: missing file name");
+			}
+			else
+			{
+				arg++;
+				cl--;
+				const char *path = *arg;
+				tareplay(path, numericArg(arg, cl, 1));
+			}
+		}
 #if defined(__APPLE__)
 		else if (!strncmp(*arg, "-NSDocumentRevisions", 20))
 		{
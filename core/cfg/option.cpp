@@ -25,6 +25,10 @@ namespace config {
 
 Option<bool> DynarecEnabled("Dynarec.Enabled", true);
 Option<bool> DynarecIdleSkip("Dynarec.idleskip", true);
+Option<bool> DynarecPersistentCache("Dynarec.PersistentCache");
+Option<bool> DynarecAsyncCompile("Dynarec.AsyncCompile");
+Option<bool> DynarecTraces("Dynarec.Traces");
+Option<bool> DynarecProfiler("Dynarec.Profiler");
 
 // General
 
@@ -36,6 +40,8 @@ Option<bool> FullMMU("Dreamcast.FullMMU");
 Option<bool> ForceWindowsCE("Dreamcast.ForceWindowsCE");
 Option<bool> AutoLoadState("Dreamcast.AutoLoadState");
 Option<bool> AutoSaveState("Dreamcast.AutoSaveState");
+Option<int> CheckpointInterval("Dreamcast.CheckpointInterval", 0);
+Option<bool> ZstdSavestates("Dreamcast.ZstdSavestates");
 Option<int> SavestateSlot("Dreamcast.SavestateSlot");
 Option<bool> ForceFreePlay("ForceFreePlay", true);
 
@@ -54,6 +60,8 @@ Option<bool> AutoLatency("aica.AutoLatency",
 		false
 #endif
 		);
+Option<int> AudioLatencyTarget("aica.LatencyTarget", 1024);	// 23 ms
+Option<bool> AudioDynamicRate("aica.DynamicRate", true);
 
 OptionString AudioBackend("backend", "auto", "audio");
 AudioVolumeOption AudioVolume;
@@ -99,6 +107,7 @@ Option<u64> PixelBufferSize("rend.PixelBufferSize", 512 * 1024 * 1024);
 Option<int> AnisotropicFiltering("rend.AnisotropicFiltering", 1);
 Option<int> TextureFiltering("rend.TextureFiltering", 0); // Default
 Option<bool> ThreadedRendering("rend.ThreadedRendering", true);
+Option<bool> TexturePrefetch("rend.TexturePrefetch", true);
 Option<bool> DupeFrames("rend.DupeFrames", false);
 
 // Misc
@@ -107,6 +116,9 @@ Option<bool> SerialConsole("Debug.SerialConsoleEnabled");
 Option<bool> SerialPTY("Debug.SerialPTY");
 Option<bool> UseReios("UseReios");
 Option<bool> FastGDRomLoad("FastGDRomLoad", false);
+Option<bool> MapRomFiles("MapRomFiles", true);
+Option<bool> CacheDecryptedRoms("CacheDecryptedRoms", true);
+Option<bool> PreDecryptRoms("PreDecryptRoms", false);
 
 Option<bool> OpenGlChecks("OpenGlChecks", false, "validate");
 
@@ -342,6 +342,10 @@ using OptionString = Option<std::string>;
 
 extern Option<bool> DynarecEnabled;
 extern Option<bool> DynarecIdleSkip;
+extern Option<bool> DynarecPersistentCache;
+extern Option<bool> DynarecAsyncCompile;
+extern Option<bool> DynarecTraces;
+extern Option<bool> DynarecProfiler;
 constexpr bool DynarecSafeMode = false;
 
 // General
@@ -354,6 +358,8 @@ extern Option<bool> FullMMU;
 extern Option<bool> ForceWindowsCE;
 extern Option<bool> AutoLoadState;
 extern Option<bool> AutoSaveState;
+extern Option<int> CheckpointInterval;
+extern Option<bool> ZstdSavestates;
 extern Option<int> SavestateSlot;
 extern Option<bool> ForceFreePlay;
 
@@ -363,6 +369,8 @@ constexpr bool LimitFPS = true;
 extern Option<bool> DSPEnabled;
 extern Option<int> AudioBufferSize;	//In samples ,*4 for bytes
 extern Option<bool> AutoLatency;
+extern Option<int> AudioLatencyTarget;	// In samples
+extern Option<bool> AudioDynamicRate;
 
 extern OptionString AudioBackend;
 
@@ -443,6 +451,7 @@ extern Option<u64> PixelBufferSize;
 extern Option<int> AnisotropicFiltering;
 extern Option<int> TextureFiltering; // 0: default, 1: force nearest, 2: force linear
 extern Option<bool> ThreadedRendering;
+extern Option<bool> TexturePrefetch;
 extern Option<bool> DupeFrames;
 
 // Misc
@@ -451,6 +460,9 @@ extern Option<bool> SerialConsole;
 extern Option<bool> SerialPTY;
 extern Option<bool> UseReios;
 extern Option<bool> FastGDRomLoad;
+extern Option<bool> MapRomFiles;
+extern Option<bool> CacheDecryptedRoms;
+extern Option<bool> PreDecryptRoms;
 
 extern Option<bool> OpenGlChecks;
 
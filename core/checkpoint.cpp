@@ -0,0 +1,309 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "checkpoint.h"
+#include "emulator.h"
+#include "serialize.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/mem/mem_watch.h"
+#include "hw/pvr/elan.h"
+#include "archive/rzip.h"
+#include "oslib/oslib.h"
+#include "rend/gui.h"
+#include "nowide/cstdio.hpp"
+
+#include <chrono>
+#include <ctime>
+#include <future>
+#include <memory>
+
+namespace checkpoint
+{
+
+enum class Kind : u32 {
+	Base,
+	Delta
+};
+static const u32 Magic = 0x54504b43;	// CKPT
+
+struct DirtyPages
+{
+	std::vector<u32> ram;
+	std::vector<u32> vram;
+	std::vector<u32> aram;
+	std::vector<u32> elanram;
+
+	size_t count() const {
+		return ram.size() + vram.size() + aram.size() + elanram.size();
+	}
+};
+
+static bool hasBase;
+static u32 baseId;
+static std::chrono::steady_clock::time_point lastSave;
+static std::future<void> writer;
+
+static std::string getPath(Kind kind)
+{
+	std::string path = hostfs::getSavestatePath(0, true) + ".ckpt";
+	if (kind == Kind::Delta)
+		path += ".delta";
+	return path;
+}
+
+static void writeFile(const std::string& path, const std::vector<u8>& data)
+{
+	std::string tmpPath = path + ".tmp";
+	RZipFile zipFile;
+	if (!zipFile.Open(tmpPath, true))
+	{
+		WARN_LOG(SAVESTATE, "Checkpoint: cannot open %s for writing", tmpPath.c_str());
+		return;
+	}
+	bool success = zipFile.Write(data.data(), data.size()) == data.size();
+	zipFile.Close();
+	if (!success)
+	{
+		WARN_LOG(SAVESTATE, "Checkpoint: error writing %s", tmpPath.c_str());
+		nowide::remove(tmpPath.c_str());
+		return;
+	}
+	// Replace the previous file only once the new one is complete
+	if (nowide::rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		nowide::remove(path.c_str());
+		if (nowide::rename(tmpPath.c_str(), path.c_str()) != 0)
+			WARN_LOG(SAVESTATE, "Checkpoint: cannot rename %s", tmpPath.c_str());
+	}
+}
+
+static bool readFile(const std::string& path, std::vector<u8>& data)
+{
+	RZipFile zipFile;
+	if (!zipFile.Open(path, false))
+		return false;
+	data.resize(zipFile.Size());
+	bool success = zipFile.Read(data.data(), data.size()) == data.size();
+	zipFile.Close();
+	if (!success)
+		WARN_LOG(SAVESTATE, "Checkpoint: error reading %s", path.c_str());
+	return success;
+}
+
+static void writeHeader(Serializer& ser, Kind kind)
+{
+	ser << Magic;
+	ser << kind;
+	ser << baseId;
+}
+
+static u32 readHeader(Deserializer& deser, Kind kind)
+{
+	u32 magic;
+	Kind k;
+	u32 id;
+	deser >> magic;
+	deser >> k;
+	deser >> id;
+	if (magic != Magic || k != kind)
+		throw Deserializer::Exception("Invalid checkpoint");
+	return id;
+}
+
+template<typename Watcher>
+static void serializePages(Serializer& ser, Watcher& watcher, const std::vector<u32>& offsets)
+{
+	ser << (u32)offsets.size();
+	for (u32 offset : offsets)
+	{
+		ser << offset;
+		ser.serialize((const u8 *)watcher.getMemPage(offset), PAGE_SIZE);
+	}
+}
+
+template<typename Watcher>
+static void deserializePages(Deserializer& deser, Watcher& watcher, u32 memSize)
+{
+	u32 count;
+	deser >> count;
+	for (u32 i = 0; i < count; i++)
+	{
+		u32 offset;
+		deser >> offset;
+		if (offset >= memSize || (offset & PAGE_MASK) != 0)
+			throw Deserializer::Exception("Invalid checkpoint page");
+		deser.deserialize((u8 *)watcher.getMemPage(offset), PAGE_SIZE);
+	}
+}
+
+static void serializeDelta(Serializer& ser, const DirtyPages& pages)
+{
+	writeHeader(ser, Kind::Delta);
+	dc_serialize(ser);
+	serializePages(ser, memwatch::ramWatcher, pages.ram);
+	serializePages(ser, memwatch::vramWatcher, pages.vram);
+	serializePages(ser, memwatch::aramWatcher, pages.aram);
+	serializePages(ser, memwatch::elanWatcher, pages.elanram);
+}
+
+static void startWriter(Kind kind, const std::shared_ptr<std::vector<u8>>& data)
+{
+	const std::string path = getPath(kind);
+	writer = std::async(std::launch::async, [path, data]() {
+		writeFile(path, *data);
+	});
+}
+
+static void saveBase()
+{
+	// Pages written from now on will go to the next deltas
+	memwatch::startTracking();
+	baseId = (u32)time(nullptr) ^ (baseId + 1);
+
+	Serializer dryrun(nullptr, std::numeric_limits<size_t>::max());
+	writeHeader(dryrun, Kind::Base);
+	dc_serialize(dryrun);
+	std::shared_ptr<std::vector<u8>> data = std::make_shared<std::vector<u8>>(dryrun.size());
+	Serializer ser(data->data(), data->size());
+	writeHeader(ser, Kind::Base);
+	dc_serialize(ser);
+	hasBase = true;
+
+	// The delta of the previous base is now useless
+	nowide::remove(getPath(Kind::Delta).c_str());
+	startWriter(Kind::Base, data);
+	DEBUG_LOG(SAVESTATE, "Checkpoint: base %x size %d", baseId, (int)data->size());
+}
+
+bool enabled()
+{
+	// Dirty page tracking needs the fault handler
+	return config::CheckpointInterval > 0 && !config::GGPOEnable && _nvmem_enabled()
+			&& !settings.content.path.empty();
+}
+
+bool due()
+{
+	if (!enabled())
+		return false;
+	// Skip this one if the previous checkpoint is still being written
+	if (writer.valid() && writer.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return false;
+	return std::chrono::steady_clock::now() - lastSave >= std::chrono::seconds((int)config::CheckpointInterval);
+}
+
+void save()
+{
+	if (writer.valid())
+		writer.get();
+	lastSave = std::chrono::steady_clock::now();
+	if (!hasBase || !memwatch::tracking)
+	{
+		saveBase();
+		return;
+	}
+	DirtyPages pages;
+	pages.ram = memwatch::ramWatcher.getDirtyPages();
+	pages.vram = memwatch::vramWatcher.getDirtyPages();
+	pages.aram = memwatch::aramWatcher.getDirtyPages();
+	if (settings.platform.isNaomi2())
+		pages.elanram = memwatch::elanWatcher.getDirtyPages();
+	// Deltas are cumulative so start over when they get too big
+	if (pages.count() * PAGE_SIZE > (RAM_SIZE + VRAM_SIZE + ARAM_SIZE) / 2)
+	{
+		saveBase();
+		return;
+	}
+	// The page list is fixed so both passes have the same size
+	Serializer dryrun(nullptr, std::numeric_limits<size_t>::max(), true);
+	serializeDelta(dryrun, pages);
+	std::shared_ptr<std::vector<u8>> data = std::make_shared<std::vector<u8>>(dryrun.size());
+	Serializer ser(data->data(), data->size(), true);
+	serializeDelta(ser, pages);
+
+	startWriter(Kind::Delta, data);
+	DEBUG_LOG(SAVESTATE, "Checkpoint: delta of base %x, %d pages, size %d", baseId, (int)pages.count(), (int)data->size());
+}
+
+void rebase()
+{
+	hasBase = false;
+	lastSave = std::chrono::steady_clock::time_point();
+}
+
+bool recover()
+{
+	if (!enabled())
+	{
+		discard();
+		return false;
+	}
+	std::vector<u8> data;
+	if (!readFile(getPath(Kind::Base), data))
+		return false;
+	try {
+		Deserializer deser(data.data(), data.size());
+		u32 id = readHeader(deser, Kind::Base);
+		dc_loadstate(deser);
+
+		if (readFile(getPath(Kind::Delta), data))
+		{
+			Deserializer delta(data.data(), data.size(), true);
+			if (readHeader(delta, Kind::Delta) == id)
+			{
+				dc_loadstate(delta);
+				deserializePages(delta, memwatch::ramWatcher, RAM_SIZE);
+				deserializePages(delta, memwatch::vramWatcher, VRAM_SIZE);
+				deserializePages(delta, memwatch::aramWatcher, ARAM_SIZE);
+				deserializePages(delta, memwatch::elanWatcher, elan::ELAN_RAM_SIZE);
+			}
+			else
+			{
+				WARN_LOG(SAVESTATE, "Checkpoint: ignoring delta of base %x", id);
+			}
+		}
+	} catch (const Deserializer::Exception& e) {
+		ERROR_LOG(SAVESTATE, "Checkpoint recovery failed: %s", e.what());
+		return false;
+	}
+	EventManager::event(Event::LoadState);
+	INFO_LOG(SAVESTATE, "Recovered state from checkpoint %s", getPath(Kind::Base).c_str());
+	gui_display_notification("State recovered", 2000);
+
+	return true;
+}
+
+void discard()
+{
+	if (writer.valid())
+		writer.get();
+	hasBase = false;
+	if (settings.content.path.empty())
+		return;
+	nowide::remove(getPath(Kind::Base).c_str());
+	nowide::remove(getPath(Kind::Delta).c_str());
+}
+
+void term()
+{
+	if (writer.valid())
+		writer.get();
+}
+
+}
@@ -0,0 +1,44 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+//
+// Crash recovery checkpoints.
+// A full savestate (the base) is written when the emulator starts. Then a delta is periodically
+// written, containing the cpu and device state and the memory pages written since the base.
+// Each delta replaces the previous one so that recovering only needs the base and the last delta.
+//
+namespace checkpoint
+{
+
+bool enabled();
+// Called on vblank. Returns true if a checkpoint should be saved.
+bool due();
+// Must be called with the sh4 stopped
+void save();
+// Force a full state to be saved on the next checkpoint
+void rebase();
+// Load the last checkpoint if any. Returns true if the state has been restored.
+bool recover();
+// Delete the checkpoint files
+void discard();
+void term();
+
+}
@@ -32,7 +32,9 @@
 #include "oslib/audiostream.h"
 #include "debug/gdb_server.h"
 #include "hw/pvr/Renderer_if.h"
+#include "hw/pvr/ta_capture.h"
 #include "rend/CustomTexture.h"
+#include "rend/TexPrefetch.h"
 #include "hw/arm7/arm7_rec.h"
 #include "network/ggpo.h"
 #include "hw/mem/mem_watch.h"
@@ -40,6 +42,7 @@
 #include "rend/gui.h"
 #include "network/naomi_network.h"
 #include "serialize.h"
+#include "checkpoint.h"
 #include "hw/pvr/pvr.h"
 #include <chrono>
 
@@ -530,7 +533,7 @@ void Emulator::loadGame(const char *path, LoadProgress *progress)
 		{
 			if (config::GGPOEnable)
 				dc_loadstate(-1);
-			else if (config::AutoLoadState && !NaomiNetworkSupported())
+			else if (!checkpoint::recover() && config::AutoLoadState && !NaomiNetworkSupported())
 				dc_loadstate(config::SavestateSlot);
 		}
 		EventManager::event(Event::Start);
@@ -550,6 +553,7 @@ void Emulator::runInternal()
 	}
 	else
 	{
+		bool resume;
 		do {
 			resetRequested = false;
 
@@ -560,7 +564,15 @@ void Emulator::runInternal()
 				SaveRomFiles();
 				dc_reset(false);
 			}
-		} while (resetRequested);
+			resume = resetRequested;
+			if (checkpointRequested)
+			{
+				checkpointRequested = false;
+				checkpoint::save();
+				// The cpu was only stopped for the checkpoint unless the emulator is stopping
+				resume |= config::ThreadedRendering && state == Running;
+			}
+		} while (resume);
 	}
 }
 
@@ -571,6 +583,8 @@ void Emulator::unloadGame()
 	{
 		if (state == Loaded && config::AutoSaveState && !settings.content.path.empty())
 			dc_savestate(config::SavestateSlot);
+		if (state == Loaded)
+			checkpoint::discard();
 		dc_reset(true);
 
 		config::Settings::instance().reset();
@@ -590,6 +604,9 @@ void Emulator::term()
 		debugger::term();
 		sh4_cpu.Term();
 		custom_texture.Terminate();	// lr: avoid deadlock on exit (win32)
+		texture_prefetcher.Terminate();
+		checkpoint::term();
+		tacapture::stop();
 		reios_term();
 		libAICA_Term();
 		pvr::term();
@@ -674,6 +691,7 @@ void Emulator::step()
 void dc_loadstate(Deserializer& deser)
 {
 	custom_texture.Terminate();
+	texture_prefetcher.Cancel();
 #if FEAT_AREC == DYNAREC_JIT
 	aicaarm::recompiler::flush();
 #endif
@@ -752,7 +770,7 @@ void Emulator::start()
 	verify(state == Loaded);
 	state = Running;
 	SetMemoryHandlers();
-	settings.aica.NoBatch = config::ForceWindowsCE || config::DSPEnabled || config::GGPOEnable;
+	settings.aica.NoBatch = config::ForceWindowsCE || config::GGPOEnable;
 	rend_resize_renderer();
 #if FEAT_SHREC != DYNAREC_NONE
 	if (config::DynarecEnabled)
@@ -768,6 +786,7 @@ void Emulator::start()
 	}
 	EventManager::event(Event::Resume);
 	memwatch::protect();
+	checkpoint::rebase();
 
 	if (config::ThreadedRendering)
 	{
@@ -830,6 +849,13 @@ bool Emulator::render()
 void Emulator::vblank()
 {
 	EventManager::event(Event::VBlank);
+	if (checkpoint::due())
+	{
+		checkpointRequested = true;
+		// Without threaded rendering, the cpu stops at the end of each frame anyway
+		if (config::ThreadedRendering)
+			sh4_cpu.Stop();
+	}
 	// Time out if a frame hasn't been rendered for 50 ms
 	if (sh4_sched_now64() - startTime <= 10000000)
 		return;
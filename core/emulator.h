@@ -168,6 +168,7 @@ private:
 	State state = Uninitialized;
 	std::shared_future<void> threadResult;
 	bool resetRequested = false;
+	bool checkpointRequested = false;
 	bool singleStep = false;
 	u64 startTime = 0;
 	bool renderTimeout = false;
@@ -1,3 +1,4 @@
+#include "build.h"
 #include "dsp.h"
 #include "aica.h"
 /*
@@ -96,14 +97,6 @@ void DecodeInst(const u32 *IPtr, Instruction *i)
 	i->NXADR = IPtr[3] & 0x80;
 }
 
-#if FEAT_DSPREC == DYNAREC_NONE
-void recInit() {
-}
-
-void recompile() {
-}
-#endif
-
 void init()
 {
 	memset(&state, 0, sizeof(state));
@@ -126,7 +119,8 @@ void term()
 	state.stopped = true;
 }
 
-void step()
+// Recompile the DSP program if it has changed. Returns false if it's a no-op.
+static bool prepare()
 {
 	if (state.dirty)
 	{
@@ -141,9 +135,47 @@ void step()
 		if (!state.stopped)
 			recompile();
 	}
-	if (state.stopped)
+	return !state.stopped;
+}
+
+void step()
+{
+	if (prepare())
+		runStep();
+}
+
+#if HOST_CPU != CPU_X64 || FEAT_DSPREC == DYNAREC_NONE
+// The x64 recompiler loops over the samples of the block in the compiled code.
+// The other implementations run the program once per sample.
+void runBlock(const s32 mixs[16][BlockSize], const s32 exts[2][BlockSize], u32 efreg[BlockSize][16])
+{
+	for (int i = 0; i < BlockSize; i++)
+	{
+		for (int j = 0; j < 16; j++)
+			state.MIXS[j] = mixs[j][i];
+		DSPData->EXTS[0] = exts[0][i];
+		DSPData->EXTS[1] = exts[1][i];
+		runStep();
+		memcpy(efreg[i], DSPData->EFREG, sizeof(efreg[i]));
+	}
+}
+#endif
+
+void stepBlock(const s32 mixs[16][BlockSize], const s32 exts[2][BlockSize], u32 efreg[BlockSize][16])
+{
+	// The program can't change during a block
+	if (prepare())
+	{
+		runBlock(mixs, exts, efreg);
 		return;
-	runStep();
+	}
+	// Same inputs as after the last sample
+	for (int j = 0; j < 16; j++)
+		state.MIXS[j] = mixs[j][BlockSize - 1];
+	DSPData->EXTS[0] = exts[0][BlockSize - 1];
+	DSPData->EXTS[1] = exts[1][BlockSize - 1];
+	for (int i = 0; i < BlockSize; i++)
+		memcpy(efreg[i], DSPData->EFREG, sizeof(efreg[i]));
 }
 
 }
@@ -56,14 +56,27 @@ struct DSPState
 
 extern DSPState state;
 
+constexpr int BlockSize = 32;
+
 void init();
 void term();
 void step();
+// Run the DSP program for a block of samples. mixs and exts are the MIXS and EXTS inputs of each sample,
+// efreg receives the EFREG outputs of each sample.
+void stepBlock(const s32 mixs[16][BlockSize], const s32 exts[2][BlockSize], u32 efreg[BlockSize][16]);
 void writeProg(u32 addr);
 
 void recInit();
 void runStep();
+void runBlock(const s32 mixs[16][BlockSize], const s32 exts[2][BlockSize], u32 efreg[BlockSize][16]);
+void recompile();
+
+// The interpreter is always available to check the recompilers
+namespace interp
+{
 void recompile();
+void runStep();
+}
 
 struct Instruction
 {
@@ -6,15 +6,28 @@
 //
 
 #include "build.h"
-
-#if FEAT_DSPREC != DYNAREC_JIT
-
 #include "dsp.h"
 #include "aica.h"
 #include "aica_if.h"
 
 namespace dsp
 {
+namespace interp
+{
+
+// Decoded program
+static Instruction program[128];
+static bool emptyInst[128];
+
+void recompile()
+{
+	for (int step = 0; step < 128; step++)
+	{
+		const u32 *IPtr = DSPData->MPRO + step * 4;
+		DecodeInst(IPtr, &program[step]);
+		emptyInst[step] = IPtr[0] == 0 && IPtr[1] == 0 && IPtr[2] == 0 && IPtr[3] == 0;
+	}
+}
 
 void runStep()
 {
@@ -27,16 +40,15 @@ void runStep()
 	s32 Y = 0;			//13 bit
 	s32 B = 0;			//26 bit
 	s32 INPUTS = 0;		//24 bit
-	s32 MEMVAL[4] = {0};
 	s32 FRC_REG = 0;	//13 bit
 	s32 Y_REG = 0;		//24 bit
 	u32 ADRS_REG = 0;	//13 bit
 
 	for (int step = 0; step < 128; ++step)
 	{
-		u32 *IPtr = DSPData->MPRO + step * 4;
+		const Instruction& op = program[step];
 
-		if (IPtr[0] == 0 && IPtr[1] == 0 && IPtr[2] == 0 && IPtr[3] == 0)
+		if (emptyInst[step])
 		{
 			// Empty instruction shortcut
 			X = state.TEMP[state.MDEC_CT & 0x7F];
@@ -47,22 +59,10 @@ void runStep()
 			continue;
 		}
 
-		u32 TRA = (IPtr[0] >> 9) & 0x7F;
-		bool TWT = IPtr[0] & 0x100;
-
-		bool XSEL = IPtr[1] & 0x8000;
-		u32 YSEL = (IPtr[1] >> 13) & 3;
-		u32 IRA = (IPtr[1] >> 7) & 0x3F;
-		bool IWT = IPtr[1] & 0x40;
-
-		bool EWT = IPtr[2] & 0x1000;
-		bool ADRL = IPtr[2] & 0x80;
-		bool FRCL = IPtr[2] & 0x40;
-		u32 SHIFT = (IPtr[2] >> 4) & 3;
-		bool YRL = IPtr[2] & 8;
-		bool NEGB = IPtr[2] & 4;
-		bool ZERO = IPtr[2] & 2;
-		bool BSEL = IPtr[2] & 1;
+		const u32 TRA = op.TRA;
+		const u32 YSEL = op.YSEL;
+		const u32 IRA = op.IRA;
+		const u32 SHIFT = op.SHIFT;
 
 		u32 COEF = step;
 
@@ -78,21 +78,20 @@ void runStep()
 		else
 			INPUTS = 0;
 
-		if (IWT)
+		if (op.IWT)
 		{
-			u32 IWA = (IPtr[1] >> 1) & 0x1F;
-			state.MEMS[IWA] = MEMVAL[step & 3];	// MEMVAL was selected in previous MRD
+			state.MEMS[op.IWA] = state.MEMVAL[step & 3];	// MEMVAL was selected in previous MRD
 		}
 
 		// Operand sel
 		// B
-		if (!ZERO)
+		if (!op.ZERO)
 		{
-			if (BSEL)
+			if (op.BSEL)
 				B = ACC;
 			else
 				B = state.TEMP[(TRA + state.MDEC_CT) & 0x7F];
-			if (NEGB)
+			if (op.NEGB)
 				B = -B;
 		}
 		else
@@ -101,7 +100,7 @@ void runStep()
 		}
 
 		// X
-		if (XSEL)
+		if (op.XSEL)
 			X = INPUTS;
 		else
 			X = state.TEMP[(TRA + state.MDEC_CT) & 0x7F];
@@ -116,7 +115,7 @@ void runStep()
 		else if (YSEL == 3)
 			Y = (Y_REG >> 4) & 0x0FFF;
 
-		if (YRL)
+		if (op.YRL)
 			Y_REG = INPUTS;
 
 		// Shifter
@@ -132,13 +131,10 @@ void runStep()
 		// ACCUM
 		ACC = (((s64)X * (s64)Y) >> 12) + B;
 
-		if (TWT)
-		{
-			u32 TWA = (IPtr[0] >> 1) & 0x7F;
-			state.TEMP[(TWA + state.MDEC_CT) & 0x7F] = SHIFTED;
-		}
+		if (op.TWT)
+			state.TEMP[(op.TWA + state.MDEC_CT) & 0x7F] = SHIFTED;
 
-		if (FRCL)
+		if (op.FRCL)
 		{
 			if (SHIFT == 3)
 				FRC_REG = SHIFTED & 0x0FFF;
@@ -148,25 +144,15 @@ void runStep()
 
 		if (step & 1)
 		{
-			bool MWT = IPtr[2] & 0x4000;
-			bool MRD = IPtr[2] & 0x2000;
-
-			if (MRD || MWT)
+			if (op.MRD || op.MWT)
 			{
-				bool TABLE = IPtr[2] & 0x8000;
-
-				//bool NOFL = IPtr[3] & 0x8000;
-				//verify(!NOFL);
-				u32 MASA = (IPtr[3] >> 9) & 0x3f;
-				bool ADREB = IPtr[3] & 0x100;
-				bool NXADR = IPtr[3] & 0x80;
-
-				u32 ADDR = DSPData->MADRS[MASA];
-				if (ADREB)
+				//verify(!op.NOFL);
+				u32 ADDR = DSPData->MADRS[op.MASA];
+				if (op.ADREB)
 					ADDR += ADRS_REG & 0x0FFF;
-				if (NXADR)
+				if (op.NXADR)
 					ADDR++;
-				if (!TABLE)
+				if (!op.TABLE)
 				{
 					ADDR += state.MDEC_CT;
 					ADDR &= state.RBL;		// RBL is ring buffer length - 1
@@ -176,14 +162,14 @@ void runStep()
 
 				ADDR <<= 1;					// Word -> byte address
 				ADDR += state.RBP;			// RBP is already a byte address
-				if (MRD)			// memory only allowed on odd. DoA inserts NOPs on even
+				if (op.MRD)			// memory only allowed on odd. DoA inserts NOPs on even
 				{
 					//if (NOFL)
 					//	MEMVAL[(step + 2) & 3] = (*(s16 *)&aica_ram[ADDR]) << 8;
 					//else
-						MEMVAL[(step + 2) & 3] = UNPACK(*(u16 *)&aica_ram[ADDR & ARAM_MASK]);
+						state.MEMVAL[(step + 2) & 3] = UNPACK(*(u16 *)&aica_ram[ADDR & ARAM_MASK]);
 				}
-				if (MWT)
+				if (op.MWT)
 				{
 					// FIXME We should wait for the next step to copy stuff to SRAM (same as read)
 					//if (NOFL)
@@ -194,7 +180,7 @@ void runStep()
 			}
 		}
 
-		if (ADRL)
+		if (op.ADRL)
 		{
 			if (SHIFT == 3)
 				ADRS_REG = SHIFTED >> 12;
@@ -202,11 +188,8 @@ void runStep()
 				ADRS_REG = INPUTS >> 16;
 		}
 
-		if (EWT)
-		{
-			u32 EWA = (IPtr[2] >> 8) & 0x0F;
-			DSPData->EFREG[EWA] = SHIFTED >> 8;
-		}
+		if (op.EWT)
+			DSPData->EFREG[op.EWA] = SHIFTED >> 8;
 
 	}
 	--state.MDEC_CT;
@@ -215,4 +198,18 @@ void runStep()
 }
 
 }
+
+#if FEAT_DSPREC != DYNAREC_JIT
+void recInit() {
+}
+
+void recompile() {
+	interp::recompile();
+}
+
+void runStep() {
+	interp::runStep();
+}
 #endif
+
+}
@@ -63,9 +63,17 @@ public:
 		push(r14);
 		push(r15);
 #ifdef _WIN32
-		sub(rsp, 40);	// 32-byte shadow space + 8 bytes for 16-byte stack alignment
+		sub(rsp, 72);	// 32-byte shadow space + locals + 8 bytes for 16-byte stack alignment
+		mov(qword[rsp + MixsPtr], rcx);
+		mov(qword[rsp + ExtsPtr], rdx);
+		mov(qword[rsp + EfregPtr], r8);
+		mov(dword[rsp + SampleCount], r9d);
 #else
-		sub(rsp, 8);	// 16-byte stack alignment
+		sub(rsp, 40);	// locals + 8 bytes for 16-byte stack alignment
+		mov(qword[rsp + MixsPtr], rdi);
+		mov(qword[rsp + ExtsPtr], rsi);
+		mov(qword[rsp + EfregPtr], rdx);
+		mov(dword[rsp + SampleCount], ecx);
 #endif
 		mov(rbx, (uintptr_t)&DSP->TEMP[0]);	// rbx points to TEMP, right after the code
 		mov(rbp, (uintptr_t)DSPData);		// rbp points to DSPData
@@ -83,11 +91,33 @@ public:
 		const Xbyak::Reg32 call_arg0 = edi;
 #endif
 
+		mov(MDEC_CT, dword[rbx + dsp_operand(&DSP->MDEC_CT)]);
+
+		Xbyak::Label sampleLoop;
+		L(sampleLoop);
+		Xbyak::Label noInputs;
+		mov(rax, qword[rsp + MixsPtr]);
+		test(rax, rax);
+		jz(noInputs, T_NEAR);
+		// Inputs of this sample
+		for (int i = 0; i < 16; i++)
+		{
+			mov(ecx, dword[rax + i * BlockSize * 4]);
+			mov(dword[rbx + dsp_operand(DSP->MIXS, i)], ecx);
+		}
+		mov(rax, qword[rsp + ExtsPtr]);
+		mov(ecx, dword[rax]);
+		mov(dword[rbp + dspdata_operand(DSPData->EXTS, 0)], ecx);
+		mov(ecx, dword[rax + BlockSize * 4]);
+		mov(dword[rbp + dspdata_operand(DSPData->EXTS, 1)], ecx);
+		add(qword[rsp + MixsPtr], 4);
+		add(qword[rsp + ExtsPtr], 4);
+		L(noInputs);
+
 		xor_(ACC, ACC);
 		mov(dword[rbx + dsp_operand(&DSP->FRC_REG)], 0);
 		xor_(Y_REG, Y_REG);
 		xor_(ADRS_REG, ADRS_REG);
-		mov(MDEC_CT, dword[rbx + dsp_operand(&DSP->MDEC_CT)]);
 
 		for (int step = 0; step < 128; ++step)
 		{
@@ -287,7 +317,11 @@ public:
 					CalculateADDR(ADDR, op, ADRS_REG, MDEC_CT);
 					mov(rcx, (uintptr_t)&aica_ram[0]);
 					movzx(call_arg0, word[rcx + ADDR.cvt64()]);
+					if (op.MWT)
+						push(rdx);	// SHIFTED
 					GenCall(UNPACK);
+					if (op.MWT)
+						pop(rdx);
 					mov(dword[rbx + dsp_operand(&DSP->MEMVAL[(step + 2) & 3])], eax);
 				}
 				if (op.MWT)
@@ -340,10 +374,25 @@ public:
 		cmove(MDEC_CT, eax);
 		mov(dword[rbx + dsp_operand(&DSP->MDEC_CT)], MDEC_CT);
 
+		// Outputs of this sample
+		Xbyak::Label noOutputs;
+		mov(rax, qword[rsp + EfregPtr]);
+		test(rax, rax);
+		jz(noOutputs, T_NEAR);
+		for (int i = 0; i < 16; i += 2)
+		{
+			mov(rcx, qword[rbp + dspdata_operand(DSPData->EFREG, i)]);
+			mov(qword[rax + i * 4], rcx);
+		}
+		add(qword[rsp + EfregPtr], 16 * 4);
+		L(noOutputs);
+		sub(dword[rsp + SampleCount], 1);
+		jnz(sampleLoop, T_NEAR);
+
 #ifdef _WIN32
-		add(rsp, 40);
+		add(rsp, 72);
 #else
-		add(rsp, 8);
+		add(rsp, 40);
 #endif
 		pop(r15);
 		pop(r14);
@@ -357,6 +406,16 @@ public:
 	}
 
 private:
+	// Locals, above the shadow space on windows
+#ifdef _WIN32
+	static constexpr int MixsPtr = 32;
+#else
+	static constexpr int MixsPtr = 0;
+#endif
+	static constexpr int ExtsPtr = MixsPtr + 8;
+	static constexpr int EfregPtr = MixsPtr + 16;
+	static constexpr int SampleCount = MixsPtr + 24;
+
 	ptrdiff_t dsp_operand(void *data, int index = 0, u32 element_size = 4)
 	{
 		return ((u8*)data - (u8*)DSP) - offsetof(DSPState, TEMP) + index  * element_size;
@@ -428,9 +487,18 @@ void recInit()
 		die("vmem_platform_prepare_jit_block failed in x64 dsp");
 }
 
+// The compiled program runs the given number of samples. The inputs and outputs of each sample are
+// copied from and to the block arrays, or taken from and left in the DSP registers if they are null.
+using BlockFunction = void (*)(const s32 *mixs, const s32 *exts, u32 *efreg, u32 samples);
+
 void runStep()
 {
-	((void (*)())&pCodeBuffer[0])();
+	((BlockFunction)&pCodeBuffer[0])(nullptr, nullptr, nullptr, 1);
+}
+
+void runBlock(const s32 mixs[16][BlockSize], const s32 exts[2][BlockSize], u32 efreg[BlockSize][16])
+{
+	((BlockFunction)&pCodeBuffer[0])(&mixs[0][0], &exts[0][0], &efreg[0][0], BlockSize);
 }
 
 }
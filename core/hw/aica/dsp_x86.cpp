@@ -261,6 +261,20 @@ public:
 						push(ecx);
 				}
 				const Xbyak::Reg32 ADDR = Y;
+				// Read before write, as the interpreter does
+				if (op.MRD)			// memory only allowed on odd. DoA inserts NOPs on even
+				{
+					//MEMVAL[(step + 2) & 3] = UNPACK(*(u16 *)&aica_ram[ADDR & ARAM_MASK]);
+					if (op.MWT)
+						push(ecx);	// SHIFTED
+					CalculateADDR(ADDR, op);
+					mov(ecx, (uintptr_t)&aica_ram[0]);
+					movzx(ecx, word[ecx + ADDR]);
+					call((const void *)UNPACK);
+					mov(dword[&DSP->MEMVAL[(step + 2) & 3]], eax);
+					if (op.MWT)
+						pop(ecx);
+				}
 				if (op.MWT)
 				{
 					// *(u16 *)&aica_ram[ADDR & ARAM_MASK] = PACK(SHIFTED);
@@ -271,15 +285,6 @@ public:
 					mov(ecx, (uintptr_t)&aica_ram[0]);
 					mov(word[ecx + ADDR], ax);
 				}
-				if (op.MRD)			// memory only allowed on odd. DoA inserts NOPs on even
-				{
-					//MEMVAL[(step + 2) & 3] = UNPACK(*(u16 *)&aica_ram[ADDR & ARAM_MASK]);
-					CalculateADDR(ADDR, op);
-					mov(ecx, (uintptr_t)&aica_ram[0]);
-					movzx(ecx, word[ecx + ADDR]);
-					call((const void *)UNPACK);
-					mov(dword[&DSP->MEMVAL[(step + 2) & 3]], eax);
-				}
 				if (op.MRD || op.MWT)
 				{
 					if ((op.ADRL && op.SHIFT == 3) || op.EWT)
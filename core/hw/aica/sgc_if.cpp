@@ -31,6 +31,11 @@
 
 #include <algorithm>
 #include <cmath>
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+#include <emmintrin.h>
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#endif
 
 #undef FAR
 
@@ -332,6 +337,16 @@ enum _EG_state
 
 struct ChannelEx;
 
+// Channel output of a block of samples, mixed by MixBlock()
+constexpr int BlockSize = dsp::BlockSize;
+struct ChannelBlock
+{
+	alignas(16) SampleType sample[BlockSize];
+	alignas(16) s32 left[BlockSize];
+	alignas(16) s32 right[BlockSize];
+	alignas(16) s32 dsp[BlockSize];
+};
+
 static void (* STREAM_STEP_LUT[5][2][2])(ChannelEx* ch);
 static void (* STREAM_INITAL_STEP_LUT[5])(ChannelEx* ch);
 static void (* AEG_STEP_LUT[4])(ChannelEx* ch);
@@ -477,58 +492,78 @@ struct ChannelEx
 
 		return rv;
 	}
-	__forceinline bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
+	__forceinline SampleType FilteredSample()
 	{
-		if (!enabled)
+		SampleType sample = InterpolateSample();
+
+		// Low-pass filter
+		if (FEG.active)
 		{
-			oLeft=oRight=oDsp=0;
-			return false;
+			u32 fv = FEG.GetValue();
+			s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
+			f = std::max(1, f);
+			sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
+			sample >>= 13;
+			clip16(sample);
+			FEG.prev2 = FEG.prev1;
+			FEG.prev1 = sample;
+		}
+		return sample;
+	}
+
+	// x.15 gains of the left, right and dsp outputs
+	__forceinline void GetGains(s32& left, s32& right, s32& dsp)
+	{
+		//Volume & Mixer processing
+		//All attenuations are added together then applied and mixed :)
+
+		//offset is up to 511
+		//*Att is up to 511
+		//logtable handles up to 1024, anything >=255 is mute
+
+		u32 ofsatt;
+		if (ccd->VOFF == 1)
+		{
+			ofsatt = 0;
 		}
 		else
 		{
-			SampleType sample = InterpolateSample();
-
-			// Low-pass filter
-			if (FEG.active)
-			{
-				u32 fv = FEG.GetValue();
-				s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
-				f = std::max(1, f);
-				sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
-				sample >>= 13;
-				clip16(sample);
-				FEG.prev2 = FEG.prev1;
-				FEG.prev1 = sample;
-			}
+			ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
+			ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
+		}
+		u32 const max_att = ((16 << 4) - 1) - ofsatt;
 
-			//Volume & Mixer processing
-			//All attenuations are added together then applied and mixed :)
+		s32* logtable = ofsatt + tl_lut;
 
-			//offset is up to 511
-			//*Att is up to 511
-			//logtable handles up to 1024, anything >=255 is mute
+		left = logtable[std::min(VolMix.DLAtt, max_att)];
+		right = logtable[std::min(VolMix.DRAtt, max_att)];
+		dsp = logtable[std::min(VolMix.DSPAtt, max_att)];
+	}
 
-			u32 ofsatt;
-			if (ccd->VOFF == 1)
-			{
-				ofsatt = 0;
-			}
-			else
-			{
-				ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
-				ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
-			}
-			u32 const max_att = ((16 << 4) - 1) - ofsatt;
-			
-			s32* logtable = ofsatt + tl_lut;
+	__forceinline void Advance()
+	{
+		StepAEG(this);
+		StepFEG(this);
+		StepStream(this);
+		lfo.Step(this);
+	}
 
-			u32 dl = std::min(VolMix.DLAtt, max_att);
-			u32 dr = std::min(VolMix.DRAtt, max_att);
-			u32 ds = std::min(VolMix.DSPAtt, max_att);
+	__forceinline bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
+	{
+		if (!enabled)
+		{
+			oLeft=oRight=oDsp=0;
+			return false;
+		}
+		else
+		{
+			SampleType sample = FilteredSample();
+			s32 left, right, dsp;
+			GetGains(left, right, dsp);
 
-			oLeft = FPMul(sample, logtable[dl], 15);
-			oRight = FPMul(sample, logtable[dr], 15);
-			oDsp = FPMul(sample, logtable[ds], 11);	// 20 bits
+			oLeft = FPMul(sample, left, 15);
+			oRight = FPMul(sample, right, 15);
+			oDsp = FPMul(sample, dsp, 11);	// 20 bits
 
 			clip_verify(((s16)oLeft)==oLeft);
 			clip_verify(((s16)oRight)==oRight);
@@ -537,14 +572,30 @@ struct ChannelEx
 			clip_verify(sample*oRight>=0);
 			clip_verify((s64)sample*oDsp>=0);
 
-			StepAEG(this);
-			StepFEG(this);
-			StepStream(this);
-			lfo.Step(this);
+			Advance();
 			return true;
 		}
 	}
 
+	// Generate the samples of the next block until the channel is disabled.
+	// Returns the number of samples generated.
+	__forceinline int StepBlock(ChannelBlock& block)
+	{
+		int i = 0;
+		for (; i < BlockSize && enabled; i++)
+		{
+			block.sample[i] = FilteredSample();
+			GetGains(block.left[i], block.right[i], block.dsp[i]);
+			Advance();
+		}
+		return i;
+	}
+
+	// Index of the DSP input (ISEL)
+	int DspInput() const {
+		return (int)(VolMix.DSPOut - dsp::state.MIXS);
+	}
+
 	__forceinline void Step(SampleType& mixl, SampleType& mixr)
 	{
 		SampleType oLeft,oRight,oDsp;
@@ -1409,130 +1460,91 @@ constexpr int CDDA_SIZE = 2352 / 2;
 static s16 cdda_sector[CDDA_SIZE];
 static u32 cdda_index = CDDA_SIZE;
 
-//no DSP for now in this version
-void AICA_Sample32()
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+// SSE2 has no 32-bit mullo
+static __m128i mullo32(__m128i a, __m128i b)
 {
-	SampleType mxlr[64];
-	memset(mxlr,0,sizeof(mxlr));
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
 
-	//Generate 32 samples for each channel, before moving to next channel
-	//much more cache efficient !
-	for (int ch = 0; ch < 64; ch++)
+// Apply the gains of a channel block and add the result to the left, right and dsp mixes.
+// Same as ChannelEx::Step(mixl, mixr) for each sample.
+static void MixBlock(ChannelBlock& block, int count, SampleType *mixl, SampleType *mixr, SampleType *dspMix)
+{
+	// Pad to a multiple of 4 with silent samples
+	for (int i = count; i < ((count + 3) & ~3); i++)
+		block.sample[i] = block.left[i] = block.right[i] = block.dsp[i] = 0;
+	const bool dspEnabled = config::DSPEnabled;
+	int i = 0;
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+	const __m128i monoMask = dspEnabled ? _mm_setzero_si128() : _mm_set1_epi32(-1);
+	for (; i < count; i += 4)
 	{
-		for (int i=0;i<32;i++)
-		{
-			SampleType oLeft,oRight,oDsp;
-			//stop working on this channel if its turned off ...
-			if (!Chans[ch].Step(oLeft, oRight, oDsp))
-				break;
-
-			if (oLeft + oRight == 0)
-				oLeft = oRight = oDsp >> 4;
-
-			mxlr[i*2+0] += oLeft;
-			mxlr[i*2+1] += oRight;
-		}
+		__m128i sample = _mm_load_si128((const __m128i *)&block.sample[i]);
+		__m128i left = _mm_srai_epi32(mullo32(sample, _mm_load_si128((const __m128i *)&block.left[i])), 15);
+		__m128i right = _mm_srai_epi32(mullo32(sample, _mm_load_si128((const __m128i *)&block.right[i])), 15);
+		__m128i dsp = _mm_srai_epi32(mullo32(sample, _mm_load_si128((const __m128i *)&block.dsp[i])), 11);
+		_mm_storeu_si128((__m128i *)&dspMix[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&dspMix[i]), dsp));
+
+		__m128i mono = _mm_and_si128(monoMask, _mm_cmpeq_epi32(_mm_add_epi32(left, right), _mm_setzero_si128()));
+		dsp = _mm_and_si128(mono, _mm_srai_epi32(dsp, 4));
+		left = _mm_or_si128(_mm_andnot_si128(mono, left), dsp);
+		right = _mm_or_si128(_mm_andnot_si128(mono, right), dsp);
+		_mm_storeu_si128((__m128i *)&mixl[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&mixl[i]), left));
+		_mm_storeu_si128((__m128i *)&mixr[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&mixr[i]), right));
 	}
-	//OK , generated all Channels  , now DSP/ect + final mix ;p
-	//CDDA EXTS input
-	
-	for (int i=0;i<32;i++)
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+	const uint32x4_t monoMask = vdupq_n_u32(dspEnabled ? 0 : ~0u);
+	for (; i < count; i += 4)
 	{
-		SampleType mixl,mixr;
-
-		mixl=mxlr[i*2+0];
-		mixr=mxlr[i*2+1];
-
-		if (cdda_index>=CDDA_SIZE)
-		{
-			cdda_index=0;
-			libCore_CDDA_Sector(cdda_sector);
-		}
-		s32 EXTS0L=cdda_sector[cdda_index];
-		s32 EXTS0R=cdda_sector[cdda_index+1];
-		cdda_index+=2;
-
-		//Final MIX ..
-		//Add CDDA / DSP effect(s)
-
-		//CDDA
-		VolumePan(EXTS0L, dsp_out_vol[16].EFSDL, dsp_out_vol[16].EFPAN, mixl, mixr);
-		VolumePan(EXTS0R, dsp_out_vol[17].EFSDL, dsp_out_vol[17].EFPAN, mixl, mixr);
-
-		/*
-		no dsp for now -- needs special handling of oDSP for ch paraller version ...
-		if (config::DSPEnabled)
-		{
-			dsp::step();
-
-			for (int i=0;i<16;i++)
-			{
-				VolumePan( (*(s16*)&DSPData->EFREG[i]) ,dsp_out_vol[i].EFSDL,dsp_out_vol[i].EFPAN,mixl,mixr);
-			}
-		}
-		*/
-
-		//Mono !
-		if (CommonData->Mono)
-		{
-			//Yay for mono =P
-			mixl+=mixr;
-			mixr=mixl;
-		}
-
-		//MVOL !
-		//we want to make sure mix* is *At least* 23 bits wide here, so 64 bit mul !
-		u32 mvol=CommonData->MVOL;
-		s32 val=volume_lut[mvol];
-		mixl = (s32)FPMul<s64>(mixl, val, 15);
-		mixr = (s32)FPMul<s64>(mixr, val, 15);
-
-
-		if (CommonData->DAC18B)
-		{
-			//If 18 bit output , make it 16b :p
-			mixl=FPs(mixl,2);
-			mixr=FPs(mixr,2);
-		}
-
-		//Sample is ready ! clip/saturate and store :}
-
-#ifdef CLIP_WARN
-		if (((s16)mixl) != mixl)
-			printf("Clipped mixl %d\n",mixl);
-		if (((s16)mixr) != mixr)
-			printf("Clipped mixr %d\n",mixr);
+		int32x4_t sample = vld1q_s32(&block.sample[i]);
+		int32x4_t left = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&block.left[i])), 15);
+		int32x4_t right = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&block.right[i])), 15);
+		int32x4_t dsp = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&block.dsp[i])), 11);
+		vst1q_s32(&dspMix[i], vaddq_s32(vld1q_s32(&dspMix[i]), dsp));
+
+		uint32x4_t mono = vandq_u32(monoMask, vceqq_s32(vaddq_s32(left, right), vdupq_n_s32(0)));
+		dsp = vshrq_n_s32(dsp, 4);
+		left = vbslq_s32(mono, dsp, left);
+		right = vbslq_s32(mono, dsp, right);
+		vst1q_s32(&mixl[i], vaddq_s32(vld1q_s32(&mixl[i]), left));
+		vst1q_s32(&mixr[i], vaddq_s32(vld1q_s32(&mixr[i]), right));
+	}
 #endif
-
-		clip16(mixl);
-		clip16(mixr);
-
-		if (!settings.input.fastForwardMode && !settings.aica.muteAudio)
-			WriteSample(mixr,mixl);
+	for (; i < count; i++)
+	{
+		SampleType oLeft = FPMul(block.sample[i], block.left[i], 15);
+		SampleType oRight = FPMul(block.sample[i], block.right[i], 15);
+		SampleType oDsp = FPMul(block.sample[i], block.dsp[i], 11);
+		dspMix[i] += oDsp;
+		if (oLeft + oRight == 0 && !dspEnabled)
+			oLeft = oRight = oDsp >> 4;
+		mixl[i] += oLeft;
+		mixr[i] += oRight;
 	}
 }
 
-void AICA_Sample()
+// Next CDDA sample, which is also the EXTS input of the DSP
+static void CddaSample(s32& EXTS0L, s32& EXTS0R)
 {
-	SampleType mixl,mixr;
-	mixl = 0;
-	mixr = 0;
-	memset(dsp::state.MIXS, 0, sizeof(dsp::state.MIXS));
-
-	ChannelEx::StepAll(mixl,mixr);
-	
-	//OK , generated all Channels  , now DSP/ect + final mix ;p
-	//CDDA EXTS input
-	
 	if (cdda_index>=CDDA_SIZE)
 	{
 		cdda_index=0;
 		libCore_CDDA_Sector(cdda_sector);
 	}
-	s32 EXTS0L=cdda_sector[cdda_index];
-	s32 EXTS0R=cdda_sector[cdda_index+1];
+	EXTS0L=cdda_sector[cdda_index];
+	EXTS0R=cdda_sector[cdda_index+1];
 	cdda_index+=2;
+}
 
+// CDDA, DSP effects, master volume and output of a sample.
+// efreg is the DSP output, only used if the DSP is enabled.
+static void FinalMix(SampleType mixl, SampleType mixr, s32 EXTS0L, s32 EXTS0R, const u32 *efreg)
+{
 	//Final MIX ..
 	//Add CDDA / DSP effect(s)
 
@@ -1540,15 +1552,10 @@ void AICA_Sample()
 	VolumePan(EXTS0L, dsp_out_vol[16].EFSDL, dsp_out_vol[16].EFPAN, mixl, mixr);
 	VolumePan(EXTS0R, dsp_out_vol[17].EFSDL, dsp_out_vol[17].EFPAN, mixl, mixr);
 
-	DSPData->EXTS[0] = EXTS0L;
-	DSPData->EXTS[1] = EXTS0R;
-
 	if (config::DSPEnabled)
 	{
-		dsp::step();
-
 		for (int i=0;i<16;i++)
-			VolumePan(*(s16*)&DSPData->EFREG[i], dsp_out_vol[i].EFSDL, dsp_out_vol[i].EFPAN, mixl, mixr);
+			VolumePan(*(const s16*)&efreg[i], dsp_out_vol[i].EFSDL, dsp_out_vol[i].EFPAN, mixl, mixr);
 	}
 
 	if (settings.input.fastForwardMode || settings.aica.muteAudio)
@@ -1593,6 +1600,63 @@ void AICA_Sample()
 	WriteSample(mixr,mixl);
 }
 
+// Same output as 32 calls to AICA_Sample()
+void AICA_Sample32()
+{
+	alignas(16) SampleType mixl[BlockSize] {};
+	alignas(16) SampleType mixr[BlockSize] {};
+	// DSP input of each sample, per ISEL
+	alignas(16) SampleType dspMix[16][BlockSize] {};
+	ChannelBlock block;
+
+	//Generate 32 samples for each channel, before moving to next channel
+	//much more cache efficient !
+	for (ChannelEx& channel : Chans)
+	{
+		int count = channel.StepBlock(block);
+		if (count > 0)
+			MixBlock(block, count, mixl, mixr, dspMix[channel.DspInput()]);
+	}
+	s32 exts[2][BlockSize];
+	for (int i = 0; i < BlockSize; i++)
+		CddaSample(exts[0][i], exts[1][i]);
+
+	u32 efreg[BlockSize][16];
+	if (config::DSPEnabled)
+	{
+		dsp::stepBlock(dspMix, exts, efreg);
+	}
+	else
+	{
+		// Same dsp inputs as after the last sample
+		for (int j = 0; j < 16; j++)
+			dsp::state.MIXS[j] = dspMix[j][BlockSize - 1];
+		DSPData->EXTS[0] = exts[0][BlockSize - 1];
+		DSPData->EXTS[1] = exts[1][BlockSize - 1];
+	}
+	for (int i = 0; i < BlockSize; i++)
+		FinalMix(mixl[i], mixr[i], exts[0][i], exts[1][i], efreg[i]);
+}
+
+void AICA_Sample()
+{
+	SampleType mixl,mixr;
+	mixl = 0;
+	mixr = 0;
+	memset(dsp::state.MIXS, 0, sizeof(dsp::state.MIXS));
+
+	ChannelEx::StepAll(mixl,mixr);
+
+	s32 EXTS0L, EXTS0R;
+	CddaSample(EXTS0L, EXTS0R);
+	DSPData->EXTS[0] = EXTS0L;
+	DSPData->EXTS[1] = EXTS0R;
+	if (config::DSPEnabled)
+		dsp::step();
+
+	FinalMix(mixl, mixr, EXTS0L, EXTS0R, DSPData->EFREG);
+}
+
 void channel_serialize(Serializer& ser)
 {
 	for (const ChannelEx& channel : Chans)
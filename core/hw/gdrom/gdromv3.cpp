@@ -605,6 +605,7 @@ void gd_process_spi_cmd()
 			else
 				read_params.remaining_sectors = (readcmd.b[6] << 8) | readcmd.b[7];
 			read_params.sector_type = sector_type;//yeah i know , not really many types supported...
+			libGDR_Prefetch(read_params.start_sector, read_params.remaining_sectors);
 
 			printf_spicmd("SPI_CD_READ - Sector=%d Size=%d/%d DMA=%d",read_params.start_sector,read_params.remaining_sectors,read_params.sector_type,Features.CDRead.DMA);
 			if (Features.CDRead.DMA == 1)
@@ -767,6 +768,8 @@ void gd_process_spi_cmd()
 					cdda.EndAddr.FAD = ses_inf[3] << 16 | ses_inf[4] << 8 | ses_inf[5];
 				}
 				cdda.repeats = packet_cmd.data_8[6] & 0xF;
+				if (cdda.EndAddr.FAD > cdda.CurrAddr.FAD)
+					libGDR_Prefetch(cdda.CurrAddr.FAD, cdda.EndAddr.FAD - cdda.CurrAddr.FAD);
 				GDStatus.DSC = 1;
 			}
 			else if (param_type == 7)
@@ -25,6 +25,7 @@ VramWatcher vramWatcher;
 RamWatcher ramWatcher;
 AicaRamWatcher aramWatcher;
 ElanRamWatcher elanWatcher;
+bool tracking;
 
 void AicaRamWatcher::protectMem(u32 addr, u32 size)
 {
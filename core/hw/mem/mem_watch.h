@@ -26,17 +26,23 @@
 #include "rend/TexCache.h"
 #include <array>
 #include <unordered_map>
+#include <vector>
 
 namespace memwatch
 {
 
 using PageMap = std::unordered_map<u32, std::array<u8, PAGE_SIZE>>;
+// Largest watched area (naomi ram, elan ram)
+constexpr u32 MaxTrackedSize = 32 * 1024 * 1024;
 
 template<typename T>
 class Watcher
 {
 	bool started;
+	bool saving;	// save the content of written pages (rollback)
+	bool tracking;	// record written pages (checkpoints)
 	PageMap pages;
+	std::vector<u8> dirty;	// written to from the render thread too, hence not vector<bool>
 
 public:
 	void protect()
@@ -52,12 +58,24 @@ public:
 				static_cast<T&>(*this).protectMem(pair.first, PAGE_SIZE);
 		}
 		pages.clear();
+		saving = true;
+	}
+
+	// Protect all pages and record the ones written from now on, without saving their content
+	void startTracking()
+	{
+		dirty.assign(MaxTrackedSize / PAGE_SIZE, 0);
+		static_cast<T&>(*this).protectMem(0, 0xffffffff);
+		tracking = true;
 	}
 
 	void reset()
 	{
 		started = false;
+		saving = false;
+		tracking = false;
 		pages.clear();
+		dirty.clear();
 	}
 
 	bool hit(void *addr)
@@ -66,10 +84,15 @@ public:
 		if (offset == (u32)-1)
 			return false;
 		offset &= ~PAGE_MASK;
-		if (pages.count(offset) > 0)
-			// already saved
-			return true;
-		memcpy(&pages[offset][0], static_cast<T&>(*this).getMemPage(offset), PAGE_SIZE);
+		if (tracking && offset / PAGE_SIZE < dirty.size())
+			dirty[offset / PAGE_SIZE] = 1;
+		if (saving)
+		{
+			if (pages.count(offset) > 0)
+				// already saved
+				return true;
+			memcpy(&pages[offset][0], static_cast<T&>(*this).getMemPage(offset), PAGE_SIZE);
+		}
 		static_cast<T&>(*this).unprotectMem(offset, PAGE_SIZE);
 		return true;
 	}
@@ -77,6 +100,16 @@ public:
 	const PageMap& getPages() {
 		return pages;
 	}
+
+	// Offsets of the pages written since startTracking()
+	std::vector<u32> getDirtyPages() const
+	{
+		std::vector<u32> offsets;
+		for (u32 page = 0; page < dirty.size(); page++)
+			if (dirty[page] != 0)
+				offsets.push_back(page * PAGE_SIZE);
+		return offsets;
+	}
 };
 
 class VramWatcher : public Watcher<VramWatcher>
@@ -170,9 +203,11 @@ extern RamWatcher ramWatcher;
 extern AicaRamWatcher aramWatcher;
 extern ElanRamWatcher elanWatcher;
 
+extern bool tracking;
+
 inline static bool writeAccess(void *p)
 {
-	if (!config::GGPOEnable)
+	if (!config::GGPOEnable && !tracking)
 		return false;
 	if (ramWatcher.hit(p))
 	{
@@ -205,6 +240,18 @@ inline static void reset()
 	ramWatcher.reset();
 	aramWatcher.reset();
 	elanWatcher.reset();
+	tracking = false;
+}
+
+// Start recording the pages written to ram, vram and aica ram
+inline static void startTracking()
+{
+	vramWatcher.startTracking();
+	ramWatcher.startTracking();
+	aramWatcher.startTracking();
+	if (settings.platform.isNaomi2())
+		elanWatcher.startTracking();
+	tracking = true;
 }
 
 }
@@ -163,6 +163,7 @@ ROM board internal layouts:
 #include "awcartridge.h"
 #include "awave_regs.h"
 #include "serialize.h"
+#include "cfg/option.h"
 
 u32 AWCartridge::ReadMem(u32 address, u32 size) {
 	verify(size != 1);
@@ -338,6 +339,16 @@ void AWCartridge::Init(LoadProgress *progress, std::vector<u8> *digest)
 {
 	mpr_offset = decrypt16(0x58/2) | (decrypt16(0x5a/2) << 16);
 	INFO_LOG(NAOMI, "AWCartridge::SetKey rombd_key %02x mpr_offset %08x", rombd_key, mpr_offset);
+	if (config::CacheDecryptedRoms || config::PreDecryptRoms)
+	{
+		decryptCache.reset(new DecryptCache(RomSize, [this](u32 offset, u8 *dst, u32 size) {
+			u16 *words = (u16 *)dst;
+			for (u32 i = 0; i < size / 2; i++)
+				words[i] = decrypt16(offset / 2 + i);
+		}));
+		if (config::PreDecryptRoms)
+			decryptCache->loadOrDecryptAll(RomPtr, rombd_key, progress);
+	}
 	device_reset();
 }
 
@@ -389,7 +400,13 @@ void AWCartridge::recalc_dma_offset(int mode)
 
 void *AWCartridge::GetDmaPtr(u32 &size)
 {
-	size = std::min(std::min(size, 32u), dma_limit - dma_offset);
+	size = std::min(size, dma_limit - dma_offset);
+	if (decryptCache && size != 0 && dma_offset < RomSize && (dma_offset & 1) == 0)
+	{
+		size = std::min(size, RomSize - dma_offset);
+		return (void *)decryptCache->get(dma_offset, size);
+	}
+	size = std::min(size, 32u);
 	u32 offset = dma_offset / 2;
 	for (u32 i = 0; i < size / 2; i++)
 		decrypted_buf[i] = decrypt16(offset + i);
@@ -13,6 +13,9 @@
 #define CORE_HW_NAOMI_AWCARTRIDGE_H_
 
 #include "naomi_cart.h"
+#include "decrypt_cache.h"
+
+#include <memory>
 
 class AWCartridge: public Cartridge
 {
@@ -43,6 +46,7 @@ private:
 	u16 decrypted_buf[16];
 
 	u32 dma_offset, dma_limit;
+	std::unique_ptr<DecryptCache> decryptCache;
 
 	struct sbox_set {
 		u8 S0[32];
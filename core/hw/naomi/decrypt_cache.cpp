@@ -0,0 +1,324 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "decrypt_cache.h"
+#include "emulator.h"
+#include "oslib/oslib.h"
+#include "oslib/directory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+#include <nowide/cstdio.hpp>
+#include <xxhash.h>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr u32 CacheMagic = 0x4d4f5244;	// DROM
+static constexpr u32 CacheVersion = 2;
+static const std::string CacheExtension = ".decrypted";
+
+// after the magic, version, rom size and hash
+static constexpr long LastUsedOffset = 4 + 4 + 4 + 8;
+
+// Microseconds since the epoch
+static u64 now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static u64 elapsedMicros(Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+DecryptCache::DecryptCache(u32 size, DecryptFunc decrypt)
+	: romSize(size), pageCount((size + PageSize - 1) / PageSize), decrypt(decrypt),
+	  data(new u8[size]), state(new std::atomic<u8>[pageCount]())
+{
+	thread = std::thread(&DecryptCache::threadMain, this);
+}
+
+DecryptCache::~DecryptCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		cond.notify_all();
+	}
+	thread.join();
+	const Stats stats = getStats();
+	const u64 reads = stats.hits + stats.misses;
+	if (reads != 0)
+		INFO_LOG(NAOMI, "Decrypted rom cache: %" PRIu64 " page reads, %.1f%% hits, %" PRIu64 " pages prefetched, stall time %" PRIu64 " ms",
+				reads, stats.hits * 100.0 / reads, stats.prefetched, stats.stallTime / 1000);
+}
+
+// Returns false if the page is already decrypted or being decrypted by another thread
+bool DecryptCache::decryptPage(u32 page)
+{
+	u8 expected = Empty;
+	if (!state[page].compare_exchange_strong(expected, Busy, std::memory_order_acquire))
+		return false;
+	decrypt(page * PageSize, &data[page * PageSize], pageSize(page));
+	state[page].store(Ready, std::memory_order_release);
+	return true;
+}
+
+void DecryptCache::waitPage(u32 page)
+{
+	Clock::time_point start = Clock::now();
+	if (decryptPage(page))
+		misses.fetch_add(1, std::memory_order_relaxed);
+	else
+	{
+		// being decrypted by the background thread
+		while (state[page].load(std::memory_order_acquire) != Ready)
+			std::this_thread::yield();
+		hits.fetch_add(1, std::memory_order_relaxed);
+	}
+	stallTime.fetch_add(elapsedMicros(start), std::memory_order_relaxed);
+}
+
+const u8 *DecryptCache::get(u32 offset, u32& size)
+{
+	const u32 page = offset / PageSize;
+	size = std::min(size, (page + 1) * PageSize - offset);
+	if (state[page].load(std::memory_order_acquire) == Ready)
+		hits.fetch_add(1, std::memory_order_relaxed);
+	else
+		waitPage(page);
+	if (page != lastPage)
+	{
+		lastPage = page;
+		std::lock_guard<std::mutex> lock(mutex);
+		prefetchNext = page + 1;
+		prefetchEnd = std::min(page + 1 + ReadAheadPages, pageCount);
+		cond.notify_all();
+	}
+	return &data[offset];
+}
+
+void DecryptCache::threadMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running)
+	{
+		if (prefetchNext >= prefetchEnd)
+		{
+			cond.wait(lock);
+			continue;
+		}
+		const u32 page = prefetchNext++;
+		lock.unlock();
+		const bool decrypted = decryptPage(page);
+		lock.lock();
+		if (decrypted)
+			prefetched++;
+	}
+}
+
+void DecryptCache::decryptAll(LoadProgress *progress)
+{
+	Clock::time_point start = Clock::now();
+	std::atomic<u32> nextPage { 0 };
+	std::atomic<u32> donePages { 0 };
+	std::atomic<bool> cancelled { false };
+	auto worker = [&]() {
+		for (u32 page = nextPage++; page < pageCount && !cancelled; page = nextPage++)
+		{
+			decryptPage(page);
+			donePages++;
+		}
+	};
+	const u32 threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<std::thread> threads;
+	// The calling thread updates the progress if needed, or takes part in the decryption
+	for (u32 i = progress == nullptr ? 1 : 0; i < threadCount; i++)
+		threads.emplace_back(worker);
+	if (progress == nullptr)
+		worker();
+	else
+	{
+		progress->label = "Decrypting...";
+		while (donePages < pageCount && !cancelled)
+		{
+			if (progress->cancelled)
+				cancelled = true;
+			progress->progress = (float)donePages / pageCount;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	if (cancelled)
+		throw LoadCancelledException();
+	// some pages may still be decrypted by the background thread
+	for (u32 page = 0; page < pageCount; page++)
+		while (state[page].load(std::memory_order_acquire) != Ready)
+			std::this_thread::yield();
+	INFO_LOG(NAOMI, "Decrypted %d KB with %d threads in %" PRIu64 " ms", romSize / 1024, threadCount, elapsedMicros(start) / 1000);
+}
+
+bool DecryptCache::load(const std::string& path, u64 hash)
+{
+	FILE *f = nowide::fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return false;
+	Clock::time_point start = Clock::now();
+	u32 magic = 0, version = 0, fileSize = 0;
+	u64 fileHash = 0, lastUsed = 0;
+	bool ok = fread(&magic, sizeof(magic), 1, f) == 1
+			&& fread(&version, sizeof(version), 1, f) == 1
+			&& fread(&fileSize, sizeof(fileSize), 1, f) == 1
+			&& fread(&fileHash, sizeof(fileHash), 1, f) == 1
+			&& fread(&lastUsed, sizeof(lastUsed), 1, f) == 1
+			&& magic == CacheMagic && version == CacheVersion && fileSize == romSize && fileHash == hash;
+	if (ok)
+	{
+		// Pages aren't decrypted yet so nothing else writes to the buffer
+		ok = fread(&data[0], 1, romSize, f) == romSize;
+		if (ok)
+			for (u32 page = 0; page < pageCount; page++)
+				state[page].store(Ready, std::memory_order_release);
+	}
+	std::fclose(f);
+	if (ok)
+	{
+		INFO_LOG(NAOMI, "Loaded decrypted rom %s in %" PRIu64 " ms", path.c_str(), elapsedMicros(start) / 1000);
+		// Least recently used files are deleted first
+		f = nowide::fopen(path.c_str(), "r+b");
+		if (f != nullptr)
+		{
+			const u64 lastUsed = now();
+			if (std::fseek(f, LastUsedOffset, SEEK_SET) == 0)
+				std::fwrite(&lastUsed, sizeof(lastUsed), 1, f);
+			std::fclose(f);
+		}
+	}
+	else
+		WARN_LOG(NAOMI, "Ignoring invalid decrypted rom %s", path.c_str());
+	return ok;
+}
+
+bool DecryptCache::save(const std::string& path, u64 hash) const
+{
+	FILE *f = nowide::fopen(path.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(NAOMI, "Can't save decrypted rom to %s", path.c_str());
+		return false;
+	}
+	const u64 lastUsed = now();
+	bool ok = std::fwrite(&CacheMagic, sizeof(CacheMagic), 1, f) == 1
+			&& std::fwrite(&CacheVersion, sizeof(CacheVersion), 1, f) == 1
+			&& std::fwrite(&romSize, sizeof(romSize), 1, f) == 1
+			&& std::fwrite(&hash, sizeof(hash), 1, f) == 1
+			&& std::fwrite(&lastUsed, sizeof(lastUsed), 1, f) == 1
+			&& std::fwrite(&data[0], 1, romSize, f) == romSize;
+	std::fclose(f);
+	if (!ok)
+	{
+		WARN_LOG(NAOMI, "Error writing decrypted rom %s", path.c_str());
+		nowide::remove(path.c_str());
+	}
+	return ok;
+}
+
+void DecryptCache::loadOrDecryptAll(const u8 *rom, u64 key, LoadProgress *progress)
+{
+	const u64 hash = XXH64(rom, romSize, key);
+	char name[32];
+	sprintf(name, "%016" PRIx64, hash);
+	const std::string path = hostfs::getShaderCachePath(name + CacheExtension);
+	if (load(path, hash))
+		return;
+	decryptAll(progress);
+	if (save(path, hash))
+		prune(hostfs::getShaderCachePath(""), MaxSavedSize, path);
+}
+
+void DecryptCache::prune(const std::string& dir, u64 maxSize, const std::string& keepPath)
+{
+	struct SavedRom
+	{
+		std::string path;
+		u64 size;
+		u64 lastUsed;
+	};
+	std::vector<SavedRom> roms;
+	u64 totalSize = 0;
+	DIR *d = flycast::opendir(dir.c_str());
+	if (d == nullptr)
+		return;
+	while (true)
+	{
+		struct dirent *entry = flycast::readdir(d);
+		if (entry == nullptr)
+			break;
+		const std::string name(entry->d_name);
+		if (name.length() <= CacheExtension.length()
+				|| name.compare(name.length() - CacheExtension.length(), CacheExtension.length(), CacheExtension) != 0)
+			continue;
+		SavedRom rom { dir + name, 0, 0 };
+		FILE *f = nowide::fopen(rom.path.c_str(), "rb");
+		if (f == nullptr)
+			continue;
+		u32 magic = 0, version = 0;
+		if (std::fread(&magic, sizeof(magic), 1, f) != 1 || std::fread(&version, sizeof(version), 1, f) != 1
+				|| magic != CacheMagic || version != CacheVersion
+				|| std::fseek(f, LastUsedOffset, SEEK_SET) != 0
+				|| std::fread(&rom.lastUsed, sizeof(rom.lastUsed), 1, f) != 1)
+			// Files of an older version are deleted first
+			rom.lastUsed = 0;
+		std::fseek(f, 0, SEEK_END);
+		rom.size = std::ftell(f);
+		std::fclose(f);
+		totalSize += rom.size;
+		roms.push_back(rom);
+	}
+	flycast::closedir(d);
+
+	std::sort(roms.begin(), roms.end(), [](const SavedRom& a, const SavedRom& b) {
+		return a.lastUsed < b.lastUsed;
+	});
+	for (const SavedRom& rom : roms)
+	{
+		if (totalSize <= maxSize)
+			break;
+		if (rom.path == keepPath)
+			continue;
+		if (nowide::remove(rom.path.c_str()) == 0)
+		{
+			INFO_LOG(NAOMI, "Deleted decrypted rom %s", rom.path.c_str());
+			totalSize -= rom.size;
+		}
+	}
+}
+
+DecryptCache::Stats DecryptCache::getStats()
+{
+	Stats stats;
+	stats.hits = hits.load(std::memory_order_relaxed);
+	stats.misses = misses.load(std::memory_order_relaxed);
+	stats.stallTime = stallTime.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.prefetched = prefetched;
+	return stats;
+}
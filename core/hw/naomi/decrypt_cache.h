@@ -0,0 +1,106 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct LoadProgress;
+
+//
+// Decrypted copy of an encrypted cartridge rom, for ciphers where each page can be decrypted independently.
+// A page is decrypted the first time it's read, and the pages following it are decrypted ahead by a background thread.
+// The whole rom can also be decrypted at load time by several threads, and saved to a file to be reused next time.
+//
+class DecryptCache
+{
+public:
+	static constexpr u32 PageSize = 64 * 1024;
+	// How many pages are decrypted ahead of the last page read
+	static constexpr u32 ReadAheadPages = 4;
+
+	// Decrypts size bytes of the rom at the given offset. Offsets are page-aligned.
+	using DecryptFunc = std::function<void(u32 offset, u8 *dst, u32 size)>;
+
+	struct Stats
+	{
+		u64 hits;			// reads of an already decrypted page
+		u64 misses;			// pages decrypted by the emulation thread
+		u64 prefetched;		// pages decrypted by the background thread
+		u64 stallTime;		// time spent by the emulation decrypting or waiting for pages, in microseconds
+	};
+
+	DecryptCache(u32 size, DecryptFunc decrypt);
+	~DecryptCache();
+
+	// Returns the decrypted data at offset. size is reduced so that the data doesn't cross a page boundary.
+	const u8 *get(u32 offset, u32& size);
+
+	// Decrypts the whole rom using all the available cores
+	void decryptAll(LoadProgress *progress = nullptr);
+	// Decrypts the whole rom, or loads it from the cache directory if it has been saved before.
+	// The file name is derived from the hash of the encrypted rom and key.
+	void loadOrDecryptAll(const u8 *rom, u64 key, LoadProgress *progress = nullptr);
+	bool load(const std::string& path, u64 hash);
+	bool save(const std::string& path, u64 hash) const;
+	// Deletes the least recently used decrypted roms in dir until their total size is at most maxSize.
+	// The file at keepPath is never deleted.
+	static void prune(const std::string& dir, u64 maxSize, const std::string& keepPath = "");
+
+	// Total size of the decrypted roms saved by loadOrDecryptAll()
+	static constexpr u64 MaxSavedSize = 1024 * 1024 * 1024;
+
+	Stats getStats();
+
+private:
+	enum PageState : u8 { Empty, Busy, Ready };
+
+	u32 pageSize(u32 page) const {
+		const u32 left = romSize - page * PageSize;
+		return left < PageSize ? left : PageSize;
+	}
+	bool decryptPage(u32 page);
+	void waitPage(u32 page);
+	void threadMain();
+
+	u32 romSize;
+	u32 pageCount;
+	DecryptFunc decrypt;
+	std::unique_ptr<u8[]> data;
+	std::unique_ptr<std::atomic<u8>[]> state;
+	u32 lastPage = ~0u;
+	// updated by the emulation thread without locking
+	std::atomic<u64> hits { 0 };
+	std::atomic<u64> misses { 0 };
+	std::atomic<u64> stallTime { 0 };
+	// protects the read-ahead range and prefetched count
+	std::mutex mutex;
+	std::condition_variable cond;
+	u32 prefetchNext = 0;
+	u32 prefetchEnd = 0;
+	u64 prefetched = 0;
+	bool running = true;
+	std::thread thread;
+};
@@ -10,6 +10,7 @@
 
 #include "m4cartridge.h"
 #include "serialize.h"
+#include "cfg/option.h"
 
 
 // Decoder for M4-type NAOMI cart encryption
@@ -46,6 +47,20 @@ static u8 cfidata[] = {
 0x01,0x00
 };
 
+void M4Cartridge::Init(LoadProgress *progress, std::vector<u8> *digest)
+{
+	device_start();
+	device_reset();
+	if (config::CacheDecryptedRoms || config::PreDecryptRoms)
+	{
+		decryptCache.reset(new DecryptCache(RomSize, [this](u32 offset, u8 *dst, u32 size) {
+			decrypt_blocks(RomPtr + offset, dst, size);
+		}));
+		if (config::PreDecryptRoms)
+			decryptCache->loadOrDecryptAll(RomPtr, m4id | ((u32)subkey1 << 16) | ((u64)subkey2 << 32), progress);
+	}
+}
+
 void M4Cartridge::device_start()
 {
 	if (m4id == 0)
@@ -230,6 +245,21 @@ void M4Cartridge::enc_fill()
 	const u8 *base = RomPtr + rom_cur_address;
 	while (buffer_actual_size < sizeof(buffer))
 	{
+		// The cipher is reset every 16 words, so whole blocks starting at a 32-byte aligned address
+		// can be copied from the decrypted rom
+		if (decryptCache && counter == 0 && rom_cur_address % 32 == 0 && rom_cur_address < RomSize)
+		{
+			u32 size = std::min((u32)sizeof(buffer) - buffer_actual_size, RomSize - rom_cur_address) & ~31;
+			if (size != 0)
+			{
+				const u8 *src = decryptCache->get(rom_cur_address, size);
+				memcpy(buffer + buffer_actual_size, src, size);
+				buffer_actual_size += size;
+				base += size;
+				rom_cur_address += size;
+				continue;
+			}
+		}
 		u16 enc = base[0] | (base[1] << 8);
 		u16 dec = iv;
 		iv = decrypt_one_round(enc ^ iv, subkey1);
@@ -259,6 +289,25 @@ void M4Cartridge::enc_fill()
 
 }
 
+// Decrypts whole blocks of 16 words
+void M4Cartridge::decrypt_blocks(const u8 *src, u8 *dst, u32 size)
+{
+	u16 iv = 0;
+	for (u32 i = 0; i < size; i += 2)
+	{
+		u16 enc = src[i] | (src[i + 1] << 8);
+		u16 dec = iv;
+		iv = decrypt_one_round(enc ^ iv, subkey1);
+		dec ^= decrypt_one_round(iv, subkey2);
+
+		dst[i] = dec;
+		dst[i + 1] = dec >> 8;
+
+		if (i % 32 == 30)
+			iv = 0;
+	}
+}
+
 bool M4Cartridge::Write(u32 offset, u32 size, u32 data)
 {
 	if (((offset&0xffff) == 0x00aa) && (data == 0x0098))
@@ -14,17 +14,16 @@
 
 #include "naomi_cart.h"
 #include "naomi_regs.h"
+#include "decrypt_cache.h"
+
+#include <memory>
 
 class M4Cartridge: public NaomiCartridge {
 public:
 	M4Cartridge(u32 size) : NaomiCartridge(size) { }
 	~M4Cartridge() override;
 
-	void Init(LoadProgress *progress = nullptr, std::vector<u8> *digest = nullptr) override
-	{
-		device_start();
-		device_reset();
-	}
+	void Init(LoadProgress *progress = nullptr, std::vector<u8> *digest = nullptr) override;
 
 	u32 ReadMem(u32 address, u32 size) override
 	{
@@ -73,10 +72,12 @@ private:
 	bool encryption;
 	bool cfi_mode;
 	bool xfer_ready;
+	std::unique_ptr<DecryptCache> decryptCache;
 
 	void enc_init();
 	void enc_reset();
 	void enc_fill();
+	void decrypt_blocks(const u8 *src, u8 *dst, u32 size);
 	u16 decrypt_one_round(u16 word, u16 subkey);
 };
 
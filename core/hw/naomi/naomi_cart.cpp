@@ -19,6 +19,7 @@
 // license:BSD-3-Clause
 // copyright-holders:MetalliC
 
+#include <algorithm>
 #include <memory>
 #include "naomi_cart.h"
 #include "naomi_regs.h"
@@ -41,6 +42,14 @@
 #include "naomi_flashrom.h"
 #include "network/net_serial_maxspeed.h"
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__SWITCH__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_ROM_MAPPING
+#endif
+
 Cartridge *CurrentCartridge;
 bool bios_loaded = false;
 
@@ -407,6 +416,153 @@ static void loadMameRom(const char *filename, LoadProgress *progress)
 	}
 }
 
+// Map the rom files copy-on-write into a contiguous address range, so that they're only read when accessed.
+// Each file must start on a page boundary and not share a page with another file or reserved range.
+// Returns nullptr if the files can't be mapped.
+static u8 *mapRomFiles(const std::string& folder, const std::vector<std::string>& files,
+		const std::vector<u32>& fstart, const std::vector<u32>& fsize, u32 romSize)
+{
+#ifdef HAVE_ROM_MAPPING
+	const u32 pageSize = (u32)sysconf(_SC_PAGESIZE);
+	std::vector<std::pair<u32, u32>> pages;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (files[i] != "null" && fstart[i] % pageSize != 0)
+			return nullptr;
+		u32 end = fstart[i] + fsize[i];
+		pages.emplace_back(fstart[i] / pageSize, (end + pageSize - 1) / pageSize);
+	}
+	std::sort(pages.begin(), pages.end());
+	for (size_t i = 1; i < pages.size(); i++)
+		if (pages[i].first < pages[i - 1].second)
+			return nullptr;
+
+	u8 *romBase = (u8 *)mmap(nullptr, romSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (romBase == MAP_FAILED)
+		return nullptr;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (files[i] == "null")
+		{
+			memset(romBase + fstart[i], -1, fsize[i]);
+			continue;
+		}
+		std::string path(folder + files[i]);
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		void *p = MAP_FAILED;
+		// Let the regular loader report missing or truncated files
+		if (fd >= 0 && fstat(fd, &st) == 0 && (u64)st.st_size >= fsize[i])
+			p = mmap(romBase + fstart[i], fsize[i], PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+		if (fd >= 0)
+			close(fd);
+		if (p == MAP_FAILED)
+		{
+			munmap(romBase, romSize);
+			return nullptr;
+		}
+	}
+	return romBase;
+#else
+	return nullptr;
+#endif
+}
+
+void unmapRomFiles(u8 *romBase, u32 romSize)
+{
+#ifdef HAVE_ROM_MAPPING
+	munmap(romBase, romSize);
+#endif
+}
+
+DecryptedCartridge::~DecryptedCartridge()
+{
+	if (mapped)
+	{
+		unmapRomFiles(RomPtr, RomSize);
+		RomPtr = nullptr;
+	}
+}
+
+u8 *loadRomFiles(const std::string& folder, const std::vector<std::string>& files,
+		const std::vector<u32>& fstart, const std::vector<u32>& fsize, u32 romSize, bool& mapped)
+{
+	const double startTime = os_GetSeconds();
+	if (config::MapRomFiles && !config::GGPOEnable)
+	{
+		u8 *romBase = mapRomFiles(folder, files, fstart, fsize, romSize);
+		if (romBase != nullptr)
+		{
+			INFO_LOG(NAOMI, "ROM memory mapped in %.1f ms", (os_GetSeconds() - startTime) * 1000.0);
+			mapped = true;
+			return romBase;
+		}
+		INFO_LOG(NAOMI, "ROM files can't be memory mapped");
+	}
+
+	MD5Sum md5;
+
+	// Allocate space for the rom
+	u8 *romBase = (u8 *)malloc(romSize);
+	verify(romBase != nullptr);
+
+	bool load_error = false;
+
+	for (size_t i = 0; i<files.size(); i++)
+	{
+		FILE *fp = nullptr;
+
+		if (files[i] != "null")
+		{
+			std::string file(folder + files[i]);
+
+			fp = nowide::fopen(file.c_str(), "rb");
+			if (fp == nullptr)
+			{
+				ERROR_LOG(NAOMI, "Unable to open file %s: error %d", file.c_str(), errno);
+				load_error = true;
+				break;
+			}
+		}
+		u8* romDest = romBase + fstart[i];
+
+		if (fp == nullptr)
+		{
+			//printf("-Reserving ram at 0x%08X, size 0x%08X\n", fstart[i], fsize[i]);
+			memset(romDest, -1, fsize[i]);
+		}
+		else
+		{
+			//printf("-Mapping \"%s\" at 0x%08X, size 0x%08X\n", files[i].c_str(), fstart[i], fsize[i]);
+			bool read = fread(romDest, 1, fsize[i], fp) == fsize[i];
+			if (config::GGPOEnable)
+				md5.add(fp);
+			fclose(fp);
+			if (!read)
+			{
+				ERROR_LOG(NAOMI, "Unable to read file %s @ %08x size %x", files[i].c_str(),
+						fstart[i], fsize[i]);
+				load_error = true;
+				break;
+			}
+		}
+	}
+
+	if (load_error)
+	{
+		free(romBase);
+		throw FlycastException("Error: Failed to load BIN/DAT file");
+	}
+	if (config::GGPOEnable)
+		md5.getDigest(settings.network.md5.game);
+
+	DEBUG_LOG(NAOMI, "Legacy ROM loaded successfully");
+	INFO_LOG(NAOMI, "ROM read in %.1f ms", (os_GetSeconds() - startTime) * 1000.0);
+	mapped = false;
+
+	return romBase;
+}
+
 static void loadDecryptedRom(const char* file, LoadProgress *progress)
 {
 	// Try to load BIOS from naomi.zip
@@ -498,65 +654,9 @@ static void loadDecryptedRom(const char* file, LoadProgress *progress)
 
 	INFO_LOG(NAOMI, "+%zd romfiles, %.2f MB set address space", files.size(), romSize / 1024.f / 1024.f);
 
-	MD5Sum md5;
-
-	// Allocate space for the rom
-	u8 *romBase = (u8 *)malloc(romSize);
-	verify(romBase != nullptr);
-
-	bool load_error = false;
-
-	for (size_t i = 0; i<files.size(); i++)
-	{
-		FILE *fp = nullptr;
-
-		if (files[i] != "null")
-		{
-			std::string file(folder + files[i]);
-
-			fp = nowide::fopen(file.c_str(), "rb");
-			if (fp == nullptr)
-			{
-				ERROR_LOG(NAOMI, "Unable to open file %s: error %d", file.c_str(), errno);
-				load_error = true;
-				break;
-			}
-		}
-		u8* romDest = romBase + fstart[i];
-
-		if (fp == nullptr)
-		{
-			//printf("-Reserving ram at 0x%08X, size 0x%08X\n", fstart[i], fsize[i]);
-			memset(romDest, -1, fsize[i]);
-		}
-		else
-		{
-			//printf("-Mapping \"%s\" at 0x%08X, size 0x%08X\n", files[i].c_str(), fstart[i], fsize[i]);
-			bool mapped = fread(romDest, 1, fsize[i], fp) == fsize[i];
-			if (config::GGPOEnable)
-				md5.add(fp);
-			fclose(fp);
-			if (!mapped)
-			{
-				ERROR_LOG(NAOMI, "Unable to read file %s @ %08x size %x", files[i].c_str(),
-						fstart[i], fsize[i]);
-				load_error = true;
-				break;
-			}
-		}
-	}
-
-	if (load_error)
-	{
-		free(romBase);
-		throw FlycastException("Error: Failed to load BIN/DAT file");
-	}
-	if (config::GGPOEnable)
-		md5.getDigest(settings.network.md5.game);
-
-	DEBUG_LOG(NAOMI, "Legacy ROM loaded successfully");
-
-	CurrentCartridge = new DecryptedCartridge(romBase, romSize);
+	bool mapped;
+	u8 *romBase = loadRomFiles(folder, files, fstart, fsize, romSize, mapped);
+	CurrentCartridge = new DecryptedCartridge(romBase, romSize, mapped);
 }
 
 void naomi_cart_LoadRom(const char* file, LoadProgress *progress)
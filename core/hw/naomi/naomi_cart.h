@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 #include "types.h"
 #include "emulator.h"
 
@@ -47,6 +48,8 @@ class Cartridge
 {
 public:
 	Cartridge(u32 size);
+	// Takes ownership of a malloc'ed rom
+	Cartridge(u8 *romPtr, u32 size) : RomPtr(romPtr), RomSize(size) {}
 	virtual ~Cartridge();
 
 	virtual void Init(LoadProgress *progress = nullptr, std::vector<u8> *digest = nullptr) {
@@ -76,6 +79,7 @@ class NaomiCartridge : public Cartridge
 {
 public:
 	NaomiCartridge(u32 size) : Cartridge(size), RomPioOffset(0), RomPioAutoIncrement(false), DmaOffset(0), DmaCount(0xffff) {}
+	NaomiCartridge(u8 *romPtr, u32 size) : Cartridge(romPtr, size), RomPioOffset(0), RomPioAutoIncrement(false), DmaOffset(0), DmaCount(0xffff) {}
 
 	u32 ReadMem(u32 address, u32 size) override;
 	void WriteMem(u32 address, u32 data, u32 size) override;
@@ -100,7 +104,12 @@ protected:
 class DecryptedCartridge : public NaomiCartridge
 {
 public:
-	DecryptedCartridge(u8 *rom_ptr, u32 size) : NaomiCartridge(size) { free(RomPtr); RomPtr = rom_ptr; }
+	// A mapped rom is released with unmapRomFiles()
+	DecryptedCartridge(u8 *rom_ptr, u32 size, bool mapped = false) : NaomiCartridge(rom_ptr, size), mapped(mapped) {}
+	~DecryptedCartridge() override;
+
+private:
+	bool mapped;
 };
 
 class M2Cartridge : public NaomiCartridge
@@ -131,6 +140,11 @@ void naomi_cart_Close();
 int naomi_cart_GetPlatform(const char *path);
 void naomi_cart_LoadBios(const char *filename);
 void naomi_cart_ConfigureEEPROM();
+// Map or read the files of a decrypted rom at their start address, in a buffer of romSize bytes.
+// If mapped is set, the buffer must be released with unmapRomFiles(), otherwise with free().
+u8 *loadRomFiles(const std::string& folder, const std::vector<std::string>& files,
+		const std::vector<u32>& fstart, const std::vector<u32>& fsize, u32 romSize, bool& mapped);
+void unmapRomFiles(u8 *romBase, u32 romSize);
 
 extern char naomi_game_id[];
 extern u8 *naomi_default_eeprom;
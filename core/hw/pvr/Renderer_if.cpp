@@ -2,6 +2,8 @@
 #include "spg.h"
 #include "hw/pvr/pvr_mem.h"
 #include "rend/TexCache.h"
+#include "rend/TexPrefetch.h"
+#include "ta_capture.h"
 #include "cfg/option.h"
 #include "network/ggpo.h"
 #include "emulator.h"
@@ -180,6 +182,7 @@ void rend_term_renderer()
 void rend_reset()
 {
 	FinishRender(DequeueRender());
+	texture_prefetcher.Cancel();
 	do_swap = false;
 	render_called = false;
 	pend_rend = false;
@@ -243,9 +246,13 @@ void rend_start_render(TA_context *ctx)
 			ctx->rend.fog_clamp_max = FOG_CLAMP_MAX;
 		}
 
+		if (tacapture::active)
+			tacapture::capture(ctx);
 		if (!config::DelayFrameSwapping && !ctx->rend.isRTT)
 			ggpo::endOfFrame();
 		palette_update();
+		if (config::ThreadedRendering)
+			texture_prefetcher.Prefetch(ctx);
 		if (QueueRender(ctx))
 		{
 			pend_rend = true;
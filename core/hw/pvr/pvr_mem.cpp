@@ -11,6 +11,14 @@
 #include "hw/holly/holly_intc.h"
 #include "serialize.h"
 
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+#include <emmintrin.h>
+#define YUV_SSE2
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define YUV_NEON
+#endif
+
 static u32 pvr_map32(u32 offset32);
 
 VArray2 vram;
@@ -52,6 +60,7 @@ void YUV_init()
 	YUV_index = 0;
 }
 
+#if !defined(YUV_SSE2) && !defined(YUV_NEON)
 static void YUV_Block8x8(const u8* inuv, const u8* iny, u8* out)
 {
 	u8* line_out_0=out+0;
@@ -87,9 +96,45 @@ static void YUV_Block8x8(const u8* inuv, const u8* iny, u8* out)
 		line_out_1+=YUV_x_size*4-8*2;
 	}
 }
+#endif
 
+// Converts a 16x16 macroblock made of 8x8 U, 8x8 V and four 8x8 Y blocks to YUV422
 static INLINE void YUV_Block384(const u8 *in, u8 *out)
 {
+#if defined(YUV_SSE2) || defined(YUV_NEON)
+	const u32 stride = YUV_x_size * 2;
+	// Two lines at a time, sharing the same U and V samples
+	for (int y = 0; y < 16; y += 2)
+	{
+		const u8 *inu = in + y / 2 * 8;
+		const u8 *inv = inu + 64;
+		// left and right Y blocks
+		const u8 *iny = in + 128 + y / 8 * 128 + y % 8 * 8;
+		u8 *line_out = out + y * stride;
+#ifdef YUV_SSE2
+		__m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)inu), _mm_loadl_epi64((const __m128i *)inv));
+		for (int i = 0; i < 2; i++)
+		{
+			__m128i yy = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)iny), _mm_loadl_epi64((const __m128i *)(iny + 64)));
+			_mm_storeu_si128((__m128i *)line_out, _mm_unpacklo_epi8(uv, yy));
+			_mm_storeu_si128((__m128i *)(line_out + 16), _mm_unpackhi_epi8(uv, yy));
+			iny += 8;
+			line_out += stride;
+		}
+#else
+		uint8x8x2_t uvzip = vzip_u8(vld1_u8(inu), vld1_u8(inv));
+		uint8x16_t uv = vcombine_u8(uvzip.val[0], uvzip.val[1]);
+		for (int i = 0; i < 2; i++)
+		{
+			uint8x16x2_t yuv = vzipq_u8(uv, vcombine_u8(vld1_u8(iny), vld1_u8(iny + 64)));
+			vst1q_u8(line_out, yuv.val[0]);
+			vst1q_u8(line_out + 16, yuv.val[1]);
+			iny += 8;
+			line_out += stride;
+		}
+#endif
+	}
+#else
 	const u8 *inuv = in;
 	const u8 *iny = in + 128;
 	u8* p_out = out;
@@ -98,34 +143,47 @@ static INLINE void YUV_Block384(const u8 *in, u8 *out)
 	YUV_Block8x8(inuv+ 4,iny+64,p_out+8*2);                 //(8,0)
 	YUV_Block8x8(inuv+32,iny+128,p_out+YUV_x_size*8*2);     //(0,8)
 	YUV_Block8x8(inuv+36,iny+192,p_out+YUV_x_size*8*2+8*2); //(8,8)
+#endif
 }
 
-static INLINE void YUV_ConvertMacroBlock(const u8 *datap)
+// Converts consecutive macroblocks. Macroblocks up to the end of the current row or of the texture
+// are converted in one go before the converter state is updated.
+static void YUV_ConvertMacroBlocks(const u8 *datap, u32 blocks)
 {
-	//do shit
-	TA_YUV_TEX_CNT++;
-
-	YUV_Block384(datap, vram.data + YUV_dest);
-
-	YUV_dest+=32;
-
-	YUV_x_curr+=16;
-	if (YUV_x_curr==YUV_x_size)
+	while (blocks > 0)
 	{
-		YUV_dest+=15*YUV_x_size*2;
-		YUV_x_curr=0;
-		YUV_y_curr+=16;
-		if (YUV_y_curr==YUV_y_size)
+		u32 count = std::min(blocks, (YUV_x_size - YUV_x_curr) / 16);
+		const u32 remaining = YUV_blockcount - TA_YUV_TEX_CNT;
+		if (remaining != 0)
+			count = std::min(count, remaining);
+
+		u8 *out = vram.data + YUV_dest;
+		for (u32 i = 0; i < count; i++)
+			YUV_Block384(datap + i * 384, out + i * 32);
+		datap += count * 384;
+		blocks -= count;
+
+		TA_YUV_TEX_CNT += count;
+		YUV_dest += count * 32;
+
+		YUV_x_curr += count * 16;
+		if (YUV_x_curr==YUV_x_size)
 		{
-			YUV_y_curr=0;
+			YUV_dest+=15*YUV_x_size*2;
+			YUV_x_curr=0;
+			YUV_y_curr+=16;
+			if (YUV_y_curr==YUV_y_size)
+			{
+				YUV_y_curr=0;
+			}
 		}
-	}
 
-	if (YUV_blockcount==TA_YUV_TEX_CNT)
-	{
-		YUV_init();
-		
-		asic_RaiseInterrupt(holly_YUV_DMA);
+		if (YUV_blockcount==TA_YUV_TEX_CNT)
+		{
+			YUV_init();
+
+			asic_RaiseInterrupt(holly_YUV_DMA);
+		}
 	}
 }
 
@@ -144,21 +202,21 @@ static void YUV_data(const SQBuffer *data, u32 count)
 
 	while (count > 0)
 	{
-		if (YUV_index + count >= block_size)
+		if (YUV_index == 0 && count >= block_size)
+		{
+			// Avoid copy and convert all the whole blocks at once
+			u32 blocks = count / block_size;
+			YUV_ConvertMacroBlocks((const u8 *)data, blocks);
+			data += blocks * block_size;
+			count -= blocks * block_size;
+		}
+		else if (YUV_index + count >= block_size)
 		{
 			//more or exactly one block remaining
 			u32 dr = block_size - YUV_index;				//remaining bytes til block end
-			if (YUV_index == 0)
-			{
-				// Avoid copy
-				YUV_ConvertMacroBlock((const u8 *)data);	//convert block
-			}
-			else
-			{
-				memcpy(&YUV_tempdata[YUV_index], data, dr * sizeof(SQBuffer));	//copy em
-				YUV_ConvertMacroBlock((const u8 *)&YUV_tempdata[0]);	//convert block
-				YUV_index = 0;
-			}
+			memcpy(&YUV_tempdata[YUV_index], data, dr * sizeof(SQBuffer));	//copy em
+			YUV_ConvertMacroBlocks((const u8 *)&YUV_tempdata[0], 1);	//convert block
+			YUV_index = 0;
 			data += dr;											//count em
 			count -= dr;
 		}
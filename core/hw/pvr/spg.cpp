@@ -2,6 +2,8 @@
 #include "spg.h"
 #include "hw/holly/holly_intc.h"
 #include "hw/holly/sb.h"
+#include "hw/pvr/ta.h"
+#include "hw/sh4/dyna/asynccompile.h"
 #include "hw/sh4/sh4_sched.h"
 #include "input/gamepad_device.h"
 #include "oslib/oslib.h"
@@ -215,6 +217,10 @@ int spg_line_sched(int tag, int cycl, int jit)
 					spd_vbs/full_rps,mode,res,fullvbs,
 					spd_fps,fskip/ts
 					, mv, mv_c);
+				ta_log_stats(ts);
+#if FEAT_SHREC != DYNAREC_NONE
+				rdv_LogAsyncCompileStats(spd_vbs * ts);
+#endif
 				
 				fskip=0;
 				last_fps=os_GetSeconds();
@@ -3,6 +3,9 @@
 #include "hw/holly/holly_intc.h"
 #include "pvr_mem.h"
 
+#include <algorithm>
+#include <cinttypes>
+
 /*
 	Threaded TA Implementation
 
@@ -511,18 +514,22 @@ void ta_vtx_SoftReset()
 	ta_cur_state = TAS_NS;
 }
 
+TaStats taStats;
+
 static INLINE
 void DYNACALL ta_thd_data32_i(const simd256_t *data)
 {
 	if (ta_ctx == NULL)
 	{
 		INFO_LOG(PVR, "Warning: data sent to TA prior to ListInit. Ignored");
+		taStats.droppedBytes += 32;
 		return;
 	}
 	if (ta_tad.End() - ta_tad.thd_root >= TA_DATA_SIZE)
 	{
 		INFO_LOG(PVR, "Warning: TA data buffer overflow");
 		asic_RaiseInterrupt(holly_MATR_NOMEM);
+		taStats.droppedBytes += 32;
 		return;
 	}
 
@@ -556,28 +563,72 @@ void DYNACALL ta_thd_data32_i(const simd256_t *data)
 
 void DYNACALL ta_vtx_data32(const SQBuffer *data)
 {
+	taStats.sqWrites++;
 	ta_thd_data32_i((const simd256_t *)data);
 }
 
+// Processes large TA transfers (DMA, PVR_TA_INPUT) in batches: the context and the space left in the TA buffer
+// are checked once, then the blocks are copied and run through the state machine in a tight loop.
 void ta_vtx_data(const SQBuffer *data, u32 size)
 {
-	while (size >= 4)
+	taStats.dmaTransfers++;
+	taStats.dmaBytes += size * sizeof(SQBuffer);
+	if (ta_ctx == nullptr)
 	{
-		ta_thd_data32_i((simd256_t *)data);
-		data++;
-		ta_thd_data32_i((simd256_t *)data);
-		data++;
-		ta_thd_data32_i((simd256_t *)data);
-		data++;
-		ta_thd_data32_i((simd256_t *)data);
-		data++;
-		size -= 4;
+		INFO_LOG(PVR, "Warning: data sent to TA prior to ListInit. Ignored");
+		taStats.droppedBytes += size * sizeof(SQBuffer);
+		return;
 	}
-
 	while (size > 0)
 	{
-		ta_thd_data32_i((simd256_t *)data);
-		data++;
-		size--;
+		if (ta_tad.thd_data == ta_tad.thd_root)
+		{
+			// The first block of a list is checked against the previous list size (see tad_context::End)
+			ta_thd_data32_i((const simd256_t *)data);
+			data++;
+			size--;
+			continue;
+		}
+		const u32 used = (u32)(ta_tad.thd_data - ta_tad.thd_root);
+		if (used >= TA_DATA_SIZE)
+		{
+			INFO_LOG(PVR, "Warning: TA data buffer overflow");
+			asic_RaiseInterrupt(holly_MATR_NOMEM);
+			taStats.droppedBytes += size * sizeof(SQBuffer);
+			return;
+		}
+		const u32 count = std::min(size, (TA_DATA_SIZE - used + 31) / 32);
+		simd256_t *dst = (simd256_t *)ta_tad.thd_data;
+		const simd256_t *src = (const simd256_t *)data;
+		const simd256_t *end = src + count;
+		u8 state = ta_cur_state;
+		for (; src < end; src++, dst++)
+		{
+			const PCW pcw = *(const PCW *)src;
+			*dst = *src;
+			const u32 trans = ta_fsm[(state << 8) | (pcw.ParaType << 5) | ((pcw.obj_ctrl >> 2) & 31)];
+			state = (u8)trans;
+			if (unlikely(trans & 0xF0))
+			{
+				// ta_handle_cmd reads the last block written and updates the state
+				ta_tad.thd_data = (u8 *)(dst + 1);
+				ta_handle_cmd(trans);
+				state = ta_cur_state;
+			}
+		}
+		ta_cur_state = state;
+		ta_tad.thd_data = (u8 *)dst;
+		data += count;
+		size -= count;
 	}
 }
+
+void ta_log_stats(double seconds)
+{
+	const u64 bytes = taStats.sqWrites * sizeof(SQBuffer) + taStats.dmaBytes;
+	if (bytes != 0)
+		INFO_LOG(PVR, "TA: %.2f MB/s, %.1f%% in %" PRIu64 " DMA transfers, %" PRIu64 " store queue writes, %" PRIu64 " bytes dropped",
+				bytes / seconds / 1024.0 / 1024.0, taStats.dmaBytes * 100.0 / bytes, taStats.dmaTransfers,
+				taStats.sqWrites, taStats.droppedBytes);
+	taStats = {};
+}
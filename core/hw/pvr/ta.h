@@ -12,9 +12,22 @@ void ta_vtx_ListInit();
 void ta_vtx_SoftReset();
 
 void DYNACALL ta_vtx_data32(const SQBuffer *data);
+// Batched ingestion of size consecutive 32-byte blocks
 void ta_vtx_data(const SQBuffer *data, u32 size);
 
+// TA input counters, logged and reset periodically in debug builds
+struct TaStats
+{
+	u64 sqWrites;		// single 32-byte blocks written by store queues
+	u64 dmaBytes;		// bytes received in batches (DMA, PVR_TA_INPUT)
+	u64 dmaTransfers;
+	u64 droppedBytes;	// ignored because of a missing context or a full TA buffer
+};
+extern TaStats taStats;
+void ta_log_stats(double seconds);
+
 bool ta_parse(TA_context *ctx);
+void ta_get_textures(TA_context *ctx, std::vector<std::pair<TSP, TCW>>& textures);
 
 class TaTypeLut
 {
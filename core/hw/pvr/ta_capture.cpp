@@ -0,0 +1,424 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "ta_capture.h"
+#include "pvr_regs.h"
+#include "Renderer_if.h"
+#include "serialize.h"
+#include "cfg/option.h"
+#include "rend/sorter.h"
+#include "nowide/cstdio.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+
+Renderer* rend_norend();
+
+namespace tacapture
+{
+
+static const u32 Magic = 0x50434154;	// TACP
+static const u32 FormatVersion = 1;
+// Size of the render context fields that follow the TA data and PVR registers
+static const u32 MaxRendContextSize = 1024;
+static const u32 MaxFrameSize = 4 + MAX_PASSES * (4 + TA_DATA_SIZE) + pvr_RegSize + MaxRendContextSize;
+// Number of frames waiting to be written before the capture blocks
+static const size_t MaxPendingFrames = 4;
+
+bool active;
+static FILE *captureFile;
+static int framesLeft;
+static int framesCaptured;
+
+// Frames are compressed and written to the file by a separate thread
+static std::thread writerThread;
+static std::mutex writerMutex;
+static std::condition_variable writerCond;
+static std::deque<std::vector<u8>> pendingFrames;
+static std::vector<std::vector<u8>> freeBuffers;
+static bool stopWriter;
+static bool writeError;
+
+static void serializeFrame(Serializer& ser, TA_context *ctx)
+{
+	u32 count = 0;
+	for (TA_context *c = ctx; c != nullptr; c = c->nextContext)
+		count++;
+	ser << count;
+	for (TA_context *c = ctx; c != nullptr; c = c->nextContext)
+	{
+		u32 size = (u32)(c->tad.End() - c->tad.thd_root);
+		ser << size;
+		ser.serialize(c->tad.thd_root, size);
+	}
+	ser.serialize(pvr_regs, pvr_RegSize);
+
+	const rend_context& rc = ctx->rend;
+	ser << rc.isRTT;
+	ser << rc.fb_X_CLIP;
+	ser << rc.fb_Y_CLIP;
+	ser << rc.fb_W_LINESTRIDE;
+	ser << rc.fog_clamp_min;
+	ser << rc.fog_clamp_max;
+	// Background polygon set by FillBGP
+	const PolyParam& bgpp = *rc.global_param_op.head();
+	ser << bgpp.isp.full;
+	ser << bgpp.tsp.full;
+	ser << bgpp.tcw.full;
+	ser << bgpp.pcw.full;
+	ser.serialize(rc.verts.head(), 4);
+}
+
+static void deserializeContext(Deserializer& deser, TA_context& ctx)
+{
+	u32 size;
+	deser >> size;
+	if (size > TA_DATA_SIZE)
+		throw Deserializer::Exception("TA data too big");
+	ctx.Reset();
+	deser.deserialize(ctx.tad.thd_root, size);
+	ctx.tad.thd_data = ctx.tad.thd_root + size;
+}
+
+static bool writeFrame(const std::vector<u8>& data, std::vector<u8>& zipped)
+{
+	uLongf zippedSize = compressBound(data.size());
+	zipped.resize(zippedSize);
+	if (compress2(zipped.data(), &zippedSize, data.data(), data.size(), Z_BEST_SPEED) != Z_OK)
+	{
+		WARN_LOG(PVR, "TA capture: compression error");
+		return false;
+	}
+	const u32 sizes[] { (u32)data.size(), (u32)zippedSize };
+	if (std::fwrite(sizes, sizeof(sizes), 1, captureFile) != 1
+			|| std::fwrite(zipped.data(), zippedSize, 1, captureFile) != 1)
+	{
+		WARN_LOG(PVR, "TA capture: write error");
+		return false;
+	}
+	return true;
+}
+
+static void writerLoop()
+{
+	std::vector<u8> zipped;
+	std::unique_lock<std::mutex> lock(writerMutex);
+	for (;;)
+	{
+		writerCond.wait(lock, []() { return !pendingFrames.empty() || stopWriter; });
+		// Pending frames are written before stopping
+		if (pendingFrames.empty())
+			break;
+		std::vector<u8> data = std::move(pendingFrames.front());
+		pendingFrames.pop_front();
+		bool error = writeError;
+		lock.unlock();
+		writerCond.notify_all();
+		if (!error && !writeFrame(data, zipped))
+			error = true;
+		lock.lock();
+		writeError = writeError || error;
+		freeBuffers.push_back(std::move(data));
+	}
+}
+
+bool start(const std::string& path, int frames)
+{
+	stop();
+	captureFile = nowide::fopen(path.c_str(), "wb");
+	if (captureFile == nullptr)
+	{
+		WARN_LOG(PVR, "TA capture: cannot create %s", path.c_str());
+		return false;
+	}
+	const u32 header[] { Magic, FormatVersion };
+	if (std::fwrite(header, sizeof(header), 1, captureFile) != 1)
+	{
+		WARN_LOG(PVR, "TA capture: write error");
+		stop();
+		return false;
+	}
+	framesLeft = frames;
+	framesCaptured = 0;
+	stopWriter = false;
+	writeError = false;
+	writerThread = std::thread(writerLoop);
+	active = true;
+	INFO_LOG(PVR, "TA capture to %s started", path.c_str());
+
+	return true;
+}
+
+void capture(TA_context *ctx)
+{
+	if (ctx->rend.isRenderFramebuffer)
+		return;
+	if (settings.platform.isNaomi2())
+	{
+		// The Naomi 2 T&L state isn't captured
+		WARN_LOG(PVR, "TA capture isn't supported on Naomi 2");
+		stop();
+		return;
+	}
+	std::vector<u8> data;
+	bool error;
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		error = writeError;
+		if (!freeBuffers.empty())
+		{
+			data = std::move(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+	}
+	if (error)
+	{
+		stop();
+		return;
+	}
+	Serializer dryrun(nullptr, std::numeric_limits<size_t>::max());
+	serializeFrame(dryrun, ctx);
+	data.resize(dryrun.size());
+	Serializer ser(data.data(), data.size());
+	serializeFrame(ser, ctx);
+	{
+		std::unique_lock<std::mutex> lock(writerMutex);
+		writerCond.wait(lock, []() { return pendingFrames.size() < MaxPendingFrames; });
+		pendingFrames.push_back(std::move(data));
+	}
+	writerCond.notify_all();
+	framesCaptured++;
+	if (framesLeft > 0 && --framesLeft == 0)
+		stop();
+}
+
+void stop()
+{
+	if (captureFile == nullptr)
+		return;
+	active = false;
+	if (writerThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(writerMutex);
+			stopWriter = true;
+		}
+		writerCond.notify_all();
+		writerThread.join();
+	}
+	freeBuffers.clear();
+	std::fclose(captureFile);
+	captureFile = nullptr;
+	if (writeError)
+		WARN_LOG(PVR, "TA capture stopped after an error");
+	else
+		INFO_LOG(PVR, "TA capture stopped: %d frames", framesCaptured);
+}
+
+bool Reader::open(const std::string& path)
+{
+	close();
+	file = nowide::fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+	u32 header[2];
+	if (std::fread(header, sizeof(header), 1, file) != 1
+			|| header[0] != Magic || header[1] != FormatVersion)
+	{
+		WARN_LOG(PVR, "%s isn't a TA capture file", path.c_str());
+		close();
+		return false;
+	}
+	long pos = std::ftell(file);
+	std::fseek(file, 0, SEEK_END);
+	fileSize = std::ftell(file);
+	std::fseek(file, pos, SEEK_SET);
+	frame = 0;
+
+	return true;
+}
+
+void Reader::close()
+{
+	if (file != nullptr)
+		std::fclose(file);
+	file = nullptr;
+}
+
+bool Reader::read(TA_context& ctx)
+{
+	u32 sizes[2];
+	if (file == nullptr || std::fread(sizes, sizeof(sizes), 1, file) != 1)
+		return false;
+	if (sizes[0] > MaxFrameSize || sizes[1] > compressBound(MaxFrameSize)
+			|| (long)sizes[1] > fileSize - std::ftell(file))
+	{
+		WARN_LOG(PVR, "TA capture: frame %d has an invalid size", frame);
+		return false;
+	}
+	zipped.resize(sizes[1]);
+	buffer.resize(sizes[0]);
+	uLongf size = sizes[0];
+	if (std::fread(zipped.data(), zipped.size(), 1, file) != 1
+			|| uncompress(buffer.data(), &size, zipped.data(), zipped.size()) != Z_OK
+			|| size != sizes[0])
+	{
+		WARN_LOG(PVR, "TA capture: frame %d is truncated or corrupted", frame);
+		return false;
+	}
+	try {
+		Deserializer deser(buffer.data(), buffer.size());
+		u32 count;
+		deser >> count;
+		if (count == 0 || count > MAX_PASSES)
+			throw Deserializer::Exception("Invalid context count");
+		deserializeContext(deser, ctx);
+		TA_context *prev = &ctx;
+		for (u32 i = 1; i < count; i++)
+		{
+			if (children.size() < i)
+			{
+				children.emplace_back(new TA_context());
+				children.back()->Alloc();
+			}
+			TA_context *child = children[i - 1].get();
+			deserializeContext(deser, *child);
+			prev->nextContext = child;
+			prev = child;
+		}
+		prev->nextContext = nullptr;
+		deser.deserialize(pvr_regs, pvr_RegSize);
+
+		rend_context& rc = ctx.rend;
+		deser >> rc.isRTT;
+		deser >> rc.fb_X_CLIP;
+		deser >> rc.fb_Y_CLIP;
+		deser >> rc.fb_W_LINESTRIDE;
+		deser >> rc.fog_clamp_min;
+		deser >> rc.fog_clamp_max;
+		PolyParam& bgpp = *rc.global_param_op.head();
+		bgpp.init();
+		deser >> bgpp.isp.full;
+		deser >> bgpp.tsp.full;
+		deser >> bgpp.tcw.full;
+		deser >> bgpp.pcw.full;
+		bgpp.count = 4;
+		deser.deserialize(rc.verts.head(), 4);
+	} catch (const Deserializer::Exception& e) {
+		WARN_LOG(PVR, "TA capture: invalid frame %d: %s", frame, e.what());
+		return false;
+	}
+	frame++;
+
+	return true;
+}
+
+// Same as what the renderers do before drawing the translucent lists
+static void sortTranslucent()
+{
+	std::vector<SortTrigDrawParam> pidx;
+	std::vector<u32> vidx;
+	u32 previousCount = 0;
+	for (const RenderPass& pass : pvrrc.render_passes)
+	{
+		if (pass.autosort)
+		{
+			if (config::PerStripSorting)
+				SortPParams(previousCount, pass.tr_count - previousCount);
+			else
+				GenSorted(previousCount, pass.tr_count - previousCount, pidx, vidx);
+		}
+		previousCount = pass.tr_count;
+	}
+}
+
+bool replay(const std::string& path, int loops, ReplayStats& stats)
+{
+	using Clock = std::chrono::steady_clock;
+	auto elapsed = [](Clock::time_point from, Clock::time_point to) {
+		return std::chrono::duration<double, std::micro>(to - from).count();
+	};
+
+	Renderer *savedRenderer = renderer;
+	TA_context *savedContext = _pvrrc;
+	std::unique_ptr<Renderer> norend(rend_norend());
+	renderer = norend.get();
+	renderer->Init();
+	TA_context ctx;
+	ctx.Alloc();
+	_pvrrc = &ctx;
+
+	bool success = true;
+	for (int loop = 0; loop < loops && success; loop++)
+	{
+		Reader reader;
+		if (!reader.open(path))
+		{
+			success = false;
+			break;
+		}
+		while (reader.read(ctx))
+		{
+			Clock::time_point start = Clock::now();
+			renderer->Process(&ctx);
+			Clock::time_point parsed = Clock::now();
+			sortTranslucent();
+			Clock::time_point sorted = Clock::now();
+			renderer->Render();
+			Clock::time_point rendered = Clock::now();
+
+			stats.frames++;
+			stats.vertices += ctx.rend.verts.used();
+			stats.polys += ctx.rend.global_param_op.used() + ctx.rend.global_param_pt.used() + ctx.rend.global_param_tr.used();
+			stats.parseTime += elapsed(start, parsed);
+			stats.sortTime += elapsed(parsed, sorted);
+			stats.renderTime += elapsed(sorted, rendered);
+		}
+		if (reader.frameNumber() == 0)
+			success = false;
+	}
+	ctx.nextContext = nullptr;
+	_pvrrc = savedContext;
+	renderer->Term();
+	renderer = savedRenderer;
+
+	return success;
+}
+
+void ReplayStats::print() const
+{
+	if (frames == 0)
+	{
+		printf("No frame replayed\n");
+		return;
+	}
+	printf("Frames:         %d\n", frames);
+	printf("Vertices/frame: %.0f\n", (double)vertices / frames);
+	printf("Polys/frame:    %.0f\n", (double)polys / frames);
+	printf("ta_parse:       %.3f ms/frame\n", parseTime / frames / 1000.0);
+	printf("Sorting:        %.3f ms/frame\n", sortTime / frames / 1000.0);
+	printf("Render:         %.3f ms/frame\n", renderTime / frames / 1000.0);
+	printf("Total:          %.3f ms/frame, %.1f frames/s, %.2f Mvertices/s\n", totalTime() / frames / 1000.0,
+			frames * 1000000.0 / totalTime(), vertices / totalTime());
+}
+
+}
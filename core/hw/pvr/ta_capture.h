@@ -0,0 +1,81 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+#include "ta_ctx.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+//
+// Capture of the TA display lists and PVR registers of each rendered frame,
+// and headless replay through ta_parse, sorting and the null renderer to benchmark the render front-end.
+//
+namespace tacapture
+{
+
+extern bool active;
+
+// Capture the next frames to the given file. frames == 0 captures until stop() is called.
+bool start(const std::string& path, int frames = 0);
+// Called by rend_start_render for each frame
+void capture(TA_context *ctx);
+void stop();
+
+class Reader
+{
+public:
+	~Reader() { close(); }
+	bool open(const std::string& path);
+	// Read the next frame into ctx and restore the PVR registers.
+	// Additional contexts needed by multipass frames are allocated and linked to ctx.
+	// Returns false at the end of the file.
+	bool read(TA_context& ctx);
+	void close();
+	int frameNumber() const { return frame; }
+
+private:
+	FILE *file = nullptr;
+	long fileSize = 0;
+	std::vector<u8> zipped;
+	std::vector<u8> buffer;
+	std::vector<std::unique_ptr<TA_context>> children;
+	int frame = 0;
+};
+
+struct ReplayStats
+{
+	int frames = 0;
+	u64 vertices = 0;
+	u64 polys = 0;
+	// in microseconds
+	double parseTime = 0;
+	double sortTime = 0;
+	double renderTime = 0;
+
+	double totalTime() const { return parseTime + sortTime + renderTime; }
+	void print() const;
+};
+
+// Replay all the frames of a capture file through the null renderer.
+// Returns false if the file cannot be read.
+bool replay(const std::string& path, int loops, ReplayStats& stats);
+
+}
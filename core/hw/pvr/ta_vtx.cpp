@@ -6,6 +6,7 @@
 */
 #include "ta.h"
 #include "ta_ctx.h"
+#include "ta_vtx_simd.h"
 #include "pvr_mem.h"
 #include "Renderer_if.h"
 #include "cfg/option.h"
@@ -657,39 +658,30 @@ private:
 		cv->v = (vtx->v_name);
 
 	#define vert_uv_16(u_name,v_name) \
-		cv->u = f16(vtx->u_name);\
-		cv->v = f16(vtx->v_name);
+		uv16(&vtx->v_name, cv->u, cv->v);
 
 	#define vert_uv1_32(u_name,v_name) \
 		cv->u1 = (vtx->u_name);\
 		cv->v1 = (vtx->v_name);
 
 	#define vert_uv1_16(u_name,v_name) \
-		cv->u1 = f16(vtx->u_name);\
-		cv->v1 = f16(vtx->v_name);
+		uv16(&vtx->v_name, cv->u1, cv->v1);
 
 		//Color conversions
 	#define vert_packed_color_(to,src) \
-		{ \
-		u32 t=src; \
-		to[Blue] = (u8)(t);t>>=8;\
-		to[Green] = (u8)(t);t>>=8;\
-		to[Red] = (u8)(t);t>>=8;\
-		to[Alpha] = (u8)(t);      \
-		}
-
-	#define vert_float_color_(to,a,r,g,b) \
-		to[Red] = float_to_satu8(r); \
-		to[Green] = float_to_satu8(g); \
-		to[Blue] = float_to_satu8(b); \
-		to[Alpha] = float_to_satu8(a);
+		VtxConv<Red, Green, Blue, Alpha>::packedColor(to, src);
 
 		//Macros to make thins easier ;)
 	#define vert_packed_color(to,src) \
 		vert_packed_color_(cv->to,vtx->src);
 
 	#define vert_float_color(to,src) \
-		vert_float_color_(cv->to,vtx->src##A,vtx->src##R,vtx->src##G,vtx->src##B)
+		VtxConv<Red, Green, Blue, Alpha>::floatColor(cv->to, &vtx->src##A);
+
+		//Base and offset colors at once
+	#define vert_float_colors(base,offs) \
+		static_assert(offsetof(Vertex, spc) == offsetof(Vertex, col) + 4, "col and spc must be contiguous"); \
+		VtxConv<Red, Green, Blue, Alpha>::floatColors(cv->col, &vtx->base##A);
 
 		//Intensity handling
 
@@ -698,32 +690,16 @@ private:
 		//Intensity is clamped before the mul, as well as on face color to work the same as the hardware. [Fixes red dog]
 
 	#define vert_face_base_color(baseint) \
-		{ u32 satint = float_to_satu8(vtx->baseint); \
-		cv->col[Red] = FaceBaseColor[Red] * satint / 256;  \
-		cv->col[Green] = FaceBaseColor[Green] * satint / 256;  \
-		cv->col[Blue] = FaceBaseColor[Blue] * satint / 256;  \
-		cv->col[Alpha] = FaceBaseColor[Alpha]; }
+		VtxConv<Red, Green, Blue, Alpha>::intensityColor(cv->col, FaceBaseColor, vtx->baseint);
 
 	#define vert_face_offs_color(offsint) \
-		{ u32 satint = float_to_satu8(vtx->offsint); \
-		cv->spc[Red] = FaceOffsColor[Red] * satint / 256;  \
-		cv->spc[Green] = FaceOffsColor[Green] * satint / 256;  \
-		cv->spc[Blue] = FaceOffsColor[Blue] * satint / 256;  \
-		cv->spc[Alpha] = FaceOffsColor[Alpha]; }
+		VtxConv<Red, Green, Blue, Alpha>::intensityColor(cv->spc, FaceOffsColor, vtx->offsint);
 
 	#define vert_face_base_color1(baseint) \
-		{ u32 satint = float_to_satu8(vtx->baseint); \
-		cv->col1[Red] = FaceBaseColor1[Red] * satint / 256;  \
-		cv->col1[Green] = FaceBaseColor1[Green] * satint / 256;  \
-		cv->col1[Blue] = FaceBaseColor1[Blue] * satint / 256;  \
-		cv->col1[Alpha] = FaceBaseColor1[Alpha]; }
+		VtxConv<Red, Green, Blue, Alpha>::intensityColor(cv->col1, FaceBaseColor1, vtx->baseint);
 
 	#define vert_face_offs_color1(offsint) \
-		{ u32 satint = float_to_satu8(vtx->offsint); \
-		cv->spc1[Red] = FaceOffsColor1[Red] * satint / 256;  \
-		cv->spc1[Green] = FaceOffsColor1[Green] * satint / 256;  \
-		cv->spc1[Blue] = FaceOffsColor1[Blue] * satint / 256;  \
-		cv->spc1[Alpha] = FaceOffsColor1[Alpha]; }
+		VtxConv<Red, Green, Blue, Alpha>::intensityColor(cv->spc1, FaceOffsColor1, vtx->offsint);
 
 
 	//(Non-Textured, Packed Color)
@@ -786,8 +762,7 @@ private:
 	{
 		vert_res_base;
 
-		vert_float_color(col,Base);
-		vert_float_color(spc,Offs);
+		vert_float_colors(Base,Offs);
 	}
 
 	//(Textured, Floating Color, 16bit UV)
@@ -804,8 +779,7 @@ private:
 	{
 		vert_res_base;
 
-		vert_float_color(col,Base);
-		vert_float_color(spc,Offs);
+		vert_float_colors(Base,Offs);
 	}
 
 	//(Textured, Intensity)
@@ -1131,9 +1105,8 @@ static void getRegionTileClipping(u32& xmin, u32& xmax, u32& ymin, u32& ymax);
 //
 static bool is_vertex_inf(const Vertex& vtx)
 {
-	return std::isnan(vtx.x) || fabsf(vtx.x) > 3.4e37f
-			|| std::isnan(vtx.y) || fabsf(vtx.y) > 3.4e37f
-			|| std::isnan(vtx.z) || vtx.z < 0.f || vtx.z > 3.4e37f;
+	static_assert(offsetof(Vertex, col) == offsetof(Vertex, z) + 4, "xyz must be followed by 4 bytes");
+	return isVertexInvalid(&vtx.x);
 }
 
 //
@@ -1448,6 +1421,92 @@ bool ta_parse(TA_context *ctx)
 		return ta_parse_vdrc(ctx);
 }
 
+// Lightweight walk of the TA data to find the textures referenced by a context, without generating any vertex.
+// Used to decode textures ahead of ta_parse().
+void ta_get_textures(TA_context *ctx, std::vector<std::pair<TSP, TCW>>& textures)
+{
+	// Naomi 2 polygons are generated by the Elan and aren't in the TA data
+	if (settings.platform.isNaomi2())
+		return;
+	const PolyParam *bgpp = ctx->rend.global_param_op.head();
+	if (bgpp->pcw.Texture)
+		textures.emplace_back(bgpp->tsp, bgpp->tcw);
+
+	const u32 *ta_type_lut = TaTypeLut::instance().table;
+	for (TA_context *childCtx = ctx; childCtx != nullptr; childCtx = childCtx->nextContext)
+	{
+		Ta_Dma *data = (Ta_Dma *)childCtx->tad.thd_root;
+		Ta_Dma *data_end = (Ta_Dma *)childCtx->tad.End();
+		u32 listType = ListType_None;
+		u32 vertexSize = SZ32;
+
+		while (data < data_end)
+		{
+			switch (data->pcw.ParaType)
+			{
+			case ParamType_End_Of_List:
+				listType = ListType_None;
+				data += SZ32;
+				break;
+
+			case ParamType_User_Tile_Clip:
+			case ParamType_Object_List_Set:
+				data += SZ32;
+				break;
+
+			case ParamType_Polygon_or_Modifier_Volume:
+				if (listType == ListType_None)
+					listType = data->pcw.ListType;
+				if (IsModVolList(listType))
+				{
+					vertexSize = SZ64;
+					data += SZ32;
+				}
+				else
+				{
+					u32 uid = ta_type_lut[data->pcw.obj_ctrl];
+					u32 vt = uid & 0x7f;
+					u32 ppid = (u8)(uid >> 8);
+					vertexSize = vt == 5 || vt == 6 || (vt >= 11 && vt <= 14) ? SZ64 : SZ32;
+					if (data->pcw.Texture)
+					{
+						TA_PolyParam0 *pp = (TA_PolyParam0 *)data;
+						textures.emplace_back(pp->tsp, pp->tcw);
+						// Two volumes
+						if (ppid == 3 || ppid == 4)
+						{
+							TA_PolyParam3 *pp3 = (TA_PolyParam3 *)data;
+							textures.emplace_back(pp3->tsp1, pp3->tcw1);
+						}
+					}
+					data += uid >> 30;
+				}
+				break;
+
+			case ParamType_Sprite:
+				if (listType == ListType_None)
+					listType = data->pcw.ListType;
+				if (data->pcw.Texture)
+				{
+					TA_SpriteParam *sp = (TA_SpriteParam *)data;
+					textures.emplace_back(sp->tsp, sp->tcw);
+				}
+				vertexSize = SZ64;
+				data += SZ32;
+				break;
+
+			case ParamType_Vertex_Parameter:
+				data += vertexSize;
+				break;
+
+			default:
+				// Invalid parameter: stop here, ta_parse() will complain
+				return;
+			}
+		}
+	}
+}
+
 static PolyParam *n2CurrentPP;
 static ModifierVolumeParam *n2CurrentMVP;
 
@@ -1651,11 +1710,6 @@ void decode_pvr_vertex(u32 base, u32 ptr, Vertex* cv)
 	}
 }
 
-static u8 float_to_satu8_math(float val)
-{
-	return (u8)(std::min(1.f, std::max(0.f, val)) * 255.f);
-}
-
 static void vtxdec_init()
 {
 	/*
@@ -0,0 +1,200 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Conversion of TA vertex parameters to the Vertex format.
+// Results are identical to the scalar code, including for NaN, infinite and out of range values.
+//
+#pragma once
+#include "types.h"
+#include <algorithm>
+#include <cmath>
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+#include <emmintrin.h>
+#define TAVTX_SSE2
+#elif HOST_CPU == CPU_ARM64
+#include <arm_neon.h>
+#define TAVTX_NEON
+#endif
+
+// Only the 16 most significant bits of the float are used, like the f32_su8_tbl lookup table
+static inline u8 float_to_satu8_math(float val)
+{
+	return (u8)(std::min(1.f, std::max(0.f, val)) * 255.f);
+}
+
+static inline u8 float_to_satu8_trunc(float val)
+{
+	u32 bits;
+	memcpy(&bits, &val, sizeof(bits));
+	bits &= 0xffff0000;
+	memcpy(&val, &bits, sizeof(val));
+	return float_to_satu8_math(val);
+}
+
+template<int Red, int Green, int Blue, int Alpha>
+struct VtxConv
+{
+	// Packed ARGB8888 color
+	static void packedColor(u8 *to, u32 argb)
+	{
+		u32 c;
+		if (Red == 2 && Green == 1 && Blue == 0 && Alpha == 3)
+			c = argb;
+		else if (Red == 0 && Green == 1 && Blue == 2 && Alpha == 3)
+			c = (argb & 0xff00ff00) | ((argb >> 16) & 0xff) | ((argb & 0xff) << 16);
+		else
+			c = ((argb & 0xff) << (Blue * 8)) | (((argb >> 8) & 0xff) << (Green * 8))
+				| (((argb >> 16) & 0xff) << (Red * 8)) | ((argb >> 24) << (Alpha * 8));
+		memcpy(to, &c, sizeof(c));
+	}
+
+	// Floating point color in A, R, G, B order
+	static void floatColor(u8 *to, const float *argb)
+	{
+#if defined(TAVTX_SSE2)
+		__m128i c = toU8(shuffle(_mm_loadu_ps(argb)));
+		c = _mm_packs_epi32(c, c);
+		*(u32 *)to = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+#elif defined(TAVTX_NEON)
+		uint16x4_t c = vmovn_u32(toU8(shuffle(vld1q_f32(argb))));
+		vst1_lane_u32((u32 *)to, vreinterpret_u32_u8(vmovn_u16(vcombine_u16(c, c))), 0);
+#else
+		to[Alpha] = float_to_satu8_trunc(argb[0]);
+		to[Red] = float_to_satu8_trunc(argb[1]);
+		to[Green] = float_to_satu8_trunc(argb[2]);
+		to[Blue] = float_to_satu8_trunc(argb[3]);
+#endif
+	}
+
+	// Two consecutive floating point colors (base and offset) to two consecutive u8[4]
+	static void floatColors(u8 *to, const float *argb)
+	{
+#if defined(TAVTX_SSE2)
+		__m128i c0 = toU8(shuffle(_mm_loadu_ps(argb)));
+		__m128i c1 = toU8(shuffle(_mm_loadu_ps(argb + 4)));
+		__m128i c = _mm_packs_epi32(c0, c1);
+		_mm_storel_epi64((__m128i *)to, _mm_packus_epi16(c, c));
+#elif defined(TAVTX_NEON)
+		uint16x4_t c0 = vmovn_u32(toU8(shuffle(vld1q_f32(argb))));
+		uint16x4_t c1 = vmovn_u32(toU8(shuffle(vld1q_f32(argb + 4))));
+		vst1_u8(to, vmovn_u16(vcombine_u16(c0, c1)));
+#else
+		floatColor(to, argb);
+		floatColor(to + 4, argb + 4);
+#endif
+	}
+
+	// Face color modulated by the intensity. Alpha is unchanged.
+	static void intensityColor(u8 *to, const u8 *faceColor, float intensity)
+	{
+#if defined(TAVTX_SSE2)
+		const u32 satint = float_to_satu8_trunc(intensity);
+		const __m128i alphaMask = _mm_set_epi16(0, 0, 0, 0,
+				Alpha == 3 ? -1 : 0, Alpha == 2 ? -1 : 0, Alpha == 1 ? -1 : 0, Alpha == 0 ? -1 : 0);
+		__m128i face = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)faceColor), _mm_setzero_si128());
+		__m128i c = _mm_srli_epi16(_mm_mullo_epi16(face, _mm_set1_epi16((short)satint)), 8);
+		c = _mm_or_si128(_mm_andnot_si128(alphaMask, c), _mm_and_si128(alphaMask, face));
+		*(u32 *)to = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+#else
+		const u32 satint = float_to_satu8_trunc(intensity);
+		to[Red] = faceColor[Red] * satint / 256;
+		to[Green] = faceColor[Green] * satint / 256;
+		to[Blue] = faceColor[Blue] * satint / 256;
+		to[Alpha] = faceColor[Alpha];
+#endif
+	}
+
+private:
+#if defined(TAVTX_SSE2)
+	// Reorder A, R, G, B lanes to the output component order
+	static __m128 shuffle(__m128 argb)
+	{
+		return _mm_shuffle_ps(argb, argb, _MM_SHUFFLE(
+				srcLane(3), srcLane(2), srcLane(1), srcLane(0)));
+	}
+
+	// Same as float_to_satu8_trunc on each lane.
+	// maxps returns the second operand if either is NaN so NaN gives 0.
+	static __m128i toU8(__m128 v)
+	{
+		v = _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0xffff0000)));
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.f));
+		return _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.f)));
+	}
+#elif defined(TAVTX_NEON)
+	static float32x4_t shuffle(float32x4_t argb)
+	{
+		const uint8x16_t index = {
+			srcByte(0, 0), srcByte(0, 1), srcByte(0, 2), srcByte(0, 3),
+			srcByte(1, 0), srcByte(1, 1), srcByte(1, 2), srcByte(1, 3),
+			srcByte(2, 0), srcByte(2, 1), srcByte(2, 2), srcByte(2, 3),
+			srcByte(3, 0), srcByte(3, 1), srcByte(3, 2), srcByte(3, 3),
+		};
+		return vreinterpretq_f32_u8(vqtbl1q_u8(vreinterpretq_u8_f32(argb), index));
+	}
+
+	// NaN gives 0
+	static uint32x4_t toU8(float32x4_t v)
+	{
+		v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0xffff0000)));
+		v = vminnmq_f32(vmaxnmq_f32(v, vdupq_n_f32(0.f)), vdupq_n_f32(1.f));
+		return vcvtq_u32_f32(vmulq_f32(v, vdupq_n_f32(255.f)));
+	}
+#endif
+
+	// Index of the A, R, G, B input lane that goes to the given output component
+	static constexpr int srcLane(int component) {
+		return component == Alpha ? 0 : component == Red ? 1 : component == Green ? 2 : 3;
+	}
+#if defined(TAVTX_NEON)
+	static constexpr u8 srcByte(int component, int byte) {
+		return (u8)(srcLane(component) * 4 + byte);
+	}
+#endif
+};
+
+// 16-bit u and v packed in a u32: v in the low half, u in the high half
+static inline void uv16(const u16 *vu, float& u, float& v)
+{
+	u32 bits;
+	memcpy(&bits, vu, sizeof(bits));
+	u32 ubits = bits & 0xffff0000;
+	u32 vbits = bits << 16;
+	memcpy(&u, &ubits, sizeof(u));
+	memcpy(&v, &vbits, sizeof(v));
+}
+
+// Check if a vertex has huge x,y,z values or negative z.
+// The 4th float following xyz is read but ignored.
+static inline bool isVertexInvalid(const float *xyz)
+{
+#if defined(TAVTX_SSE2)
+	__m128 v = _mm_loadu_ps(xyz);
+	__m128 absv = _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+	// Ordered comparisons are false for NaN
+	__m128 valid = _mm_and_ps(_mm_cmple_ps(absv, _mm_set1_ps(3.4e37f)),
+			_mm_cmpge_ps(v, _mm_set_ps(0.f, 0.f, -INFINITY, -INFINITY)));
+	return (_mm_movemask_ps(valid) & 7) != 7;
+#else
+	return std::isnan(xyz[0]) || fabsf(xyz[0]) > 3.4e37f
+			|| std::isnan(xyz[1]) || fabsf(xyz[1]) > 3.4e37f
+			|| std::isnan(xyz[2]) || xyz[2] < 0.f || xyz[2] > 3.4e37f;
+#endif
+}
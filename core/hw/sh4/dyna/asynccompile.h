@@ -0,0 +1,221 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+//
+// Queue of blocks to compile on a background thread.
+// Jobs are requested by the emulation thread, processed in order by the worker function on the compile thread,
+// and taken back by the emulation thread once done.
+//
+template<typename Job>
+class AsyncCompileQueue
+{
+public:
+	// Processes a job on the compile thread. Returns false if it failed.
+	using Worker = std::function<bool(Job&)>;
+
+	AsyncCompileQueue(Worker worker, size_t maxJobs) : worker(worker), maxJobs(maxJobs) {}
+	~AsyncCompileQueue() { stop(); }
+
+	void start()
+	{
+		if (thread.joinable())
+			return;
+		exiting = false;
+		thread = std::thread(&AsyncCompileQueue::threadMain, this);
+	}
+
+	void stop()
+	{
+		if (!thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			exiting = true;
+		}
+		workCond.notify_one();
+		thread.join();
+	}
+
+	bool running() const { return thread.joinable(); }
+
+	// Queues a job for the given address.
+	// Returns false if there is already a job for this address, or if the queue is full.
+	bool request(u32 addr, std::unique_ptr<Job>&& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (jobs.size() >= maxJobs || jobs.count(addr) != 0)
+				return false;
+			Entry& entry = jobs[addr];
+			entry.job = std::move(job);
+			entry.requestTime = std::chrono::steady_clock::now();
+			queue.push_back(addr);
+		}
+		workCond.notify_one();
+		return true;
+	}
+
+	// Returns true if a job has been requested for this address and not taken yet
+	bool contains(u32 addr) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return jobs.count(addr) != 0;
+	}
+
+	// Removes and returns the job for the given address if it has been processed, or returns null.
+	// success is set to the result of the worker function,
+	// and latency to the time elapsed between the request and the end of processing.
+	std::unique_ptr<Job> take(u32 addr, bool& success, std::chrono::microseconds& latency)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = jobs.find(addr);
+		if (it == jobs.end() || it->second.state < Done)
+			return nullptr;
+		return takeEntry(it, success, latency);
+	}
+
+	// Removes and returns the oldest processed job, or returns null if none is done.
+	// addr is set to the job address.
+	std::unique_ptr<Job> takeDone(u32& addr, bool& success, std::chrono::microseconds& latency)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!done.empty())
+		{
+			addr = done.front();
+			done.pop_front();
+			// skip the jobs already taken by address
+			auto it = jobs.find(addr);
+			if (it != jobs.end() && it->second.state >= Done)
+				return takeEntry(it, success, latency);
+		}
+		return nullptr;
+	}
+
+	// Drops all the jobs, after the one being processed is done
+	void clear()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		queue.clear();
+		doneCond.wait(lock, [this]() { return !processing; });
+		jobs.clear();
+		done.clear();
+	}
+
+	// Waits until all the queued jobs have been processed
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCond.wait(lock, [this]() { return queue.empty() && !processing; });
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return jobs.size();
+	}
+
+private:
+	enum State { Queued, Done, Failed };
+	struct Entry
+	{
+		std::unique_ptr<Job> job;
+		State state = Queued;
+		std::chrono::steady_clock::time_point requestTime;
+		std::chrono::steady_clock::time_point doneTime;
+	};
+
+	std::unique_ptr<Job> takeEntry(typename std::unordered_map<u32, Entry>::iterator it, bool& success, std::chrono::microseconds& latency)
+	{
+		success = it->second.state == Done;
+		latency = std::chrono::duration_cast<std::chrono::microseconds>(it->second.doneTime - it->second.requestTime);
+		std::unique_ptr<Job> job = std::move(it->second.job);
+		jobs.erase(it);
+		return job;
+	}
+
+	void threadMain()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			workCond.wait(lock, [this]() { return exiting || !queue.empty(); });
+			if (exiting)
+				break;
+			const u32 addr = queue.front();
+			queue.pop_front();
+			Job *job = jobs[addr].job.get();
+			processing = true;
+			lock.unlock();
+
+			const bool success = worker(*job);
+
+			lock.lock();
+			processing = false;
+			Entry& entry = jobs[addr];
+			entry.state = success ? Done : Failed;
+			entry.doneTime = std::chrono::steady_clock::now();
+			done.push_back(addr);
+			doneCond.notify_all();
+		}
+	}
+
+	Worker worker;
+	const size_t maxJobs;
+	std::thread thread;
+	mutable std::mutex mutex;
+	std::condition_variable workCond;
+	std::condition_variable doneCond;
+	std::deque<u32> queue;
+	// addresses of the processed jobs, in completion order
+	std::deque<u32> done;
+	std::unordered_map<u32, Entry> jobs;
+	bool processing = false;
+	bool exiting = false;
+};
+
+// Counters of the asynchronous compile mode, logged with the emulation speed
+struct AsyncCompileStats
+{
+	u64 requests;			// blocks queued for compilation
+	u64 installed;			// background compiled blocks added to the code cache
+	u64 rejected;			// blocks that failed to decode or whose guest code or cpu state changed in the meantime
+	u64 fallbacks;			// guest blocks run by the interpreter while waiting for compilation
+	u64 interpretedOps;		// instructions run by the interpreter
+	u64 latencyMicros;		// total time between the compile requests and the end of decoding
+	u64 maxLatencyMicros;
+	u64 installMicros;		// total time spent generating the host code of the installed blocks
+};
+
+// Logs and resets the async compile counters
+void rdv_LogAsyncCompileStats(double frames);
+// Queues the block at pc for compilation and waits until it's decoded.
+// Returns false if async compile isn't available for this block.
+bool rdv_RequestAsyncCompile(u32 pc);
+AsyncCompileStats rdv_GetAsyncCompileStats();
@@ -0,0 +1,374 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "blockcache.h"
+#include "blockmanager.h"
+#include "cfg/option.h"
+#include "emulator.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "oslib/oslib.h"
+#include "version.h"
+
+#include <unordered_map>
+#include <xxhash.h>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+namespace
+{
+
+constexpr u32 CacheMagic = 0x43424346;	// FCBC
+constexpr u32 CacheVersion = 1;
+constexpr size_t MaxEntries = 128 * 1024;
+constexpr u32 MaxBlockOps = 1024;		// sanity check, the decoder limit is lower
+
+struct CachedBlock
+{
+	u64 code_hash;
+	u64 page_hash;		// only if read_only
+	u32 sh4_code_size;
+	u32 guest_opcodes;
+	u32 guest_cycles;
+	u32 BranchBlock;
+	u32 NextBlock;
+	u32 BlockType;
+	bool has_fpu_op;
+	bool has_jcond;
+	bool read_only;
+	std::vector<shil_opcode> oplist;
+};
+
+std::unordered_map<u64, CachedBlock> blocks;
+std::string cachePath;
+bool dirty;
+bool idleSkip;
+struct {
+	u32 hits;
+	u32 misses;
+	u32 rejected;
+} stats;
+
+// Decoding only depends on these fpscr bits
+u64 makeKey(u32 vaddr, fpscr_t fpu_cfg)
+{
+	return ((u64)((fpu_cfg.PR << 3) | (fpu_cfg.SZ << 2) | fpu_cfg.RM) << 32) | vaddr;
+}
+
+bool hashMemory(u32 addr, u32 size, u64& hash)
+{
+	const u8 *ptr = GetMemPtr(addr, size);
+	if (ptr == nullptr)
+		return false;
+	hash = XXH64(ptr, size, 0);
+	return true;
+}
+
+// SSA passes read the memory of the pages spanned by read-only blocks
+bool hashPages(u32 addr, u32 size, u64& hash)
+{
+	u32 start = addr & ~PAGE_MASK;
+	u32 end = (addr + size + PAGE_MASK) & ~PAGE_MASK;
+	return hashMemory(start, end - start, hash);
+}
+
+bool isEnabled()
+{
+	return config::DynarecPersistentCache && !mmu_enabled() && !cachePath.empty();
+}
+
+template<typename T>
+bool read(FILE *f, T& v) {
+	return fread(&v, sizeof(T), 1, f) == 1;
+}
+template<typename T>
+void write(FILE *f, const T& v) {
+	fwrite(&v, sizeof(T), 1, f);
+}
+
+bool readParam(FILE *f, shil_param& param)
+{
+	if (!read(f, param._imm) || !read(f, param.type) || fread(param.version, sizeof(param.version), 1, f) != 1)
+		return false;
+	return param.type <= FMT_V16;
+}
+
+void writeParam(FILE *f, const shil_param& param)
+{
+	write(f, param._imm);
+	write(f, param.type);
+	fwrite(param.version, sizeof(param.version), 1, f);
+}
+
+bool readBlock(FILE *f, u64& key, CachedBlock& block)
+{
+	u8 flags;
+	u32 opcount;
+	if (!read(f, key) || !read(f, block.code_hash) || !read(f, block.page_hash)
+			|| !read(f, block.sh4_code_size) || !read(f, block.guest_opcodes) || !read(f, block.guest_cycles)
+			|| !read(f, block.BranchBlock) || !read(f, block.NextBlock) || !read(f, block.BlockType)
+			|| !read(f, flags) || !read(f, opcount))
+		return false;
+	if (opcount > MaxBlockOps || block.sh4_code_size == 0 || block.sh4_code_size > PAGE_SIZE * 4)
+		return false;
+	block.has_fpu_op = flags & 1;
+	block.has_jcond = flags & 2;
+	block.read_only = flags & 4;
+	block.oplist.resize(opcount);
+	for (shil_opcode& op : block.oplist)
+	{
+		u32 opid;
+		u8 delay_slot;
+		if (!read(f, opid) || !read(f, op.Flow) || !read(f, op.flags) || !read(f, op.flags2)
+				|| !readParam(f, op.rd) || !readParam(f, op.rd2)
+				|| !readParam(f, op.rs1) || !readParam(f, op.rs2) || !readParam(f, op.rs3)
+				|| !read(f, op.guest_offs) || !read(f, delay_slot))
+			return false;
+		if (opid >= shop_max)
+			return false;
+		op.op = (shilop)opid;
+		op.delay_slot = delay_slot != 0;
+		op.host_offs = 0;
+	}
+	return true;
+}
+
+void writeBlock(FILE *f, u64 key, const CachedBlock& block)
+{
+	write(f, key);
+	write(f, block.code_hash);
+	write(f, block.page_hash);
+	write(f, block.sh4_code_size);
+	write(f, block.guest_opcodes);
+	write(f, block.guest_cycles);
+	write(f, block.BranchBlock);
+	write(f, block.NextBlock);
+	write(f, block.BlockType);
+	write(f, (u8)(block.has_fpu_op | (block.has_jcond << 1) | (block.read_only << 2)));
+	write(f, (u32)block.oplist.size());
+	for (const shil_opcode& op : block.oplist)
+	{
+		write(f, (u32)op.op);
+		write(f, op.Flow);
+		write(f, op.flags);
+		write(f, op.flags2);
+		writeParam(f, op.rd);
+		writeParam(f, op.rd2);
+		writeParam(f, op.rs1);
+		writeParam(f, op.rs2);
+		writeParam(f, op.rs3);
+		write(f, op.guest_offs);
+		write(f, (u8)op.delay_slot);
+	}
+}
+
+// The cache is only valid for a given build and idle skip setting
+bool readHeader(FILE *f)
+{
+	u32 magic, version, hashLen;
+	u8 idle;
+	if (!read(f, magic) || !read(f, version) || !read(f, hashLen))
+		return false;
+	if (magic != CacheMagic || version != CacheVersion || hashLen != strlen(GIT_HASH))
+		return false;
+	std::string hash(hashLen, '\0');
+	if (fread(&hash[0], 1, hashLen, f) != hashLen || hash != GIT_HASH)
+		return false;
+	if (!read(f, idle))
+		return false;
+	return (idle != 0) == idleSkip;
+}
+
+void loadCache()
+{
+	blocks.clear();
+	dirty = false;
+	FILE *f = nowide::fopen(cachePath.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	u32 count;
+	if (!readHeader(f) || !read(f, count) || count > MaxEntries)
+	{
+		INFO_LOG(DYNAREC, "Ignoring outdated or invalid block cache %s", cachePath.c_str());
+		fclose(f);
+		return;
+	}
+	for (u32 i = 0; i < count; i++)
+	{
+		u64 key;
+		CachedBlock block;
+		if (!readBlock(f, key, block))
+		{
+			WARN_LOG(DYNAREC, "Block cache %s is corrupted", cachePath.c_str());
+			blocks.clear();
+			break;
+		}
+		blocks[key] = std::move(block);
+	}
+	fclose(f);
+	INFO_LOG(DYNAREC, "Loaded %d blocks from %s", (int)blocks.size(), cachePath.c_str());
+}
+
+void saveCache()
+{
+	if (!dirty || cachePath.empty())
+		return;
+	FILE *f = nowide::fopen(cachePath.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(DYNAREC, "Can't save block cache to %s", cachePath.c_str());
+		return;
+	}
+	write(f, CacheMagic);
+	write(f, CacheVersion);
+	write(f, (u32)strlen(GIT_HASH));
+	fwrite(GIT_HASH, 1, strlen(GIT_HASH), f);
+	write(f, (u8)idleSkip);
+	write(f, (u32)blocks.size());
+	for (const auto& pair : blocks)
+		writeBlock(f, pair.first, pair.second);
+	fclose(f);
+	dirty = false;
+	INFO_LOG(DYNAREC, "Saved %d blocks to %s. hits %d misses %d rejected %d", (int)blocks.size(), cachePath.c_str(),
+			stats.hits, stats.misses, stats.rejected);
+}
+
+std::string getCacheName()
+{
+	std::string name = settings.content.gameId.empty() ? "dc_bios" : settings.content.gameId;
+	for (char& c : name)
+		if (!isalnum((u8)c))
+			c = '_';
+	return name + ".blkcache";
+}
+
+void eventCallback(Event event, void *)
+{
+	switch (event)
+	{
+	case Event::Start:
+		stats = {};
+		cachePath.clear();
+		blocks.clear();
+		if (config::DynarecPersistentCache)
+		{
+			idleSkip = config::DynarecIdleSkip;
+			cachePath = hostfs::getShaderCachePath(getCacheName());
+			loadCache();
+		}
+		break;
+	case Event::Pause:
+		saveCache();
+		break;
+	case Event::Terminate:
+		saveCache();
+		blocks.clear();
+		cachePath.clear();
+		break;
+	default:
+		break;
+	}
+}
+
+}
+
+void bc_Init()
+{
+	EventManager::listen(Event::Start, eventCallback);
+	EventManager::listen(Event::Pause, eventCallback);
+	EventManager::listen(Event::Terminate, eventCallback);
+}
+
+void bc_Term()
+{
+	EventManager::unlisten(Event::Start, eventCallback);
+	EventManager::unlisten(Event::Pause, eventCallback);
+	EventManager::unlisten(Event::Terminate, eventCallback);
+	blocks.clear();
+	cachePath.clear();
+}
+
+bool bc_Restore(RuntimeBlockInfo *block, bool& block_protected)
+{
+	block_protected = false;
+	if (!isEnabled())
+		return false;
+	auto it = blocks.find(makeKey(block->vaddr, block->fpu_cfg));
+	if (it == blocks.end())
+	{
+		stats.misses++;
+		return false;
+	}
+	const CachedBlock& cached = it->second;
+	u64 hash;
+	// If the FPU is disabled, let the decoder raise the exception
+	if ((cached.has_fpu_op && sr.FD == 1)
+			|| !hashMemory(block->addr, cached.sh4_code_size, hash) || hash != cached.code_hash)
+	{
+		stats.rejected++;
+		return false;
+	}
+	// The guest code is identical so the decoder would produce the same block size and protection
+	block->sh4_code_size = cached.sh4_code_size;
+	block->SetProtectedFlags();
+	block_protected = true;
+	if (block->read_only != cached.read_only
+			|| (cached.read_only && (!hashPages(block->addr, cached.sh4_code_size, hash) || hash != cached.page_hash)))
+	{
+		stats.rejected++;
+		return false;
+	}
+	block->guest_opcodes = cached.guest_opcodes;
+	block->guest_cycles = cached.guest_cycles;
+	block->BranchBlock = cached.BranchBlock;
+	block->NextBlock = cached.NextBlock;
+	block->BlockType = (BlockEndType)cached.BlockType;
+	block->has_fpu_op = cached.has_fpu_op;
+	block->has_jcond = cached.has_jcond;
+	block->oplist = cached.oplist;
+	stats.hits++;
+
+	return true;
+}
+
+void bc_Add(const RuntimeBlockInfo *block)
+{
+	if (!isEnabled() || blocks.size() >= MaxEntries)
+		return;
+	CachedBlock cached;
+	if (!hashMemory(block->addr, block->sh4_code_size, cached.code_hash))
+		return;
+	cached.page_hash = 0;
+	if (block->read_only && !hashPages(block->addr, block->sh4_code_size, cached.page_hash))
+		return;
+	cached.sh4_code_size = block->sh4_code_size;
+	cached.guest_opcodes = block->guest_opcodes;
+	cached.guest_cycles = block->guest_cycles;
+	cached.BranchBlock = block->BranchBlock;
+	cached.NextBlock = block->NextBlock;
+	cached.BlockType = block->BlockType;
+	cached.has_fpu_op = block->has_fpu_op;
+	cached.has_jcond = block->has_jcond;
+	cached.read_only = block->read_only;
+	cached.oplist = block->oplist;
+	blocks[makeKey(block->vaddr, block->fpu_cfg)] = std::move(cached);
+	dirty = true;
+}
+
+#endif // FEAT_SHREC != DYNAREC_NONE
@@ -0,0 +1,36 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+struct RuntimeBlockInfo;
+
+//
+// Persistent per-game cache of decoded and optimized SHIL blocks.
+// Entries are keyed by block address and fpu config, and validated against a hash
+// of the guest code (and of the block pages if the block is read-only) before use.
+//
+void bc_Init();
+void bc_Term();
+
+// Returns true if the block could be restored from the cache. The block vaddr, addr and fpu_cfg must be set.
+// block_protected is set to true if SetProtectedFlags() has been called.
+bool bc_Restore(RuntimeBlockInfo *block, bool& block_protected);
+// Records a newly decoded and optimized block
+void bc_Add(const RuntimeBlockInfo *block);
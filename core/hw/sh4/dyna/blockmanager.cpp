@@ -4,15 +4,18 @@
 */
 
 #include <algorithm>
+#include <cinttypes>
 #include <set>
-#include <map>
+#include <xxhash.h>
 #include "blockmanager.h"
+#include "blockmap.h"
 #include "ngen.h"
 
 #include "../sh4_core.h"
 #include "hw/sh4/sh4_mem.h"
 #include "hw/sh4/sh4_opcode_list.h"
 #include "hw/sh4/sh4_sched.h"
+#include "profiler/blockprofiler.h"
 
 
 #if defined(__unix__) && defined(DYNA_OPROF)
@@ -25,13 +28,19 @@ op_agent_t          oprofHandle;
 
 typedef std::vector<RuntimeBlockInfoPtr> bm_List;
 typedef std::set<RuntimeBlockInfoPtr> bm_Set;
-typedef std::map<void*, RuntimeBlockInfoPtr> bm_Map;
+typedef BlockCodeMap<RuntimeBlockInfoPtr> bm_Map;
 
 static bm_Set all_temp_blocks;
 static bm_List del_blocks;
 
 bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
-static std::set<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+static PageBlockList<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+// Pages written to are protected again periodically, until they've been written to SMC_MAX_FAULTS times
+#define SMC_MAX_FAULTS 8
+static u8 page_faults[RAM_SIZE_MAX/PAGE_SIZE];
+static std::vector<u32> reprotect_pages;
+static PageBlockList<RuntimeBlockInfo*> gated_blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+SmcStats smcStats;
 
 static bm_Map blkmap;
 // Stats
@@ -121,17 +130,16 @@ RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code)
 		return NULL;
 
 	void *dynarecrw = CC_RX2RW(dynarec_code);
-	// Returns a block who's code addr is bigger than dynarec_code (or end)
-	auto iter = blkmap.upper_bound(dynarecrw);
-	if (iter == blkmap.begin())
+	// Returns the block with the highest code addr lower or equal to dynarec_code
+	const RuntimeBlockInfoPtr *block = blkmap.floor(dynarecrw);
+	if (block == nullptr)
 		return NULL;
-	iter--;  // Need to go back to find the potential candidate
 
 	// However it might be out of bounds, check for that
-	if (!iter->second->containsCode(dynarecrw))
+	if (!(*block)->containsCode(dynarecrw))
 		return NULL;
 
-	return iter->second;
+	return *block;
 }
 
 static void bm_CleanupDeletedBlocks()
@@ -162,12 +170,12 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 	RuntimeBlockInfoPtr block(blk);
 	if (block->temp_block)
 		all_temp_blocks.insert(block);
-	auto iter = blkmap.find((void*)blk->code);
-	if (iter != blkmap.end()) {
-		ERROR_LOG(DYNAREC, "DUP: %08X %p %08X %p", iter->second->addr, iter->second->code, block->addr, block->code);
+	if (!blkmap.insert((void*)block->code, block))
+	{
+		const RuntimeBlockInfoPtr& dup = *blkmap.find((void*)block->code);
+		ERROR_LOG(DYNAREC, "DUP: %08X %p %08X %p", dup->addr, dup->code, block->addr, block->code);
 		die("Duplicated block");
 	}
-	blkmap[(void*)block->code] = block;
 
 	verify((void*)bm_GetCode(block->addr) == (void*)ngen_FailedToFindBlock);
 	FPCA(block->addr) = (DynarecCodeEntryPtr)CC_RW2RX(block->code);
@@ -191,12 +199,17 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 void bm_DiscardBlock(RuntimeBlockInfo* block)
 {
 	// Remove from block map
-	auto it = blkmap.find((void*)block->code);
-	verify(it != blkmap.end());
-	RuntimeBlockInfoPtr block_ptr = it->second;
+	const RuntimeBlockInfoPtr *it = blkmap.find((void*)block->code);
+	verify(it != nullptr);
+	RuntimeBlockInfoPtr block_ptr = *it;
 
-	blkmap.erase(it);
+	blkmap.erase((void*)block->code);
 
+	// The code of this block may be reused so the blocks it's linked to must forget it
+	if (block_ptr->pBranchBlock != nullptr)
+		block_ptr->pBranchBlock->RemRef(block_ptr);
+	if (block_ptr->pNextBlock != nullptr)
+		block_ptr->pNextBlock->RemRef(block_ptr);
 	block_ptr->pNextBlock = NULL;
 	block_ptr->pBranchBlock = NULL;
 	block_ptr->Relink();
@@ -212,9 +225,49 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 	block_ptr->Discard();
 }
 
+std::vector<u32> bm_DiscardBlocks(const void *codeStart, const void *codeEnd)
+{
+	std::vector<RuntimeBlockInfo*> blocks;
+	for (const auto& it : blkmap)
+		if ((const u8 *)it.second->code >= (const u8 *)codeStart && (const u8 *)it.second->code < (const u8 *)codeEnd)
+			blocks.push_back(it.second.get());
+	std::vector<u32> addresses;
+	addresses.reserve(blocks.size());
+	for (RuntimeBlockInfo *block : blocks)
+	{
+		addresses.push_back(block->addr);
+		bm_DiscardBlock(block);
+	}
+	return addresses;
+}
+
+// Protects the written pages again. Their blocks with gated checks are discarded if their code has changed,
+// and the other ones skip their code checks from now on.
+static void bm_ReprotectPages()
+{
+	for (u32 page : reprotect_pages)
+	{
+		auto& gated_list = gated_blocks_per_page[page];
+		if (!gated_list.empty())
+		{
+			std::vector<RuntimeBlockInfo*> list_copy(gated_list.begin(), gated_list.end());
+			for (RuntimeBlockInfo *block : list_copy)
+				if (block->CodeChanged())
+					bm_DiscardBlock(block);
+			// Pages without blocks are locked when a block is added
+			if (!gated_list.empty())
+				bm_LockPage(page * PAGE_SIZE);
+		}
+		unprotected_pages[page] = false;
+		smcStats.reprotected++;
+	}
+	reprotect_pages.clear();
+}
+
 void bm_Periodical_1s()
 {
 	bm_CleanupDeletedBlocks();
+	bm_ReprotectPages();
 }
 
 void bm_vmem_pagefill(void** ptr, u32 size_bytes)
@@ -322,8 +375,12 @@ void bm_ResetCache()
 
 	for (auto& block_list : blocks_per_page)
 		block_list.clear();
+	for (auto& block_list : gated_blocks_per_page)
+		block_list.clear();
 
 	memset(unprotected_pages, 0, sizeof(unprotected_pages));
+	memset(page_faults, 0, sizeof(page_faults));
+	reprotect_pages.clear();
 
 #ifdef DYNA_OPROF
 	if (oprofHandle)
@@ -343,11 +400,10 @@ void bm_ResetTempCache(bool full)
 {
 	if (!full)
 	{
-		for (const auto& block : all_temp_blocks)
-		{
-			FPCA(block->addr) = ngen_FailedToFindBlock;
-			blkmap.erase((void*)block->code);
-		}
+		// Unlink the temp blocks since their code will be overwritten
+		std::vector<RuntimeBlockInfoPtr> temp_blocks(all_temp_blocks.begin(), all_temp_blocks.end());
+		for (const auto& block : temp_blocks)
+			bm_DiscardBlock(block.get());
 	}
 	del_blocks.insert(del_blocks.begin(),all_temp_blocks.begin(),all_temp_blocks.end());
 	all_temp_blocks.clear();
@@ -380,9 +436,9 @@ void bm_WriteBlockMap(const std::string& file)
 	if (f)
 	{
 		INFO_LOG(DYNAREC, "Writing block map !");
-		for (auto& it : blkmap)
+		for (const auto& it : blkmap)
 		{
-			RuntimeBlockInfoPtr& block = it.second;
+			const RuntimeBlockInfoPtr& block = it.second;
 			fprintf(f, "block: %d:%08X:%p:%d:%d:%d\n", block->BlockType, block->addr, block->code, block->host_code_size, block->guest_cycles, block->guest_opcodes);
 			for(size_t j = 0; j < block->oplist.size(); j++)
 				fprintf(f,"\top: %zd:%d:%s\n", j, block->oplist[j].guest_offs, block->oplist[j].dissasm().c_str());
@@ -397,10 +453,16 @@ void sh4_jitsym(FILE* out)
 	for (const auto& it : blkmap)
 	{
 		const RuntimeBlockInfoPtr& block = it.second;
-		fprintf(out, "%p %d %08X\n", block->code, block->host_code_size, block->addr);
+		fprintf(out, "%" PRIxPTR " %x sh4_%08X\n", (uintptr_t)CC_RW2RX((void*)block->code), block->host_code_size, block->vaddr);
 	}
 }
 
+void bm_ForEachBlock(const std::function<void(const RuntimeBlockInfo *)>& callback)
+{
+	for (const auto& it : blkmap)
+		callback(it.second.get());
+}
+
 #if 0
 u32 GetLookup(RuntimeBlockInfo* elem)
 {
@@ -509,6 +571,8 @@ void bm_Sort()
 
 RuntimeBlockInfo::~RuntimeBlockInfo()
 {
+	if (prof_blockEnabled)
+		prof_blockRetire(this);
 	if (sh4_code_size != 0)
 	{
 		if (read_only)
@@ -530,6 +594,25 @@ void RuntimeBlockInfo::RemRef(const RuntimeBlockInfoPtr& other)
 		pre_refs.erase(it);
 }
 
+// Indexes of the RAM pages containing the guest code of a block, including all the code ranges of a trace
+static std::vector<u32> codePages(const RuntimeBlockInfo *block)
+{
+	std::vector<u32> pages;
+	auto addRange = [&pages](u32 addr, u32 size) {
+		for (u32 page = addr & ~PAGE_MASK; page < addr + size; page += PAGE_SIZE)
+			pages.push_back((page & RAM_MASK) / PAGE_SIZE);
+	};
+	addRange(block->addr, block->sh4_code_size);
+	if (!block->trace_ranges.empty())
+	{
+		for (const auto& range : block->trace_ranges)
+			addRange(range.addr, range.size);
+		std::sort(pages.begin(), pages.end());
+		pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+	}
+	return pages;
+}
+
 void RuntimeBlockInfo::Discard()
 {
 	// Update references
@@ -547,44 +630,76 @@ void RuntimeBlockInfo::Discard()
 	if (read_only)
 	{
 		// Remove this block from the per-page block lists
-		for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + this->sh4_code_size; addr += PAGE_SIZE)
-		{
-			auto& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
-			block_list.erase(this);
-		}
+		for (u32 page : codePages(this))
+			blocks_per_page[page].remove(this);
+	}
+	else if (gated_checks)
+	{
+		for (u32 page : codePages(this))
+			gated_blocks_per_page[page].remove(this);
 	}
 }
 
+bool RuntimeBlockInfo::CodeChanged() const
+{
+	const u8 *code = GetMemPtr(addr, sh4_code_size);
+	return code == nullptr || XXH64(code, sh4_code_size, 0) != code_hash;
+}
+
+bool bm_CanProtect(u32 addr, u32 size)
+{
+	// Don't write protect rom and BIOS/IP.BIN (Grandia II)
+	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+		return false;
+	for (u32 page = addr & ~PAGE_MASK; page < addr + size; page += PAGE_SIZE)
+		if (unprotected_pages[(page & RAM_MASK) / PAGE_SIZE])
+			return false;
+	return true;
+}
+
 void RuntimeBlockInfo::SetProtectedFlags()
 {
 #ifdef TARGET_NO_EXCEPTIONS
 	this->read_only = false;
 	return;
 #endif
-	// Don't write protect rom and BIOS/IP.BIN (Grandia II)
-	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+	bool protectable = bm_CanProtect(addr, sh4_code_size);
+	for (const auto& range : trace_ranges)
+		protectable = protectable && bm_CanProtect(range.addr, range.size);
+	if (!protectable)
 	{
 		this->read_only = false;
 		unprotected_blocks++;
-		return;
-	}
-	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
-	{
-		if (unprotected_pages[(addr & RAM_MASK) / PAGE_SIZE])
-		{
-			this->read_only = false;
-			unprotected_blocks++;
+		// Code in rom, BIOS/IP.BIN or pages written too often is always checked
+		if (!trace_ranges.empty() || !IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+			return;
+		std::vector<u32> pages = codePages(this);
+		for (u32 page : pages)
+			if (page_faults[page] >= SMC_MAX_FAULTS)
+				return;
+		const u8 *code = GetMemPtr(addr, sh4_code_size);
+		if (code == nullptr)
 			return;
+		gated_checks = true;
+		code_hash = XXH64(code, sh4_code_size, 0);
+		for (u32 page : pages)
+		{
+			auto& gated_list = gated_blocks_per_page[page];
+			// The checks are skipped while the page is protected so it must be locked
+			if (!unprotected_pages[page] && gated_list.empty() && blocks_per_page[page].empty())
+				bm_LockPage(page * PAGE_SIZE);
+			gated_list.add(this);
 		}
+		return;
 	}
 	this->read_only = true;
 	protected_blocks++;
-	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
+	for (u32 page : codePages(this))
 	{
-		auto& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
+		auto& block_list = blocks_per_page[page];
 		if (block_list.empty())
-			bm_LockPage(addr);
-		block_list.insert(this);
+			bm_LockPage(page * PAGE_SIZE);
+		block_list.add(this);
 	}
 }
 
@@ -598,14 +713,18 @@ void bm_RamWriteAccess(u32 addr)
 		return;
 	}
 	unprotected_pages[addr / PAGE_SIZE] = true;
+	smcStats.faults++;
+	u8& faults = page_faults[addr / PAGE_SIZE];
+	if (faults < SMC_MAX_FAULTS && ++faults < SMC_MAX_FAULTS)
+		reprotect_pages.push_back(addr / PAGE_SIZE);
+	else
+		smcStats.unprotected++;
 	bm_UnlockPage(addr);
-	std::set<RuntimeBlockInfo*>& block_list = blocks_per_page[addr / PAGE_SIZE];
+	auto& block_list = blocks_per_page[addr / PAGE_SIZE];
 	if (!block_list.empty())
 	{
-		std::vector<RuntimeBlockInfo*> list_copy;
-		list_copy.insert(list_copy.begin(), block_list.begin(), block_list.end());
-		if (!list_copy.empty())
-			DEBUG_LOG(DYNAREC, "bm_RamWriteAccess write access to %08x pc %08x", addr, next_pc);
+		std::vector<RuntimeBlockInfo*> list_copy = block_list.take();
+		DEBUG_LOG(DYNAREC, "bm_RamWriteAccess write access to %08x pc %08x", addr, next_pc);
 		for (auto& block : list_copy)
 		{
 			bm_DiscardBlock(block);
@@ -650,6 +769,18 @@ bool bm_RamWriteAccess(void *p)
 	return true;
 }
 
+void bm_LogSmcStats()
+{
+	if (smcStats.faults != 0)
+		INFO_LOG(DYNAREC, "SMC: %" PRIu64 " write faults, %" PRIu64 " pages protected again, %" PRIu64 " pages left unprotected",
+				smcStats.faults, smcStats.reprotected, smcStats.unprotected);
+	if (smcStats.checkedBlocks != 0)
+		INFO_LOG(DYNAREC, "SMC: %" PRIu64 " checked blocks, %" PRIu64 " with gated checks. Check instructions for one run of each: "
+				"%" PRIu64 " without gates, %" PRIu64 " when their pages are protected",
+				smcStats.checkedBlocks, smcStats.gatedBlocks, smcStats.checkInstrs,
+				smcStats.checkInstrs - smcStats.gatedCheckInstrs + smcStats.gateInstrs);
+}
+
 bool print_stats = true;
 
 void fprint_hex(FILE* d,const char* init,u8* ptr, u32& ofs, u32 limit)
@@ -687,9 +818,9 @@ void print_blocks()
 		INFO_LOG(DYNAREC, "Writing blocks to %p", f);
 	}
 
-	for (auto it : blkmap)
+	for (const auto& it : blkmap)
 	{
-		RuntimeBlockInfoPtr blk = it.second;
+		const RuntimeBlockInfoPtr& blk = it.second;
 		if (f)
 		{
 			fprintf(f,"block: %p\n",blk.get());
@@ -4,6 +4,7 @@
 #include "decoder.h"
 #include "stdclass.h"
 
+#include <functional>
 #include <memory>
 
 typedef void (*DynarecCodeEntryPtr)();
@@ -20,6 +21,8 @@ struct RuntimeBlockInfo_Core
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
 	bool Setup(u32 pc,fpscr_t fpu_cfg);
+	// Resets the block before decoding it. vaddr and addr are set to pc
+	void Init(u32 pc,fpscr_t fpu_cfg);
 	const char* hash();
 
 	u32 vaddr;
@@ -29,6 +32,9 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 
 	u32 runs;
 	s32 staging_runs;
+	// block profiler counters
+	u64 prof_runs;
+	u64 prof_ticks;
 
 	fpscr_t fpu_cfg;
 	u32 guest_cycles;
@@ -37,6 +43,7 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool has_fpu_op;
 	u32 blockcheck_failures;
 	bool temp_block;
+	bool from_cache;	// decoded SHIL restored from the persistent block cache
 
 	u32 BranchBlock; //if not 0xFFFFFFFF then jump target
 	u32 NextBlock;   //if not 0xFFFFFFFF then next block (by position)
@@ -71,11 +78,30 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 
 	void Discard();
 	void SetProtectedFlags();
+	// Returns true if the guest code of a block with gated checks has changed since it was decoded
+	bool CodeChanged() const;
 
 	bool read_only;
+	// Not write-protected because its pages have been written to. The code checks of the block
+	// are skipped when all its pages are protected again.
+	bool gated_checks;
+	u64 code_hash;
+
+	// Set before decoding to follow static jumps and calls into the target blocks
+	bool trace;
+	struct CodeRange
+	{
+		u32 addr;
+		u32 size;
+	};
+	// Guest code of a trace following the first range [addr, addr + sh4_code_size)
+	std::vector<CodeRange> trace_ranges;
 };
 
 void bm_WriteBlockMap(const std::string& file);
+// Writes the code address, size and name of each block in perf map format
+void sh4_jitsym(FILE* out);
+void bm_ForEachBlock(const std::function<void(const RuntimeBlockInfo *)>& callback);
 
 DynarecCodeEntryPtr DYNACALL bm_GetCodeByVAddr(u32 addr);
 RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code);
@@ -84,6 +110,8 @@ RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr);
 
 void bm_AddBlock(RuntimeBlockInfo* blk);
 void bm_DiscardBlock(RuntimeBlockInfo* block);
+// Discards the blocks whose host code starts in [codeStart, codeEnd). Returns their physical addresses.
+std::vector<u32> bm_DiscardBlocks(const void *codeStart, const void *codeEnd);
 void bm_Reset();
 void bm_ResetCache();
 void bm_ResetTempCache(bool full);
@@ -95,12 +123,36 @@ void bm_Term();
 void bm_vmem_pagefill(void** ptr,u32 size_bytes);
 bool bm_RamWriteAccess(void *p);
 void bm_RamWriteAccess(u32 addr);
+// Returns true if blocks in the given memory range can be write-protected
+bool bm_CanProtect(u32 addr, u32 size);
 static inline bool bm_IsRamPageProtected(u32 addr)
 {
 	extern bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
 	addr &= RAM_MASK;
 	return !unprotected_pages[addr / PAGE_SIZE];
 }
+// Flag set while a RAM page isn't protected, tested by blocks with gated checks
+static inline const bool *bm_RamPageUnprotectedFlag(u32 addr)
+{
+	extern bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
+	addr &= RAM_MASK;
+	return &unprotected_pages[addr / PAGE_SIZE];
+}
+
+// Self-modifying code detection counters, logged with the code cache stats
+struct SmcStats
+{
+	u64 faults;				// writes to protected pages
+	u64 reprotected;		// written pages protected again
+	u64 unprotected;		// pages written too often to be protected again
+	u64 checkedBlocks;		// blocks compiled with code checks
+	u64 gatedBlocks;		// checked blocks that skip their code checks when their pages are protected
+	u64 checkInstrs;		// host instructions checking the code of a block, for all checked blocks
+	u64 gateInstrs;			// host instructions testing the page flags of the gated blocks
+	u64 gatedCheckInstrs;	// code check instructions of the gated blocks
+};
+extern SmcStats smcStats;
+void bm_LogSmcStats();
 void bm_LockPage(u32 addr, u32 size = PAGE_SIZE);
 void bm_UnlockPage(u32 addr, u32 size = PAGE_SIZE);
 u32 bm_getRamOffset(void *p);
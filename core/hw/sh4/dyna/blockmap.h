@@ -0,0 +1,263 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//
+// Sorted index of host code start addresses.
+// Entries are kept in small sorted pages so that lookups are two binary searches over
+// contiguous memory and insertions/deletions only move the entries of a single page.
+// Blocks are emitted at increasing addresses so insertions mostly append to the last page.
+//
+template<typename T, size_t PageCapacity = 256>
+class BlockCodeMap
+{
+public:
+	using value_type = std::pair<uintptr_t, T>;
+
+private:
+	using Page = std::vector<value_type>;
+
+	std::vector<uintptr_t> firstKeys;	// first key of each page
+	std::vector<Page> pages;
+	size_t count = 0;
+
+	static bool keyLess(const value_type& entry, uintptr_t key) {
+		return entry.first < key;
+	}
+	static bool lessKey(uintptr_t key, const value_type& entry) {
+		return key < entry.first;
+	}
+
+	// index of the page that may contain key, or -1 if key is before the first entry
+	ptrdiff_t findPage(uintptr_t key) const
+	{
+		auto it = std::upper_bound(firstKeys.begin(), firstKeys.end(), key);
+		return (it - firstKeys.begin()) - 1;
+	}
+
+	void split(size_t pageIdx)
+	{
+		Page& page = pages[pageIdx];
+		Page newPage(page.begin() + page.size() / 2, page.end());
+		page.resize(page.size() / 2);
+		firstKeys.insert(firstKeys.begin() + pageIdx + 1, newPage.front().first);
+		pages.insert(pages.begin() + pageIdx + 1, std::move(newPage));
+	}
+
+public:
+	class const_iterator
+	{
+		const std::vector<Page> *pages;
+		size_t pageIdx;
+		size_t entryIdx;
+
+	public:
+		const_iterator(const std::vector<Page> *pages, size_t pageIdx, size_t entryIdx)
+			: pages(pages), pageIdx(pageIdx), entryIdx(entryIdx) {}
+
+		const value_type& operator*() const { return (*pages)[pageIdx][entryIdx]; }
+		const value_type *operator->() const { return &(*pages)[pageIdx][entryIdx]; }
+
+		const_iterator& operator++()
+		{
+			if (++entryIdx == (*pages)[pageIdx].size())
+			{
+				pageIdx++;
+				entryIdx = 0;
+			}
+			return *this;
+		}
+		bool operator==(const const_iterator& other) const {
+			return pageIdx == other.pageIdx && entryIdx == other.entryIdx;
+		}
+		bool operator!=(const const_iterator& other) const {
+			return !(*this == other);
+		}
+	};
+
+	const_iterator begin() const { return const_iterator(&pages, 0, 0); }
+	const_iterator end() const { return const_iterator(&pages, pages.size(), 0); }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	void clear()
+	{
+		firstKeys.clear();
+		pages.clear();
+		count = 0;
+	}
+
+	// Returns false if an entry already exists for this key
+	bool insert(const void *code, const T& value)
+	{
+		uintptr_t key = (uintptr_t)code;
+		if (pages.empty())
+		{
+			firstKeys.push_back(key);
+			pages.emplace_back();
+			pages.back().reserve(PageCapacity);
+			pages.back().emplace_back(key, value);
+			count++;
+			return true;
+		}
+		ptrdiff_t pageIdx = findPage(key);
+		if (pageIdx < 0)
+			pageIdx = 0;
+		Page& page = pages[pageIdx];
+		if (page.back().first < key)
+		{
+			// fast path: append
+			page.emplace_back(key, value);
+		}
+		else
+		{
+			auto it = std::lower_bound(page.begin(), page.end(), key, keyLess);
+			if (it != page.end() && it->first == key)
+				return false;
+			page.emplace(it, key, value);
+			firstKeys[pageIdx] = page.front().first;
+		}
+		count++;
+		if (page.size() > PageCapacity)
+		{
+			if ((size_t)pageIdx == pages.size() - 1 && page.back().first == key)
+			{
+				// Appending: start a new page instead of leaving two half-filled pages
+				value_type last = std::move(page.back());
+				page.pop_back();
+				firstKeys.push_back(key);
+				pages.emplace_back();
+				pages.back().reserve(PageCapacity);
+				pages.back().push_back(std::move(last));
+			}
+			else
+			{
+				split(pageIdx);
+			}
+		}
+		return true;
+	}
+
+	// Returns the value whose key is exactly code, or nullptr
+	const T *find(const void *code) const
+	{
+		uintptr_t key = (uintptr_t)code;
+		ptrdiff_t pageIdx = findPage(key);
+		if (pageIdx < 0)
+			return nullptr;
+		const Page& page = pages[pageIdx];
+		auto it = std::lower_bound(page.begin(), page.end(), key, keyLess);
+		if (it == page.end() || it->first != key)
+			return nullptr;
+		return &it->second;
+	}
+
+	// Returns the value with the highest key lower or equal to code, or nullptr
+	const T *floor(const void *code) const
+	{
+		uintptr_t key = (uintptr_t)code;
+		ptrdiff_t pageIdx = findPage(key);
+		if (pageIdx < 0)
+			return nullptr;
+		const Page& page = pages[pageIdx];
+		// firstKeys[pageIdx] <= key so the result is always in this page
+		auto it = std::upper_bound(page.begin(), page.end(), key, lessKey);
+		return &(it - 1)->second;
+	}
+
+	// Returns false if no entry exists for this key
+	bool erase(const void *code)
+	{
+		uintptr_t key = (uintptr_t)code;
+		ptrdiff_t pageIdx = findPage(key);
+		if (pageIdx < 0)
+			return false;
+		Page& page = pages[pageIdx];
+		auto it = std::lower_bound(page.begin(), page.end(), key, keyLess);
+		if (it == page.end() || it->first != key)
+			return false;
+		page.erase(it);
+		count--;
+		if (page.empty())
+		{
+			pages.erase(pages.begin() + pageIdx);
+			firstKeys.erase(firstKeys.begin() + pageIdx);
+		}
+		else
+		{
+			firstKeys[pageIdx] = page.front().first;
+			// merge small neighbors to keep the number of pages low
+			if ((size_t)pageIdx + 1 < pages.size()
+					&& page.size() + pages[pageIdx + 1].size() <= PageCapacity / 2)
+			{
+				Page& next = pages[pageIdx + 1];
+				page.insert(page.end(), std::make_move_iterator(next.begin()), std::make_move_iterator(next.end()));
+				pages.erase(pages.begin() + pageIdx + 1);
+				firstKeys.erase(firstKeys.begin() + pageIdx + 1);
+			}
+		}
+		return true;
+	}
+};
+
+//
+// Unordered list of blocks overlapping a guest RAM page.
+// Pages rarely contain more than a handful of blocks so a vector beats a node-based set.
+//
+template<typename T>
+class PageBlockList
+{
+	std::vector<T> blocks;
+
+public:
+	using iterator = typename std::vector<T>::iterator;
+
+	void add(const T& block) {
+		blocks.push_back(block);
+	}
+	void remove(const T& block)
+	{
+		auto it = std::find(blocks.begin(), blocks.end(), block);
+		if (it != blocks.end())
+		{
+			*it = blocks.back();
+			blocks.pop_back();
+		}
+	}
+	bool empty() const { return blocks.empty(); }
+	size_t size() const { return blocks.size(); }
+	void clear() {
+		std::vector<T>().swap(blocks);
+	}
+	// Moves the content of this list to the returned vector
+	std::vector<T> take()
+	{
+		std::vector<T> v;
+		v.swap(blocks);
+		return v;
+	}
+	iterator begin() { return blocks.begin(); }
+	iterator end() { return blocks.end(); }
+};
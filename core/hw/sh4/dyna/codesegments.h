@@ -0,0 +1,88 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+//
+// Splits the dynarec code buffer into equal segments that are filled one at a time.
+// When all of them have been used, a single segment is picked for reuse and only its blocks are discarded:
+// the least looked up segment since the previous eviction, or the oldest one in case of a tie.
+//
+template<u32 Count = 16>
+class CodeSegments
+{
+public:
+	static constexpr u32 SegmentCount = Count;
+
+	explicit CodeSegments(u32 bufferSize) : bufferSize(bufferSize), segmentSize(bufferSize / Count) {
+		reset();
+	}
+
+	// All segments are empty and the first one is filled first
+	void reset()
+	{
+		for (u32 i = 0; i < Count; i++)
+			age[i] = 0;
+		clock = 0;
+		use(0);
+	}
+
+	u32 start(u32 segment) const { return segment * segmentSize; }
+	u32 end(u32 segment) const { return segment == Count - 1 ? bufferSize : start(segment + 1); }
+	u32 segmentOf(u32 offset) const {
+		const u32 segment = offset / segmentSize;
+		return segment < Count ? segment : Count - 1;
+	}
+	u32 current() const { return currentSegment; }
+	bool used(u32 segment) const { return age[segment] != 0; }
+
+	// Returns the segment to fill once the current one is full.
+	// lookups is the number of block lookups in each segment since the previous eviction.
+	// The current segment and the pinned one, which holds the code calling the dynarec, are never picked.
+	u32 next(const u64 *lookups, u32 pinned) const
+	{
+		for (u32 i = 0; i < Count; i++)
+			if (!used(i))
+				return i;
+		u32 victim = Count;
+		for (u32 i = 0; i < Count; i++)
+		{
+			if (i == currentSegment || i == pinned)
+				continue;
+			if (victim == Count || lookups[i] < lookups[victim]
+					|| (lookups[i] == lookups[victim] && age[i] < age[victim]))
+				victim = i;
+		}
+		return victim;
+	}
+
+	void use(u32 segment)
+	{
+		age[segment] = ++clock;
+		currentSegment = segment;
+	}
+
+private:
+	u32 bufferSize;
+	u32 segmentSize;
+	u32 currentSegment = 0;
+	// allocation order of each segment, 0 if not used yet
+	u64 age[Count];
+	u64 clock = 0;
+};
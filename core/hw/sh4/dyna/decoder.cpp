@@ -19,8 +19,11 @@
 
 #define BLOCK_MAX_SH_OPS_SOFT 500
 #define BLOCK_MAX_SH_OPS_HARD 511
+// Max number of guest code ranges in a trace
+#define TRACE_MAX_RANGES 4
 
-static RuntimeBlockInfo* blk;
+// Blocks may be decoded on the background compile thread
+static thread_local RuntimeBlockInfo* blk;
 
 static const char idle_hash[] =
        //BIOS
@@ -61,7 +64,7 @@ static inline shil_param mk_regi(int reg)
 	return mk_reg((Sh4RegType)reg);
 }
 
-static state_t state;
+static thread_local state_t state;
 
 static void Emit(shilop op,shil_param rd=shil_param(),shil_param rs1=shil_param(),shil_param rs2=shil_param(),u32 flags=0,shil_param rs3=shil_param(),shil_param rd2=shil_param())
 {
@@ -529,9 +532,9 @@ static void dec_param(DecParam p,shil_param& r1,shil_param& r2, u32 op)
 #define DIV1_KEY 0x3004
 #define ROTCL_KEY 0x4024
 
-static Sh4RegType div_som_reg1;
-static Sh4RegType div_som_reg2;
-static Sh4RegType div_som_reg3;
+static thread_local Sh4RegType div_som_reg1;
+static thread_local Sh4RegType div_som_reg2;
+static thread_local Sh4RegType div_som_reg3;
 
 static u32 MatchDiv32(u32 pc , Sh4RegType &reg1,Sh4RegType &reg2 , Sh4RegType &reg3)
 {
@@ -938,12 +941,64 @@ void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op)
 	}
 }
 
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
+// Ends the guest code range being decoded
+static void dec_EndRange(u32 rangeStart)
+{
+	const u32 size = state.cpu.rpc - rangeStart;
+	if (rangeStart == blk->vaddr)
+		blk->sh4_code_size = size;
+	else
+		blk->trace_ranges.push_back({ rangeStart, size });
+}
+
+static bool dec_InRange(u32 addr)
+{
+	if (addr >= blk->vaddr && addr < blk->vaddr + blk->sh4_code_size)
+		return true;
+	for (const RuntimeBlockInfo::CodeRange& range : blk->trace_ranges)
+		if (addr >= range.addr && addr < range.addr + range.size)
+			return true;
+	return false;
+}
+
+// Continues decoding a trace at the target of the static jump or call ending the current range.
+// Conditional and dynamic branches still end the trace since shil has no side exit.
+static bool dec_FollowBranch(u32 max_cycles, u32& rangeStart)
+{
+	// Static jumps without delay slot end blocks on purpose: size limit or FPSCR change
+	if ((state.BlockType != BET_StaticJump && state.BlockType != BET_StaticCall) || !state.cpu.is_delayslot)
+		return false;
+	if (blk->oplist.size() >= BLOCK_MAX_SH_OPS_SOFT
+			|| blk->guest_cycles >= max_cycles
+			|| !IsOnRam(state.JumpAddr)
+			|| OpDesc[IReadMem16(state.cpu.rpc - 2)]->SetFPSCR())
+		return false;
+	dec_EndRange(rangeStart);
+	// Limit the number of ranges and don't decode the same code twice (loops)
+	if (blk->trace_ranges.size() + 1 >= TRACE_MAX_RANGES || dec_InRange(state.JumpAddr))
+	{
+		if (rangeStart != blk->vaddr)
+			blk->trace_ranges.pop_back();
+		return false;
+	}
+	rangeStart = state.JumpAddr;
+	state.cpu.rpc = state.JumpAddr;
+	state.cpu.is_delayslot = false;
+	state.NextOp = NDO_NextOp;
+	state.BlockType = BET_SCL_Intr;
+	state.JumpAddr = NullAddress;
+	state.NextAddr = NullAddress;
+
+	return true;
+}
+
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,bool background)
 {
 	blk=rbi;
 	state_Setup(blk->vaddr, blk->fpu_cfg);
 	
 	blk->guest_opcodes=0;
+	u32 rangeStart = blk->vaddr;
 	// If full MMU, don't allow the block to extend past the end of the current 4K page
 	u32 max_pc = mmu_enabled() ? ((state.cpu.rpc >> 12) + 1) << 12 : 0xFFFFFFFF;
 	
@@ -971,7 +1026,8 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 
 					if (OpDesc[op]->IsFloatingPoint())
 					{
-						if (sr.FD == 1)
+						// The cpu state belongs to the emulation thread, which checks the FPU is enabled before using the block
+						if (!background && sr.FD == 1)
 						{
 							// We need to know FPSCR to compile the block, so let the exception handler run first
 							// as it may change the fp registers
@@ -1009,6 +1065,8 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 			break;
 
 		case NDO_End:
+			if (blk->trace && dec_FollowBranch(max_cycles, rangeStart))
+				break;
 			// Disabled for now since we need to know if the block is read-only,
 			// which isn't determined until after the decoding.
 			// This is a relatively rare optimization anyway
@@ -1040,7 +1098,7 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 	}
 
 _end:
-	blk->sh4_code_size=state.cpu.rpc-blk->vaddr;
+	dec_EndRange(rangeStart);
 	blk->NextBlock=state.NextAddr;
 	blk->BranchBlock=state.JumpAddr;
 	blk->BlockType=state.BlockType;
@@ -38,7 +38,9 @@ enum NextDecoderOperation
 };
 
 struct RuntimeBlockInfo;
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles);
+// background is true when decoding outside of the normal execution flow (on the compile thread or to build a trace),
+// in which case the cpu state isn't used
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,bool background = false);
 void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op);
 
 struct state_t
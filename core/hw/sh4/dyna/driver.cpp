@@ -1,4 +1,5 @@
 #include "types.h"
+#include <memory>
 #include <unordered_set>
 
 #include "hw/sh4/sh4_interpreter.h"
@@ -9,10 +10,17 @@
 #include "hw/sh4/modules/mmu.h"
 #include "cfg/option.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <ctime>
 #include <cfloat>
 
+#include "asynccompile.h"
 #include "blockmanager.h"
+#include "blockcache.h"
+#include "codesegments.h"
+#include "profiler/blockprofiler.h"
 #include "ngen.h"
 #include "decoder.h"
 
@@ -44,6 +52,49 @@ static u32 *emit_ptr_limit;
 
 static std::unordered_set<u32> smc_hotspots;
 
+// The code cache is reused one segment at a time when full
+static CodeSegments<> codeSegments(CODE_SIZE);
+// block lookups in each segment since the last eviction
+static u64 segmentLookups[CodeSegments<>::SegmentCount];
+// offset of the first block, after the main loop
+static u32 blocksStart = ~0u;
+// host code calling the dynarec, whose segment must not be reused
+static const void *callerCode;
+// physical addresses of the evicted blocks that haven't been compiled again
+static std::unordered_set<u32> evicted_blocks;
+
+// Code cache counters, logged when the cache is flushed and when the dynarec terminates
+struct CodeCacheStats
+{
+	u64 evictions;			// segments reused
+	u64 evictedBlocks;		// blocks discarded by evictions
+	u64 recompiledBlocks;	// evicted blocks compiled again
+	u64 recompiledBytes;	// host code size of the recompiled blocks
+	u64 flushes;			// full code cache flushes
+	u64 traces;				// hot blocks recompiled as traces
+	u64 traceRanges;		// guest code ranges of these traces
+	u64 failedTraces;		// hot blocks that couldn't be extended
+	u64 compiledBlocks;		// blocks decoded and compiled on the emulation thread, including traces
+	u64 compileNanos;		// time spent decoding, optimizing and generating these blocks
+};
+static CodeCacheStats cacheStats;
+
+static void logCacheStats()
+{
+	if (cacheStats.evictions != 0 || cacheStats.flushes != 0)
+		INFO_LOG(DYNAREC, "Code cache: %" PRIu64 " flushes, %" PRIu64 " segment evictions, %" PRIu64 " blocks evicted, "
+				"%" PRIu64 " recompiled (%" PRIu64 " KB)",
+				cacheStats.flushes, cacheStats.evictions, cacheStats.evictedBlocks,
+				cacheStats.recompiledBlocks, cacheStats.recompiledBytes / 1024);
+	if (cacheStats.traces != 0 || cacheStats.failedTraces != 0)
+		INFO_LOG(DYNAREC, "Traces: %" PRIu64 " hot blocks promoted, %" PRIu64 " code ranges, %" PRIu64 " failed",
+				cacheStats.traces, cacheStats.traceRanges, cacheStats.failedTraces);
+	if (cacheStats.compiledBlocks != 0)
+		INFO_LOG(DYNAREC, "Compiled %" PRIu64 " blocks, %.1f us per block",
+				cacheStats.compiledBlocks, cacheStats.compileNanos / 1000.0 / cacheStats.compiledBlocks);
+	bm_LogSmcStats();
+}
+
 static sh4_if sh4Interp;
 
 void* emit_GetCCPtr() { return emit_ptr==0?(void*)&CodeCache[LastAddr]:(void*)emit_ptr; }
@@ -58,7 +109,13 @@ static void clear_temp_cache(bool full)
 static void recSh4_ClearCache()
 {
 	INFO_LOG(DYNAREC, "recSh4:Dynarec Cache clear at %08X free space %d", next_pc, emit_FreeSpace());
+	logCacheStats();
+	cacheStats.flushes++;
 	LastAddr = 0;
+	blocksStart = ~0u;
+	codeSegments.reset();
+	memset(segmentLookups, 0, sizeof(segmentLookups));
+	evicted_blocks.clear();
 	bm_ResetCache();
 	smc_hotspots.clear();
 	clear_temp_cache(true);
@@ -89,8 +146,43 @@ u32 emit_FreeSpace()
 {
 	if (emit_ptr)
 		return (emit_ptr_limit - emit_ptr) * sizeof(u32);
-	else
+	// The main loop is generated before any block and may use the whole buffer
+	else if (blocksStart == ~0u)
 		return CODE_SIZE - LastAddr;
+	else
+		return codeSegments.end(codeSegments.current()) - LastAddr;
+}
+
+// Called when the current code segment is full.
+// Moves to the next segment, discarding its blocks if it's been used before.
+static void nextCodeSegment()
+{
+#if FEAT_SHREC == DYNAREC_JIT
+	u32 pinned = CodeSegments<>::SegmentCount;
+	if (callerCode != nullptr)
+	{
+		const u32 offset = (u32)((const u8 *)callerCode - CodeCache);
+		if (offset < CODE_SIZE)
+			pinned = codeSegments.segmentOf(offset);
+	}
+	const u32 segment = codeSegments.next(segmentLookups, pinned);
+	const u32 start = std::max(codeSegments.start(segment), blocksStart);
+	if (codeSegments.used(segment))
+	{
+		std::vector<u32> blocks = bm_DiscardBlocks(&CodeCache[start], &CodeCache[codeSegments.end(segment)]);
+		DEBUG_LOG(DYNAREC, "Code cache: segment %d evicted at %08X, %d blocks, %d lookups", segment, next_pc,
+				(int)blocks.size(), (int)segmentLookups[segment]);
+		evicted_blocks.insert(blocks.begin(), blocks.end());
+		cacheStats.evictions++;
+		cacheStats.evictedBlocks += blocks.size();
+		memset(segmentLookups, 0, sizeof(segmentLookups));
+	}
+	codeSegments.use(segment);
+	LastAddr = start;
+#else
+	// Blocks compiled by the cpp dynarec can't be reused individually
+	recSh4_ClearCache();
+#endif
 }
 
 void AnalyseBlock(RuntimeBlockInfo* blk);
@@ -117,15 +209,17 @@ const char* RuntimeBlockInfo::hash()
 		hash = XXH32_digest(state);
 		XXH32_freeState(state);
 	}
-	static char block_hash[20];
+	static thread_local char block_hash[20];
 	sprintf(block_hash, ">:1:%02X:%08X", this->guest_opcodes, hash);
 
 	return block_hash;
 }
 
-bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+void RuntimeBlockInfo::Init(u32 rpc,fpscr_t rfpu_cfg)
 {
 	staging_runs=addr=lookups=runs=host_code_size=0;
+	prof_runs = prof_ticks = 0;
+	from_cache = false;
 	guest_cycles=guest_opcodes=host_opcodes=0;
 	sh4_code_size = 0;
 	pBranchBlock=pNextBlock=0;
@@ -136,8 +230,19 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	BlockType = BET_SCL_Intr;
 	has_fpu_op = false;
 	temp_block = false;
-	
+	trace = false;
+	trace_ranges.clear();
+	gated_checks = false;
+
 	vaddr = rpc;
+	addr = rpc;
+	fpu_cfg = rfpu_cfg;
+	oplist.clear();
+}
+
+bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+{
+	Init(rpc, rfpu_cfg);
 	if (mmu_enabled())
 	{
 		u32 rv = mmu_instruction_translation(vaddr, addr);
@@ -147,34 +252,109 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 			return false;
 		}
 	}
-	else
-		addr = vaddr;
-	fpu_cfg=rfpu_cfg;
-	
-	oplist.clear();
+
+	bool block_protected;
+	if (bc_Restore(this, block_protected))
+	{
+		from_cache = true;
+		return true;
+	}
 
 	try {
 		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2))
+		{
+			if (block_protected)
+				Discard();
 			return false;
+		}
 	}
 	catch (const SH4ThrownException& ex) {
+		if (block_protected)
+			Discard();
 		Do_Exception(rpc, ex.expEvn, ex.callVect);
 		return false;
 	}
-	SetProtectedFlags();
+	if (!block_protected)
+		SetProtectedFlags();
 
 	AnalyseBlock(this);
 
 	return true;
 }
 
+// The code cache is cleared when the bios or a game starts
+static bool isBootPC(u32 pc)
+{
+	return pc == 0x8c0000e0 || pc == 0xac010000 || pc == 0xac008300;
+}
+
+// Blocks ending with a static jump or call can be recompiled as a trace including the target code
+// once they've run staging_runs times. Only the x64 dynarec counts runs.
+static bool canPromote(const RuntimeBlockInfo* rbi)
+{
+	return config::DynarecTraces && !mmu_enabled() && rbi->read_only && !rbi->temp_block && !rbi->trace
+			&& (rbi->BlockType == BET_StaticJump || rbi->BlockType == BET_StaticCall)
+			// blocks split at the size limit or after an FPSCR change
+			&& rbi->BranchBlock != rbi->vaddr + rbi->sh4_code_size
+			&& IsOnRam(rbi->BranchBlock);
+}
+
+// Generates the host code of a decoded block and adds it to the block manager
+static DynarecCodeEntryPtr compileBlock(RuntimeBlockInfo* rbi)
+{
+	if (!rbi->temp_block && blocksStart == ~0u)
+		blocksStart = LastAddr;
+	bool do_opts = !rbi->temp_block;
+	rbi->staging_runs=do_opts?100:-100;
+	bool block_check = !rbi->read_only;
+	if (block_check)
+	{
+		smcStats.checkedBlocks++;
+		if (rbi->gated_checks)
+			smcStats.gatedBlocks++;
+	}
+	ngen_Compile(rbi, block_check, (rbi->vaddr & 0xFFFFFF) == 0x08300 || (rbi->vaddr & 0xFFFFFF) == 0x10000, canPromote(rbi), do_opts);
+	verify(rbi->code!=0);
+
+	if (!rbi->temp_block && !evicted_blocks.empty() && evicted_blocks.erase(rbi->addr) != 0)
+	{
+		cacheStats.recompiledBlocks++;
+		cacheStats.recompiledBytes += rbi->host_code_size;
+	}
+	bm_AddBlock(rbi);
+
+	if (emit_ptr != NULL)
+	{
+		TempLastAddr = (u8*)emit_ptr - TempCodeCache;
+		emit_ptr = NULL;
+		emit_ptr_limit = NULL;
+	}
+
+	return rbi->code;
+}
+
+static void countCompileTime(std::chrono::steady_clock::time_point start)
+{
+	cacheStats.compiledBlocks++;
+	cacheStats.compileNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void rdv_GetCompileStats(u64& blocks, u64& nanos)
+{
+	blocks = cacheStats.compiledBlocks;
+	nanos = cacheStats.compileNanos;
+}
+
 DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 {
 	u32 pc=next_pc;
 
-	if (emit_FreeSpace()<16*1024 || pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
+	if (isBootPC(pc))
 		recSh4_ClearCache();
+	else if (emit_FreeSpace() < 16*1024)
+		nextCodeSegment();
 
+	const auto start = std::chrono::steady_clock::now();
 	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
 
 	if (!rbi->Setup(pc,fpscr))
@@ -193,24 +373,275 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 		if (rbi->read_only)
 			INFO_LOG(DYNAREC, "WARNING: temp block %x (%x) is protected!", rbi->vaddr, rbi->addr);
 	}
-	bool do_opts = !rbi->temp_block;
-	rbi->staging_runs=do_opts?100:-100;
-	bool block_check = !rbi->read_only;
-	ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, false, do_opts);
-	verify(rbi->code!=0);
+	else if (!rbi->from_cache)
+	{
+		bc_Add(rbi);
+	}
 
-	bm_AddBlock(rbi);
+	DynarecCodeEntryPtr code = compileBlock(rbi);
+	countCompileTime(start);
 
-	if (emit_ptr != NULL)
+	return code;
+}
+
+// Compiles the block at next_pc and returns its RX address, or the address of the block to run if an exception occurred
+static DynarecCodeEntryPtr compileNextPC()
+{
+	DynarecCodeEntryPtr code = rdv_CompilePC(0);
+	if (code == NULL)
+		code = bm_GetCodeByVAddr(next_pc);
+	else
+		code = (DynarecCodeEntryPtr)CC_RW2RX(code);
+	return code;
+}
+
+// Asynchronous compile mode: blocks are decoded and optimized on a background thread while the interpreter runs them.
+// The host code is generated on the emulation thread since it updates the code cache and block manager.
+// The x86 and x64 backends keep the cycle counter in the sh4 context, where the interpreter updates it.
+#if FEAT_SHREC == DYNAREC_JIT && (HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86)
+
+struct AsyncBlock
+{
+	std::unique_ptr<RuntimeBlockInfo> block;
+	// whether the block can be write-protected if it's contained in its first page, or spans two pages
+	bool protectable[2];
+	// hash of the two memory pages that may be read by the decoder and optimizer
+	u64 codeHash;
+};
+
+static bool decodeAsyncBlock(AsyncBlock& job);
+static AsyncCompileQueue<AsyncBlock> compileQueue(decodeAsyncBlock, 1024);
+static AsyncCompileStats asyncStats;
+
+// Blocks are no longer than a page so the decoder only reads the page of the block start and the next one
+static bool hashCodePages(u32 addr, u64& hash)
+{
+	const u32 start = addr & ~PAGE_MASK;
+	if ((start & RAM_MASK) + 2 * PAGE_SIZE > RAM_SIZE)
+		return false;
+	const u8 *ptr = GetMemPtr(start, 2 * PAGE_SIZE);
+	if (ptr == nullptr)
+		return false;
+	hash = XXH64(ptr, 2 * PAGE_SIZE, 0);
+	return true;
+}
+
+// Runs on the compile thread and must not change the emulator state.
+// The guest code is hashed before and after decoding to detect concurrent modifications.
+static bool decodeAsyncBlock(AsyncBlock& job)
+{
+	RuntimeBlockInfo *rbi = job.block.get();
+	if (!hashCodePages(rbi->addr, job.codeHash))
+		return false;
+	try {
+		if (!dec_DecodeBlock(rbi, SH4_TIMESLICE / 2, true))
+			return false;
+	} catch (const FlycastException&) {
+		// Will be reported when compiling the block on the emulation thread
+		return false;
+	} catch (const SH4ThrownException&) {
+		return false;
+	}
+	// The optimizer needs to know if the block will be write-protected
+	rbi->read_only = job.protectable[(rbi->addr & PAGE_MASK) + rbi->sh4_code_size <= PAGE_SIZE ? 0 : 1];
+	AnalyseBlock(rbi);
+
+	u64 hash;
+	return hashCodePages(rbi->addr, hash) && hash == job.codeHash;
+}
+
+static bool asyncCompileAllowed(u32 pc)
+{
+	// Interpreted code isn't cycle-exact with compiled code and depends on when the compile thread is done
+	return config::DynarecAsyncCompile && !config::GGPOEnable && !mmu_enabled() && IsOnRam(pc) && !isBootPC(pc)
+			&& smc_hotspots.find(pc) == smc_hotspots.end();
+}
+
+static bool requestAsyncCompile(u32 pc)
+{
+	std::unique_ptr<AsyncBlock> job(new AsyncBlock());
+	job->block.reset(ngen_AllocateBlock());
+	job->block->Init(pc, fpscr);
+	job->protectable[0] = bm_CanProtect(pc, PAGE_SIZE - (pc & PAGE_MASK));
+	job->protectable[1] = bm_CanProtect(pc, 2 * PAGE_SIZE - (pc & PAGE_MASK));
+	compileQueue.start();
+	if (!compileQueue.request(pc, std::move(job)))
+		return false;
+	asyncStats.requests++;
+	return true;
+}
+
+// Generates the host code of a block decoded by the compile thread.
+// Returns null if the block can't be used because the guest code or the cpu state has changed.
+static DynarecCodeEntryPtr installAsyncBlock(std::unique_ptr<AsyncBlock> job)
+{
+	RuntimeBlockInfo *rbi = job->block.get();
+	u64 hash;
+	if (mmu_enabled()
+			// Let the decoder raise the exception if the FPU is disabled
+			|| (rbi->has_fpu_op && sr.FD == 1)
+			|| rbi->fpu_cfg.PR != fpscr.PR || rbi->fpu_cfg.SZ != fpscr.SZ || rbi->fpu_cfg.RM != fpscr.RM
+			|| !hashCodePages(rbi->addr, hash) || hash != job->codeHash)
+		return nullptr;
+
+	const auto start = std::chrono::steady_clock::now();
+	if (emit_FreeSpace() < 16*1024)
+		nextCodeSegment();
+	const bool readOnly = rbi->read_only;
+	rbi->SetProtectedFlags();
+	if (rbi->read_only != readOnly)
 	{
-		TempLastAddr = (u8*)emit_ptr - TempCodeCache;
-		emit_ptr = NULL;
-		emit_ptr_limit = NULL;
+		rbi->Discard();
+		return nullptr;
 	}
+	rbi->blockcheck_failures = 0;
+	bc_Add(rbi);
+	DynarecCodeEntryPtr code = compileBlock(job->block.release());
+	asyncStats.installMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
 
-	return rbi->code;
+	return code;
+}
+
+// Installs a job taken from the compile queue. Returns null if it was rejected.
+static DynarecCodeEntryPtr installAsyncJob(std::unique_ptr<AsyncBlock> job, bool decoded, std::chrono::microseconds latency)
+{
+	asyncStats.latencyMicros += latency.count();
+	asyncStats.maxLatencyMicros = std::max<u64>(asyncStats.maxLatencyMicros, latency.count());
+	DynarecCodeEntryPtr code = decoded ? installAsyncBlock(std::move(job)) : nullptr;
+	if (code == nullptr)
+	{
+		asyncStats.rejected++;
+		return nullptr;
+	}
+	asyncStats.installed++;
+	return (DynarecCodeEntryPtr)CC_RW2RX(code);
+}
+
+// Adds the blocks decoded by the compile thread to the code cache as soon as they're done,
+// so that the dispatcher and linked blocks find them without going through the interpreter again.
+// The number of blocks is limited to bound the time spent generating code.
+// Returns the code of the block at next_pc if it's one of them, or null.
+static DynarecCodeEntryPtr installCompletedBlocks()
+{
+	constexpr int MaxBlocks = 8;
+	for (int i = 0; i < MaxBlocks; i++)
+	{
+		u32 addr;
+		bool decoded;
+		std::chrono::microseconds latency;
+		std::unique_ptr<AsyncBlock> job = compileQueue.takeDone(addr, decoded, latency);
+		if (job == nullptr)
+			break;
+		if (addr == next_pc)
+		{
+			DynarecCodeEntryPtr code = installAsyncJob(std::move(job), decoded, latency);
+			return code != nullptr ? code : compileNextPC();
+		}
+		if (bm_GetCodeByVAddr(addr) != ngen_FailedToFindBlock)
+			// compiled synchronously in the meantime
+			continue;
+		installAsyncJob(std::move(job), decoded, latency);
+	}
+	return nullptr;
+}
+
+// Runs the guest code at next_pc with the interpreter until a compiled block is found.
+// Blocks that haven't been compiled yet are queued for compilation and installed when ready.
+static DynarecCodeEntryPtr interpretUntilCompiled()
+{
+	for (;;)
+	{
+		DynarecCodeEntryPtr code = bm_GetCodeByVAddr(next_pc);
+		if (code != ngen_FailedToFindBlock)
+			return code;
+		if (!asyncCompileAllowed(next_pc) || !sh4_int_bCpuRun)
+			return compileNextPC();
+
+		bool decoded;
+		std::chrono::microseconds latency;
+		std::unique_ptr<AsyncBlock> job = compileQueue.take(next_pc, decoded, latency);
+		if (job != nullptr)
+		{
+			code = installAsyncJob(std::move(job), decoded, latency);
+			return code != nullptr ? code : compileNextPC();
+		}
+		code = installCompletedBlocks();
+		if (code != nullptr)
+			return code;
+		if (!compileQueue.contains(next_pc) && !requestAsyncCompile(next_pc))
+			// queue full
+			return compileNextPC();
+
+		asyncStats.fallbacks++;
+		asyncStats.interpretedOps += ExecuteUntilBranch();
+		if (p_sh4rcb->cntx.cycle_counter <= 0)
+		{
+			p_sh4rcb->cntx.cycle_counter += SH4_TIMESLICE;
+			UpdateSystem_INTC();
+		}
+	}
+}
+
+static void resetAsyncCompile()
+{
+	compileQueue.clear();
+}
+
+bool rdv_RequestAsyncCompile(u32 pc)
+{
+	if (!asyncCompileAllowed(pc) || !requestAsyncCompile(pc))
+		return false;
+	compileQueue.flush();
+	return true;
+}
+
+AsyncCompileStats rdv_GetAsyncCompileStats() {
+	return asyncStats;
+}
+
+static void termAsyncCompile()
+{
+	compileQueue.stop();
+	compileQueue.clear();
+}
+
+void rdv_LogAsyncCompileStats(double frames)
+{
+	if (asyncStats.requests == 0 && asyncStats.fallbacks == 0)
+		return;
+	const u64 compiled = asyncStats.installed + asyncStats.rejected;
+	INFO_LOG(DYNAREC, "Async compile: %.1f interpreter fallbacks/frame (%.0f instructions), %" PRIu64 " requests, "
+			"%" PRIu64 " installed, %" PRIu64 " rejected, latency avg %.0f us max %" PRIu64 " us, code generation avg %.0f us",
+			asyncStats.fallbacks / frames, asyncStats.interpretedOps / frames, asyncStats.requests,
+			asyncStats.installed, asyncStats.rejected,
+			compiled == 0 ? 0.0 : (double)asyncStats.latencyMicros / compiled, asyncStats.maxLatencyMicros,
+			asyncStats.installed == 0 ? 0.0 : (double)asyncStats.installMicros / asyncStats.installed);
+	asyncStats = {};
+}
+
+#else
+
+static bool asyncCompileAllowed(u32 pc) {
+	return false;
+}
+static DynarecCodeEntryPtr interpretUntilCompiled() {
+	return compileNextPC();
+}
+static void resetAsyncCompile() {
+}
+static void termAsyncCompile() {
+}
+void rdv_LogAsyncCompileStats(double frames) {
+}
+bool rdv_RequestAsyncCompile(u32 pc) {
+	return false;
+}
+AsyncCompileStats rdv_GetAsyncCompileStats() {
+	return {};
 }
 
+#endif
+
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
 {
 	return rdv_FailedToFindBlock(next_pc);
@@ -220,12 +651,9 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock(u32 pc)
 {
 	//DEBUG_LOG(DYNAREC, "rdv_FailedToFindBlock %08x", pc);
 	next_pc=pc;
-	DynarecCodeEntryPtr code = rdv_CompilePC(0);
-	if (code == NULL)
-		code = bm_GetCodeByVAddr(next_pc);
-	else
-		code = (DynarecCodeEntryPtr)CC_RW2RX(code);
-	return code;
+	if (asyncCompileAllowed(pc))
+		return interpretUntilCompiled();
+	return compileNextPC();
 }
 
 static void ngen_FailedToFindBlock_internal() {
@@ -263,13 +691,65 @@ DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr)
 				DEBUG_LOG(DYNAREC, "rdv_BlockCheckFail SMC hotspot @ %08x fails %d", addr, blockcheck_failures);
 		}
 		bm_DiscardBlock(block.get());
+		// the discarded block jumps to the new one on return
+		callerCode = (const void *)block->code;
 	}
 	else
 	{
 		next_pc = addr;
 		recSh4_ClearCache();
 	}
-	return (DynarecCodeEntryPtr)CC_RW2RX(rdv_CompilePC(blockcheck_failures));
+	DynarecCodeEntryPtr code = (DynarecCodeEntryPtr)CC_RW2RX(rdv_CompilePC(blockcheck_failures));
+	callerCode = nullptr;
+	return code;
+}
+
+// Called by a block that has run staging_runs times, before running it again.
+// Replaces it with a trace following its static jumps and calls. The caller then looks up next_pc.
+void DYNACALL rdv_PromoteBlock(u32 addr)
+{
+	if (emit_FreeSpace() < 16*1024)
+		nextCodeSegment();
+	RuntimeBlockInfoPtr block = bm_GetBlock(addr);
+	if (!block || block->trace || block->vaddr != next_pc)
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	RuntimeBlockInfo* trace = ngen_AllocateBlock();
+	trace->Init(block->vaddr, block->fpu_cfg);
+	trace->trace = true;
+	bool decoded;
+	try {
+		decoded = dec_DecodeBlock(trace, SH4_TIMESLICE / 2, true);
+	} catch (const FlycastException&) {
+		decoded = false;
+	} catch (const SH4ThrownException&) {
+		decoded = false;
+	}
+	// Let the original block raise the exception if the FPU is disabled
+	if (!decoded || trace->trace_ranges.empty() || (trace->has_fpu_op && sr.FD == 1))
+	{
+		delete trace;
+		cacheStats.failedTraces++;
+		return;
+	}
+	trace->SetProtectedFlags();
+	if (!trace->read_only)
+	{
+		delete trace;
+		cacheStats.failedTraces++;
+		return;
+	}
+	AnalyseBlock(trace);
+	trace->blockcheck_failures = 0;
+	DEBUG_LOG(DYNAREC, "Trace at %08X: %d code ranges, %d guest ops", trace->vaddr,
+			(int)trace->trace_ranges.size() + 1, trace->guest_opcodes);
+	cacheStats.traces++;
+	cacheStats.traceRanges += trace->trace_ranges.size() + 1;
+
+	bm_DiscardBlock(block.get());
+	compileBlock(trace);
+	countCompileTime(start);
 }
 
 DynarecCodeEntryPtr rdv_FindOrCompile()
@@ -281,6 +761,13 @@ DynarecCodeEntryPtr rdv_FindOrCompile()
 	return rv;
 }
 
+static void countLookup(RuntimeBlockInfo *block)
+{
+	block->lookups++;
+	if (!block->temp_block)
+		segmentLookups[codeSegments.segmentOf((u32)((u8 *)block->code - CodeCache))]++;
+}
+
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 {
 	// code is the RX addr to return after, however bm_GetBlock returns RW
@@ -316,7 +803,17 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 			next_pc = rbi->NextBlock;
 	}
 
+	// The calling block must not be evicted if a block is compiled
+	callerCode = CC_RX2RW(code);
+	if (asyncCompileAllowed(next_pc) && bm_GetCodeByVAddr(next_pc) == ngen_FailedToFindBlock)
+	{
+		// Not compiled yet. The block will be linked once it is.
+		DynarecCodeEntryPtr rv = interpretUntilCompiled();
+		callerCode = nullptr;
+		return (void*)rv;
+	}
 	DynarecCodeEntryPtr rv = rdv_FindOrCompile();  // Returns rx ptr
+	callerCode = nullptr;
 
 	if (!mmu_enabled() && !stale_block)
 	{
@@ -334,11 +831,13 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 			{
 				rbi->pBranchBlock = bm_GetBlock(next_pc).get();
 				rbi->pBranchBlock->AddRef(rbi);
+				countLookup(rbi->pBranchBlock);
 			}
 		}
 		else
 		{
 			RuntimeBlockInfo* nxt = bm_GetBlock(next_pc).get();
+			countLookup(nxt);
 
 			if (rbi->BranchBlock == next_pc)
 				rbi->pBranchBlock = nxt;
@@ -371,6 +870,7 @@ static void recSh4_Step()
 static void recSh4_Reset(bool hard)
 {
 	sh4Interp.Reset(hard);
+	resetAsyncCompile();
 	recSh4_ClearCache();
 	if (hard)
 		bm_Reset();
@@ -382,6 +882,8 @@ static void recSh4_Init()
 	Get_Sh4Interpreter(&sh4Interp);
 	sh4Interp.Init();
 	bm_Init();
+	bc_Init();
+	prof_blockInit();
 
 	
 	if (_nvmem_enabled())
@@ -417,6 +919,10 @@ static void recSh4_Init()
 static void recSh4_Term()
 {
 	INFO_LOG(DYNAREC, "recSh4 Term");
+	logCacheStats();
+	termAsyncCompile();
+	prof_blockTerm();
+	bc_Term();
 	bm_Term();
 	sh4Interp.Term();
 }
@@ -72,10 +72,14 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock(u32 pc);
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc();
 //Called when a block check failed, and the block needs to be invalidated
 DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr);
+//Called when a block compiled with staging becomes hot. The block may be replaced by a trace.
+void DYNACALL rdv_PromoteBlock(u32 addr);
 //Called to compile code @pc
 DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures);
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
+//Number of blocks compiled by the emulation thread and time spent decoding, optimizing and generating them
+void rdv_GetCompileStats(u64& blocks, u64& nanos);
 
 //code -> pointer to code of block, dpc -> if dynamic block, pc. if cond, 0 for next, 1 for branch
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc);
@@ -721,7 +721,8 @@ private:
 			return false;
 		bool success = false;
 		const u32 start_page = block->vaddr >> 12;
-		const u32 end_page = (block->vaddr + (block->guest_opcodes - 1) * 2) >> 12;
+		// only the first code range of traces
+		const u32 end_page = (block->vaddr + block->sh4_code_size - 2) >> 12;
 		while (true)
 		{
 			if ((addr >> 12) < start_page || ((addr + 2) >> 12) > end_page)
@@ -14,8 +14,6 @@
 #include "../sh4_cache.h"
 #include "debug/gdb_server.h"
 
-#define CPU_RATIO      (8)
-
 sh4_icache icache;
 sh4_ocache ocache;
 
@@ -63,6 +61,25 @@ static void Sh4_int_Run()
 	sh4_int_bCpuRun = false;
 }
 
+u32 ExecuteUntilBranch()
+{
+	u32 count = 0;
+	try {
+		do
+		{
+			const u32 pc = next_pc;
+			ExecuteOpcode(ReadNexOp());
+			count++;
+			if (next_pc != pc + 2)
+				break;
+		} while (p_sh4rcb->cntx.cycle_counter > 0);
+	} catch (const SH4ThrownException& ex) {
+		Do_Exception(ex.epc, ex.expEvn, ex.callVect);
+		p_sh4rcb->cntx.cycle_counter -= CPU_RATIO * 5;	// an exception requires the instruction pipeline to drain, so approx 5 cycles
+	}
+	return count;
+}
+
 static void Sh4_int_Stop()
 {
 	sh4_int_bCpuRun = false;
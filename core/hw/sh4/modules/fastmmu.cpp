@@ -51,16 +51,117 @@ static u32 full_table_size;
 static TLB_LinkedEntry *entry_buckets[NBUCKETS];
 u32 mmuAddressLUT[0x100000];
 
+// Per-ASID page tables caching the result of find_entry() for each 4 KB page.
+// The tables are invalidated by bumping the generation, stale directories being cleared when next used.
+MmuPageDirectory mmuPageDirectories[256];
+MmuPageLeaf mmuLeafPool[512];
+u32 mmuTableGeneration = 1;
+static u32 leaf_pool_size = 1;	// index 0 is reserved
+// ASIDs with a directory of the current generation, so that shared entries only invalidate those
+static u8 live_asids[256];
+static u32 live_asid_count;
+
 static u16 bucket_index(u32 address, int size, u32 asid)
 {
 	return ((address >> 20) ^ (address >> 12) ^ (address | asid | (size << 8))) & (NBUCKETS - 1);
 }
 
+static void flush_page_tables()
+{
+	mmuTableGeneration++;
+	leaf_pool_size = 1;
+	live_asid_count = 0;
+}
+
+static const TLB_Entry *page_table_lookup(u32 address, u32 asid)
+{
+	const MmuPageDirectory& dir = mmuPageDirectories[asid];
+	if (dir.generation != mmuTableGeneration)
+		return nullptr;
+	u16 leaf = dir.leaves[address >> 22];
+	if (leaf == 0)
+		return nullptr;
+	u32 index = mmuLeafPool[leaf].entries[(address >> 12) & 1023];
+	if (index == 0)
+		return nullptr;
+	return &full_table[index - 1].entry;
+}
+
+static void page_table_insert(u32 address, u32 asid, const TLB_Entry *entry)
+{
+	MmuPageDirectory& dir = mmuPageDirectories[asid];
+	if (dir.generation != mmuTableGeneration)
+	{
+		memset(dir.leaves, 0, sizeof(dir.leaves));
+		dir.generation = mmuTableGeneration;
+		live_asids[live_asid_count++] = asid;
+	}
+	u16& leaf = dir.leaves[address >> 22];
+	if (leaf == 0)
+	{
+		if (leaf_pool_size == ARRAY_SIZE(mmuLeafPool))
+		{
+			flush_page_tables();
+			page_table_insert(address, asid, entry);
+			return;
+		}
+		leaf = leaf_pool_size++;
+		memset(&mmuLeafPool[leaf], 0, sizeof(mmuLeafPool[leaf]));
+	}
+	// entries found by find_entry() are always in full_table
+	const TLB_LinkedEntry *linkedEntry = reinterpret_cast<const TLB_LinkedEntry *>(entry);
+	const u32 page = (address >> 12) & 1023;
+	mmuLeafPool[leaf].entries[page] = linkedEntry - full_table + 1;
+	// Same translation as mmu_data_translation(). The on-chip RAM area isn't translated.
+	u32 paddr = 0;
+	if ((address & 0xFC000000) != 0x7C000000)
+	{
+		const u32 mask = mmu_mask[entry->Data.SZ1 * 2 + entry->Data.SZ0];
+		paddr = ((entry->Data.PPN << 10) | (address & ~mask)) & ~0xfff;
+		if ((paddr & 0x1C000000) == 0x1C000000)
+			paddr |= 0xF0000000;
+	}
+	mmuLeafPool[leaf].paddr[page] = paddr;
+}
+
+static void page_table_invalidate(MmuPageDirectory& dir, u32 start, u32 pages)
+{
+	for (u32 page = 0; page < pages; page++)
+	{
+		u32 address = start + (page << 12);
+		u16 leaf = dir.leaves[address >> 22];
+		if (leaf != 0)
+		{
+			mmuLeafPool[leaf].entries[(address >> 12) & 1023] = 0;
+			mmuLeafPool[leaf].paddr[(address >> 12) & 1023] = 0;
+		}
+	}
+}
+
+// Forget the cached pages covered by a new entry since it takes precedence over the previous ones
+static void page_table_invalidate(const TLB_Entry &entry, u32 sz)
+{
+	const u32 start = (entry.Address.VPN << 10) & mmu_mask[sz];
+	const u32 pages = (~mmu_mask[sz] >> 12) + 1;
+	if (entry.Data.SH == 1)
+	{
+		for (u32 i = 0; i < live_asid_count; i++)
+			page_table_invalidate(mmuPageDirectories[live_asids[i]], start, pages);
+	}
+	else
+	{
+		MmuPageDirectory& dir = mmuPageDirectories[entry.Address.ASID];
+		if (dir.generation == mmuTableGeneration)
+			page_table_invalidate(dir, start, pages);
+	}
+}
+
 static void cache_entry(const TLB_Entry &entry)
 {
 	if (entry.Data.SZ0 == 0 && entry.Data.SZ1 == 0)
 		return;
 	verify(full_table_size < ARRAY_SIZE(full_table));
+	page_table_invalidate(entry, entry.Data.SZ1 * 2 + entry.Data.SZ0);
 
 	full_table[full_table_size].entry = entry;
 
@@ -74,6 +175,7 @@ static void flush_cache()
 {
 	full_table_size = 0;
 	memset(entry_buckets, 0, sizeof(entry_buckets));
+	flush_page_tables();
 }
 
 template<u32 size>
@@ -222,6 +324,7 @@ u32 mmu_full_lookup(u32 va, const TLB_Entry** tlb_entry_ret, u32& rv)
 			rv = (lru_entry->Data.PPN << 10) | (va & ~lru_mask);
 			if (tlb_entry_ret != nullptr)
 				*tlb_entry_ret = lru_entry;
+			MMU_STAT(lruHits);
 
 			return MMU_ERROR_NONE;
 		}
@@ -230,8 +333,23 @@ u32 mmu_full_lookup(u32 va, const TLB_Entry** tlb_entry_ret, u32& rv)
 	if (tlb_entry_ret == nullptr)
 		tlb_entry_ret = &localEntry;
 
+	*tlb_entry_ret = page_table_lookup(va, CCN_PTEH.ASID);
+	if (*tlb_entry_ret != nullptr)
+	{
+		u32 mask = mmu_mask[(*tlb_entry_ret)->Data.SZ1 * 2 + (*tlb_entry_ret)->Data.SZ0];
+		rv = ((*tlb_entry_ret)->Data.PPN << 10) | (va & ~mask);
+		lru_entry = *tlb_entry_ret;
+		lru_mask = mask;
+		lru_address = ((*tlb_entry_ret)->Address.VPN << 10);
+		MMU_STAT(tableHits);
+
+		return MMU_ERROR_NONE;
+	}
+	MMU_STAT(tableMisses);
+
 	if (find_entry(va, tlb_entry_ret))
 	{
+		page_table_insert(va, CCN_PTEH.ASID, *tlb_entry_ret);
 		u32 mask = mmu_mask[(*tlb_entry_ret)->Data.SZ1 * 2 + (*tlb_entry_ret)->Data.SZ0];
 		rv = ((*tlb_entry_ret)->Data.PPN << 10) | (va & ~mask);
 		lru_entry = *tlb_entry_ret;
@@ -260,10 +378,12 @@ u32 mmu_full_lookup(u32 va, const TLB_Entry** tlb_entry_ret, u32& rv)
 		rv = (entry.Data.PPN << 10) | (va & ~mmu_mask[sz]);
 
 		cache_entry(entry);
+		MMU_STAT(winceResolved);
 
 		return MMU_ERROR_NONE;
 	}
 #endif
+	MMU_STAT(tlbMisses);
 
 	return MMU_ERROR_TLB_MISS;
 }
@@ -332,5 +452,6 @@ void mmu_flush_table()
 	lru_entry = nullptr;
 	flush_cache();
 	mmuAddressLUTFlush(true);
+	MMU_STAT(flushes);
 }
 #endif 	// FAST_MMU
@@ -29,6 +29,8 @@ and a fast-hack mode for 1mb sqremaps (for katana)
 
 #include "hw/mem/_vmem.h"
 
+#include <cinttypes>
+
 //#define TRACE_WINCE_SYSCALLS
 
 #ifdef TRACE_WINCE_SYSCALLS
@@ -535,8 +537,26 @@ void MMU_init()
 }
 
 
+#ifdef MMU_STATS
+MmuStats mmuStats;
+#endif
+
+void mmu_log_stats()
+{
+#ifdef MMU_STATS
+	const u64 lookups = mmuStats.lruHits + mmuStats.tableHits + mmuStats.tableMisses;
+	if (lookups != 0 || mmuStats.lutMisses != 0)
+		INFO_LOG(SH4, "MMU: %" PRIu64 " lookups: %.1f%% last entry, %.1f%% page table, %" PRIu64 " TLB searches, %" PRIu64 " WinCE, %" PRIu64 " TLB misses, "
+				"%" PRIu64 " dynarec LUT misses, %" PRIu64 " flushes",
+				lookups, lookups == 0 ? 0.0 : mmuStats.lruHits * 100.0 / lookups, lookups == 0 ? 0.0 : mmuStats.tableHits * 100.0 / lookups,
+				mmuStats.tableMisses, mmuStats.winceResolved, mmuStats.tlbMisses, mmuStats.lutMisses, mmuStats.flushes);
+	mmuStats = {};
+#endif
+}
+
 void MMU_reset()
 {
+	mmu_log_stats();
 	memset(UTLB, 0, sizeof(UTLB));
 	memset(ITLB, 0, sizeof(ITLB));
 	mmu_set_state();
@@ -545,6 +565,7 @@ void MMU_reset()
 
 void MMU_term()
 {
+	mmu_log_stats();
 }
 
 #ifndef FAST_MMU
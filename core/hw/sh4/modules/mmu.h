@@ -124,6 +124,44 @@ bool mmu_TranslateSQW(u32 adr, u32* out);
 // maps 4K virtual page number to physical address
 extern u32 mmuAddressLUT[0x100000];
 
+#ifdef FAST_MMU
+// Per-ASID two-level page tables caching the TLB entry of each 4 KB page.
+// A directory entry covers 4 MB and points to a leaf of the pool.
+// The x64 dynarec reads them to refill mmuAddressLUT.
+struct MmuPageLeaf
+{
+	u32 entries[1024];		// TLB cache index + 1, or 0 if not cached
+	u32 paddr[1024];		// physical page address, or 0 if not cached
+};
+struct MmuPageDirectory
+{
+	u32 generation;			// valid if equal to mmuTableGeneration
+	u16 leaves[1024];		// mmuLeafPool index, or 0 if not allocated
+};
+extern MmuPageDirectory mmuPageDirectories[256];
+extern MmuPageLeaf mmuLeafPool[512];
+extern u32 mmuTableGeneration;
+#endif
+
+#ifdef MMU_STATS
+// Address translation counters, logged and reset when the MMU is reset
+struct MmuStats
+{
+	u64 lruHits;		// last used TLB entry
+	u64 tableHits;		// per-ASID page tables
+	u64 tableMisses;	// full search of the TLB cache
+	u64 winceResolved;	// resolved from the WinCE page tables
+	u64 tlbMisses;		// TLB miss exceptions
+	u64 lutMisses;		// dynarec address LUT misses
+	u64 flushes;		// full TLB flushes
+};
+extern MmuStats mmuStats;
+#define MMU_STAT(counter) mmuStats.counter++
+#else
+#define MMU_STAT(counter)
+#endif
+void mmu_log_stats();
+
 static inline void mmuAddressLUTFlush(bool full) {
 	if (full)
 		memset(mmuAddressLUT, 0, sizeof(mmuAddressLUT) / 2);	// flush user memory
@@ -138,6 +176,7 @@ static inline u32 mmuDynarecLookup(u32 vaddr, u32 write, u32 pc)
 {
 	u32 paddr;
 	u32 rv;
+	MMU_STAT(lutMisses);
 	if (write)
 		rv = mmu_data_translation<MMU_TT_DWRITE, u32>(vaddr, paddr);
 	else
@@ -40,8 +40,13 @@ enum OpcodeType
 
 void ExecuteDelayslot();
 void ExecuteDelayslot_RTE();
+// Executes instructions until the pc is changed by a branch or an exception, or the time slice is over.
+// Used by the dynarec to run code that hasn't been compiled yet. Returns the number of instructions executed.
+u32 ExecuteUntilBranch();
 
 #define SH4_TIMESLICE 448	// at 112 Bangai-O doesn't start. 224 is ok
+// cycles counted by the interpreter for each instruction
+constexpr int CPU_RATIO = 8;
 
 int UpdateSystem();
 int UpdateSystem_INTC();
@@ -2,6 +2,7 @@
 #include "sh4_interrupts.h"
 #include "sh4_core.h"
 #include "sh4_sched.h"
+#include "sh4_sched_queue.h"
 
 //sh4 scheduler
 
@@ -22,44 +23,53 @@
 u64 sh4_sched_ffb;
 std::vector<sched_list> sch_list;
 int sh4_sched_next_id = -1;
+// pending events ordered by expiration time
+static SchedQueue sch_queue;
 
 static u32 sh4_sched_now();
 
-static u32 sh4_sched_remaining(const sched_list& sched, u32 reference)
+// 64-bit expiration time of a pending event
+static u64 sh4_sched_end64(const sched_list& sched, u64 now)
 {
-	if (sched.end != -1)
-		return sched.end - reference;
+	return now + (u32)(sched.end - (u32)now);
+}
+
+static void sh4_sched_update(int id)
+{
+	const sched_list& sched = sch_list[id];
+	if (sched.end == -1)
+		sch_queue.remove(id);
 	else
-		return -1;
+		sch_queue.set(id, sh4_sched_end64(sched, sh4_sched_now64()));
 }
 
 void sh4_sched_ffts()
 {
-	u32 diff = -1;
-	int slot = -1;
+	sh4_sched_ffb -= Sh4cntx.sh4_sched_next;
 
-	u32 now = sh4_sched_now();
-	for (const sched_list& sched : sch_list)
+	if (!sch_queue.empty())
 	{
-		u32 remaining = sh4_sched_remaining(sched, now);
-		if (remaining < diff)
-		{
-			slot = &sched - &sch_list[0];
-			diff = remaining;
-		}
+		sh4_sched_next_id = sch_queue.topId();
+		u64 now = sh4_sched_ffb;
+		Sh4cntx.sh4_sched_next = sch_queue.topEnd() > now ? (int)(sch_queue.topEnd() - now) : 0;
 	}
-
-	sh4_sched_ffb -= Sh4cntx.sh4_sched_next;
-
-	sh4_sched_next_id = slot;
-	if (slot != -1)
-		Sh4cntx.sh4_sched_next = diff;
 	else
+	{
+		sh4_sched_next_id = -1;
 		Sh4cntx.sh4_sched_next = SH4_MAIN_CLOCK;
+	}
 
 	sh4_sched_ffb += Sh4cntx.sh4_sched_next;
 }
 
+void sh4_sched_rebuild()
+{
+	sch_queue.clear();
+	for (u32 id = 0; id < sch_list.size(); id++)
+		if (sch_list[id].end != -1)
+			sh4_sched_update(id);
+}
+
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
 	sched_list t{ ssc, tag, -1, -1};
@@ -80,6 +90,7 @@ void sh4_sched_unregister(int id)
 	if (id == -1)
 		return;
 	verify(id < (int)sch_list.size());
+	sch_queue.remove(id);
 	if (id == (int)sch_list.size() - 1)
 		sch_list.resize(sch_list.size() - 1);
 	else
@@ -123,6 +134,7 @@ void sh4_sched_request(int id, int cycles)
 		if (sched.end == -1)
 			sched.end++;
 	}
+	sh4_sched_update(id);
 
 	sh4_sched_ffts();
 }
@@ -140,17 +152,19 @@ static int sh4_sched_elapsed(sched_list& sched)
 		return -1;
 }
 
-static void handle_cb(sched_list& sched)
+static void handle_cb(int id)
 {
+	sched_list& sched = sch_list[id];
 	int remain = sched.end - sched.start;
 	int elapsd = sh4_sched_elapsed(sched);
 	int jitter = elapsd - remain;
 
 	sched.end = -1;
+	sch_queue.remove(id);
 	int re_sch = sched.cb(sched.tag, remain, jitter);
 
 	if (re_sch > 0)
-		sh4_sched_request(&sched - &sch_list[0], std::max(0, re_sch - jitter));
+		sh4_sched_request(id, std::max(0, re_sch - jitter));
 }
 
 void sh4_sched_tick(int cycles)
@@ -158,16 +172,14 @@ void sh4_sched_tick(int cycles)
 	if (Sh4cntx.sh4_sched_next >= 0)
 		return;
 
-	u32 fztime = sh4_sched_now() - cycles;
 	if (sh4_sched_next_id != -1)
 	{
-		for (sched_list& sched : sch_list)
-		{
-			int remaining = sh4_sched_remaining(sched, fztime);
-			verify(remaining >= 0 || remaining == -1);
-			if (remaining >= 0 && remaining <= (int)cycles)
-				handle_cb(sched);
-		}
+		// Expired callbacks are called in id order. Callbacks may schedule other events
+		// that are already due: they are called in this loop if their id is higher.
+		u64 now = sh4_sched_now64();
+		int id = -1;
+		while ((id = sch_queue.firstDue(now, id)) != -1)
+			handle_cb(id);
 	}
 	sh4_sched_ffts();
 }
@@ -180,6 +192,7 @@ void sh4_sched_reset(bool hard)
 		sh4_sched_next_id = -1;
 		for (sched_list& sched : sch_list)
 			sched.start = sched.end = -1;
+		sch_queue.clear();
 		Sh4cntx.sh4_sched_next = 0;
 	}
 }
@@ -44,6 +44,11 @@ void sh4_sched_tick(int cycles);
 void sh4_sched_ffts();
 void sh4_sched_reset(bool hard);
 
+/*
+	Rebuild the pending event queue from sch_list after it has been restored from a savestate
+*/
+void sh4_sched_rebuild();
+
 struct sched_list
 {
 	sh4_sched_callback* cb;
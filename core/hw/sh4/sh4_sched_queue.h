@@ -0,0 +1,155 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+#include <vector>
+
+//
+// Indexed binary min-heap of pending scheduler events, ordered by (end time, id).
+// Ties are broken by id so that the selected event is the same as with a linear scan of the scheduler list.
+//
+class SchedQueue
+{
+	struct Event
+	{
+		u64 end;
+		int id;
+
+		bool operator<(const Event& other) const {
+			return end < other.end || (end == other.end && id < other.id);
+		}
+	};
+	std::vector<Event> heap;
+	std::vector<int> position;	// heap index of each id, or -1
+
+	void place(size_t i, const Event& event)
+	{
+		heap[i] = event;
+		position[event.id] = (int)i;
+	}
+
+	void siftUp(size_t i)
+	{
+		Event event = heap[i];
+		while (i > 0)
+		{
+			size_t parent = (i - 1) / 2;
+			if (!(event < heap[parent]))
+				break;
+			place(i, heap[parent]);
+			i = parent;
+		}
+		place(i, event);
+	}
+
+	void siftDown(size_t i)
+	{
+		Event event = heap[i];
+		for (;;)
+		{
+			size_t child = i * 2 + 1;
+			if (child >= heap.size())
+				break;
+			if (child + 1 < heap.size() && heap[child + 1] < heap[child])
+				child++;
+			if (!(heap[child] < event))
+				break;
+			place(i, heap[child]);
+			i = child;
+		}
+		place(i, event);
+	}
+
+	void firstDue(size_t i, u64 time, int afterId, int& bestId) const
+	{
+		if (i >= heap.size() || heap[i].end > time)
+			return;
+		if (heap[i].id > afterId && (bestId == -1 || heap[i].id < bestId))
+			bestId = heap[i].id;
+		firstDue(i * 2 + 1, time, afterId, bestId);
+		firstDue(i * 2 + 2, time, afterId, bestId);
+	}
+
+public:
+	// Inserts or reschedules an event
+	void set(int id, u64 end)
+	{
+		if (id >= (int)position.size())
+			position.resize(id + 1, -1);
+		int pos = position[id];
+		if (pos == -1)
+		{
+			heap.push_back({ end, id });
+			position[id] = (int)heap.size() - 1;
+			siftUp(heap.size() - 1);
+		}
+		else
+		{
+			u64 oldEnd = heap[pos].end;
+			heap[pos].end = end;
+			if (end < oldEnd)
+				siftUp(pos);
+			else
+				siftDown(pos);
+		}
+	}
+
+	void remove(int id)
+	{
+		if (id >= (int)position.size() || position[id] == -1)
+			return;
+		size_t pos = position[id];
+		position[id] = -1;
+		Event last = heap.back();
+		heap.pop_back();
+		if (pos < heap.size())
+		{
+			place(pos, last);
+			siftUp(pos);
+			siftDown(position[last.id]);
+		}
+	}
+
+	void clear()
+	{
+		heap.clear();
+		position.clear();
+	}
+
+	bool empty() const { return heap.empty(); }
+	size_t size() const { return heap.size(); }
+	int topId() const { return heap.front().id; }
+	u64 topEnd() const { return heap.front().end; }
+
+	bool contains(int id) const {
+		return id < (int)position.size() && position[id] != -1;
+	}
+	u64 end(int id) const {
+		return heap[position[id]].end;
+	}
+
+	// Returns the lowest id greater than afterId whose event is due at the given time, or -1.
+	// Only visits the due events.
+	int firstDue(u64 time, int afterId) const
+	{
+		int bestId = -1;
+		firstDue(0, time, afterId, bestId);
+		return bestId;
+	}
+};
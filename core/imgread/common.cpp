@@ -1,4 +1,5 @@
 #include "common.h"
+#include "sectorcache.h"
 #include "hw/gdrom/gdromv3.h"
 #include "cfg/option.h"
 #include "stdclass.h"
@@ -114,6 +115,7 @@ static bool loadDisk(const std::string& path)
 			MD5Sum().add(digest)
 					.getDigest(settings.network.md5.game);
 		INFO_LOG(GDROM, "gdrom: Opened image \"%s\"", path.c_str());
+		disc->cache = new SectorCache(disc);
 	}
 	else
 	{
@@ -172,6 +174,8 @@ bool DiscSwap(const std::string& path)
 
 void TermDrive()
 {
+	if (disc != nullptr)
+		delete disc->cache;
 	delete disc;
 	disc = NULL;
 }
@@ -207,6 +211,12 @@ void libGDR_ReadSector(u8 *buff, u32 startSector, u32 sectorCount, u32 sectorSiz
 		disc->ReadSectors(startSector, sectorCount, buff, sectorSize);
 }
 
+void libGDR_Prefetch(u32 startSector, u32 sectorCount)
+{
+	if (disc != nullptr && disc->cache != nullptr)
+		disc->cache->prefetch(startSector, sectorCount);
+}
+
 void libGDR_GetToc(u32* to, DiskArea area)
 {
 	if (!disc)
@@ -295,7 +305,12 @@ void Disc::ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt, LoadProgress *progr
 			progress->label = "Loading...";
 			progress->progress = (float)i / count;
 		}
-		if (ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
+		bool read;
+		if (cache != nullptr)
+			read = cache->read(FAD, temp, &secfmt, q_subchannel, &subfmt);
+		else
+			read = ReadSector(FAD, temp, &secfmt, q_subchannel, &subfmt);
+		if (read)
 		{
 			//TODO: Proper sector conversions
 			if (secfmt==SECFMT_2352)
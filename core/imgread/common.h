@@ -98,6 +98,8 @@ struct Track
 	}
 };
 
+class SectorCache;
+
 struct Disc
 {
 	std::vector<Session> sessions;	//info for sessions
@@ -105,6 +107,7 @@ struct Disc
 	Track LeadOut;				//info for lead out track (can't read from here)
 	u32 EndFAD;					//Last valid disc sector
 	DiscType type;
+	SectorCache *cache = nullptr;	//read-ahead cache used by ReadSectors, if any
 
 	bool ReadSector(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
 	{
@@ -221,6 +224,7 @@ DiscType GuessDiscType(bool m1, bool m2, bool da);
 
 //IO
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz);
+void libGDR_Prefetch(u32 StartSector, u32 SectorCount);
 void libGDR_ReadSubChannel(u8 * buff, u32 len);
 void libGDR_GetToc(u32 *toc, DiskArea area);
 u32 libGDR_GetDiscType();
@@ -0,0 +1,215 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "sectorcache.h"
+
+#include <chrono>
+#include <cinttypes>
+
+using Clock = std::chrono::steady_clock;
+
+static u64 elapsedMicros(Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+SectorCache::SectorCache(Disc *disc)
+	: disc(disc), sectors(new Sector[CacheChunks * ChunkSectors]),
+	  workerChunk(new Sector[ChunkSectors]), missChunk(new Sector[ChunkSectors])
+{
+	thread = std::thread(&SectorCache::threadMain, this);
+}
+
+SectorCache::~SectorCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		cond.notify_all();
+	}
+	thread.join();
+	const u64 reads = stats.hits + stats.misses;
+	if (reads != 0)
+		INFO_LOG(GDROM, "Sector cache: %" PRIu64 " sectors read, %.1f%% hits, %" PRIu64 " chunks prefetched, read time %" PRIu64 " ms, stall time %" PRIu64 " ms",
+				reads, stats.hits * 100.0 / reads, stats.prefetched, stats.readTime / 1000, stats.stallTime / 1000);
+}
+
+int SectorCache::findChunk(u32 fad) const
+{
+	for (u32 i = 0; i < CacheChunks; i++)
+		if (chunks[i].fad == fad)
+			return i;
+	return -1;
+}
+
+void SectorCache::insertChunk(u32 fad, const Sector *chunkSectors)
+{
+	u32 lru = 0;
+	for (u32 i = 1; i < CacheChunks; i++)
+		if (chunks[i].lastUse < chunks[lru].lastUse)
+			lru = i;
+	chunks[lru].fad = fad;
+	chunks[lru].lastUse = ++useCounter;
+	std::copy(chunkSectors, chunkSectors + ChunkSectors, &sectors[lru * ChunkSectors]);
+}
+
+// Must be called with discMutex held
+void SectorCache::readChunk(u32 fad, Sector *chunkSectors)
+{
+	Clock::time_point start = Clock::now();
+	for (u32 i = 0; i < ChunkSectors; i++)
+	{
+		Sector& sector = chunkSectors[i];
+		sector.valid = disc->ReadSector(fad + i, sector.data, &sector.format, sector.subcode, &sector.subcodeFormat);
+	}
+	u64 time = elapsedMicros(start);
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.readTime += time;
+}
+
+bool SectorCache::read(u32 fad, u8 *dst, SectorFormat *sectorFormat, u8 *subcode, SubcodeFormat *subcodeFormat)
+{
+	const u32 chunkFad = fad - fad % ChunkSectors;
+	std::unique_lock<std::mutex> lock(mutex);
+	int chunk = findChunk(chunkFad);
+	if (chunk >= 0)
+	{
+		stats.hits++;
+	}
+	else
+	{
+		lock.unlock();
+		Clock::time_point start = Clock::now();
+		{
+			std::lock_guard<std::mutex> discLock(discMutex);
+			lock.lock();
+			// may have been read by the background thread in the meantime
+			chunk = findChunk(chunkFad);
+			if (chunk < 0)
+			{
+				lock.unlock();
+				readChunk(chunkFad, missChunk.get());
+				lock.lock();
+				insertChunk(chunkFad, missChunk.get());
+				chunk = findChunk(chunkFad);
+			}
+		}
+		stats.misses++;
+		stats.stallTime += elapsedMicros(start);
+	}
+	chunks[chunk].lastUse = ++useCounter;
+	const Sector& sector = sectors[chunk * ChunkSectors + fad % ChunkSectors];
+	if (sector.valid)
+	{
+		memcpy(dst, sector.data, sizeof(sector.data));
+		*sectorFormat = sector.format;
+		*subcodeFormat = sector.subcodeFormat;
+		if (sector.subcodeFormat == SUBFMT_96)
+			memcpy(subcode, sector.subcode, sizeof(sector.subcode));
+	}
+	updateStreams(fad);
+
+	return sector.valid;
+}
+
+// Must be called with the mutex held
+void SectorCache::updateStreams(u32 fad)
+{
+	Stream *stream = nullptr;
+	for (Stream& s : streams)
+		if (fad + 1 >= s.next && fad < s.end)
+			stream = &s;
+	const bool sequential = fad == lastRead + 1;
+	lastRead = fad;
+	if (stream == nullptr)
+	{
+		if (!sequential)
+			return;
+		// Start a new stream
+		stream = streams[0].lastUse < streams[1].lastUse ? &streams[0] : &streams[1];
+		stream->end = fad + 1 + ReadAheadSectors;
+	}
+	stream->next = fad + 1;
+	stream->lastUse = ++useCounter;
+	cond.notify_all();
+}
+
+void SectorCache::prefetch(u32 fad, u32 count)
+{
+	if (count == 0)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	Stream *stream = streams[0].lastUse < streams[1].lastUse ? &streams[0] : &streams[1];
+	for (Stream& s : streams)
+		if (fad >= s.next && fad <= s.end)
+			stream = &s;
+	stream->next = fad;
+	stream->end = fad + count;
+	stream->lastUse = ++useCounter;
+	cond.notify_all();
+}
+
+// Must be called with the mutex held
+bool SectorCache::nextPrefetch(u32& fad) const
+{
+	// Most recently used stream first
+	const int first = streams[0].lastUse >= streams[1].lastUse ? 0 : 1;
+	for (int i = 0; i < 2; i++)
+	{
+		const Stream& stream = streams[first ^ i];
+		const u32 end = std::min(stream.end, stream.next + ReadAheadSectors);
+		for (u32 chunkFad = stream.next - stream.next % ChunkSectors; chunkFad < end; chunkFad += ChunkSectors)
+			if (findChunk(chunkFad) < 0)
+			{
+				fad = chunkFad;
+				return true;
+			}
+	}
+	return false;
+}
+
+void SectorCache::threadMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running)
+	{
+		u32 fad;
+		if (!nextPrefetch(fad))
+		{
+			cond.wait(lock);
+			continue;
+		}
+		lock.unlock();
+		std::lock_guard<std::mutex> discLock(discMutex);
+		lock.lock();
+		// may have been read by the emulation thread in the meantime
+		if (findChunk(fad) >= 0)
+			continue;
+		lock.unlock();
+		readChunk(fad, workerChunk.get());
+		lock.lock();
+		insertChunk(fad, workerChunk.get());
+		stats.prefetched++;
+	}
+}
+
+SectorCache::Stats SectorCache::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
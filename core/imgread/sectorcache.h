@@ -0,0 +1,102 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "common.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//
+// LRU cache of disc sectors filled in advance by a background thread.
+// Sectors are cached in chunks of consecutive FADs. Read-ahead follows up to two sequential streams
+// (typically data and CDDA), started by the GD-ROM read and play commands or by two consecutive sector reads.
+// Sectors are read from the disc by one thread at a time.
+//
+class SectorCache
+{
+public:
+	static constexpr u32 ChunkSectors = 16;
+	static constexpr u32 CacheChunks = 64;
+	// How far ahead of the last read sector each stream is prefetched
+	static constexpr u32 ReadAheadSectors = 8 * ChunkSectors;
+
+	struct Stats
+	{
+		u64 hits;			// sectors found in the cache
+		u64 misses;			// sectors read synchronously
+		u64 prefetched;		// chunks read by the background thread
+		u64 readTime;		// time spent reading and decompressing chunks, in microseconds
+		u64 stallTime;		// time spent by the emulation waiting for sectors, in microseconds
+	};
+
+	SectorCache(Disc *disc);
+	~SectorCache();
+
+	bool read(u32 fad, u8 *dst, SectorFormat *sectorFormat, u8 *subcode, SubcodeFormat *subcodeFormat);
+	// Hint that the sectors [fad, fad + count) are about to be read
+	void prefetch(u32 fad, u32 count);
+	Stats getStats();
+
+private:
+	struct Sector
+	{
+		u8 data[2448];
+		u8 subcode[96];
+		SectorFormat format;
+		SubcodeFormat subcodeFormat;
+		bool valid;
+	};
+	struct Chunk
+	{
+		u32 fad = ~0u;
+		u64 lastUse = 0;
+	};
+	struct Stream
+	{
+		u32 next = 0;
+		u32 end = 0;
+		u64 lastUse = 0;
+	};
+
+	int findChunk(u32 fad) const;
+	void insertChunk(u32 fad, const Sector *sectors);
+	void readChunk(u32 fad, Sector *sectors);
+	void updateStreams(u32 fad);
+	bool nextPrefetch(u32& fad) const;
+	void threadMain();
+
+	Disc *disc;
+	Chunk chunks[CacheChunks];
+	std::unique_ptr<Sector[]> sectors;
+	Stream streams[2];
+	u32 lastRead = ~0u;
+	u64 useCounter = 0;
+	Stats stats {};
+	// protects the cache, streams and stats
+	std::mutex mutex;
+	// serializes disc reads
+	std::mutex discMutex;
+	std::condition_variable cond;
+	bool running = true;
+	std::thread thread;
+	std::unique_ptr<Sector[]> workerChunk;
+	std::unique_ptr<Sector[]> missChunk;
+};
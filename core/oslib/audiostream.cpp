@@ -1,11 +1,36 @@
 #include "audiostream.h"
+#include "stdclass.h"
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <thread>
 
 struct SoundFrame { s16 l; s16 r; };
 
 static SoundFrame Buffer[SAMPLE_COUNT];
 static u32 writePtr;  // next sample index
 
+// The emulator thread (WriteSample) passes the samples through a lock-free ring buffer to the audio output thread,
+// which pushes them to the backend. So the backend latency and jitter don't stall the emulation.
+static RingBuffer ringBuffer;
+static u32 latencyTarget;	// in bytes
+static std::thread outputThread;
+static std::atomic<bool> outputRunning;
+static std::atomic<bool> outputBusy;
+static cResetEvent samplesWritten;
+static cResetEvent samplesRead;
+static std::atomic<u64> underruns;
+static std::atomic<u64> overruns;
+
+// Dynamic rate control
+constexpr float MaxRateDelta = 0.005f;
+static SoundFrame resampled[SAMPLE_COUNT * 2];
+static SoundFrame lastFrame;
+static int resamplePos;		// position of the next output frame relative to Buffer[0], 16.16 fixed point
+static float bufferLevel;	// smoothed ring buffer level, in bytes
+static u32 unthrottledBlocks;	// blocks pushed since the emulator was last throttled by the audio output
+static std::atomic<float> rateRatio { 1.f };
+
 static audiobackend_t *audiobackend_current = nullptr;
 static std::unique_ptr<std::vector<audiobackend_t *>> audiobackends;	// Using a pointer to avoid out of order init
 
@@ -77,6 +102,94 @@ audiobackend_t* GetAudioBackend(const std::string& slug)
 	return nullptr;
 }
 
+// Linear interpolation of the sample buffer. step is the number of input frames per output frame in 16.16 fixed point.
+static u32 resample(int step)
+{
+	u32 count = 0;
+	int pos = resamplePos;
+	for (; pos <= (int)(SAMPLE_COUNT - 1) << 16; pos += step)
+	{
+		const int i = pos >> 16;
+		const SoundFrame& a = i < 0 ? lastFrame : Buffer[i];
+		// 15 bits to avoid overflows
+		const int frac = (pos & 0xffff) >> 1;
+		if (frac == 0)
+		{
+			resampled[count++] = a;
+			continue;
+		}
+		const SoundFrame& b = Buffer[i + 1];
+		resampled[count].l = a.l + (((b.l - a.l) * frac) >> 15);
+		resampled[count].r = a.r + (((b.r - a.r) * frac) >> 15);
+		count++;
+	}
+	resamplePos = pos - (SAMPLE_COUNT << 16);
+	lastFrame = Buffer[SAMPLE_COUNT - 1];
+
+	return count;
+}
+
+static void pushBlock()
+{
+	const u32 level = ringBuffer.readSize();
+	bufferLevel += (level - bufferLevel) * 0.1f;
+	int step = 1 << 16;
+	// When the emulator is throttled by the audio output, the audio clock drives the emulation and there's no drift to absorb.
+	// Otherwise (vsync, or emulation too slow) resample slightly faster or slower to keep the buffer half full.
+	if (config::AudioDynamicRate && unthrottledBlocks >= 8)
+	{
+		const float halfTarget = latencyTarget / 2.f;
+		const float delta = std::min(1.f, std::max(-1.f, (halfTarget - bufferLevel) / halfTarget));
+		step = (int)std::lround(65536.f / (1.f + MaxRateDelta * delta));
+	}
+	rateRatio = 65536.f / step;
+	const u32 size = resample(step) * sizeof(SoundFrame);
+
+	unthrottledBlocks++;
+	if (config::LimitFPS)
+	{
+		// Wait until the buffer level is below the latency target, unless the backend is stuck
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(250);
+		while (ringBuffer.readSize() + size > latencyTarget && std::chrono::steady_clock::now() < deadline)
+		{
+			unthrottledBlocks = 0;
+			samplesRead.Wait(10);
+		}
+	}
+	if (ringBuffer.write((const u8 *)resampled, size))
+		samplesWritten.Set();
+	else if (config::LimitFPS)
+		// The backend hasn't consumed any sample before the deadline
+		overruns++;
+	// Otherwise the emulator runs faster than the output and the block is dropped on purpose
+}
+
+static void outputThreadMain()
+{
+	SoundFrame frames[SAMPLE_COUNT];
+	bool starving = true;	// don't count an underrun until the first samples are received
+	while (outputRunning)
+	{
+		outputBusy = true;
+		if (!ringBuffer.read((u8 *)frames, sizeof(frames)))
+		{
+			outputBusy = false;
+			// Give the emulator the duration of a block to catch up
+			if (!samplesWritten.Wait(SAMPLE_COUNT * 1000 / 44100) && !starving)
+			{
+				underruns++;
+				starving = true;
+			}
+			continue;
+		}
+		starving = false;
+		// Backends drop the samples instead of waiting when the frame rate isn't limited
+		audiobackend_current->push(frames, SAMPLE_COUNT, config::LimitFPS);
+		outputBusy = false;
+		samplesRead.Set();
+	}
+}
+
 void WriteSample(s16 r, s16 l)
 {
 	Buffer[writePtr].r = r * config::AudioVolume.dbPower();
@@ -85,11 +198,31 @@ void WriteSample(s16 r, s16 l)
 	if (++writePtr == SAMPLE_COUNT)
 	{
 		if (audiobackend_current != nullptr)
-			audiobackend_current->push(Buffer, SAMPLE_COUNT, config::LimitFPS);
+			pushBlock();
 		writePtr = 0;
 	}
 }
 
+void FlushAudio()
+{
+	if (!outputThread.joinable())
+		return;
+	// The ring buffer level must be checked first since the output thread is busy before reading it
+	while (ringBuffer.readSize() >= sizeof(Buffer) || outputBusy)
+		std::this_thread::yield();
+}
+
+AudioStats GetAudioStats()
+{
+	AudioStats stats;
+	stats.underruns = underruns;
+	stats.overruns = overruns;
+	stats.bufferedFrames = outputThread.joinable() ? ringBuffer.readSize() / sizeof(SoundFrame) : 0;
+	stats.rateRatio = rateRatio;
+
+	return stats;
+}
+
 void InitAudio()
 {
 	TermAudio();
@@ -105,6 +238,21 @@ void InitAudio()
 
 	INFO_LOG(AUDIO, "Initializing audio backend \"%s\" (%s)...", audiobackend_current->slug.c_str(), audiobackend_current->name.c_str());
 	audiobackend_current->init();
+
+	latencyTarget = std::min(std::max((u32)config::AudioLatencyTarget, SAMPLE_COUNT * 2), 16384u) * sizeof(SoundFrame);
+	// Room for a resampled block above the target
+	ringBuffer.setCapacity(latencyTarget + sizeof(resampled) + 1);
+	writePtr = 0;
+	resamplePos = 0;
+	lastFrame = {};
+	bufferLevel = 0.f;
+	unthrottledBlocks = 0;
+	rateRatio = 1.f;
+	underruns = 0;
+	overruns = 0;
+	outputRunning = true;
+	outputThread = std::thread(outputThreadMain);
+
 	if (audio_recording_started)
 	{
 		// Restart recording
@@ -120,6 +268,14 @@ void TermAudio()
 		bool rec_started = audio_recording_started;
 		StopAudioRecording();
 		audio_recording_started = rec_started;
+		if (outputThread.joinable())
+		{
+			outputRunning = false;
+			samplesWritten.Set();
+			outputThread.join();
+		}
+		if (underruns != 0 || overruns != 0)
+			INFO_LOG(AUDIO, "Audio buffer: %d underruns, %d overruns", (int)underruns, (int)overruns);
 		audiobackend_current->term();
 		INFO_LOG(AUDIO, "Terminating audio backend \"%s\" (%s)...", audiobackend_current->slug.c_str(), audiobackend_current->name.c_str());
 		audiobackend_current = nullptr;
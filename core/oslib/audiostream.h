@@ -46,6 +46,17 @@ bool RegisterAudioBackend(audiobackend_t* backend);
 void InitAudio();
 void TermAudio();
 void WriteSample(s16 right, s16 left);
+// Wait until all the buffered samples have been pushed to the audio backend
+void FlushAudio();
+
+struct AudioStats
+{
+	u64 underruns;		// times the audio output ran out of samples
+	u64 overruns;		// sample blocks dropped because the buffer was full
+	u32 bufferedFrames;
+	float rateRatio;	// dynamic rate control: output samples per emulated sample
+};
+AudioStats GetAudioStats();
 
 void StartAudioRecording(bool eight_khz);
 u32 RecordAudio(void *buffer, u32 samples);
@@ -63,6 +74,7 @@ class RingBuffer
 	std::atomic_int readCursor { 0 };
 	std::atomic_int writeCursor { 0 };
 
+public:
 	u32 readSize() {
 		return (u32)((writeCursor - readCursor + buffer.size()) % buffer.size());
 	}
@@ -70,7 +82,6 @@ class RingBuffer
 		return (u32)((readCursor - writeCursor + buffer.size() - 1) % buffer.size());
 	}
 
-public:
 	bool write(const u8 *data, u32 size)
 	{
 		if (size > writeSize())
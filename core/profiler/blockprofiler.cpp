@@ -0,0 +1,253 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "blockprofiler.h"
+#include "cfg/option.h"
+#include "emulator.h"
+#include "stdclass.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+#if FEAT_SHREC != DYNAREC_NONE
+#include "hw/sh4/dyna/blockmanager.h"
+
+#include <chrono>
+#include <unordered_map>
+#if HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+bool prof_blockEnabled;
+
+namespace
+{
+
+std::unordered_map<u64, ProfBlockStats> retiredBlocks;
+RuntimeBlockInfo *currentBlock;
+u64 lastTicks;
+u64 startTicks;
+std::chrono::steady_clock::time_point startTime;
+
+inline u64 getTicks()
+{
+#if HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+u64 makeKey(const RuntimeBlockInfo *block) {
+	return ((u64)block->addr << 32) | block->vaddr;
+}
+
+void addStats(std::unordered_map<u64, ProfBlockStats>& map, const RuntimeBlockInfo *block)
+{
+	ProfBlockStats& stats = map[makeKey(block)];
+	stats.vaddr = block->vaddr;
+	stats.addr = block->addr;
+	stats.runs += block->prof_runs;
+	stats.guest_cycles += block->prof_runs * block->guest_cycles;
+	stats.ticks += block->prof_ticks;
+	stats.host_code_size = block->host_code_size;
+	stats.guest_opcodes = block->guest_opcodes;
+	stats.compiles++;
+}
+
+void reset()
+{
+	retiredBlocks.clear();
+	currentBlock = nullptr;
+	startTicks = lastTicks = getTicks();
+	startTime = std::chrono::steady_clock::now();
+}
+
+void eventCallback(Event event, void *)
+{
+	switch (event)
+	{
+	case Event::Start:
+		prof_blockEnabled = config::DynarecProfiler;
+		reset();
+		break;
+	case Event::Pause:
+		if (prof_blockEnabled)
+			prof_blockDump();
+		break;
+	case Event::Terminate:
+		if (prof_blockEnabled)
+			prof_blockDump();
+		prof_blockEnabled = false;
+		reset();
+		break;
+	default:
+		break;
+	}
+}
+
+}
+
+void prof_blockInit()
+{
+	EventManager::listen(Event::Start, eventCallback);
+	EventManager::listen(Event::Pause, eventCallback);
+	EventManager::listen(Event::Terminate, eventCallback);
+}
+
+void prof_blockTerm()
+{
+	EventManager::unlisten(Event::Start, eventCallback);
+	EventManager::unlisten(Event::Pause, eventCallback);
+	EventManager::unlisten(Event::Terminate, eventCallback);
+	prof_blockEnabled = false;
+	reset();
+}
+
+void DYNACALL prof_blockEnter(RuntimeBlockInfo *block)
+{
+	u64 now = getTicks();
+	if (currentBlock != nullptr)
+		currentBlock->prof_ticks += now - lastTicks;
+	currentBlock = block;
+	block->prof_runs++;
+	lastTicks = now;
+}
+
+void prof_blockRetire(RuntimeBlockInfo *block)
+{
+	if (block == currentBlock)
+	{
+		u64 now = getTicks();
+		block->prof_ticks += now - lastTicks;
+		lastTicks = now;
+		currentBlock = nullptr;
+	}
+	if (block->prof_runs != 0)
+		addStats(retiredBlocks, block);
+}
+
+void prof_blockDump()
+{
+	std::unordered_map<u64, ProfBlockStats> allBlocks = retiredBlocks;
+	bm_ForEachBlock([&allBlocks](const RuntimeBlockInfo *block) {
+		if (block->prof_runs != 0)
+			addStats(allBlocks, block);
+	});
+	std::vector<ProfBlockStats> blocks;
+	blocks.reserve(allBlocks.size());
+	u64 totalTicks = 0;
+	for (const auto& pair : allBlocks)
+	{
+		blocks.push_back(pair.second);
+		totalTicks += pair.second.ticks;
+	}
+	prof_blockSort(blocks);
+	double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+	u64 elapsedTicks = getTicks() - startTicks;
+	double nsPerTick = elapsedTicks == 0 ? 0.0 : elapsedNs / elapsedTicks;
+
+	std::string path = get_writable_data_path("sh4_profile.csv");
+	FILE *f = nowide::fopen(path.c_str(), "w");
+	if (f != nullptr)
+	{
+		prof_blockWriteCsv(f, blocks, nsPerTick);
+		fclose(f);
+	}
+	path = get_writable_data_path("sh4_profile.folded");
+	f = nowide::fopen(path.c_str(), "w");
+	if (f != nullptr)
+	{
+		prof_blockWriteFolded(f, blocks);
+		fclose(f);
+	}
+#ifdef __linux__
+	path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+	f = fopen(path.c_str(), "w");
+	if (f != nullptr)
+	{
+		sh4_jitsym(f);
+		fclose(f);
+	}
+#endif
+
+	INFO_LOG(DYNAREC, "Block profile: %d blocks, %.0f ms in blocks, %.0f ms elapsed", (int)blocks.size(),
+			totalTicks * nsPerTick / 1000000.0, elapsedNs / 1000000.0);
+	for (size_t i = 0; i < blocks.size() && i < 20; i++)
+	{
+		const ProfBlockStats& stats = blocks[i];
+		INFO_LOG(DYNAREC, "Block %08X: %5.2f%% runs %" PRIu64 " cycles %" PRIu64 " host %u bytes / %u ops",
+				stats.vaddr, totalTicks == 0 ? 0.0 : stats.ticks * 100.0 / totalTicks, stats.runs, stats.guest_cycles,
+				stats.host_code_size, stats.guest_opcodes);
+	}
+}
+
+#else
+
+bool prof_blockEnabled;
+void prof_blockInit() { }
+void prof_blockTerm() { }
+void DYNACALL prof_blockEnter(RuntimeBlockInfo *block) { }
+void prof_blockRetire(RuntimeBlockInfo *block) { }
+void prof_blockDump() { }
+
+#endif // FEAT_SHREC != DYNAREC_NONE
+
+static const char *getArea(u32 addr)
+{
+	switch ((addr >> 26) & 7)
+	{
+	case 0:
+		return "rom";
+	case 3:
+		return "ram";
+	default:
+		return "other";
+	}
+}
+
+void prof_blockSort(std::vector<ProfBlockStats>& blocks)
+{
+	std::sort(blocks.begin(), blocks.end(), [](const ProfBlockStats& a, const ProfBlockStats& b) {
+		return a.ticks > b.ticks || (a.ticks == b.ticks && a.vaddr < b.vaddr);
+	});
+}
+
+void prof_blockWriteCsv(FILE *f, const std::vector<ProfBlockStats>& blocks, double nsPerTick)
+{
+	fprintf(f, "vaddr,addr,runs,guest_cycles,host_ns,ns_per_run,host_bytes,guest_opcodes,host_bytes_per_opcode,compiles\n");
+	for (const ProfBlockStats& stats : blocks)
+		fprintf(f, "%08X,%08X,%" PRIu64 ",%" PRIu64 ",%.0f,%.1f,%u,%u,%.1f,%u\n", stats.vaddr, stats.addr, stats.runs, stats.guest_cycles,
+				stats.ticks * nsPerTick, stats.runs == 0 ? 0.0 : stats.ticks * nsPerTick / stats.runs, stats.host_code_size, stats.guest_opcodes,
+				stats.guest_opcodes == 0 ? 0.0 : (double)stats.host_code_size / stats.guest_opcodes, stats.compiles);
+}
+
+// Folded stacks for flamegraph.pl
+void prof_blockWriteFolded(FILE *f, const std::vector<ProfBlockStats>& blocks)
+{
+	for (const ProfBlockStats& stats : blocks)
+		if (stats.ticks != 0)
+			fprintf(f, "sh4;%s;sh4_%08X %" PRIu64 "\n", getArea(stats.addr), stats.vaddr, stats.ticks);
+}
@@ -0,0 +1,64 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+#include <cstdio>
+#include <vector>
+
+struct RuntimeBlockInfo;
+
+//
+// Instrumented dynarec block profiler.
+// When enabled (Dynarec.Profiler), each compiled block calls prof_blockEnter() on entry, which
+// counts the block runs and attributes the host time elapsed since the previous block entry to
+// the previous block. This includes the time spent in memory handlers, interpreter fallbacks and
+// the scheduler called from that block.
+// The profile is written when the emulator is paused or stopped:
+// - sh4_profile.csv: per-block runs, guest cycles, host time and code size
+// - sh4_profile.folded: folded stacks for flamegraph.pl, weighted by host time
+// - /tmp/perf-<pid>.map on linux, so that perf can symbolize the generated code
+//
+extern bool prof_blockEnabled;
+
+struct ProfBlockStats
+{
+	u32 vaddr;
+	u32 addr;
+	u64 runs;
+	u64 guest_cycles;
+	u64 ticks;
+	u32 host_code_size;
+	u32 guest_opcodes;
+	u32 compiles;
+};
+
+void prof_blockInit();
+void prof_blockTerm();
+
+// Called by the generated code on block entry
+void DYNACALL prof_blockEnter(RuntimeBlockInfo *block);
+// Saves the counters of a block that is about to be deleted
+void prof_blockRetire(RuntimeBlockInfo *block);
+void prof_blockDump();
+
+// Sorts the blocks by decreasing host time, then by address
+void prof_blockSort(std::vector<ProfBlockStats>& blocks);
+void prof_blockWriteCsv(FILE *f, const std::vector<ProfBlockStats>& blocks, double nsPerTick);
+void prof_blockWriteFolded(FILE *f, const std::vector<ProfBlockStats>& blocks);
@@ -20,6 +20,7 @@ using namespace Xbyak::util;
 #include "x64_regalloc.h"
 #include "xbyak_base.h"
 #include "oslib/oslib.h"
+#include "profiler/blockprofiler.h"
 
 struct DynaRBI : RuntimeBlockInfo
 {
@@ -96,6 +97,10 @@ static void ngen_blockcheckfail(u32 pc) {
 	rdv_BlockCheckFail(pc);
 }
 
+static void ngen_promoteblock(u32 pc) {
+	rdv_PromoteBlock(pc);
+}
+
 static void handle_sh4_exception(SH4ThrownException& ex, u32 pc)
 {
 	if (pc & 1)
@@ -163,8 +168,26 @@ public:
 
 		CheckBlock(force_checks, block);
 
+		if (staging)
+		{
+			// Count the runs of the block. The main loop runs the trace replacing it once it's hot.
+			Xbyak::Label notHot;
+			mov(rax, (uintptr_t)&block->staging_runs);
+			dec(dword[rax]);
+			jnz(notHot);
+			mov(call_regs[0], block->addr);
+			jmp(reinterpret_cast<const void*>(CC_RX2RW(&ngen_promoteblock)));
+			L(notHot);
+		}
+
 		sub(rsp, STACK_ALIGN);
 
+		if (prof_blockEnabled)
+		{
+			mov(call_regs64[0], (uintptr_t)block);
+			GenCall(prof_blockEnter);
+		}
+
 		if (mmu_enabled() && block->has_fpu_op)
 		{
 			Xbyak::Label fpu_enabled;
@@ -796,7 +819,41 @@ private:
 				mov(eax, dword[(uintptr_t)mmuAddressLUT + rax * 4]);
 			}
 			test(eax, eax);
-			jne(inCache);
+			jne(inCache, T_NEAR);
+#ifdef FAST_MMU
+			// Refill the LUT from the page table of the current ASID
+			Xbyak::Label slowPath;
+			mov(r10, (uintptr_t)&CCN_PTEH.reg_data);
+			movzx(r10d, byte[r10]);		// ASID
+			imul(r10d, r10d, sizeof(MmuPageDirectory));
+			mov(r11, (uintptr_t)&mmuPageDirectories[0]);
+			add(r10, r11);
+			mov(r11, (uintptr_t)&mmuTableGeneration);
+			mov(r11d, dword[r11]);
+			cmp(r11d, dword[r10 + offsetof(MmuPageDirectory, generation)]);
+			jne(slowPath, T_NEAR);
+			mov(eax, call_regs[0]);
+			shr(eax, 22);
+			movzx(eax, word[r10 + rax * 2 + offsetof(MmuPageDirectory, leaves)]);
+			test(eax, eax);
+			je(slowPath, T_NEAR);
+			static_assert(sizeof(MmuPageLeaf) == 1 << 13, "MmuPageLeaf size");
+			shl(rax, 13);
+			mov(r11, (uintptr_t)&mmuLeafPool[0].paddr[0]);
+			add(rax, r11);
+			mov(r10d, call_regs[0]);
+			shr(r10d, 12);
+			and_(r10d, 1023);
+			mov(eax, dword[rax + r10 * 4]);
+			test(eax, eax);
+			je(slowPath, T_NEAR);
+			mov(r10d, call_regs[0]);
+			shr(r10d, 12);
+			mov(r11, (uintptr_t)mmuAddressLUT);
+			mov(dword[r11 + r10 * 4], eax);
+			jmp(inCache, T_NEAR);
+			L(slowPath);
+#endif
 			mov(call_regs[1], write);
 			mov(call_regs[2], block->vaddr + op.guest_offs - (op.delay_slot ? 2 : 0));	// pc
 			GenCall(mmuDynarecLookup);
@@ -1074,14 +1131,34 @@ private:
 		if (!force_checks)
 			return;
 
+		Xbyak::Label codeUnchanged;
+		u32 gateInstrs = 0;
+		if (block->gated_checks)
+		{
+			// Only check the code if one of its pages has been written to since it was protected
+			Xbyak::Label checkCode;
+			for (u32 addr = block->addr & ~PAGE_MASK; addr < block->addr + block->sh4_code_size; addr += PAGE_SIZE)
+			{
+				mov(rax, (uintptr_t)bm_RamPageUnprotectedFlag(addr));
+				cmp(byte[rax], 0);
+				jne(checkCode);
+				gateInstrs += 3;
+			}
+			jmp(codeUnchanged, T_NEAR);
+			gateInstrs++;
+			L(checkCode);
+		}
+
 		s32 sz=block->sh4_code_size;
 		u32 sa=block->addr;
+		u32 checkInstrs = 0;
 
 		void* ptr = (void*)GetMemPtr(sa, sz > 8 ? 8 : sz);
 		if (ptr)
 		{
 			while (sz > 0)
 			{
+				checkInstrs += 4;
 				uintptr_t uintptr = reinterpret_cast<uintptr_t>(ptr);
 				mov(rax, uintptr);
 
@@ -1107,6 +1184,13 @@ private:
 				ptr = (void*)GetMemPtr(sa, sz > 8 ? 8 : sz);
 			}
 		}
+		smcStats.checkInstrs += checkInstrs;
+		if (block->gated_checks)
+		{
+			L(codeUnchanged);
+			smcStats.gateInstrs += gateInstrs;
+			smcStats.gatedCheckInstrs += checkInstrs;
+		}
 	}
 
 	void genMemHandlers()
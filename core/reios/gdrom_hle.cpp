@@ -379,6 +379,7 @@ static void GD_HLE_Command(u32 cc)
 			gd_hle_state.multi_read_count = num * 2048;
 			gd_hle_state.multi_read_total = gd_hle_state.multi_read_count;
 			gd_hle_state.multi_read_offset = 0;
+			libGDR_Prefetch(sector, num);
 			gd_hle_state.result[2] = 2048;
 			gd_hle_state.result[3] = num > 0 ? 1 : 0;
 		}
@@ -509,6 +510,7 @@ static void GD_HLE_Command(u32 cc)
 			gd_hle_state.multi_read_count = num * 2048;
 			gd_hle_state.multi_read_total = gd_hle_state.multi_read_count;
 			gd_hle_state.multi_read_offset = 0;
+			libGDR_Prefetch(sector, num);
 
 			// wild guesses here
 			gd_hle_state.result[2] = 0;
@@ -1,5 +1,6 @@
 #include "TexCache.h"
 #include "CustomTexture.h"
+#include "TexPrefetch.h"
 #include "deps/xbrz/xbrz.h"
 #include "hw/pvr/pvr_mem.h"
 #include "hw/mem/_vmem.h"
@@ -13,7 +14,7 @@
 #include <omp.h>
 #endif
 
-u8* vq_codebook;
+thread_local u8* vq_codebook;
 u32 palette_index;
 bool KillTex=false;
 u32 palette16_ram[1024];
@@ -247,6 +248,18 @@ void libCore_vramlock_Lock(u32 start_offset64, u32 end_offset64, BaseTextureCach
 	}
 }
 
+// true if a texture is currently locking this exact vram range, meaning its data is already decoded and up to date
+bool libCore_vramlock_IsLocked(u32 start_offset, u32 end_offset)
+{
+	if (end_offset >= VRAM_SIZE)
+		return false;
+	std::lock_guard<std::mutex> lock(vramlist_lock);
+	for (vram_block *block : VramLocks[start_offset / PAGE_SIZE])
+		if (block != nullptr && block->start == start_offset && block->end == end_offset)
+			return true;
+	return false;
+}
+
 bool VramLockedWriteOffset(size_t offset)
 {
 	if (offset >= VRAM_SIZE)
@@ -320,6 +333,30 @@ void parallelize(Func func, int start, int end)
 }
 #endif
 
+template<typename Pixel>
+void ConvertTexture(TexConv<Pixel> texconv, PixelBuffer<Pixel>& pb, u8 *p_in, u32 width, u32 height)
+{
+#ifndef TARGET_NO_OPENMP
+	// Bands are multiple of 8 rows so they start on a twiddled block boundary
+	const u32 bands = height / 8;
+	if (width * height >= 256 * 256 && bands >= 2 && getThreadCount() > 1)
+	{
+		u8 *codebook = vq_codebook;
+		parallelize([=, &pb](int start, int end) {
+			vq_codebook = codebook;
+			PixelBuffer<Pixel> band;
+			band.alias(pb);
+			texconv(&band, p_in, width, height, start * 8, (u32)end == bands ? height : end * 8);
+		}, 0, bands);
+		return;
+	}
+#endif
+	texconv(&pb, p_in, width, height, 0, height);
+}
+template void ConvertTexture<u8>(TexConv<u8> texconv, PixelBuffer<u8>& pb, u8 *p_in, u32 width, u32 height);
+template void ConvertTexture<u16>(TexConv<u16> texconv, PixelBuffer<u16>& pb, u8 *p_in, u32 width, u32 height);
+template void ConvertTexture<u32>(TexConv<u32> texconv, PixelBuffer<u32>& pb, u8 *p_in, u32 width, u32 height);
+
 static struct xbrz::ScalerCfg xbrz_cfg;
 
 void UpscalexBRZ(int factor, u32* source, u32* dest, int width, int height, bool has_alpha)
@@ -474,6 +511,7 @@ void BaseTextureCacheData::Create()
 
 	//decode info from tsp/tcw into the texture struct
 	tex = &pvrTexInfo[tcw.PixelFmt == PixelReserved ? Pixel1555 : tcw.PixelFmt];	//texture format table entry
+	tex_type = tex->type;
 
 	sa_tex = (tcw.TexAddr << 3) & VRAM_MASK;	//texture start address
 	sa = sa_tex;								//data texture start address (modified for MIPs, as needed)
@@ -561,6 +599,14 @@ void BaseTextureCacheData::ComputeHash()
 	texture_hash ^= tcw.full & tcwMask;
 }
 
+u32 BaseTextureCacheData::GetStride()
+{
+	if (tcw.StrideSel && tcw.ScanOrder && (tex->PL || tex->PL32))
+		return (TEXT_CONTROL & 31) * 32;
+	else
+		return width;
+}
+
 void BaseTextureCacheData::Update()
 {
 	//texture state tracking stuff
@@ -602,10 +648,7 @@ void BaseTextureCacheData::Update()
 		::vq_codebook = &vram[sa_tex];    // might be used if VQ tex
 
 	//texture conversion work
-	u32 stride = width;
-
-	if (tcw.StrideSel && tcw.ScanOrder && (tex->PL || tex->PL32))
-		stride = (TEXT_CONTROL & 31) * 32;
+	u32 stride = GetStride();
 
 	u32 original_h = height;
 	if (sa_tex > VRAM_SIZE || size == 0 || sa + size > VRAM_SIZE)
@@ -626,18 +669,42 @@ void BaseTextureCacheData::Update()
 	if (config::CustomTextures)
 		custom_texture.LoadCustomTextureAsync(this);
 
-	void *temp_tex_buffer = NULL;
-	u32 upscaled_w = width;
-	u32 upscaled_h = height;
+	std::unique_ptr<DecodedTexture> decoded = texture_prefetcher.Take(this, stride);
+	if (decoded == nullptr)
+	{
+		decoded = std::unique_ptr<DecodedTexture>(new DecodedTexture());
+		Decode(*decoded, stride, has_alpha, TextureDecodeParams::current());
+	}
+	tex_type = decoded->tex_type;
+	// Restore the original texture height if it was constrained to VRAM limits above
+	height = original_h;
 
-	PixelBuffer<u16> pb16;
-	PixelBuffer<u32> pb32;
-	PixelBuffer<u8> pb8;
+	//lock the texture to detect changes in it
+	libCore_vramlock_Lock(sa_tex, sa + size - 1, this);
+
+	UploadToGPU(decoded->width, decoded->height, decoded->data, IsMipmapped(), decoded->mipmapped);
+	if (config::DumpTextures)
+	{
+		ComputeHash();
+		custom_texture.DumpTexture(texture_hash, decoded->width, decoded->height, tex_type, decoded->data);
+		NOTICE_LOG(RENDERER, "Dumped texture %x.png. Old hash %x", texture_hash, old_texture_hash);
+	}
+	PrintTextureName();
+}
+
+void BaseTextureCacheData::Decode(DecodedTexture& decoded, u32 stride, bool has_alpha, const TextureDecodeParams& params)
+{
+	PixelBuffer<u16>& pb16 = decoded.pb16;
+	PixelBuffer<u32>& pb32 = decoded.pb32;
+	PixelBuffer<u8>& pb8 = decoded.pb8;
+	decoded.width = width;
+	decoded.height = height;
+	decoded.tex_type = tex_type;
 
 	// Figure out if we really need to use a 32-bit pixel buffer
-	bool textureUpscaling = config::TextureUpscale > 1
+	bool textureUpscaling = params.upscale > 1
 			// Don't process textures that are too big
-			&& (int)(width * height) <= config::MaxFilteredTextureSize * config::MaxFilteredTextureSize
+			&& (int)(width * height) <= params.maxFilteredSize * params.maxFilteredSize
 			// Don't process YUV textures
 			&& tcw.PixelFmt != PixelYUV;
 	bool need_32bit_buffer = true;
@@ -648,7 +715,7 @@ void BaseTextureCacheData::Update()
 		need_32bit_buffer = false;
 	// TODO avoid upscaling/depost. textures that change too often
 
-	bool mipmapped = IsMipmapped() && !config::DumpTextures;
+	bool mipmapped = tcw.MipMapped != 0 && tcw.ScanOrder == 0 && params.mipmaps;
 
 	if (texconv32 != NULL && need_32bit_buffer)
 	{
@@ -656,7 +723,7 @@ void BaseTextureCacheData::Update()
 			// don't use mipmaps if upscaling
 			mipmapped = false;
 		// Force the texture type since that's the only 32-bit one we know
-		tex_type = TextureType::_8888;
+		decoded.tex_type = TextureType::_8888;
 
 		if (mipmapped)
 		{
@@ -672,7 +739,7 @@ void BaseTextureCacheData::Update()
 					{
 						PixelBuffer<u32> pb0;
 						pb0.init(2, 2 ,false);
-						texconv32(&pb0, (u8*)&vram[vram_addr], 2, 2);
+						ConvertTexture(texconv32, pb0, (u8*)&vram[vram_addr], 2, 2);
 						*pb32.data() = *pb0.data(1, 1);
 						continue;
 					}
@@ -681,33 +748,33 @@ void BaseTextureCacheData::Update()
 					vram_addr = sa_tex + OtherMipPoint[i] * tex->bpp / 8;
 				if (tcw.PixelFmt == PixelYUV && i == 0)
 					// Special case for YUV at 1x1 LoD
-					pvrTexInfo[Pixel565].TW32(&pb32, &vram[vram_addr], 1, 1);
+					ConvertTexture(pvrTexInfo[Pixel565].TW32, pb32, &vram[vram_addr], 1, 1);
 				else
-					texconv32(&pb32, &vram[vram_addr], 1 << i, 1 << i);
+					ConvertTexture(texconv32, pb32, &vram[vram_addr], 1 << i, 1 << i);
 			}
 			pb32.set_mipmap(0);
 		}
 		else
 		{
 			pb32.init(width, height);
-			texconv32(&pb32, (u8*)&vram[sa], stride, height);
+			ConvertTexture(texconv32, pb32, (u8*)&vram[sa], stride, height);
 
 			// xBRZ scaling
 			if (textureUpscaling)
 			{
 				PixelBuffer<u32> tmp_buf;
-				tmp_buf.init(width * config::TextureUpscale, height * config::TextureUpscale);
+				tmp_buf.init(width * params.upscale, height * params.upscale);
 
 				if (tcw.PixelFmt == Pixel1555 || tcw.PixelFmt == Pixel4444)
 					// Alpha channel formats. Palettes with alpha are already handled
 					has_alpha = true;
-				UpscalexBRZ(config::TextureUpscale, pb32.data(), tmp_buf.data(), width, height, has_alpha);
+				UpscalexBRZ(params.upscale, pb32.data(), tmp_buf.data(), width, height, has_alpha);
 				pb32.steal_data(tmp_buf);
-				upscaled_w *= config::TextureUpscale;
-				upscaled_h *= config::TextureUpscale;
+				decoded.width *= params.upscale;
+				decoded.height *= params.upscale;
 			}
 		}
-		temp_tex_buffer = pb32.data();
+		decoded.data = (u8 *)pb32.data();
 	}
 	else if (texconv8 != NULL && tex_type == TextureType::_8)
 	{
@@ -719,16 +786,16 @@ void BaseTextureCacheData::Update()
 			{
 				pb8.set_mipmap(i);
 				u32 vram_addr = sa_tex + OtherMipPoint[i] * tex->bpp / 8;
-				texconv8(&pb8, &vram[vram_addr], 1 << i, 1 << i);
+				ConvertTexture(texconv8, pb8, &vram[vram_addr], 1 << i, 1 << i);
 			}
 			pb8.set_mipmap(0);
 		}
 		else
 		{
 			pb8.init(width, height);
-			texconv8(&pb8, &vram[sa], stride, height);
+			ConvertTexture(texconv8, pb8, &vram[sa], stride, height);
 		}
-		temp_tex_buffer = pb8.data();
+		decoded.data = (u8 *)pb8.data();
 	}
 	else if (texconv != NULL)
 	{
@@ -746,23 +813,23 @@ void BaseTextureCacheData::Update()
 					{
 						PixelBuffer<u16> pb0;
 						pb0.init(2, 2 ,false);
-						texconv(&pb0, (u8*)&vram[vram_addr], 2, 2);
+						ConvertTexture(texconv, pb0, (u8*)&vram[vram_addr], 2, 2);
 						*pb16.data() = *pb0.data(1, 1);
 						continue;
 					}
 				}
 				else
 					vram_addr = sa_tex + OtherMipPoint[i] * tex->bpp / 8;
-				texconv(&pb16, (u8*)&vram[vram_addr], 1 << i, 1 << i);
+				ConvertTexture(texconv, pb16, (u8*)&vram[vram_addr], 1 << i, 1 << i);
 			}
 			pb16.set_mipmap(0);
 		}
 		else
 		{
 			pb16.init(width, height);
-			texconv(&pb16,(u8*)&vram[sa],stride,height);
+			ConvertTexture(texconv, pb16, (u8*)&vram[sa], stride, height);
 		}
-		temp_tex_buffer = pb16.data();
+		decoded.data = (u8 *)pb16.data();
 	}
 	else
 	{
@@ -770,23 +837,10 @@ void BaseTextureCacheData::Update()
 		WARN_LOG(RENDERER, "UNHANDLED TEXTURE");
 		pb16.init(width, height);
 		memset(pb16.data(), 0x80, width * height * 2);
-		temp_tex_buffer = pb16.data();
+		decoded.data = (u8 *)pb16.data();
 		mipmapped = false;
 	}
-	// Restore the original texture height if it was constrained to VRAM limits above
-	height = original_h;
-
-	//lock the texture to detect changes in it
-	libCore_vramlock_Lock(sa_tex, sa + size - 1, this);
-
-	UploadToGPU(upscaled_w, upscaled_h, (u8*)temp_tex_buffer, IsMipmapped(), mipmapped);
-	if (config::DumpTextures)
-	{
-		ComputeHash();
-		custom_texture.DumpTexture(texture_hash, upscaled_w, upscaled_h, tex_type, temp_tex_buffer);
-		NOTICE_LOG(RENDERER, "Dumped texture %x.png. Old hash %x", texture_hash, old_texture_hash);
-	}
-	PrintTextureName();
+	decoded.mipmapped = mipmapped;
 }
 
 void BaseTextureCacheData::CheckCustomTexture()
@@ -2,6 +2,7 @@
 #include "oslib/oslib.h"
 #include "hw/pvr/Renderer_if.h"
 #include "cfg/option.h"
+#include "TexConvSimd.h"
 
 #include <algorithm>
 #include <array>
@@ -9,7 +10,7 @@
 #include <memory>
 #include <unordered_map>
 
-extern u8* vq_codebook;
+extern thread_local u8* vq_codebook;
 extern u32 palette_index;
 extern u32 palette16_ram[1024];
 extern u32 palette32_ram[1024];
@@ -91,11 +92,26 @@ public:
 		pixels_per_line = 1 << level;
 	}
 
+	// Makes this buffer an alias of the current mipmap of another buffer, with its own cursor.
+	// The pixel data isn't owned by this buffer.
+	void alias(const PixelBuffer &buffer)
+	{
+		deinit();
+		p_current_mipmap = p_current_line = p_current_pixel = buffer.p_current_mipmap;
+		pixels_per_line = buffer.pixels_per_line;
+	}
+
 	__forceinline pixel_type *data(u32 x = 0, u32 y = 0)
 	{
 		return p_current_mipmap + pixels_per_line * y + x;
 	}
 
+	// Pointer to the current pixel, or to the pixel below it
+	__forceinline pixel_type *cursor(u32 y = 0)
+	{
+		return p_current_pixel + pixels_per_line * y;
+	}
+
 	__forceinline void prel(u32 x, pixel_type value)
 	{
 		p_current_pixel[x] = value;
@@ -130,12 +146,18 @@ struct RGBAPacker {
 	static u32 pack(u8 r, u8 g, u8 b, u8 a) {
 		return r | (g << 8) | (b << 16) | (a << 24);
 	}
+	static u32x4 pack(u32x4 r, u32x4 g, u32x4 b, u32x4 a) {
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
 };
 // DirectX
 struct BGRAPacker {
 	static u32 pack(u8 r, u8 g, u8 b, u8 a) {
 		return b | (g << 8) | (r << 16) | (a << 24);
 	}
+	static u32x4 pack(u32x4 r, u32x4 g, u32x4 b, u32x4 a) {
+		return b | (g << 8) | (r << 16) | (a << 24);
+	}
 };
 
 template<typename Packer>
@@ -159,6 +181,9 @@ struct UnpackerNop {
 	static Pixel unpack(Pixel word) {
 		return word;
 	}
+	static u32x4 unpack(u32x4 word) {
+		return word;
+	}
 };
 // ARGB1555 to RGBA5551
 struct Unpacker1555 {
@@ -166,6 +191,9 @@ struct Unpacker1555 {
 	static u16 unpack(u16 word) {
 		return ((word >> 15) & 1) | (((word >> 10) & 0x1F) << 11)  | (((word >> 5) & 0x1F) << 6)  | (((word >> 0) & 0x1F) << 1);
 	}
+	static u32x4 unpack(u32x4 word) {
+		return ((word >> 15) & 1) | (((word >> 10) & 0x1F) << 11)  | (((word >> 5) & 0x1F) << 6)  | (((word >> 0) & 0x1F) << 1);
+	}
 };
 // ARGB4444 to RGBA4444
 struct Unpacker4444 {
@@ -173,6 +201,9 @@ struct Unpacker4444 {
 	static u16 unpack(u16 word) {
 		return (((word >> 0) & 0xF) << 4) | (((word >> 4) & 0xF) << 8) | (((word >> 8) & 0xF) << 12) | (((word >> 12) & 0xF) << 0);
 	}
+	static u32x4 unpack(u32x4 word) {
+		return (((word >> 0) & 0xF) << 4) | (((word >> 4) & 0xF) << 8) | (((word >> 8) & 0xF) << 12) | (((word >> 12) & 0xF) << 0);
+	}
 };
 
 template <typename Packer>
@@ -185,6 +216,14 @@ struct Unpacker1555_32 {
 				(((word >> 0) & 0x1F) << 3) | ((word >> 2) & 7),
 				(word & 0x8000) ? 0xFF : 0);
 	}
+	static u32x4 unpack(u32x4 word) {
+		u32x4 alpha = word >> 15;
+		return Packer::pack(
+				(((word >> 10) & 0x1F) << 3) | ((word >> 12) & 7),
+				(((word >> 5) & 0x1F) << 3) | ((word >> 7) & 7),
+				(((word >> 0) & 0x1F) << 3) | ((word >> 2) & 7),
+				(alpha << 8) - alpha);
+	}
 };
 template <typename Packer>
 struct Unpacker565_32 {
@@ -196,6 +235,13 @@ struct Unpacker565_32 {
 				(((word >> 0) & 0x1F) << 3) | ((word >> 2) & 7),
 				0xFF);
 	}
+	static u32x4 unpack(u32x4 word) {
+		return Packer::pack(
+				(((word >> 11) & 0x1F) << 3) | ((word >> 13) & 7),
+				(((word >> 5) & 0x3F) << 2) | ((word >> 9) & 3),
+				(((word >> 0) & 0x1F) << 3) | ((word >> 2) & 7),
+				u32x4::set1(0xFF));
+	}
 };
 template <typename Packer>
 struct Unpacker4444_32 {
@@ -207,6 +253,13 @@ struct Unpacker4444_32 {
 				(((word >> 0) & 0xF) << 4) | ((word >> 0) & 0xF),
 				(((word >> 12) & 0xF) << 4) | ((word >> 12) & 0xF));
 	}
+	static u32x4 unpack(u32x4 word) {
+		return Packer::pack(
+				(((word >> 8) & 0xF) << 4) | ((word >> 8) & 0xF),
+				(((word >> 4) & 0xF) << 4) | ((word >> 4) & 0xF),
+				(((word >> 0) & 0xF) << 4) | ((word >> 0) & 0xF),
+				(((word >> 12) & 0xF) << 4) | ((word >> 12) & 0xF));
+	}
 };
 // ARGB8888 to whatever
 template <typename Packer>
@@ -229,11 +282,7 @@ struct ConvertPlanar
 	static constexpr u32 ypp = 1;
 	static void Convert(PixelBuffer<unpacked_type> *pb, u8 *data)
 	{
-		u16 *p_in = (u16 *)data;
-		pb->prel(0, Unpacker::unpack(p_in[0]));
-		pb->prel(1, Unpacker::unpack(p_in[1]));
-		pb->prel(2, Unpacker::unpack(p_in[2]));
-		pb->prel(3, Unpacker::unpack(p_in[3]));
+		Unpacker::unpack(u32x4::load((const u16 *)data)).store(pb->cursor());
 	}
 };
 
@@ -282,11 +331,8 @@ struct ConvertTwiddle
 	static constexpr u32 ypp = 2;
 	static void Convert(PixelBuffer<unpacked_type> *pb, u8 *data)
 	{
-		u16 *p_in = (u16 *)data;
-		pb->prel(0, 0, Unpacker::unpack(p_in[0]));
-		pb->prel(0, 1, Unpacker::unpack(p_in[1]));
-		pb->prel(1, 0, Unpacker::unpack(p_in[2]));
-		pb->prel(1, 1, Unpacker::unpack(p_in[3]));
+		// texels (0,0) (0,1) (1,0) (1,1)
+		Unpacker::unpack(u32x4::load((const u16 *)data)).storeTwiddled(pb->cursor(0), pb->cursor(1));
 	}
 };
 
@@ -391,15 +437,16 @@ struct ConvertTwiddlePal8
 };
 
 //handler functions
+// Rows [startY, endY) are converted. startY must be a multiple of 8.
 template<class PixelConvertor>
-void texture_PL(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in,u32 Width,u32 Height)
+void texture_PL(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in,u32 Width,u32 Height,u32 startY,u32 endY)
 {
-	pb->amove(0,0);
+	pb->amove(0,startY);
 
-	Height/=PixelConvertor::ypp;
 	Width/=PixelConvertor::xpp;
+	p_in+=startY/PixelConvertor::ypp*Width*8;
 
-	for (u32 y=0;y<Height;y++)
+	for (u32 y=startY/PixelConvertor::ypp;y<endY/PixelConvertor::ypp;y++)
 	{
 		for (u32 x=0;x<Width;x++)
 		{
@@ -414,16 +461,16 @@ void texture_PL(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in
 }
 
 template<class PixelConvertor>
-void texture_TW(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in,u32 Width,u32 Height)
+void texture_TW(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in,u32 Width,u32 Height,u32 startY,u32 endY)
 {
-	pb->amove(0, 0);
+	pb->amove(0, startY);
 
 	const u32 divider = PixelConvertor::xpp * PixelConvertor::ypp;
 
 	const u32 bcx = bitscanrev(Width);
 	const u32 bcy = bitscanrev(Height);
 
-	for (u32 y = 0; y < Height; y += PixelConvertor::ypp)
+	for (u32 y = startY; y < endY; y += PixelConvertor::ypp)
 	{
 		for (u32 x = 0; x < Width; x += PixelConvertor::xpp)
 		{
@@ -437,16 +484,16 @@ void texture_TW(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in
 }
 
 template<class PixelConvertor>
-void texture_VQ(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in,u32 Width,u32 Height)
+void texture_VQ(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in,u32 Width,u32 Height,u32 startY,u32 endY)
 {
 	p_in += 256 * 4 * 2;	// Skip VQ codebook
-	pb->amove(0, 0);
+	pb->amove(0, startY);
 
 	const u32 divider = PixelConvertor::xpp * PixelConvertor::ypp;
 	const u32 bcx = bitscanrev(Width);
 	const u32 bcy = bitscanrev(Height);
 
-	for (u32 y = 0; y < Height; y += PixelConvertor::ypp)
+	for (u32 y = startY; y < endY; y += PixelConvertor::ypp)
 	{
 		for (u32 x = 0; x < Width; x += PixelConvertor::xpp)
 		{
@@ -459,9 +506,15 @@ void texture_VQ(PixelBuffer<typename PixelConvertor::unpacked_type>* pb,u8* p_in
 	}
 }
 
-typedef void (*TexConvFP)(PixelBuffer<u16> *pb, u8 *p_in, u32 width, u32 height);
-typedef void (*TexConvFP8)(PixelBuffer<u8> *pb, u8 *p_in, u32 width, u32 height);
-typedef void (*TexConvFP32)(PixelBuffer<u32> *pb, u8 *p_in, u32 width, u32 height);
+template<typename Pixel>
+using TexConv = void (*)(PixelBuffer<Pixel> *pb, u8 *p_in, u32 width, u32 height, u32 startY, u32 endY);
+typedef TexConv<u16> TexConvFP;
+typedef TexConv<u8> TexConvFP8;
+typedef TexConv<u32> TexConvFP32;
+
+// Converts a whole texture. Large textures are split in bands converted by worker threads.
+template<typename Pixel>
+void ConvertTexture(TexConv<Pixel> texconv, PixelBuffer<Pixel>& pb, u8 *p_in, u32 width, u32 height);
 
 //Planar
 constexpr TexConvFP tex565_PL = texture_PL<ConvertPlanar<UnpackerNop<u16>>>;
@@ -565,12 +618,44 @@ struct vram_block
 bool VramLockedWriteOffset(size_t offset);
 bool VramLockedWrite(u8* address);
 void libCore_vramlock_Lock(u32 start_offset, u32 end_offset, BaseTextureCacheData *texture);
+bool libCore_vramlock_IsLocked(u32 start_offset, u32 end_offset);
 
 void UpscalexBRZ(int factor, u32* source, u32* dest, int width, int height, bool has_alpha);
 
 struct PvrTexInfo;
 enum class TextureType { _565, _5551, _4444, _8888, _8 };
 
+// Decoded texture data, ready to be uploaded to the GPU
+struct DecodedTexture
+{
+	PixelBuffer<u32> pb32;
+	PixelBuffer<u16> pb16;
+	PixelBuffer<u8> pb8;
+	u8 *data = nullptr;
+	u32 width = 0;
+	u32 height = 0;
+	TextureType tex_type = TextureType::_565;
+	bool mipmapped = false;		// data includes all mipmap levels
+};
+
+// Options that change the decoded texture data
+struct TextureDecodeParams
+{
+	int upscale;
+	int maxFilteredSize;
+	bool mipmaps;
+
+	static TextureDecodeParams current() {
+		return { config::TextureUpscale, config::MaxFilteredTextureSize, config::UseMipmaps && !config::DumpTextures };
+	}
+	bool operator==(const TextureDecodeParams& other) const {
+		return upscale == other.upscale && maxFilteredSize == other.maxFilteredSize && mipmaps == other.mipmaps;
+	}
+	bool operator!=(const TextureDecodeParams& other) const {
+		return !(*this == other);
+	}
+};
+
 class BaseTextureCacheData
 {
 public:
@@ -641,6 +726,10 @@ public:
 	void Create();
 	void ComputeHash();
 	void Update();
+	// Row stride in pixels of planar textures
+	u32 GetStride();
+	// Decodes the vram texture data. Doesn't change the texture state.
+	void Decode(DecodedTexture& decoded, u32 stride, bool has_alpha, const TextureDecodeParams& params);
 	virtual void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) = 0;
 	virtual bool Force32BitTexture(TextureType type) const { return false; }
 	void CheckCustomTexture();
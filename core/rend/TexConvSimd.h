@@ -0,0 +1,171 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "types.h"
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+#include <emmintrin.h>
+#define TEXCONV_SSE2
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define TEXCONV_NEON
+#endif
+
+//
+// 4 x 32-bit lanes used to convert 4 texels at once.
+// Texels are loaded as zero-extended 16-bit words and stored as 16 or 32-bit pixels,
+// either in a row or as a 2x2 twiddled block.
+//
+struct u32x4
+{
+#if defined(TEXCONV_SSE2)
+	__m128i v;
+
+	static u32x4 load(const u16 *p) {
+		return { _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128()) };
+	}
+	static u32x4 load(const u32 *p) {
+		return { _mm_loadu_si128((const __m128i *)p) };
+	}
+	static u32x4 set1(u32 x) {
+		return { _mm_set1_epi32(x) };
+	}
+	u32x4 operator>>(int n) const { return { _mm_srli_epi32(v, n) }; }
+	u32x4 operator<<(int n) const { return { _mm_slli_epi32(v, n) }; }
+	u32x4 operator&(u32 mask) const { return { _mm_and_si128(v, _mm_set1_epi32(mask)) }; }
+	u32x4 operator|(const u32x4& o) const { return { _mm_or_si128(v, o.v) }; }
+	u32x4 operator-(const u32x4& o) const { return { _mm_sub_epi32(v, o.v) }; }
+
+	void store(u32 *p) const {
+		_mm_storeu_si128((__m128i *)p, v);
+	}
+	// Lanes must fit in 16 bits
+	void store(u16 *p) const {
+		_mm_storel_epi64((__m128i *)p, narrow());
+	}
+	// Lanes 0 and 2 go to row0, lanes 1 and 3 to row1
+	void storeTwiddled(u32 *row0, u32 *row1) const
+	{
+		__m128i t = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storel_epi64((__m128i *)row0, t);
+		_mm_storel_epi64((__m128i *)row1, _mm_unpackhi_epi64(t, t));
+	}
+	void storeTwiddled(u16 *row0, u16 *row1) const
+	{
+		__m128i t = _mm_shufflelo_epi16(narrow(), _MM_SHUFFLE(3, 1, 2, 0));
+		*(u32 *)row0 = (u32)_mm_cvtsi128_si32(t);
+		*(u32 *)row1 = (u32)_mm_cvtsi128_si32(_mm_srli_si128(t, 4));
+	}
+	u32 lane(int i) const
+	{
+		alignas(16) u32 a[4];
+		_mm_store_si128((__m128i *)a, v);
+		return a[i];
+	}
+
+private:
+	// Packs the low 16 bits of each lane into the low 64 bits
+	__m128i narrow() const
+	{
+		__m128i t = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 2, 0));
+		t = _mm_shufflehi_epi16(t, _MM_SHUFFLE(3, 3, 2, 0));
+		return _mm_shuffle_epi32(t, _MM_SHUFFLE(3, 3, 2, 0));
+	}
+
+#elif defined(TEXCONV_NEON)
+	uint32x4_t v;
+
+	static u32x4 load(const u16 *p) {
+		return { vmovl_u16(vld1_u16(p)) };
+	}
+	static u32x4 load(const u32 *p) {
+		return { vld1q_u32(p) };
+	}
+	static u32x4 set1(u32 x) {
+		return { vdupq_n_u32(x) };
+	}
+	u32x4 operator>>(int n) const { return { vshlq_u32(v, vdupq_n_s32(-n)) }; }
+	u32x4 operator<<(int n) const { return { vshlq_u32(v, vdupq_n_s32(n)) }; }
+	u32x4 operator&(u32 mask) const { return { vandq_u32(v, vdupq_n_u32(mask)) }; }
+	u32x4 operator|(const u32x4& o) const { return { vorrq_u32(v, o.v) }; }
+	u32x4 operator-(const u32x4& o) const { return { vsubq_u32(v, o.v) }; }
+
+	void store(u32 *p) const {
+		vst1q_u32(p, v);
+	}
+	void store(u16 *p) const {
+		vst1_u16(p, vmovn_u32(v));
+	}
+	void storeTwiddled(u32 *row0, u32 *row1) const
+	{
+		uint32x2x2_t t = vuzp_u32(vget_low_u32(v), vget_high_u32(v));
+		vst1_u32(row0, t.val[0]);
+		vst1_u32(row1, t.val[1]);
+	}
+	void storeTwiddled(u16 *row0, u16 *row1) const
+	{
+		uint16x4_t n = vmovn_u32(v);
+		uint16x4x2_t t = vuzp_u16(n, n);
+		vst1_lane_u32((u32 *)row0, vreinterpret_u32_u16(t.val[0]), 0);
+		vst1_lane_u32((u32 *)row1, vreinterpret_u32_u16(t.val[1]), 0);
+	}
+	u32 lane(int i) const
+	{
+		u32 a[4];
+		vst1q_u32(a, v);
+		return a[i];
+	}
+
+#else
+	u32 v[4];
+
+	static u32x4 load(const u16 *p) {
+		return { { p[0], p[1], p[2], p[3] } };
+	}
+	static u32x4 load(const u32 *p) {
+		return { { p[0], p[1], p[2], p[3] } };
+	}
+	static u32x4 set1(u32 x) {
+		return { { x, x, x, x } };
+	}
+	u32x4 operator>>(int n) const { return { { v[0] >> n, v[1] >> n, v[2] >> n, v[3] >> n } }; }
+	u32x4 operator<<(int n) const { return { { v[0] << n, v[1] << n, v[2] << n, v[3] << n } }; }
+	u32x4 operator&(u32 mask) const { return { { v[0] & mask, v[1] & mask, v[2] & mask, v[3] & mask } }; }
+	u32x4 operator|(const u32x4& o) const { return { { v[0] | o.v[0], v[1] | o.v[1], v[2] | o.v[2], v[3] | o.v[3] } }; }
+	u32x4 operator-(const u32x4& o) const { return { { v[0] - o.v[0], v[1] - o.v[1], v[2] - o.v[2], v[3] - o.v[3] } }; }
+
+	template<typename T>
+	void store(T *p) const
+	{
+		for (int i = 0; i < 4; i++)
+			p[i] = (T)v[i];
+	}
+	template<typename T>
+	void storeTwiddled(T *row0, T *row1) const
+	{
+		row0[0] = (T)v[0];
+		row0[1] = (T)v[2];
+		row1[0] = (T)v[1];
+		row1[1] = (T)v[3];
+	}
+	u32 lane(int i) const {
+		return v[i];
+	}
+#endif
+};
@@ -0,0 +1,255 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "TexPrefetch.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/ta.h"
+#include "cfg/option.h"
+
+#include <xxhash.h>
+
+TexturePrefetcher texture_prefetcher;
+
+// Maximum number of textures decoded ahead for a single frame
+static const size_t MaxTextures = 256;
+
+namespace
+{
+
+// Texture used to decode vram data. It is never uploaded.
+class StagingTexture final : public BaseTextureCacheData
+{
+public:
+	std::string GetId() override { return ""; }
+	void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) override {}
+};
+
+u64 hashVram(u32 start, u32 end) {
+	return XXH64(&vram[start], end - start + 1, 0);
+}
+
+}
+
+u64 TexturePrefetcher::makeKey(TSP tsp, TCW tcw)
+{
+	// Same as the texture cache key for non-paletted textures
+	const u32 tspMask = 0x0000003F;	// TexU, TexV
+	const u32 tcwMask = 0xFC1FFFFF;	// MipMapped, VQ_Comp, PixelFmt, ScanOrder, TexAddr
+	return (tsp.full & tspMask) | ((u64)(tcw.full & tcwMask) << 32);
+}
+
+void TexturePrefetcher::Prefetch(TA_context *ctx)
+{
+	if (!config::TexturePrefetch || !config::ThreadedRendering
+			|| config::CustomTextures || config::DumpTextures
+			|| ctx->rend.isRenderFramebuffer)
+		return;
+
+	std::vector<std::pair<TSP, TCW>> textures;
+	ta_get_textures(ctx, textures);
+	if (!textures.empty())
+		Prefetch(textures);
+}
+
+void TexturePrefetcher::Prefetch(const std::vector<std::pair<TSP, TCW>>& textures)
+{
+	if (!running)
+	{
+		running = true;
+		worker_thread.Start();
+	}
+	// The options and registers may change before the worker gets to the texture
+	const TextureDecodeParams params = TextureDecodeParams::current();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// Textures decoded for the previous frame but not used are dropped
+		queue.clear();
+		for (auto it = entries.begin(); it != entries.end(); )
+		{
+			if (it->second.state != State::Decoding)
+				it = entries.erase(it);
+			else
+				++it;
+		}
+		for (const auto& pair : textures)
+		{
+			// The palette may change before the texture is used
+			if (pair.second.PixelFmt == PixelPal4 || pair.second.PixelFmt == PixelPal8)
+				continue;
+			u64 key = makeKey(pair.first, pair.second);
+			if (entries.count(key) != 0)
+				continue;
+			StagingTexture texture;
+			texture.tsp = pair.first;
+			texture.tcw = pair.second;
+			texture.Create();
+			if (texture.sa_tex > VRAM_SIZE || texture.size == 0 || texture.sa + texture.size > VRAM_SIZE)
+				// Let the render thread deal with it
+				continue;
+			Entry& entry = entries[key];
+			entry.tsp = pair.first;
+			entry.tcw = pair.second;
+			entry.state = State::Pending;
+			entry.sa = texture.sa;
+			entry.start = texture.sa_tex;
+			entry.end = texture.sa + texture.size - 1;
+			entry.stride = texture.GetStride();
+			entry.params = params;
+			queue.push_back(key);
+			if (queue.size() >= MaxTextures)
+				break;
+		}
+	}
+	wakeup_thread.Set();
+}
+
+void TexturePrefetcher::Decode(Entry& entry)
+{
+	// Already decoded by the texture cache and unchanged since
+	if (libCore_vramlock_IsLocked(entry.start, entry.end))
+		return;
+
+	StagingTexture texture;
+	texture.tsp = entry.tsp;
+	texture.tcw = entry.tcw;
+	texture.Create();
+
+	entry.hash = hashVram(entry.start, entry.end);
+	if (texture.tcw.VQ_Comp)
+		vq_codebook = &vram[texture.sa_tex];
+
+	std::unique_ptr<DecodedTexture> decoded(new DecodedTexture());
+	texture.Decode(*decoded, entry.stride, false, entry.params);
+	// The emulator may have written to the texture while it was being decoded
+	if (hashVram(entry.start, entry.end) == entry.hash)
+		entry.decoded = std::move(decoded);
+}
+
+void TexturePrefetcher::WorkerThread()
+{
+	while (running)
+	{
+		for (;;)
+		{
+			Entry *entry;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (queue.empty())
+					break;
+				// Textures are decoded in the order they are first used
+				u64 key = queue.front();
+				queue.pop_front();
+				auto it = entries.find(key);
+				if (it == entries.end() || it->second.state != State::Pending)
+					continue;
+				// Entries being decoded are neither erased nor read by the other threads
+				entry = &it->second;
+				entry->state = State::Decoding;
+			}
+			Decode(*entry);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				entry->state = State::Done;
+			}
+			decoded_cond.notify_all();
+		}
+		decoded_cond.notify_all();
+		wakeup_thread.Wait();
+	}
+}
+
+void TexturePrefetcher::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	decoded_cond.wait(lock, [this]() {
+		if (!queue.empty())
+			return false;
+		for (const auto& pair : entries)
+			if (pair.second.state == State::Decoding)
+				return false;
+		return true;
+	});
+}
+
+std::unique_ptr<DecodedTexture> TexturePrefetcher::Take(BaseTextureCacheData *texture, u32 stride)
+{
+	if (!running || texture->IsPaletted())
+		return nullptr;
+	u64 key = makeKey(texture->tsp, texture->tcw);
+	std::unique_lock<std::mutex> lock(mutex);
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return nullptr;
+	if (it->second.state == State::Pending)
+	{
+		// Not decoded yet: the caller will do it
+		entries.erase(it);
+		misses++;
+		return nullptr;
+	}
+	// Wait for the worker if it's busy with this texture
+	decoded_cond.wait(lock, [this, key]() {
+		auto it = entries.find(key);
+		return it == entries.end() || it->second.state != State::Decoding;
+	});
+	it = entries.find(key);
+	if (it == entries.end())
+		return nullptr;
+	Entry entry = std::move(it->second);
+	entries.erase(it);
+	lock.unlock();
+
+	if (entry.decoded == nullptr
+			|| entry.sa != texture->sa
+			|| entry.stride != stride
+			|| entry.params != TextureDecodeParams::current()
+			|| (entry.decoded->tex_type != TextureType::_8888 && texture->Force32BitTexture(entry.decoded->tex_type))
+			|| hashVram(entry.start, entry.end) != entry.hash)
+	{
+		misses++;
+		return nullptr;
+	}
+	hits++;
+	return std::move(entry.decoded);
+}
+
+void TexturePrefetcher::Cancel()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	queue.clear();
+	decoded_cond.wait(lock, [this]() {
+		for (const auto& pair : entries)
+			if (pair.second.state == State::Decoding)
+				return false;
+		return true;
+	});
+	entries.clear();
+}
+
+void TexturePrefetcher::Terminate()
+{
+	if (running)
+	{
+		running = false;
+		Cancel();
+		wakeup_thread.Set();
+		worker_thread.WaitToEnd();
+		DEBUG_LOG(RENDERER, "Texture prefetch: %d hits, %d misses", hits, misses);
+		hits = misses = 0;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+	Copyright 2026 flyinghead
+
+	This file is part of Flycast.
+
+    Flycast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Flycast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "TexCache.h"
+#include "stdclass.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct TA_context;
+
+//
+// Decodes the textures referenced by a TA context on a background thread,
+// while the render thread is still busy with the previous frame.
+// BaseTextureCacheData::Update() picks up the decoded data and decodes the texture itself on a miss.
+//
+class TexturePrefetcher
+{
+public:
+	TexturePrefetcher() : worker_thread(worker_thread_func, this) {}
+	~TexturePrefetcher() { Terminate(); }
+	// Called by the emulator thread when a context is queued for rendering
+	void Prefetch(TA_context *ctx);
+	void Prefetch(const std::vector<std::pair<TSP, TCW>>& textures);
+	// Waits until all the queued textures have been decoded
+	void Flush();
+	// Called by the render thread. Returns nullptr if the texture hasn't been decoded or is outdated.
+	std::unique_ptr<DecodedTexture> Take(BaseTextureCacheData *texture, u32 stride);
+	// Drops all pending and decoded textures
+	void Cancel();
+	void Terminate();
+
+private:
+	enum class State { Pending, Decoding, Done };
+
+	struct Entry
+	{
+		TSP tsp;
+		TCW tcw;
+		State state;
+		// Decoding parameters, captured when the texture is queued and checked when it is taken
+		u32 sa;
+		u32 start;
+		u32 end;
+		u32 stride;
+		TextureDecodeParams params;
+		u64 hash;
+		std::unique_ptr<DecodedTexture> decoded;
+	};
+
+	static u64 makeKey(TSP tsp, TCW tcw);
+	void Decode(Entry& entry);
+	void WorkerThread();
+	static void *worker_thread_func(void *param) { ((TexturePrefetcher *)param)->WorkerThread(); return nullptr; }
+
+	std::atomic<bool> running{ false };
+	cThread worker_thread;
+	cResetEvent wakeup_thread;
+	std::mutex mutex;
+	std::condition_variable decoded_cond;
+	std::unordered_map<u64, Entry> entries;
+	std::deque<u64> queue;
+	u32 hits = 0;
+	u32 misses = 0;
+};
+
+extern TexturePrefetcher texture_prefetcher;
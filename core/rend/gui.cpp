@@ -1392,6 +1392,10 @@ static void gui_display_settings()
 			ImGui::SameLine();
 			OptionCheckbox("保存", config::AutoSaveState,
 					"停止时保存游戏状态");
+			OptionSlider("检查点间隔", config::CheckpointInterval, 0, 60,
+					"每隔指定秒数保存增量状态，以便在崩溃后恢复游戏。0表示禁用");
+			OptionCheckbox("Zstd压缩状态", config::ZstdSavestates,
+					"使用zstd压缩保存状态，速度更快。旧版本和libretro核心无法加载这些状态");
 			OptionCheckbox("Naomi免费玩", config::ForceFreePlay, "在免费玩模式下配置Naomi游戏。");
 
 			ImGui::PopStyleVar();
@@ -1907,6 +1911,15 @@ static void gui_display_settings()
 				ImGui::SameLine();
 				ShowHelpMarker("设置最大音频延迟。并非所有音频驱动程序都支持。");
             }
+			{
+				int target = (int)roundf(config::AudioLatencyTarget * 1000.f / 44100.f);
+				if (ImGui::SliderInt("缓冲延迟", &target, 23, 371, "%d ms"))
+					config::AudioLatencyTarget = (int)roundf(target * 44100.f / 1000.f);
+				ImGui::SameLine();
+				ShowHelpMarker("模拟器和音频驱动程序之间的缓冲延迟。较高的值可以减少爆音");
+			}
+			OptionCheckbox("动态速率控制", config::AudioDynamicRate,
+					"微调音频采样率以补偿音频和视频时钟之间的偏差");
 
 			audiobackend_t* backend = nullptr;
 			std::string backend_name = config::AudioBackend;
@@ -2014,6 +2027,13 @@ static void gui_display_settings()
 		    	ImGui::Spacing();
 		    	header("动态编译设置");
 		    	OptionCheckbox("闲置跳过", config::DynarecIdleSkip, "跳过等待循环。推荐");
+		    	OptionCheckbox("持久化编译缓存", config::DynarecPersistentCache,
+		    			"保存已解码的代码块，使下次启动游戏时更快达到全速");
+		    	OptionCheckbox("后台编译", config::DynarecAsyncCompile,
+		    			"在后台线程编译新代码，编译完成前由解释器执行，以减少卡顿。"
+		    			"解释器按每条指令固定周期计时，且取决于编译线程的完成时间，因此模拟结果不确定。网络对战时无效");
+		    	OptionCheckbox("热点代码追踪", config::DynarecTraces,
+		    			"将频繁执行的代码块与其静态跳转目标合并重新编译，以提高性能");
 		    }
 	    	ImGui::Spacing();
 		    header("网络");
@@ -2081,6 +2101,8 @@ static void gui_display_settings()
 	            		"启用完整的MMU模拟和其他Windows CE设置。除非必要，否则不要启用");
 	            OptionCheckbox("多线程仿真", config::ThreadedRendering,
 	            		"在不同的线程上运行模拟的CPU和GPU");
+	            OptionCheckbox("后台纹理解码", config::TexturePrefetch,
+	            		"在渲染上一帧时提前解码下一帧的纹理。需要多线程仿真");
 #ifndef __ANDROID
 	            OptionCheckbox("串行控制台", config::SerialConsole,
 	            		"将Dreamcast串行控制台转储到stdout");
@@ -1,29 +1,29 @@
+#include "hw/pvr/ta.h"
 #include "hw/pvr/ta_ctx.h"
-#include "hw/pvr/ta_structs.h"
 #include "hw/pvr/Renderer_if.h"
 
+// Renderer that only parses the display lists. Used to replay TA captures headless.
 struct norend : Renderer
 {
-	bool Init()
+	bool Init() override
 	{
 		return true;
 	}
 
-	void Resize(int w, int h) { }
-	void Term() { }
+	void Resize(int w, int h) override { }
+	void Term() override { }
 
+	bool Process(TA_context* ctx) override
+	{
+		if (ctx->rend.isRenderFramebuffer)
+			return true;
+		return ta_parse(ctx);
+	}
 
-        bool Process(TA_context* ctx) { return true; }
-
-        void DrawOSD() {  }
-
-	bool Render()
+	bool Render() override
 	{
 		return !pvrrc.isRTT;
 	}
 };
 
-
 Renderer* rend_norend() { return new norend(); }
-
-u32 GetTexture(TSP tsp,TCW tcw) { return 0; }
@@ -495,6 +495,7 @@ static void dc_deserialize_libretro(Deserializer& deser)
 	deser >> sch_list[modem_sched].tag;
     deser >> sch_list[modem_sched].start;
     deser >> sch_list[modem_sched].end;
+	sh4_sched_rebuild();
 
 	deser >> SCIF_SCFSR2;
 	if (deser.version() < Deserializer::V9_LIBRETRO)
@@ -769,6 +770,7 @@ void dc_deserialize(Deserializer& deser)
 		deser >> sch_list[modem_sched].start;
 		deser >> sch_list[modem_sched].end;
 	}
+	sh4_sched_rebuild();
 	if (deser.version() < Deserializer::V19)
 		sh4_sched_ffts();
 	ModemDeserialize(deser);
@@ -25,6 +25,10 @@ namespace config {
 
 Option<bool> DynarecEnabled("", true);
 Option<bool> DynarecIdleSkip("", true);
+Option<bool> DynarecPersistentCache("");
+Option<bool> DynarecAsyncCompile("");
+Option<bool> DynarecTraces("");
+Option<bool> DynarecProfiler("");
 
 // General
 
@@ -36,6 +40,8 @@ Option<bool> FullMMU("");
 Option<bool> ForceWindowsCE(CORE_OPTION_NAME "_force_wince");
 Option<bool> AutoLoadState("");
 Option<bool> AutoSaveState("");
+Option<int> CheckpointInterval("", 0);
+Option<bool> ZstdSavestates("");
 Option<int> SavestateSlot("");
 Option<bool> ForceFreePlay(CORE_OPTION_NAME "_force_freeplay", true);
 
@@ -48,6 +54,8 @@ Option<int> AudioBufferSize("", 5644);	// 128 ms
 Option<int> AudioBufferSize("", 2822);	// 64 ms
 #endif
 Option<bool> AutoLatency("");
+Option<int> AudioLatencyTarget("", 1024);
+Option<bool> AudioDynamicRate("", true);
 
 OptionString AudioBackend("", "auto");
 
@@ -85,6 +93,7 @@ Option<int> AutoSkipFrame(CORE_OPTION_NAME "_auto_skip_frame", 0);
 Option<int> RenderResolution("", 480);
 Option<bool> VSync("", true);
 Option<bool> ThreadedRendering(CORE_OPTION_NAME "_threaded_rendering", true);
+Option<bool> TexturePrefetch("", true);
 Option<int> AnisotropicFiltering(CORE_OPTION_NAME "_anisotropic_filtering");
 Option<int> TextureFiltering(CORE_OPTION_NAME "_texture_filtering");
 Option<bool> PowerVR2Filter(CORE_OPTION_NAME "_pvr2_filtering");
@@ -98,6 +107,9 @@ Option<bool> UseReios(CORE_OPTION_NAME "_hle_bios");
 
 Option<bool> OpenGlChecks("", false);
 Option<bool> FastGDRomLoad(CORE_OPTION_NAME "_gdrom_fast_loading", false);
+Option<bool> MapRomFiles("", true);
+Option<bool> CacheDecryptedRoms("", true);
+Option<bool> PreDecryptRoms("", false);
 
 //Option<std::vector<std::string>, false> ContentPath("");
 //Option<bool, false> HideLegacyNaomiRoms("", true);
@@ -0,0 +1,228 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/aica/aica.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/dsp.h"
+#include "emulator.h"
+#include "benchmark.h"
+
+#include <random>
+
+class AicaDspTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+	}
+
+	// Random program using all the instruction fields. About a quarter of the steps are empty.
+	void generateProgram(u32 seed)
+	{
+		std::mt19937 rng(seed);
+		for (int step = 0; step < 128; step++)
+		{
+			u32 *mpro = &DSPData->MPRO[step * 4];
+			const bool empty = rng() % 4 == 0;
+			for (int i = 0; i < 4; i++)
+				mpro[i] = empty ? 0 : rng() & 0xffff;
+		}
+		for (u32& coef : DSPData->COEF)
+			coef = rng() & 0xfff8;
+		for (u32& madrs : DSPData->MADRS)
+			madrs = rng() & 0xffff;
+		for (u32 i = 0; i < ARAM_SIZE; i++)
+			aica_ram[i] = (u8)rng();
+		dsp::state.RBL = (8192 << (rng() % 4)) - 1;
+		dsp::state.RBP = (rng() % 4096) * 2048 & ARAM_MASK;
+		dsp::state.MDEC_CT = dsp::state.RBL + 1;
+		dsp::state.stopped = false;
+		for (int i = 0; i < BlockCount * dsp::BlockSize; i++)
+		{
+			for (int j = 0; j < 16; j++)
+				mixs[i][j] = (s32)(rng() & 0xfffff) - 0x80000;
+			exts[i][0] = (s16)rng();
+			exts[i][1] = (s16)rng();
+		}
+	}
+
+	void saveState()
+	{
+		savedDsp = dsp::state;
+		savedRam.assign(&aica_ram[0], &aica_ram[0] + ARAM_SIZE);
+		memcpy(savedEfreg, DSPData->EFREG, sizeof(savedEfreg));
+	}
+
+	void restoreState()
+	{
+		dsp::state = savedDsp;
+		memcpy(&aica_ram[0], savedRam.data(), savedRam.size());
+		memcpy(DSPData->EFREG, savedEfreg, sizeof(savedEfreg));
+	}
+
+	std::vector<u32> run(void (*runStep)())
+	{
+		std::vector<u32> efreg;
+		for (int i = 0; i < BlockCount * dsp::BlockSize; i++)
+		{
+			memcpy(dsp::state.MIXS, mixs[i], sizeof(dsp::state.MIXS));
+			DSPData->EXTS[0] = exts[i][0];
+			DSPData->EXTS[1] = exts[i][1];
+			runStep();
+			efreg.insert(efreg.end(), DSPData->EFREG, DSPData->EFREG + 16);
+		}
+		return efreg;
+	}
+
+	std::vector<u32> runBlocks()
+	{
+		std::vector<u32> efreg;
+		for (int b = 0; b < BlockCount; b++)
+		{
+			s32 blockMixs[16][dsp::BlockSize];
+			s32 blockExts[2][dsp::BlockSize];
+			for (int i = 0; i < dsp::BlockSize; i++)
+			{
+				for (int j = 0; j < 16; j++)
+					blockMixs[j][i] = mixs[b * dsp::BlockSize + i][j];
+				blockExts[0][i] = exts[b * dsp::BlockSize + i][0];
+				blockExts[1][i] = exts[b * dsp::BlockSize + i][1];
+			}
+			u32 blockEfreg[dsp::BlockSize][16];
+			dsp::stepBlock(blockMixs, blockExts, blockEfreg);
+			efreg.insert(efreg.end(), &blockEfreg[0][0], &blockEfreg[0][0] + dsp::BlockSize * 16);
+		}
+		return efreg;
+	}
+
+	void compareState(const dsp::DSPState& other, const std::vector<u8>& otherRam)
+	{
+		ASSERT_EQ(0, memcmp(other.TEMP, dsp::state.TEMP, sizeof(other.TEMP)));
+		ASSERT_EQ(0, memcmp(other.MEMS, dsp::state.MEMS, sizeof(other.MEMS)));
+		ASSERT_EQ(other.MDEC_CT, dsp::state.MDEC_CT);
+		ASSERT_EQ(0, memcmp(otherRam.data(), &aica_ram[0], ARAM_SIZE));
+	}
+
+	static constexpr int BlockCount = 64;
+	s32 mixs[BlockCount * dsp::BlockSize][16];
+	s32 exts[BlockCount * dsp::BlockSize][2];
+	dsp::DSPState savedDsp;
+	std::vector<u8> savedRam;
+	u32 savedEfreg[16];
+};
+
+// The recompiler of the host (x86, x64, arm32 or arm64) must have the same output as the interpreter,
+// one sample at a time and by blocks
+TEST_F(AicaDspTest, InterpreterVsRecompiler)
+{
+	for (u32 seed = 1; seed <= 16; seed++)
+	{
+		generateProgram(seed);
+		saveState();
+		dsp::interp::recompile();
+		std::vector<u32> interp = run(dsp::interp::runStep);
+		dsp::DSPState interpState = dsp::state;
+		std::vector<u8> interpRam(&aica_ram[0], &aica_ram[0] + ARAM_SIZE);
+
+		restoreState();
+		dsp::recompile();
+		std::vector<u32> rec = run(dsp::runStep);
+		ASSERT_EQ(interp.size(), rec.size());
+		for (size_t i = 0; i < interp.size(); i++)
+			ASSERT_EQ(interp[i], rec[i]) << "program " << seed << " sample " << i / 16 << " EFREG " << i % 16;
+		compareState(interpState, interpRam);
+
+		restoreState();
+		dsp::state.dirty = true;
+		std::vector<u32> block = runBlocks();
+		ASSERT_EQ(interp.size(), block.size());
+		for (size_t i = 0; i < interp.size(); i++)
+			ASSERT_EQ(interp[i], block[i]) << "block program " << seed << " sample " << i / 16 << " EFREG " << i % 16;
+		compareState(interpState, interpRam);
+	}
+}
+
+// An instruction with MRD and MWT reads the memory before writing it.
+// A read at the end of the program is available at the start of the next sample.
+TEST_F(AicaDspTest, MemoryReadWrite)
+{
+	memset(DSPData->MPRO, 0, sizeof(DSPData->MPRO));
+	// step 1: MEMS[1] = MEMVAL, read MADRS[0] into MEMVAL and write ACC to MADRS[0]
+	DSPData->MPRO[1 * 4 + 1] = 0x40 | (1 << 1);		// IWT, IWA=1
+	DSPData->MPRO[1 * 4 + 2] = 0x8000 | 0x4000 | 0x2000 | 0x30;	// TABLE, MWT, MRD, SHIFT=3
+	// step 3: MEMS[0] = MEMVAL
+	DSPData->MPRO[3 * 4 + 1] = 0x40;				// IWT, IWA=0
+	// step 127: read MADRS[1] into MEMVAL
+	DSPData->MPRO[127 * 4 + 2] = 0x8000 | 0x2000;	// TABLE, MRD
+	DSPData->MPRO[127 * 4 + 3] = 1 << 9;			// MASA=1
+	DSPData->MADRS[0] = 0x100;
+	DSPData->MADRS[1] = 0x180;
+	memset(mixs, 0, sizeof(mixs));
+	memset(exts, 0, sizeof(exts));
+	const s32 temp = 0x123456;
+
+	const auto check = [&](void (*recompile)(), void (*runStep)()) {
+		memset(&dsp::state, 0, sizeof(dsp::state));
+		for (s32& t : dsp::state.TEMP)
+			t = temp;
+		dsp::state.RBL = 8192 - 1;
+		dsp::state.MDEC_CT = 8192;
+		*(u16 *)&aica_ram[0x200] = 0x4321;
+		*(u16 *)&aica_ram[0x300] = 0x5678;
+		recompile();
+		runStep();
+		ASSERT_EQ(dsp::UNPACK(0x4321), dsp::state.MEMS[0]);
+		ASSERT_EQ(0, dsp::state.MEMS[1]);
+		ASSERT_EQ(dsp::PACK(temp), *(u16 *)&aica_ram[0x200]);
+		runStep();
+		ASSERT_EQ(dsp::UNPACK(dsp::PACK(temp)), dsp::state.MEMS[0]);
+		ASSERT_EQ(dsp::UNPACK(0x5678), dsp::state.MEMS[1]);
+	};
+	check(dsp::interp::recompile, dsp::interp::runStep);
+	check(dsp::recompile, dsp::runStep);
+}
+
+TEST_F(AicaDspTest, Block)
+{
+	generateProgram(42);
+	saveState();
+	dsp::recompile();
+	std::vector<u32> single = run(dsp::runStep);
+	dsp::DSPState singleState = dsp::state;
+	std::vector<u8> singleRam(&aica_ram[0], &aica_ram[0] + ARAM_SIZE);
+
+	restoreState();
+	dsp::state.dirty = true;
+	std::vector<u32> block = runBlocks();
+	ASSERT_EQ(single, block);
+	compareState(singleState, singleRam);
+}
+
+TEST_F(AicaDspTest, DISABLED_Benchmark)
+{
+	generateProgram(7);
+	saveState();
+	const int loops = 16;
+	const double interpTime = benchmark::timeMillis([&]() {
+		dsp::interp::recompile();
+		for (int i = 0; i < loops; i++)
+			run(dsp::interp::runStep);
+	});
+	restoreState();
+	const double recTime = benchmark::timeMillis([&]() {
+		dsp::recompile();
+		for (int i = 0; i < loops; i++)
+			run(dsp::runStep);
+	});
+	restoreState();
+	dsp::state.dirty = true;
+	const double blockTime = benchmark::timeMillis([&]() {
+		for (int i = 0; i < loops; i++)
+			runBlocks();
+	});
+	printf("DSP %d samples: interpreter %.1f ms, recompiler %.1f ms, recompiler in blocks %.1f ms\n",
+			loops * BlockCount * dsp::BlockSize, interpTime, recTime, blockTime);
+}
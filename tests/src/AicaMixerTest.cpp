@@ -0,0 +1,206 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/aica/aica.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/aica_mem.h"
+#include "hw/aica/dsp.h"
+#include "hw/aica/sgc_if.h"
+#include "oslib/audiostream.h"
+#include "cfg/option.h"
+#include "emulator.h"
+#include "benchmark.h"
+
+#include <random>
+
+static std::vector<u32> output;
+
+static void captureInit() {
+}
+
+static u32 capturePush(const void *data, u32 frames, bool wait)
+{
+	const u32 *samples = (const u32 *)data;
+	output.insert(output.end(), samples, samples + frames);
+	return 1;
+}
+
+static void captureTerm() {
+}
+
+static audiobackend_t captureBackend = {
+	"aicatest",
+	"AICA mixer test",
+	&captureInit,
+	&capturePush,
+	&captureTerm,
+	nullptr
+};
+static bool captureRegistered = RegisterAudioBackend(&captureBackend);
+
+class AicaMixerTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+		config::AudioBackend.set("aicatest");
+		config::AudioVolume.set(100);
+		config::AudioDynamicRate.set(false);
+		InitAudio();
+		settings.aica.muteAudio = false;
+		settings.input.fastForwardMode = false;
+	}
+
+	void TearDown() override
+	{
+		TermAudio();
+		config::AudioBackend.set("auto");
+		config::AudioDynamicRate.set(true);
+		config::DSPEnabled.set(false);
+	}
+
+	void writeChannel(int channel, u32 reg, u16 value) {
+		aicaWriteReg<u16>(channel * 0x80 + reg, value);
+	}
+
+	// Random channel settings covering all the sample formats, loop modes, LFO, filter and level settings
+	void setupChannels(bool withDsp)
+	{
+		std::mt19937 rng(11);
+		for (u32 i = 0x100000; i < 0x180000; i++)
+			aica_ram[i] = (u8)rng();
+		for (int ch = 0; ch < 64; ch++)
+		{
+			const u32 pcms = ch & 3;
+			const u32 sa = 0x100000 + (rng() % 0x40000);
+			const u16 lsa = rng() % 0x800;
+			const u16 lea = lsa + 0x100 + rng() % 0x2000;
+			const u32 loop = (ch & 4) ? 0 : 1;
+			writeChannel(ch, 0x00, (1 << 14) | (loop << 9) | (pcms << 7) | (sa >> 16) | ((ch == 13) << 10));
+			writeChannel(ch, 0x04, sa & 0xffff);
+			writeChannel(ch, 0x08, lsa);
+			writeChannel(ch, 0x0c, lea);
+			// D2R D1R AR
+			writeChannel(ch, 0x10, ((rng() % 32) << 11) | ((rng() % 32) << 6) | (10 + rng() % 22));
+			// LPSLNK KRS DL RR
+			writeChannel(ch, 0x14, ((ch & 8) << 11) | ((rng() % 16) << 10) | ((rng() % 32) << 5) | (rng() % 32));
+			// OCT FNS
+			writeChannel(ch, 0x18, (((ch * 3) % 16 ^ 8) << 11) | (rng() % 0x400));
+			// LFO
+			writeChannel(ch, 0x1c, (u16)rng());
+			// IMXL ISEL
+			writeChannel(ch, 0x20, (u16)rng() & 0xff);
+			// DISDL DIPAN
+			writeChannel(ch, 0x24, (u16)rng() & 0xf1f);
+			// TL VOFF LPOFF Q
+			writeChannel(ch, 0x28, ((rng() % 0x80) << 8) | ((ch == 17) << 6) | ((ch & 16) ? 0x20 : 0) | (rng() % 32));
+			for (u32 reg = 0x2c; reg <= 0x3c; reg += 4)
+				writeChannel(ch, reg, rng() % 0x2000);
+			writeChannel(ch, 0x40, ((rng() % 32) << 8) | (rng() % 32));
+			writeChannel(ch, 0x44, ((rng() % 32) << 8) | (rng() % 32));
+		}
+		// Key on all channels
+		writeChannel(0, 0x00, aicaReadReg<u16>(0) | (1 << 15));
+
+		CommonData->MVOL = 15;
+		for (int i = 0; i < 18; i++)
+			aicaWriteReg<u16>(0x2000 + i * 4, ((u16)rng() & 0x1f) | (12 << 8));
+		config::DSPEnabled.set(withDsp);
+		if (withDsp)
+		{
+			for (u32& instr : DSPData->MPRO)
+				instr = rng() & 0xffff;
+			for (u32& coef : DSPData->COEF)
+				coef = rng() & 0xfff8;
+			dsp::state.dirty = true;
+		}
+	}
+
+	void saveState()
+	{
+		savedRegs.assign(aica_reg, aica_reg + sizeof(aica_reg));
+		savedRam.assign(&aica_ram[0], &aica_ram[0] + ARAM_SIZE);
+		savedDsp = dsp::state;
+		Serializer dryrun(nullptr, std::numeric_limits<size_t>::max());
+		channel_serialize(dryrun);
+		savedChannels.resize(dryrun.size());
+		Serializer ser(savedChannels.data(), savedChannels.size());
+		channel_serialize(ser);
+	}
+
+	void restoreState()
+	{
+		memcpy(aica_reg, savedRegs.data(), savedRegs.size());
+		memcpy(&aica_ram[0], savedRam.data(), savedRam.size());
+		dsp::state = savedDsp;
+		dsp::state.dirty = true;
+		Deserializer deser(savedChannels.data(), savedChannels.size());
+		channel_deserialize(deser);
+	}
+
+	std::vector<u32> runSingle(int blocks)
+	{
+		output.clear();
+		for (int i = 0; i < blocks * 32; i++)
+			AICA_Sample();
+		FlushAudio();
+		return output;
+	}
+
+	std::vector<u32> runBatch(int blocks)
+	{
+		output.clear();
+		for (int i = 0; i < blocks; i++)
+			AICA_Sample32();
+		FlushAudio();
+		return output;
+	}
+
+	void compare(bool withDsp)
+	{
+		setupChannels(withDsp);
+		saveState();
+		// multiple of the audio buffer size
+		const int blocks = 64;
+		std::vector<u32> single = runSingle(blocks);
+		restoreState();
+		std::vector<u32> batch = runBatch(blocks);
+		ASSERT_EQ((size_t)blocks * 32, single.size());
+		ASSERT_EQ(single.size(), batch.size());
+		for (size_t i = 0; i < single.size(); i++)
+			ASSERT_EQ(single[i], batch[i]) << "sample " << i;
+		int nonZero = 0;
+		for (u32 s : single)
+			nonZero += s != 0;
+		ASSERT_GT(nonZero, (int)single.size() / 2);
+	}
+
+	std::vector<u8> savedRegs;
+	std::vector<u8> savedRam;
+	std::vector<u8> savedChannels;
+	dsp::DSPState savedDsp;
+};
+
+TEST_F(AicaMixerTest, BitExact)
+{
+	compare(false);
+}
+
+TEST_F(AicaMixerTest, BitExactDsp)
+{
+	compare(true);
+}
+
+TEST_F(AicaMixerTest, DISABLED_Benchmark)
+{
+	setupChannels(false);
+	saveState();
+	const int blocks = 2048;
+	const double singleTime = benchmark::timeMillis([&]() { runSingle(blocks); });
+	restoreState();
+	const double batchTime = benchmark::timeMillis([&]() { runBatch(blocks); });
+	printf("AICA %d samples: AICA_Sample %.1f ms AICA_Sample32 %.1f ms\n", blocks * 32, singleTime, batchTime);
+}
@@ -0,0 +1,451 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/sh4_mmr.h"
+#include "hw/sh4/dyna/asynccompile.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "benchmark.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+class AsyncCompileTest : public ::testing::Test {
+protected:
+	struct Job
+	{
+		u32 value;
+		u32 result;
+	};
+	using Queue = AsyncCompileQueue<Job>;
+
+	static std::unique_ptr<Job> makeJob(u32 value)
+	{
+		std::unique_ptr<Job> job(new Job());
+		job->value = value;
+		job->result = 0;
+		return job;
+	}
+};
+
+TEST_F(AsyncCompileTest, Jobs)
+{
+	Queue queue([](Job& job) {
+		job.result = job.value * 2;
+		// odd values fail
+		return job.value % 2 == 0;
+	}, 100);
+	queue.start();
+	for (u32 i = 0; i < 100; i++)
+		ASSERT_TRUE(queue.request(i * 2, makeJob(i)));
+	// one job per address
+	ASSERT_FALSE(queue.request(0, makeJob(0)));
+	// queue full
+	ASSERT_FALSE(queue.request(1000, makeJob(0)));
+	ASSERT_EQ(100u, queue.size());
+	queue.flush();
+
+	for (u32 i = 0; i < 100; i++)
+	{
+		ASSERT_TRUE(queue.contains(i * 2));
+		bool success = false;
+		std::chrono::microseconds latency(0);
+		std::unique_ptr<Job> job = queue.take(i * 2, success, latency);
+		ASSERT_NE(nullptr, job.get());
+		ASSERT_EQ(i, job->value);
+		ASSERT_EQ(i * 2, job->result);
+		ASSERT_EQ(i % 2 == 0, success);
+		ASSERT_FALSE(queue.contains(i * 2));
+		ASSERT_EQ(nullptr, queue.take(i * 2, success, latency).get());
+	}
+	ASSERT_EQ(0u, queue.size());
+}
+
+// Jobs can't be taken before they're processed, and the emulation thread never waits for the compile thread
+TEST_F(AsyncCompileTest, Pending)
+{
+	std::atomic<bool> release(false);
+	Queue queue([&release](Job& job) {
+		while (!release)
+			std::this_thread::yield();
+		job.result = 1;
+		return true;
+	}, 10);
+	queue.start();
+	ASSERT_TRUE(queue.request(0x8c010000, makeJob(0)));
+	ASSERT_TRUE(queue.request(0x8c010100, makeJob(1)));
+	bool success = false;
+	std::chrono::microseconds latency(0);
+	ASSERT_EQ(nullptr, queue.take(0x8c010000, success, latency).get());
+	ASSERT_TRUE(queue.contains(0x8c010000));
+
+	release = true;
+	queue.flush();
+	std::unique_ptr<Job> job = queue.take(0x8c010100, success, latency);
+	ASSERT_NE(nullptr, job.get());
+	ASSERT_TRUE(success);
+	ASSERT_EQ(1u, job->result);
+	ASSERT_GE(latency.count(), 0);
+}
+
+TEST_F(AsyncCompileTest, Clear)
+{
+	std::atomic<int> started(0);
+	std::atomic<int> processed(0);
+	std::atomic<bool> release(false);
+	Queue queue([&](Job&) {
+		started++;
+		while (!release)
+			std::this_thread::yield();
+		processed++;
+		return true;
+	}, 1000);
+	queue.start();
+	for (u32 i = 0; i < 10; i++)
+		ASSERT_TRUE(queue.request(i, makeJob(i)));
+	while (started == 0)
+		std::this_thread::yield();
+	std::thread releaser([&release]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		release = true;
+	});
+	// waits for the first job, and drops the other ones
+	queue.clear();
+	releaser.join();
+	ASSERT_EQ(1, processed);
+	ASSERT_EQ(0u, queue.size());
+
+	// still usable
+	ASSERT_TRUE(queue.request(0, makeJob(0)));
+	queue.flush();
+	ASSERT_EQ(2, processed);
+	bool success = false;
+	std::chrono::microseconds latency(0);
+	ASSERT_NE(nullptr, queue.take(0, success, latency).get());
+
+	queue.stop();
+	ASSERT_FALSE(queue.running());
+	queue.start();
+	ASSERT_TRUE(queue.running());
+}
+
+// Processed jobs can be taken in completion order
+TEST_F(AsyncCompileTest, TakeDone)
+{
+	Queue queue([](Job& job) {
+		job.result = job.value + 1;
+		return job.value != 2;
+	}, 10);
+	queue.start();
+	u32 addr = 0;
+	bool success = false;
+	std::chrono::microseconds latency(0);
+	ASSERT_EQ(nullptr, queue.takeDone(addr, success, latency).get());
+	for (u32 i = 0; i < 4; i++)
+		ASSERT_TRUE(queue.request(0x100 + i, makeJob(i)));
+	queue.flush();
+	// already taken by address
+	ASSERT_NE(nullptr, queue.take(0x101, success, latency).get());
+
+	for (u32 i : { 0, 2, 3 })
+	{
+		std::unique_ptr<Job> job = queue.takeDone(addr, success, latency);
+		ASSERT_NE(nullptr, job.get());
+		ASSERT_EQ(0x100 + i, addr);
+		ASSERT_EQ(i + 1, job->result);
+		ASSERT_EQ(i != 2, success);
+	}
+	ASSERT_EQ(nullptr, queue.takeDone(addr, success, latency).get());
+	ASSERT_EQ(0u, queue.size());
+}
+
+// Time spent by the emulation thread when new blocks are found, compiling them synchronously or queuing them
+TEST_F(AsyncCompileTest, DISABLED_Benchmark)
+{
+	auto compile = [](Job& job) {
+		// simulated decoding and optimization
+		u32 v = job.value;
+		for (int i = 0; i < 20000; i++)
+			v = v * 1664525 + 1013904223;
+		job.result = v;
+		return true;
+	};
+	const u32 blocks = 500;
+
+	u32 syncResult = 0;
+	const double syncTime = benchmark::timeMillis([&]() {
+		for (u32 i = 0; i < blocks; i++)
+		{
+			Job job { i, 0 };
+			compile(job);
+			syncResult ^= job.result;
+		}
+	});
+
+	Queue queue(compile, blocks);
+	queue.start();
+	const double requestTime = benchmark::timeMillis([&]() {
+		for (u32 i = 0; i < blocks; i++)
+			EXPECT_TRUE(queue.request(i, makeJob(i)));
+	});
+	queue.flush();
+
+	u64 totalLatency = 0;
+	u32 asyncResult = 0;
+	for (u32 i = 0; i < blocks; i++)
+	{
+		bool success = false;
+		std::chrono::microseconds latency(0);
+		std::unique_ptr<Job> job = queue.take(i, success, latency);
+		ASSERT_NE(nullptr, job.get());
+		totalLatency += latency.count();
+		asyncResult ^= job->result;
+	}
+	ASSERT_EQ(syncResult, asyncResult);
+	printf("%u new blocks: synchronous compile %.2f ms, async requests %.2f ms, average latency %.2f ms\n",
+			blocks, syncTime, requestTime, totalLatency / 1000.0 / blocks);
+}
+
+constexpr u16 Nop = 0x0009;
+constexpr u16 Illegal = 0x0001;
+
+// block addresses
+constexpr u32 A = 0x8C010000;
+constexpr u32 B = 0x8C010100;
+constexpr u32 Vbr = 0x8C000000;
+
+// Blocks compiled in the background and run by the interpreter until then
+class AsyncCompileDriverTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		mem_map_default();
+		asyncCompile = config::DynarecAsyncCompile;
+		config::DynarecAsyncCompile.set(true);
+		dc_reset(true);
+		ctx = &p_sh4rcb->cntx;
+		ctx->CpuRunning = true;
+		ctx->cycle_counter = SH4_TIMESLICE;
+		ctx->vbr = Vbr;
+		ctx->sr.BL = 0;
+	}
+
+	void TearDown() override
+	{
+		ctx->CpuRunning = false;
+		config::DynarecAsyncCompile.set(asyncCompile);
+	}
+
+	void write(u32 addr, std::initializer_list<u16> ops)
+	{
+		for (u16 op : ops)
+		{
+			_vmem_WriteMem16(addr, op);
+			addr += 2;
+		}
+	}
+
+	static u16 bra(u32 pc, u32 target) { return 0xA000 | (((target - pc - 4) / 2) & 0xfff); }
+	static u16 movImm(int rn, int imm) { return 0xE000 | (rn << 8) | (u8)imm; }
+	static u16 addImm(int rn, int imm) { return 0x7000 | (rn << 8) | (u8)imm; }
+
+	// Loop incrementing r1, and r2 in the delay slot
+	void writeLoop(u32 pc) {
+		write(pc, { addImm(1, 1), bra(pc + 2, pc), addImm(2, 1) });
+	}
+
+	Sh4Context *ctx = nullptr;
+	bool asyncCompile = false;
+};
+
+TEST_F(AsyncCompileDriverTest, ExecuteUntilBranch)
+{
+	write(A, { movImm(1, 5), movImm(2, 6), bra(A + 4, B), movImm(3, 7) });
+	ctx->pc = A;
+	// the delay slot is executed with its branch
+	ASSERT_EQ(3u, ExecuteUntilBranch());
+	ASSERT_EQ(B, ctx->pc);
+	ASSERT_EQ(5u, ctx->r[1]);
+	ASSERT_EQ(6u, ctx->r[2]);
+	ASSERT_EQ(7u, ctx->r[3]);
+	ASSERT_EQ(SH4_TIMESLICE - 4 * CPU_RATIO, ctx->cycle_counter);
+}
+
+TEST_F(AsyncCompileDriverTest, ExecuteUntilBranchTimeSlice)
+{
+	write(A, { addImm(1, 1), addImm(1, 1), addImm(1, 1), addImm(1, 1), addImm(1, 1) });
+	ctx->pc = A;
+	ctx->cycle_counter = 3 * CPU_RATIO;
+	ASSERT_EQ(3u, ExecuteUntilBranch());
+	ASSERT_EQ(A + 6, ctx->pc);
+	ASSERT_EQ(3u, ctx->r[1]);
+	ASSERT_EQ(0, ctx->cycle_counter);
+}
+
+TEST_F(AsyncCompileDriverTest, ExecuteUntilBranchException)
+{
+	write(A, { movImm(1, 1), Illegal, movImm(2, 2) });
+	ctx->pc = A;
+	ASSERT_EQ(1u, ExecuteUntilBranch());
+	ASSERT_EQ(Vbr + 0x100, ctx->pc);
+	ASSERT_EQ(A + 2, ctx->spc);
+	ASSERT_EQ(0x180u, CCN_EXPEVT);
+	ASSERT_EQ(1u, ctx->r[1]);
+	ASSERT_EQ(0u, ctx->r[2]);
+	ASSERT_EQ(SH4_TIMESLICE - 6 * CPU_RATIO, ctx->cycle_counter);
+
+	// in a delay slot, the exception is raised at the branch
+	write(B, { bra(B, A), Illegal });
+	ctx->pc = B;
+	ctx->sr.BL = 0;
+	ExecuteUntilBranch();
+	ASSERT_EQ(Vbr + 0x100, ctx->pc);
+	ASSERT_EQ(B, ctx->spc);
+	ASSERT_EQ(0x1A0u, CCN_EXPEVT);
+}
+
+#if FEAT_SHREC == DYNAREC_JIT && (HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86)
+
+// The interpreter runs the block until it's compiled
+TEST_F(AsyncCompileDriverTest, InterpretUntilCompiled)
+{
+	writeLoop(A);
+	const AsyncCompileStats before = rdv_GetAsyncCompileStats();
+	DynarecCodeEntryPtr code = rdv_FailedToFindBlock(A);
+	const AsyncCompileStats after = rdv_GetAsyncCompileStats();
+
+	ASSERT_NE(nullptr, (void *)code);
+	ASSERT_EQ(code, bm_GetCodeByVAddr(A));
+	ASSERT_EQ(A, ctx->pc);
+	ASSERT_EQ(before.requests + 1, after.requests);
+	ASSERT_EQ(before.installed + 1, after.installed);
+	ASSERT_EQ(before.rejected, after.rejected);
+	const u64 fallbacks = after.fallbacks - before.fallbacks;
+	ASSERT_GE(fallbacks, 1u);
+	ASSERT_EQ(fallbacks, ctx->r[1]);
+	ASSERT_EQ(fallbacks, ctx->r[2]);
+	ASSERT_EQ(fallbacks * 2, after.interpretedOps - before.interpretedOps);
+}
+
+TEST_F(AsyncCompileDriverTest, Install)
+{
+	writeLoop(A);
+	ASSERT_TRUE(rdv_RequestAsyncCompile(A));
+	const AsyncCompileStats before = rdv_GetAsyncCompileStats();
+	DynarecCodeEntryPtr code = rdv_FailedToFindBlock(A);
+	const AsyncCompileStats after = rdv_GetAsyncCompileStats();
+
+	ASSERT_NE(nullptr, (void *)code);
+	ASSERT_EQ(code, bm_GetCodeByVAddr(A));
+	ASSERT_EQ(before.installed + 1, after.installed);
+	ASSERT_EQ(before.fallbacks, after.fallbacks);
+	ASSERT_TRUE(bm_GetBlock(A)->read_only);
+}
+
+// Blocks are installed when they're done, before they're run
+TEST_F(AsyncCompileDriverTest, EagerInstall)
+{
+	writeLoop(A);
+	writeLoop(B);
+	ASSERT_TRUE(rdv_RequestAsyncCompile(B));
+	ASSERT_EQ(ngen_FailedToFindBlock, bm_GetCodeByVAddr(B));
+	const AsyncCompileStats before = rdv_GetAsyncCompileStats();
+	ASSERT_NE(nullptr, (void *)rdv_FailedToFindBlock(A));
+	const AsyncCompileStats after = rdv_GetAsyncCompileStats();
+
+	ASSERT_EQ(before.installed + 2, after.installed);
+	ASSERT_NE(ngen_FailedToFindBlock, bm_GetCodeByVAddr(B));
+	ASSERT_NE(ngen_FailedToFindBlock, bm_GetCodeByVAddr(A));
+	// B has never been run
+	ASSERT_EQ(A, ctx->pc);
+}
+
+// The guest code is changed after the block is decoded
+TEST_F(AsyncCompileDriverTest, CodeChanged)
+{
+	writeLoop(A);
+	ASSERT_TRUE(rdv_RequestAsyncCompile(A));
+	write(A, { addImm(1, 1), addImm(1, 1), bra(A + 4, A), addImm(2, 1) });
+	const AsyncCompileStats before = rdv_GetAsyncCompileStats();
+	ASSERT_NE(nullptr, (void *)rdv_FailedToFindBlock(A));
+	const AsyncCompileStats after = rdv_GetAsyncCompileStats();
+
+	ASSERT_EQ(before.rejected + 1, after.rejected);
+	ASSERT_EQ(before.installed, after.installed);
+	// compiled again from the new code
+	ASSERT_EQ(8u, bm_GetBlock(A)->sh4_code_size);
+
+	// any change in the two pages that the decoder may read
+	const u32 pc = A + 2 * PAGE_SIZE;
+	writeLoop(pc);
+	ASSERT_TRUE(rdv_RequestAsyncCompile(pc));
+	_vmem_WriteMem16(pc + PAGE_SIZE, Nop);
+	ASSERT_NE(nullptr, (void *)rdv_FailedToFindBlock(pc));
+	ASSERT_EQ(before.rejected + 2, rdv_GetAsyncCompileStats().rejected);
+}
+
+// The FPU mode is changed after the block is decoded
+TEST_F(AsyncCompileDriverTest, FpscrChanged)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		// the page of the previous block is write-protected
+		const u32 pc = A + i * PAGE_SIZE;
+		writeLoop(pc);
+		ctx->fpscr.full = 0;
+		ASSERT_TRUE(rdv_RequestAsyncCompile(pc));
+		switch (i)
+		{
+		case 0:
+			ctx->fpscr.PR = 1;
+			break;
+		case 1:
+			ctx->fpscr.SZ = 1;
+			break;
+		case 2:
+			ctx->fpscr.RM = 1;
+			break;
+		}
+		const AsyncCompileStats before = rdv_GetAsyncCompileStats();
+		ASSERT_NE(nullptr, (void *)rdv_FailedToFindBlock(pc));
+		const AsyncCompileStats after = rdv_GetAsyncCompileStats();
+		ASSERT_EQ(before.rejected + 1, after.rejected) << i;
+		ASSERT_EQ(before.installed, after.installed) << i;
+		ASSERT_EQ(ctx->fpscr.PR, bm_GetBlock(pc)->fpu_cfg.PR) << i;
+		ASSERT_EQ(ctx->fpscr.SZ, bm_GetBlock(pc)->fpu_cfg.SZ) << i;
+		ASSERT_EQ(ctx->fpscr.RM, bm_GetBlock(pc)->fpu_cfg.RM) << i;
+	}
+	ctx->fpscr.full = 0;
+}
+
+// The code page is written after the block is decoded as write-protected
+TEST_F(AsyncCompileDriverTest, ProtectionChanged)
+{
+	writeLoop(A);
+	ASSERT_TRUE(rdv_RequestAsyncCompile(A));
+	bm_RamWriteAccess(A);
+	ASSERT_FALSE(bm_IsRamPageProtected(A));
+	const AsyncCompileStats before = rdv_GetAsyncCompileStats();
+	ASSERT_NE(nullptr, (void *)rdv_FailedToFindBlock(A));
+	ASSERT_EQ(before.rejected + 1, rdv_GetAsyncCompileStats().rejected);
+	ASSERT_FALSE(bm_GetBlock(A)->read_only);
+
+	// The rejected block has been discarded and removed from the page lists,
+	// so only the new one is found when the page is protected again.
+	write(A, { addImm(1, 2) });
+	bm_Periodical_1s();
+	ASSERT_TRUE(bm_IsRamPageProtected(A));
+	ASSERT_EQ(ngen_FailedToFindBlock, bm_GetCodeByVAddr(A));
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "oslib/audiostream.h"
+#include "cfg/option.h"
+
+#include <chrono>
+#include <thread>
+
+static std::vector<u32> output;
+static u32 blockingPushes;
+
+static void captureInit() {
+}
+
+static u32 capturePush(const void *data, u32 frames, bool wait)
+{
+	if (wait)
+		blockingPushes++;
+	const u32 *samples = (const u32 *)data;
+	output.insert(output.end(), samples, samples + frames);
+	return 1;
+}
+
+static void captureTerm() {
+}
+
+static audiobackend_t captureBackend = {
+	"audiotest",
+	"Audio stream test",
+	&captureInit,
+	&capturePush,
+	&captureTerm,
+	nullptr
+};
+static bool captureRegistered = RegisterAudioBackend(&captureBackend);
+
+class AudioStreamTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		config::AudioBackend.set("audiotest");
+		config::AudioVolume.set(100);
+		config::AudioVolume.calcDbPower();
+		output.clear();
+		blockingPushes = 0;
+	}
+
+	void TearDown() override
+	{
+		TermAudio();
+		config::AudioBackend.set("auto");
+		config::AudioDynamicRate.set(true);
+		config::AudioLatencyTarget.reset();
+	}
+
+	// Left and right channels are increasing ramps
+	void writeRamp(int frames)
+	{
+		for (int i = 0; i < frames; i++, rampValue++)
+			WriteSample((s16)(rampValue / 4), (s16)(rampValue / 2));
+	}
+
+	int rampValue = -32768;
+};
+
+TEST_F(AudioStreamTest, PassThrough)
+{
+	config::AudioDynamicRate.set(false);
+	InitAudio();
+	writeRamp(SAMPLE_COUNT * 32);
+	FlushAudio();
+	ASSERT_EQ(SAMPLE_COUNT * 32, output.size());
+	const float volume = config::AudioVolume.dbPower();
+	for (u32 i = 0; i < output.size(); i++)
+	{
+		const int v = -32768 + (int)i;
+		const s16 l = (s16)(v / 2) * volume;
+		const s16 r = (s16)(v / 4) * volume;
+		ASSERT_EQ((u32)(u16)l | ((u32)(u16)r << 16), output[i]) << "sample " << i;
+	}
+	AudioStats stats = GetAudioStats();
+	ASSERT_EQ(1.f, stats.rateRatio);
+	ASSERT_EQ(0u, stats.overruns);
+	// The backend only blocks when the frame rate is limited
+	ASSERT_EQ(config::LimitFPS ? 32u : 0u, blockingPushes);
+}
+
+TEST_F(AudioStreamTest, DynamicRate)
+{
+	config::AudioDynamicRate.set(true);
+	config::AudioLatencyTarget.set(16384);
+	InitAudio();
+	// The buffer stays below half of its target so the samples are stretched
+	writeRamp(SAMPLE_COUNT * 16);
+	FlushAudio();
+	AudioStats stats = GetAudioStats();
+	ASSERT_GT(stats.rateRatio, 1.f);
+	ASSERT_LE(stats.rateRatio, 1.0051f) << stats.rateRatio;
+	ASSERT_EQ(0u, stats.overruns);
+	ASSERT_EQ(SAMPLE_COUNT * 16, output.size());
+	// Interpolated samples must still be increasing
+	for (u32 i = 1; i < output.size(); i++)
+	{
+		ASSERT_GE((s16)output[i], (s16)output[i - 1]) << "sample " << i;
+		ASSERT_GE((s16)(output[i] >> 16), (s16)(output[i - 1] >> 16)) << "sample " << i;
+	}
+}
+
+TEST_F(AudioStreamTest, Underrun)
+{
+	config::AudioDynamicRate.set(false);
+	InitAudio();
+	ASSERT_EQ(0u, GetAudioStats().underruns);
+	for (int i = 1; i <= 2; i++)
+	{
+		writeRamp(SAMPLE_COUNT);
+		FlushAudio();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		// Only counted once per starvation
+		ASSERT_EQ((u64)i, GetAudioStats().underruns);
+	}
+}
@@ -0,0 +1,256 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/dyna/blockcache.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/decoder.h"
+#include "oslib/oslib.h"
+#include "version.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+void AnalyseBlock(RuntimeBlockInfo* blk);
+
+constexpr u16 Nop = 0x0009;
+
+// block address, in a page that can be write-protected
+constexpr u32 A = 0x8C010000;
+constexpr u32 B = 0x8C010100;
+
+class BlockCacheTest : public ::testing::Test {
+protected:
+	struct TestBlock : RuntimeBlockInfo
+	{
+		u32 Relink() override { return 0; }
+		void Relocate(void *) override {}
+	};
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		mem_map_default();
+		dc_reset(true);
+		p_sh4rcb->cntx.sr.FD = 0;
+		p_sh4rcb->cntx.fpscr.full = 0;
+
+		persistentCache = config::DynarecPersistentCache;
+		idleSkip = config::DynarecIdleSkip;
+		gameId = settings.content.gameId;
+		dataDir = get_writable_data_path("");
+		config::DynarecPersistentCache.set(true);
+		config::DynarecIdleSkip.set(true);
+		settings.content.gameId = "BLOCK_CACHE_TEST";
+		const char *tmpdir = getenv("TMPDIR");
+#ifdef _WIN32
+		if (tmpdir == nullptr)
+			tmpdir = getenv("TEMP");
+#endif
+		set_user_data_dir(std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/");
+		path = hostfs::getShaderCachePath("BLOCK_CACHE_TEST.blkcache");
+		std::remove(path.c_str());
+		EventManager::event(Event::Start);
+
+		write(A, { 0xE105, 0x7101, bra(A + 4, B), Nop });	// mov #5,r1; add #1,r1; bra B; nop
+	}
+
+	void TearDown() override
+	{
+		EventManager::event(Event::Terminate);
+		std::remove(path.c_str());
+		set_user_data_dir(dataDir);
+		settings.content.gameId = gameId;
+		config::DynarecIdleSkip.set(idleSkip);
+		config::DynarecPersistentCache.set(persistentCache);
+	}
+
+	void write(u32 addr, std::initializer_list<u16> ops)
+	{
+		for (u16 op : ops)
+		{
+			_vmem_WriteMem16(addr, op);
+			addr += 2;
+		}
+	}
+
+	static u16 bra(u32 pc, u32 target) { return 0xA000 | (((target - pc - 4) / 2) & 0xfff); }
+
+	void decode(TestBlock& block, u32 pc)
+	{
+		block.Init(pc, p_sh4rcb->cntx.fpscr);
+		ASSERT_TRUE(dec_DecodeBlock(&block, SH4_TIMESLICE / 2, true));
+		AnalyseBlock(&block);
+	}
+
+	// Decodes the block at pc and adds it to the cache
+	void add(u32 pc)
+	{
+		TestBlock block;
+		decode(block, pc);
+		block.SetProtectedFlags();
+		bc_Add(&block);
+		block.Discard();
+		bm_UnlockPage(pc);
+	}
+
+	bool restore(TestBlock& block, u32 pc)
+	{
+		block.Init(pc, p_sh4rcb->cntx.fpscr);
+		bool blockProtected;
+		bool rv = bc_Restore(&block, blockProtected);
+		if (blockProtected)
+			block.Discard();
+		bm_UnlockPage(pc);
+		return rv;
+	}
+
+	bool restore(u32 pc)
+	{
+		TestBlock block;
+		return restore(block, pc);
+	}
+
+	// Saves the cache and loads it back
+	void reload()
+	{
+		EventManager::event(Event::Pause);
+		EventManager::event(Event::Start);
+	}
+
+	// Overwrites the cache file at the given offset
+	void patchFile(long offset, u8 value)
+	{
+		FILE *f = fopen(path.c_str(), "r+b");
+		ASSERT_NE(nullptr, f);
+		fseek(f, offset, SEEK_SET);
+		fwrite(&value, 1, 1, f);
+		fclose(f);
+	}
+
+	bool persistentCache = false;
+	bool idleSkip = false;
+	std::string gameId;
+	std::string dataDir;
+	std::string path;
+};
+
+TEST_F(BlockCacheTest, SaveLoad)
+{
+	add(A);
+	reload();
+	TestBlock decoded;
+	decode(decoded, A);
+	TestBlock block;
+	ASSERT_TRUE(restore(block, A));
+	ASSERT_EQ(decoded.sh4_code_size, block.sh4_code_size);
+	ASSERT_EQ(decoded.guest_opcodes, block.guest_opcodes);
+	ASSERT_EQ(decoded.guest_cycles, block.guest_cycles);
+	ASSERT_EQ(decoded.BlockType, block.BlockType);
+	ASSERT_EQ(B, block.BranchBlock);
+	ASSERT_EQ(decoded.oplist.size(), block.oplist.size());
+	for (size_t i = 0; i < block.oplist.size(); i++)
+	{
+		ASSERT_EQ(decoded.oplist[i].op, block.oplist[i].op) << i;
+		ASSERT_EQ(decoded.oplist[i].rd._imm, block.oplist[i].rd._imm) << i;
+		ASSERT_EQ(decoded.oplist[i].rs1._imm, block.oplist[i].rs1._imm) << i;
+		ASSERT_EQ(decoded.oplist[i].guest_offs, block.oplist[i].guest_offs) << i;
+	}
+	// Not cached
+	ASSERT_FALSE(restore(B));
+}
+
+TEST_F(BlockCacheTest, CodeChanged)
+{
+	add(A);
+	reload();
+	write(A + 2, { 0x7102 });	// add #2,r1
+	ASSERT_FALSE(restore(A));
+}
+
+// Read-only blocks are optimized using the content of their pages
+TEST_F(BlockCacheTest, PageChanged)
+{
+	add(A);
+	reload();
+	write(A + 0x800, { Nop });
+	ASSERT_FALSE(restore(A));
+}
+
+TEST_F(BlockCacheTest, FpscrKey)
+{
+	add(A);
+	reload();
+	p_sh4rcb->cntx.fpscr.PR = 1;
+	ASSERT_FALSE(restore(A));
+	p_sh4rcb->cntx.fpscr.PR = 0;
+	p_sh4rcb->cntx.fpscr.SZ = 1;
+	ASSERT_FALSE(restore(A));
+	p_sh4rcb->cntx.fpscr.SZ = 0;
+	p_sh4rcb->cntx.fpscr.RM = 1;
+	ASSERT_FALSE(restore(A));
+	p_sh4rcb->cntx.fpscr.RM = 0;
+	ASSERT_TRUE(restore(A));
+}
+
+TEST_F(BlockCacheTest, IdleSkipChanged)
+{
+	add(A);
+	EventManager::event(Event::Pause);
+	config::DynarecIdleSkip.set(false);
+	EventManager::event(Event::Start);
+	ASSERT_FALSE(restore(A));
+}
+
+TEST_F(BlockCacheTest, BuildChanged)
+{
+	add(A);
+	EventManager::event(Event::Pause);
+	// first character of the git hash, after the magic, version and hash length
+	patchFile(12, '#');
+	EventManager::event(Event::Start);
+	ASSERT_FALSE(restore(A));
+}
+
+TEST_F(BlockCacheTest, Corrupted)
+{
+	add(A);
+	EventManager::event(Event::Pause);
+	FILE *f = fopen(path.c_str(), "rb");
+	ASSERT_NE(nullptr, f);
+	fseek(f, 0, SEEK_END);
+	const long size = ftell(f);
+	fclose(f);
+
+	// invalid shil opcode of the first op
+	std::string data(size, '\0');
+	f = fopen(path.c_str(), "rb");
+	ASSERT_EQ((size_t)size, fread(&data[0], 1, size, f));
+	fclose(f);
+	// header, block count, key, hashes, sizes, branches, type, flags and op count
+	const long firstOp = 12 + strlen(GIT_HASH) + 1 + 4 + 8 + 8 + 8 + 4 * 6 + 1 + 4;
+	for (int i = 0; i < 4; i++)
+		patchFile(firstOp + i, 0xff);
+	EventManager::event(Event::Start);
+	ASSERT_FALSE(restore(A));
+
+	// truncated
+	f = fopen(path.c_str(), "wb");
+	ASSERT_NE(nullptr, f);
+	fwrite(data.data(), 1, size / 2, f);
+	fclose(f);
+	EventManager::event(Event::Start);
+	ASSERT_FALSE(restore(A));
+}
+
+#endif
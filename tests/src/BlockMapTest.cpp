@@ -0,0 +1,183 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/sh4/dyna/blockmap.h"
+#include "benchmark.h"
+
+#include <cstdio>
+#include <map>
+#include <random>
+
+class BlockMapTest : public ::testing::Test {
+protected:
+	// Simulates blocks emitted sequentially in a code buffer
+	static std::vector<std::pair<uintptr_t, u32>> makeBlocks(size_t count)
+	{
+		std::vector<std::pair<uintptr_t, u32>> blocks;
+		std::mt19937 rng(42);
+		uintptr_t addr = 0x10000000;
+		for (size_t i = 0; i < count; i++)
+		{
+			u32 size = 32 + rng() % 512;
+			blocks.emplace_back(addr, size);
+			addr += size;
+		}
+		return blocks;
+	}
+
+	template<typename Insert, typename Lookup, typename Erase>
+	static void benchmark(const char *name, size_t count, Insert insert, Lookup lookup, Erase erase)
+	{
+		auto blocks = makeBlocks(count);
+		const double insertTime = benchmark::timeMillis([&]() {
+			for (const auto& block : blocks)
+				insert(block.first, block.second);
+		});
+
+		std::mt19937 rng(1);
+		std::vector<uintptr_t> probes;
+		for (size_t i = 0; i < 1000000; i++)
+		{
+			const auto& block = blocks[rng() % blocks.size()];
+			probes.push_back(block.first + rng() % block.second);
+		}
+		size_t found = 0;
+		const double lookupTime = benchmark::timeMillis([&]() {
+			for (uintptr_t probe : probes)
+				found += lookup(probe);
+		});
+		ASSERT_EQ(probes.size(), found);
+
+		// Invalidate half of the blocks in random order
+		std::shuffle(blocks.begin(), blocks.end(), rng);
+		const double eraseTime = benchmark::timeMillis([&]() {
+			for (size_t i = 0; i < blocks.size() / 2; i++)
+				erase(blocks[i].first);
+		});
+
+		printf("%-14s %7zu blocks: insert %7.2f ms, 1M lookups %7.2f ms, invalidate %7.2f ms\n",
+				name, count, insertTime, lookupTime, eraseTime);
+	}
+};
+
+TEST_F(BlockMapTest, Basic)
+{
+	BlockCodeMap<int, 4> map;
+	ASSERT_TRUE(map.empty());
+	ASSERT_EQ(nullptr, map.floor((void *)100));
+
+	for (int i = 10; i > 0; i--)
+		ASSERT_TRUE(map.insert((void *)(uintptr_t)(i * 100), i));
+	ASSERT_FALSE(map.insert((void *)500, 0));
+	ASSERT_EQ(10u, map.size());
+
+	ASSERT_EQ(nullptr, map.floor((void *)99));
+	ASSERT_EQ(1, *map.floor((void *)100));
+	ASSERT_EQ(1, *map.floor((void *)199));
+	ASSERT_EQ(5, *map.floor((void *)550));
+	ASSERT_EQ(10, *map.floor((void *)100000));
+	ASSERT_EQ(7, *map.find((void *)700));
+	ASSERT_EQ(nullptr, map.find((void *)701));
+
+	int expected = 1;
+	for (const auto& entry : map)
+	{
+		ASSERT_EQ((uintptr_t)(expected * 100), entry.first);
+		ASSERT_EQ(expected, entry.second);
+		expected++;
+	}
+	ASSERT_EQ(11, expected);
+
+	ASSERT_TRUE(map.erase((void *)500));
+	ASSERT_FALSE(map.erase((void *)500));
+	ASSERT_EQ(4, *map.floor((void *)550));
+	ASSERT_TRUE(map.erase((void *)100));
+	ASSERT_EQ(nullptr, map.floor((void *)150));
+	map.clear();
+	ASSERT_TRUE(map.empty());
+	ASSERT_TRUE(map.begin() == map.end());
+}
+
+TEST_F(BlockMapTest, Random)
+{
+	BlockCodeMap<u32, 16> map;
+	std::map<uintptr_t, u32> ref;
+	std::mt19937 rng(1234);
+
+	for (int i = 0; i < 200000; i++)
+	{
+		uintptr_t key = rng() % 20000;
+		switch (rng() % 4)
+		{
+		case 0:
+		case 1:
+			ASSERT_EQ(ref.emplace(key, i).second, map.insert((void *)key, i));
+			break;
+		case 2:
+			ASSERT_EQ(ref.erase(key) == 1, map.erase((void *)key));
+			break;
+		case 3:
+			{
+				auto it = ref.upper_bound(key);
+				const u32 *v = map.floor((void *)key);
+				if (it == ref.begin())
+					ASSERT_EQ(nullptr, v);
+				else
+				{
+					ASSERT_NE(nullptr, v);
+					ASSERT_EQ(std::prev(it)->second, *v);
+				}
+			}
+			break;
+		}
+		ASSERT_EQ(ref.size(), map.size());
+	}
+	auto it = ref.begin();
+	for (const auto& entry : map)
+	{
+		ASSERT_EQ(it->first, entry.first);
+		ASSERT_EQ(it->second, entry.second);
+		++it;
+	}
+	ASSERT_TRUE(it == ref.end());
+}
+
+TEST_F(BlockMapTest, PageBlockList)
+{
+	PageBlockList<int> list;
+	ASSERT_TRUE(list.empty());
+	for (int i = 0; i < 5; i++)
+		list.add(i);
+	list.remove(2);
+	list.remove(7);
+	ASSERT_EQ(4u, list.size());
+	ASSERT_TRUE(std::find(list.begin(), list.end(), 2) == list.end());
+	std::vector<int> v = list.take();
+	ASSERT_EQ(4u, v.size());
+	ASSERT_TRUE(list.empty());
+}
+
+TEST_F(BlockMapTest, DISABLED_Benchmark)
+{
+	for (size_t count : { 10000, 100000 })
+	{
+		std::map<uintptr_t, u32> stdmap;
+		benchmark("std::map", count,
+				[&](uintptr_t addr, u32 size) { stdmap[addr] = size; },
+				[&](uintptr_t addr) {
+					auto it = stdmap.upper_bound(addr);
+					--it;
+					return addr - it->first < it->second;
+				},
+				[&](uintptr_t addr) { stdmap.erase(addr); });
+
+		// values hold the code range, like RuntimeBlockInfo does
+		BlockCodeMap<std::pair<uintptr_t, u32>> map;
+		benchmark("BlockCodeMap", count,
+				[&](uintptr_t addr, u32 size) { map.insert((void *)addr, std::make_pair(addr, size)); },
+				[&](uintptr_t addr) {
+					const std::pair<uintptr_t, u32> *block = map.floor((void *)addr);
+					return block != nullptr && addr - block->first < block->second;
+				},
+				[&](uintptr_t addr) { map.erase((void *)addr); });
+	}
+}
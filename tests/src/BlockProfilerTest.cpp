@@ -0,0 +1,69 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "profiler/blockprofiler.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class BlockProfilerTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		// vaddr, addr, runs, guest cycles, ticks, host bytes, guest ops, compiles
+		blocks = {
+			{ 0x8C010000, 0x0C010000, 100, 1200, 5000, 240, 12, 1 },
+			{ 0xA0000000, 0x00000000, 1, 8, 0, 64, 4, 1 },
+			{ 0x8C020000, 0x0C020000, 10, 400, 20000, 800, 0, 2 },
+			{ 0x8C000800, 0x0C000800, 3, 24, 5000, 30, 3, 1 },
+		};
+	}
+
+	template<typename F>
+	std::string print(F write)
+	{
+		FILE *f = tmpfile();
+		EXPECT_NE(nullptr, f);
+		if (f == nullptr)
+			return "";
+		write(f);
+		std::string s(ftell(f), '\0');
+		rewind(f);
+		EXPECT_EQ(s.size(), fread(&s[0], 1, s.size(), f));
+		fclose(f);
+		return s;
+	}
+
+	std::vector<ProfBlockStats> blocks;
+};
+
+TEST_F(BlockProfilerTest, Sort)
+{
+	prof_blockSort(blocks);
+	// by decreasing host time, then by address
+	ASSERT_EQ(0x8C020000u, blocks[0].vaddr);
+	ASSERT_EQ(0x8C000800u, blocks[1].vaddr);
+	ASSERT_EQ(0x8C010000u, blocks[2].vaddr);
+	ASSERT_EQ(0xA0000000u, blocks[3].vaddr);
+}
+
+TEST_F(BlockProfilerTest, Csv)
+{
+	prof_blockSort(blocks);
+	std::string csv = print([this](FILE *f) { prof_blockWriteCsv(f, blocks, 0.5); });
+	ASSERT_EQ("vaddr,addr,runs,guest_cycles,host_ns,ns_per_run,host_bytes,guest_opcodes,host_bytes_per_opcode,compiles\n"
+			"8C020000,0C020000,10,400,10000,1000.0,800,0,0.0,2\n"
+			"8C000800,0C000800,3,24,2500,833.3,30,3,10.0,1\n"
+			"8C010000,0C010000,100,1200,2500,25.0,240,12,20.0,1\n"
+			"A0000000,00000000,1,8,0,0.0,64,4,16.0,1\n", csv);
+}
+
+TEST_F(BlockProfilerTest, Folded)
+{
+	prof_blockSort(blocks);
+	std::string folded = print([this](FILE *f) { prof_blockWriteFolded(f, blocks); });
+	// blocks without host time are omitted
+	ASSERT_EQ("sh4;ram;sh4_8C020000 20000\n"
+			"sh4;ram;sh4_8C000800 5000\n"
+			"sh4;ram;sh4_8C010000 5000\n", folded);
+}
@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "checkpoint.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/mem/mem_watch.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_mem.h"
+#include "oslib/oslib.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Written pages are tracked by the fault handler
+class CheckpointTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		mem_map_default();
+		dc_reset(true);
+		if (!_nvmem_enabled())
+			GTEST_SKIP() << "Fast memory not available";
+		os_InstallFaultHandler();
+		faultHandler = true;
+
+		interval = config::CheckpointInterval;
+		config::CheckpointInterval.set(1);
+		contentPath = settings.content.path;
+		settings.content.path = "flycast_checkpoint_test.cdi";
+		dataDir = get_writable_data_path("");
+		const char *tmpdir = getenv("TMPDIR");
+#ifdef _WIN32
+		if (tmpdir == nullptr)
+			tmpdir = getenv("TEMP");
+#endif
+		set_user_data_dir(std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/");
+	}
+
+	void TearDown() override
+	{
+		if (!faultHandler)
+			return;
+		checkpoint::discard();
+		// Write to all the pages so that they aren't protected anymore
+		touch(&mem_b[0], RAM_SIZE);
+		touch(&vram[0], VRAM_SIZE);
+		touch(&aica_ram[0], ARAM_SIZE);
+		memwatch::reset();
+		os_UninstallFaultHandler();
+		set_user_data_dir(dataDir);
+		settings.content.path = contentPath;
+		config::CheckpointInterval.set(interval);
+	}
+
+	static void touch(u8 *p, u32 size)
+	{
+		volatile u8 *vp = p;
+		for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+			vp[offset] = vp[offset];
+	}
+
+	static void writeVram(u32 offset, u32 value) {
+		*(u32 *)&vram[offset] = value;
+	}
+	static u32 readVram(u32 offset) {
+		return *(u32 *)&vram[offset];
+	}
+
+	bool faultHandler = false;
+	int interval = 0;
+	std::string contentPath;
+	std::string dataDir;
+};
+
+TEST_F(CheckpointTest, DirtyPages)
+{
+	memwatch::startTracking();
+	ASSERT_TRUE(memwatch::ramWatcher.getDirtyPages().empty());
+	ASSERT_TRUE(memwatch::vramWatcher.getDirtyPages().empty());
+
+	WriteMem32_nommu(0x8C010004, 0x12345678);
+	WriteMem32_nommu(0x8C123000, 1);
+	// same page again
+	WriteMem32_nommu(0x8C010ff8, 2);
+	writeVram(0x2010, 0xcafebabe);
+	writeVram(0x400000, 3);
+
+	ASSERT_EQ(std::vector<u32>({ 0x10000, 0x123000 }), memwatch::ramWatcher.getDirtyPages());
+	ASSERT_EQ(std::vector<u32>({ 0x2000, 0x400000 }), memwatch::vramWatcher.getDirtyPages());
+	ASSERT_EQ(0x12345678u, ReadMem32_nommu(0x8C010004));
+	ASSERT_EQ(0xcafebabeu, readVram(0x2010));
+
+	// Tracking again forgets the pages written before
+	memwatch::startTracking();
+	ASSERT_TRUE(memwatch::ramWatcher.getDirtyPages().empty());
+	WriteMem32_nommu(0x8C123000, 4);
+	ASSERT_EQ(std::vector<u32>({ 0x123000 }), memwatch::ramWatcher.getDirtyPages());
+	ASSERT_TRUE(memwatch::vramWatcher.getDirtyPages().empty());
+}
+
+TEST_F(CheckpointTest, Recover)
+{
+	ASSERT_TRUE(checkpoint::enabled());
+	WriteMem32_nommu(0x8C010000, 0x11111111);
+	WriteMem32_nommu(0x8C200000, 0x22222222);
+	writeVram(0x1000, 0x33333333);
+	writeVram(0x200000, 0x44444444);
+	p_sh4rcb->cntx.r[0] = 1;
+	checkpoint::rebase();
+	// Full state
+	checkpoint::save();
+
+	WriteMem32_nommu(0x8C010000, 0x55555555);
+	writeVram(0x1000, 0x66666666);
+	p_sh4rcb->cntx.r[0] = 2;
+	ASSERT_EQ(std::vector<u32>({ 0x10000 }), memwatch::ramWatcher.getDirtyPages());
+	ASSERT_EQ(std::vector<u32>({ 0x0 }), memwatch::vramWatcher.getDirtyPages());
+	// Delta with the pages written since the full state
+	checkpoint::save();
+	checkpoint::term();
+
+	WriteMem32_nommu(0x8C010000, 0);
+	WriteMem32_nommu(0x8C200000, 0);
+	writeVram(0x1000, 0);
+	writeVram(0x200000, 0);
+	p_sh4rcb->cntx.r[0] = 0;
+
+	ASSERT_TRUE(checkpoint::recover());
+	ASSERT_EQ(0x55555555u, ReadMem32_nommu(0x8C010000));
+	ASSERT_EQ(0x22222222u, ReadMem32_nommu(0x8C200000));
+	ASSERT_EQ(0x66666666u, readVram(0x1000));
+	ASSERT_EQ(0x44444444u, readVram(0x200000));
+	ASSERT_EQ(2u, p_sh4rcb->cntx.r[0]);
+}
@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/sh4/dyna/codesegments.h"
+
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+class CodeSegmentsTest : public ::testing::Test {
+protected:
+	using Segments = CodeSegments<4>;
+	static constexpr u32 BufferSize = 4 * 1024 * 1024;
+	const u32 NoPin = Segments::SegmentCount;
+};
+
+TEST_F(CodeSegmentsTest, Layout)
+{
+	CodeSegments<3> segments(1000);
+	ASSERT_EQ(0u, segments.start(0));
+	ASSERT_EQ(333u, segments.end(0));
+	ASSERT_EQ(666u, segments.start(2));
+	ASSERT_EQ(1000u, segments.end(2));
+	ASSERT_EQ(1u, segments.segmentOf(665));
+	ASSERT_EQ(2u, segments.segmentOf(999));
+	ASSERT_EQ(0u, segments.current());
+	ASSERT_TRUE(segments.used(0));
+	ASSERT_FALSE(segments.used(1));
+}
+
+TEST_F(CodeSegmentsTest, Victims)
+{
+	Segments segments(BufferSize);
+	u64 lookups[Segments::SegmentCount] {};
+	// unused segments first
+	for (u32 i = 1; i < Segments::SegmentCount; i++)
+	{
+		u32 next = segments.next(lookups, NoPin);
+		ASSERT_EQ(i, next);
+		ASSERT_FALSE(segments.used(next));
+		segments.use(next);
+	}
+	// then the oldest one
+	ASSERT_EQ(0u, segments.next(lookups, NoPin));
+	// unless it's pinned
+	ASSERT_EQ(1u, segments.next(lookups, 0));
+	// or hotter than another one
+	lookups[0] = 10;
+	lookups[1] = 5;
+	lookups[2] = 1;
+	lookups[3] = 20;
+	ASSERT_EQ(2u, segments.next(lookups, NoPin));
+	segments.use(2);
+	// the current segment is never reused
+	lookups[2] = 0;
+	ASSERT_EQ(1u, segments.next(lookups, NoPin));
+
+	segments.reset();
+	ASSERT_EQ(0u, segments.current());
+	ASSERT_EQ(1u, segments.next(lookups, NoPin));
+}
+
+// Simulates a game with a hot working set of blocks and a stream of code that runs once,
+// and compares the volume of code compiled with full flushes and with segment eviction.
+TEST_F(CodeSegmentsTest, Simulation)
+{
+	const u32 margin = 16 * 1024;
+	const u32 hotBlocks = 6000;
+	std::mt19937 rng(7);
+	std::vector<u32> sizes(200000);
+	for (u32& size : sizes)
+		size = 64 + rng() % 1024;
+
+	for (int evict = 0; evict < 2; evict++)
+	{
+		Segments segments(BufferSize);
+		u64 lookups[Segments::SegmentCount] {};
+		std::unordered_map<u32, u32> compiled;	// block -> code offset
+		std::vector<std::vector<u32>> segmentBlocks(Segments::SegmentCount);
+		u32 lastAddr = 0;
+		u64 compiledBytes = 0;
+		u32 flushes = 0;
+		std::mt19937 rng(8);
+		for (int i = 0; i < 2000000; i++)
+		{
+			// 90% of the lookups hit the hot blocks
+			const u32 block = rng() % 10 != 0 ? rng() % hotBlocks : hotBlocks + rng() % (sizes.size() - hotBlocks);
+			auto it = compiled.find(block);
+			if (it != compiled.end())
+			{
+				lookups[segments.segmentOf(it->second)]++;
+				continue;
+			}
+			if (segments.end(segments.current()) - lastAddr < margin)
+			{
+				if (evict == 0)
+				{
+					flushes++;
+					compiled.clear();
+					for (auto& blocks : segmentBlocks)
+						blocks.clear();
+					segments.reset();
+					lastAddr = 0;
+				}
+				else
+				{
+					const u32 next = segments.next(lookups, NoPin);
+					for (u32 b : segmentBlocks[next])
+						compiled.erase(b);
+					segmentBlocks[next].clear();
+					for (u64& l : lookups)
+						l = 0;
+					segments.use(next);
+					lastAddr = segments.start(next);
+				}
+			}
+			compiled[block] = lastAddr;
+			segmentBlocks[segments.current()].push_back(block);
+			lastAddr += sizes[block];
+			compiledBytes += sizes[block];
+		}
+		printf("%s: %.1f MB compiled, %d full flushes\n", evict == 0 ? "Full flush" : "Segment eviction",
+				compiledBytes / 1024.0 / 1024.0, flushes);
+		if (evict == 0)
+			ASSERT_NE(0u, flushes);
+	}
+}
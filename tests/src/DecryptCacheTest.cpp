@@ -0,0 +1,270 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "hw/naomi/awave_regs.h"
+#include "hw/naomi/awcartridge.h"
+#include "hw/naomi/decrypt_cache.h"
+#include "hw/naomi/m4cartridge.h"
+#include "hw/naomi/naomi_regs.h"
+#include "oslib/directory.h"
+#include "benchmark.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+class DecryptCacheTest : public ::testing::Test {
+protected:
+	static constexpr u32 RomSize = 8 * 1024 * 1024;
+
+	void TearDown() override
+	{
+		config::CacheDecryptedRoms.reset();
+		config::PreDecryptRoms.reset();
+	}
+
+	static void fillRom(Cartridge *cart, u32 seed)
+	{
+		u32 size = RomSize;
+		u8 *rom = (u8 *)cart->GetPtr(0, size);
+		std::mt19937 rng(seed);
+		for (u32 i = 0; i < RomSize; i++)
+			rom[i] = (u8)rng();
+	}
+
+	std::unique_ptr<AWCartridge> createAWCart(bool cache)
+	{
+		config::CacheDecryptedRoms.set(cache);
+		std::unique_ptr<AWCartridge> cart(new AWCartridge(RomSize));
+		fillRom(cart.get(), 1);
+		cart->SetKey(0x5a);
+		cart->Init();
+		return cart;
+	}
+
+	std::unique_ptr<M4Cartridge> createM4Cart(bool cache)
+	{
+		config::CacheDecryptedRoms.set(cache);
+		std::unique_ptr<M4Cartridge> cart(new M4Cartridge(RomSize));
+		fillRom(cart.get(), 2);
+		u8 *keyData = (u8 *)malloc(2048);
+		std::mt19937 rng(3);
+		for (int i = 0; i < 2048; i++)
+			keyData[i] = (u8)rng();
+		cart->SetKeyData(keyData);
+		cart->SetKey(0x5504);
+		cart->Init();
+		// Encrypted transfers
+		cart->WriteMem(NAOMI_ROM_OFFSETH_addr, 0x4000, 2);
+		return cart;
+	}
+
+	static void setAWOffset(Cartridge *cart, u32 offset)
+	{
+		cart->WriteMem(AW_EPR_OFFSETH_addr, offset >> 17, 2);
+		cart->WriteMem(AW_EPR_OFFSETL_addr, (offset >> 1) & 0xffff, 2);
+	}
+
+	static void setM4Offset(Cartridge *cart, u32 offset)
+	{
+		cart->WriteMem(NAOMI_DMA_OFFSETH_addr, offset >> 16, 2);
+		cart->WriteMem(NAOMI_DMA_OFFSETL_addr, offset & 0xffff, 2);
+	}
+
+	// Reads size bytes by DMA, in transfers of at most 32 KB like the NAOMI DMA does
+	static std::vector<u8> dma(Cartridge *cart, u32 size)
+	{
+		std::vector<u8> data;
+		data.reserve(size);
+		while (size > 0)
+		{
+			u32 chunkSize = std::min(size, 0x8000u);
+			const u8 *p = (const u8 *)cart->GetDmaPtr(chunkSize);
+			if (chunkSize == 0)
+				break;
+			data.insert(data.end(), p, p + chunkSize);
+			cart->AdvancePtr(chunkSize);
+			size -= chunkSize;
+		}
+		return data;
+	}
+};
+
+TEST_F(DecryptCacheTest, Pages)
+{
+	const u32 pageSize = DecryptCache::PageSize;
+	const u32 size = 10 * pageSize + 1000;
+	auto decrypt = [](u32 offset, u8 *dst, u32 size) {
+		for (u32 i = 0; i < size; i++)
+			dst[i] = (u8)((offset + i) * 13);
+	};
+	DecryptCache cache(size, decrypt);
+	std::mt19937 rng(4);
+	for (int i = 0; i < 1000; i++)
+	{
+		const u32 offset = rng() % size;
+		u32 len = 1 + rng() % 0x20000;
+		const u8 *p = cache.get(offset, len);
+		ASSERT_GT(len, 0u);
+		ASSERT_LE(offset % pageSize + len, pageSize);
+		for (u32 j = 0; j < len && offset + j < size; j++)
+			ASSERT_EQ((u8)((offset + j) * 13), p[j]) << "offset " << offset + j;
+	}
+	DecryptCache::Stats stats = cache.getStats();
+	ASSERT_EQ(1000u, stats.hits + stats.misses);
+
+	// Save the whole rom and load it back
+	cache.decryptAll();
+	const std::string path = "decrypt_cache_test.bin";
+	ASSERT_TRUE(cache.save(path, 42));
+	DecryptCache loaded(size, [](u32, u8 *, u32) {
+		FAIL() << "Rom loaded from file must not be decrypted";
+	});
+	ASSERT_FALSE(loaded.load(path, 43));
+	ASSERT_TRUE(loaded.load(path, 42));
+	std::remove(path.c_str());
+	for (u32 offset = 0; offset < size; )
+	{
+		u32 len = size - offset;
+		const u8 *p = loaded.get(offset, len);
+		for (u32 j = 0; j < len; j++)
+			ASSERT_EQ((u8)((offset + j) * 13), p[j]) << "offset " << offset + j;
+		offset += len;
+	}
+}
+
+// The least recently used files are deleted first
+TEST_F(DecryptCacheTest, Prune)
+{
+	const char *tmpdir = getenv("TMPDIR");
+#ifdef _WIN32
+	if (tmpdir == nullptr)
+		tmpdir = getenv("TEMP");
+#endif
+	const std::string dir = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/decrypt_cache_test/";
+	flycast::mkdir(dir.c_str(), 0755);
+	auto exists = [&dir](const std::string& name) {
+		FILE *f = fopen((dir + name).c_str(), "rb");
+		if (f != nullptr)
+			fclose(f);
+		return f != nullptr;
+	};
+	auto write = [&dir](const std::string& name, u32 size) {
+		FILE *f = fopen((dir + name).c_str(), "wb");
+		ASSERT_NE(nullptr, f);
+		std::vector<u8> data(size);
+		fwrite(data.data(), 1, size, f);
+		fclose(f);
+	};
+	// older version, unrelated file
+	write("old.decrypted", 100);
+	write("other.bin", 1000000);
+
+	const u32 size = DecryptCache::PageSize;
+	DecryptCache cache(size, [](u32 offset, u8 *dst, u32 size) { memset(dst, 1, size); });
+	cache.decryptAll();
+	for (const char *name : { "a", "b", "c" })
+	{
+		ASSERT_TRUE(cache.save(dir + name + ".decrypted", name[0]));
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	DecryptCache loaded(size, [](u32 offset, u8 *dst, u32 size) {});
+	ASSERT_TRUE(loaded.load(dir + "a.decrypted", 'a'));
+
+	FILE *f = fopen((dir + "a.decrypted").c_str(), "rb");
+	ASSERT_NE(nullptr, f);
+	fseek(f, 0, SEEK_END);
+	const u64 fileSize = ftell(f);
+	fclose(f);
+	DecryptCache::prune(dir, 2 * fileSize);
+	ASSERT_FALSE(exists("old.decrypted"));
+	ASSERT_FALSE(exists("b.decrypted"));
+	ASSERT_TRUE(exists("c.decrypted"));
+	ASSERT_TRUE(exists("a.decrypted"));
+	ASSERT_TRUE(exists("other.bin"));
+
+	DecryptCache::prune(dir, 0, dir + "a.decrypted");
+	ASSERT_FALSE(exists("c.decrypted"));
+	ASSERT_TRUE(exists("a.decrypted"));
+
+	std::remove((dir + "a.decrypted").c_str());
+	std::remove((dir + "other.bin").c_str());
+	std::remove(dir.c_str());
+}
+
+TEST_F(DecryptCacheTest, Atomiswave)
+{
+	std::unique_ptr<AWCartridge> reference = createAWCart(false);
+	std::unique_ptr<AWCartridge> cart = createAWCart(true);
+	std::mt19937 rng(5);
+	for (int i = 0; i < 100; i++)
+	{
+		const u32 offset = (rng() % RomSize) & ~1;
+		const u32 size = rng() % 0x30000 & ~1;
+		setAWOffset(reference.get(), offset);
+		setAWOffset(cart.get(), offset);
+		ASSERT_EQ(dma(reference.get(), size), dma(cart.get(), size)) << "offset " << offset << " size " << size;
+	}
+}
+
+TEST_F(DecryptCacheTest, M4)
+{
+	std::unique_ptr<M4Cartridge> reference = createM4Cart(false);
+	std::unique_ptr<M4Cartridge> cart = createM4Cart(true);
+	std::mt19937 rng(6);
+	for (int i = 0; i < 100; i++)
+	{
+		// aligned and unaligned transfers. Encrypted transfers are decrypted 32 KB ahead.
+		const u32 offset = (rng() % (RomSize - 0x40000)) & (i % 2 == 0 ? ~31 : ~1);
+		const u32 size = rng() % 0x30000 & ~1;
+		setM4Offset(reference.get(), offset);
+		setM4Offset(cart.get(), offset);
+		ASSERT_EQ(dma(reference.get(), size), dma(cart.get(), size)) << "offset " << offset << " size " << size;
+	}
+}
+
+TEST_F(DecryptCacheTest, DISABLED_Benchmark)
+{
+	const u32 size = 0x400000;
+	for (int type = 0; type < 2; type++)
+	{
+		std::unique_ptr<Cartridge> reference;
+		std::unique_ptr<Cartridge> cart;
+		if (type == 0) {
+			reference = createAWCart(false);
+			cart = createAWCart(true);
+		}
+		else {
+			reference = createM4Cart(false);
+			cart = createM4Cart(true);
+		}
+		auto setOffset = type == 0 ? setAWOffset : setM4Offset;
+
+		std::vector<u8> refData;
+		const double refTime = benchmark::timeMillis([&]() {
+			setOffset(reference.get(), 0);
+			refData = dma(reference.get(), size);
+		});
+
+		std::vector<u8> data;
+		const double coldTime = benchmark::timeMillis([&]() {
+			setOffset(cart.get(), 0);
+			data = dma(cart.get(), size);
+		});
+		ASSERT_EQ(refData, data);
+
+		const double warmTime = benchmark::timeMillis([&]() {
+			setOffset(cart.get(), 0);
+			data = dma(cart.get(), size);
+		});
+		ASSERT_EQ(refData, data);
+
+		const double bytes = refData.size();
+		printf("%s DMA %.1f MB: uncached %.1f MB/s, decrypt cache %.1f MB/s, decrypted %.1f MB/s\n", type == 0 ? "Atomiswave" : "M4",
+				bytes / 1024.0 / 1024.0, benchmark::mbPerSec(bytes, refTime), benchmark::mbPerSec(bytes, coldTime),
+				benchmark::mbPerSec(bytes, warmTime));
+	}
+}
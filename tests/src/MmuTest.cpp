@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "emulator.h"
+
+#ifdef FAST_MMU
+
+class MmuTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+		CCN_PTEH.reg_data = 0;
+	}
+
+	// sz: 0 1 KB, 1 4 KB, 2 64 KB, 3 1 MB
+	void loadEntry(u32 vaddr, u32 paddr, u32 asid, u32 sz, bool shared = false)
+	{
+		TLB_Entry& entry = UTLB[nextEntry];
+		entry.Address.reg_data = 0;
+		entry.Address.VPN = vaddr >> 10;
+		entry.Address.ASID = asid;
+		entry.Data.reg_data = 0;
+		entry.Data.PPN = paddr >> 10;
+		entry.Data.SZ0 = sz & 1;
+		entry.Data.SZ1 = sz >> 1;
+		entry.Data.SH = shared;
+		entry.Data.V = 1;
+		UTLB_Sync(nextEntry);
+		nextEntry = (nextEntry + 1) % 64;
+	}
+
+	u32 translate(u32 vaddr, u32 asid)
+	{
+		CCN_PTEH.ASID = asid;
+		u32 paddr;
+		if (mmu_full_lookup(vaddr, nullptr, paddr) != MMU_ERROR_NONE)
+			return ~0u;
+		return paddr;
+	}
+
+	// Physical page in the page table, as used by the dynarec
+	u32 cachedPage(u32 vaddr, u32 asid)
+	{
+		const MmuPageDirectory& dir = mmuPageDirectories[asid];
+		if (dir.generation != mmuTableGeneration || dir.leaves[vaddr >> 22] == 0)
+			return 0;
+		return mmuLeafPool[dir.leaves[vaddr >> 22]].paddr[(vaddr >> 12) & 1023];
+	}
+
+	u32 nextEntry = 0;
+};
+
+TEST_F(MmuTest, Lookup)
+{
+	loadEntry(0x00010000, 0x0c100000, 1, 1);
+	loadEntry(0x00010000, 0x0c200000, 2, 1);
+	loadEntry(0x00020000, 0x0c300000, 1, 2);
+	loadEntry(0x7f000000, 0x0c400000, 1, 3);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		ASSERT_EQ(0x0c100123u, translate(0x00010123, 1));
+		ASSERT_EQ(0x0c200123u, translate(0x00010123, 2));
+		ASSERT_EQ(~0u, translate(0x00010123, 3));
+		ASSERT_EQ(0x0c30abcdu, translate(0x0002abcd, 1));
+		ASSERT_EQ(~0u, translate(0x0002abcd, 2));
+		ASSERT_EQ(0x0c4fedcbu, translate(0x7f0fedcb, 1));
+		ASSERT_EQ(~0u, translate(0x7f0fedcb, 2));
+		ASSERT_EQ(0x0c412345u, translate(0x7f012345, 1));
+	}
+#ifdef MMU_STATS
+	ASSERT_GT(mmuStats.tableHits, 0u);
+	ASSERT_GT(mmuStats.tlbMisses, 0u);
+#endif
+	ASSERT_EQ(0x0c100000u, cachedPage(0x00010123, 1));
+	ASSERT_EQ(0x0c200000u, cachedPage(0x00010123, 2));
+	ASSERT_EQ(0x0c30a000u, cachedPage(0x0002abcd, 1));
+	// on-chip RAM area, not translated by the dynarec
+	ASSERT_EQ(0u, cachedPage(0x7f0fedcb, 1));
+	ASSERT_EQ(0u, cachedPage(0x0002abcd, 2));
+}
+
+// Physical addresses in the 1C000000-1FFFFFFF area are P4 registers
+TEST_F(MmuTest, P4Page)
+{
+	loadEntry(0x00050000, 0x1c000000, 1, 1);
+	loadEntry(0x00060000, 0x0c000000, 1, 1);
+	ASSERT_EQ(0x0c000000u, translate(0x00060000, 1));
+	ASSERT_EQ(0x1c000010u, translate(0x00050010, 1));
+	ASSERT_EQ(0xfc000000u, cachedPage(0x00050010, 1));
+}
+
+// A shared entry forgets the pages cached by the other ASIDs
+TEST_F(MmuTest, SharedEntry)
+{
+	loadEntry(0x00010000, 0x0c100000, 1, 1);
+	loadEntry(0x00010000, 0x0c200000, 2, 1);
+	loadEntry(0x00080000, 0x0c300000, 3, 1);
+	ASSERT_EQ(0x0c100010u, translate(0x00010010, 1));
+	ASSERT_EQ(0x0c200010u, translate(0x00010010, 2));
+	ASSERT_EQ(0x0c300010u, translate(0x00080010, 3));
+	ASSERT_EQ(0x0c100000u, cachedPage(0x00010010, 1));
+	ASSERT_EQ(0x0c200000u, cachedPage(0x00010010, 2));
+
+	loadEntry(0x00010000, 0x0c500000, 1, 1, true);
+	ASSERT_EQ(0u, cachedPage(0x00010010, 1));
+	ASSERT_EQ(0u, cachedPage(0x00010010, 2));
+	ASSERT_EQ(0x0c300000u, cachedPage(0x00080010, 3));
+	// not the last used entry
+	ASSERT_EQ(0x0c300010u, translate(0x00080010, 3));
+	ASSERT_EQ(0x0c500010u, translate(0x00010010, 1));
+	ASSERT_EQ(0x0c500000u, cachedPage(0x00010010, 1));
+}
+
+TEST_F(MmuTest, NewEntry)
+{
+	loadEntry(0x00010000, 0x0c100000, 1, 1);
+	loadEntry(0x00030000, 0x0c300000, 1, 1);
+	ASSERT_EQ(0x0c100010u, translate(0x00010010, 1));
+	ASSERT_EQ(0x0c300010u, translate(0x00030010, 1));
+	ASSERT_EQ(0x0c100010u, translate(0x00010010, 1));
+	// The most recent entry for a page wins
+	loadEntry(0x00010000, 0x0c500000, 1, 1);
+	loadEntry(0x00030000, 0x0c700000, 1, 2);
+	loadEntry(0x00040000, 0x0c800000, 1, 1);
+	ASSERT_EQ(0x0c500010u, translate(0x00010010, 1));
+	// 4 KB pages are searched first
+	ASSERT_EQ(0x0c300010u, translate(0x00030010, 1));
+	ASSERT_EQ(0x0c70f010u, translate(0x0003f010, 1));
+	ASSERT_EQ(0x0c800010u, translate(0x00040010, 1));
+}
+
+TEST_F(MmuTest, Flush)
+{
+	loadEntry(0x00010000, 0x0c100000, 1, 1);
+	ASSERT_EQ(0x0c100000u, translate(0x00010000, 1));
+	ASSERT_EQ(0x0c100000u, translate(0x00010000, 1));
+	mmu_flush_table();
+	ASSERT_EQ(~0u, translate(0x00010000, 1));
+	loadEntry(0x00010000, 0x0c200000, 1, 1);
+	ASSERT_EQ(0x0c200000u, translate(0x00010000, 1));
+}
+
+// Use more page table leaves than available
+TEST_F(MmuTest, ManyPages)
+{
+	const u32 regions = 200;
+	for (u32 asid = 0; asid < 4; asid++)
+		for (u32 i = 0; i < regions; i++)
+			loadEntry(i << 22, (i & 0x7f) << 20, asid, 3);
+	for (int pass = 0; pass < 2; pass++)
+		for (u32 asid = 0; asid < 4; asid++)
+			for (u32 i = 0; i < regions; i++)
+				ASSERT_EQ(((i & 0x7f) << 20) | 0x1234, translate((i << 22) | 0x1234, asid)) << "region " << i << " asid " << asid;
+}
+
+#endif
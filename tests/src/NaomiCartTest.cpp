@@ -0,0 +1,147 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "hw/naomi/naomi_cart.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__SWITCH__)
+constexpr bool CanMap = true;
+#else
+constexpr bool CanMap = false;
+#endif
+
+// Offsets are multiples of 64 KB so that they are page-aligned on all hosts
+class NaomiCartTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		mapRomFiles = config::MapRomFiles;
+		config::MapRomFiles.set(true);
+		const char *tmpdir = getenv("TMPDIR");
+#ifdef _WIN32
+		if (tmpdir == nullptr)
+			tmpdir = getenv("TEMP");
+#endif
+		folder = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/";
+	}
+
+	void TearDown() override
+	{
+		for (const std::string& file : created)
+			std::remove((folder + file).c_str());
+		config::MapRomFiles.set(mapRomFiles);
+	}
+
+	// Creates a rom file and adds it at the given address
+	void addFile(const std::string& name, u32 start, u32 size)
+	{
+		std::vector<u8> data(size);
+		std::mt19937 rng(start ^ size);
+		for (u8& b : data)
+			b = (u8)rng();
+		FILE *f = fopen((folder + name).c_str(), "wb");
+		ASSERT_NE(nullptr, f);
+		ASSERT_EQ(size, fwrite(data.data(), 1, size, f));
+		fclose(f);
+		created.push_back(name);
+		add(name, start, size);
+		contents.push_back(data);
+	}
+
+	void addNull(u32 start, u32 size)
+	{
+		add("null", start, size);
+		contents.emplace_back(size, 0xff);
+	}
+
+	void add(const std::string& name, u32 start, u32 size)
+	{
+		files.push_back(name);
+		fstart.push_back(start);
+		fsize.push_back(size);
+		romSize = std::max(romSize, start + size);
+	}
+
+	// Loads the rom and checks its content
+	bool load()
+	{
+		bool mapped;
+		u8 *rom = loadRomFiles(folder, files, fstart, fsize, romSize, mapped);
+		EXPECT_NE(nullptr, rom);
+		for (size_t i = 0; i < files.size(); i++)
+			EXPECT_EQ(0, memcmp(contents[i].data(), rom + fstart[i], fsize[i])) << files[i];
+		// The rom can be written to, without changing the files
+		for (size_t i = 0; i < files.size(); i++)
+			rom[fstart[i]] ^= 0xff;
+		for (size_t i = 0; i < files.size(); i++)
+			EXPECT_EQ((u8)~contents[i][0], rom[fstart[i]]) << files[i];
+		if (mapped)
+			unmapRomFiles(rom, romSize);
+		else
+			free(rom);
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			if (files[i] == "null")
+				continue;
+			FILE *f = fopen((folder + files[i]).c_str(), "rb");
+			EXPECT_NE(nullptr, f);
+			if (f == nullptr)
+				continue;
+			EXPECT_EQ(contents[i][0], fgetc(f)) << files[i];
+			fclose(f);
+		}
+		return mapped;
+	}
+
+	bool mapRomFiles = true;
+	std::string folder;
+	std::vector<std::string> created;
+	std::vector<std::string> files;
+	std::vector<u32> fstart;
+	std::vector<u32> fsize;
+	std::vector<std::vector<u8>> contents;
+	u32 romSize = 0;
+};
+
+TEST_F(NaomiCartTest, Aligned)
+{
+	addFile("naomi_cart_test_ic22.bin", 0, 0x20100);
+	addFile("naomi_cart_test_ic1.bin", 0x40000, 0x10000);
+	addNull(0x60000, 0x1000);
+	ASSERT_EQ(CanMap, load());
+}
+
+TEST_F(NaomiCartTest, Misaligned)
+{
+	addFile("naomi_cart_test_ic22.bin", 0, 0x20100);
+	addFile("naomi_cart_test_ic1.bin", 0x40800, 0x10000);
+	ASSERT_FALSE(load());
+}
+
+// A reserved range sharing a page with a file
+TEST_F(NaomiCartTest, SharedPage)
+{
+	addFile("naomi_cart_test_ic22.bin", 0, 0x100);
+	addNull(0x100, 0x100);
+	ASSERT_FALSE(load());
+}
+
+TEST_F(NaomiCartTest, MappingDisabled)
+{
+	config::MapRomFiles.set(false);
+	addFile("naomi_cart_test_ic22.bin", 0, 0x20100);
+	ASSERT_FALSE(load());
+}
+
+TEST_F(NaomiCartTest, MissingFile)
+{
+	addFile("naomi_cart_test_ic22.bin", 0, 0x10000);
+	add("naomi_cart_test_missing.bin", 0x10000, 0x10000);
+	bool mapped;
+	ASSERT_THROW(loadRomFiles(folder, files, fstart, fsize, romSize, mapped), FlycastException);
+}
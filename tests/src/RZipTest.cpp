@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "archive/rzip.h"
+#include "cfg/option.h"
+#include "benchmark.h"
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+class RZipTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		// Compressible but not trivial data, not a multiple of the chunk size
+		std::mt19937 rng(3);
+		data.resize(11 * 1024 * 1024 + 123);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (i & 0x100) ? (u8)rng() : (u8)(i >> 12);
+		const char *tmpdir = getenv("TMPDIR");
+#ifdef _WIN32
+		if (tmpdir == nullptr)
+			tmpdir = getenv("TEMP");
+#endif
+		path = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/flycast_rzip_test.rzip";
+	}
+
+	void TearDown() override
+	{
+		std::remove(path.c_str());
+	}
+
+	void writeV1(const char *path)
+	{
+		FILE *f = fopen(path, "wb");
+		const u8 header[8] = { '#', 'R', 'Z', 'I', 'P', 'v', 1, '#' };
+		const u32 chunkSize = 1024 * 1024;
+		const u64 size = data.size();
+		fwrite(header, sizeof(header), 1, f);
+		fwrite(&chunkSize, sizeof(chunkSize), 1, f);
+		fwrite(&size, sizeof(size), 1, f);
+		std::vector<u8> zipped(compressBound(chunkSize));
+		for (size_t pos = 0; pos < data.size(); pos += chunkSize)
+		{
+			uLongf zippedSize = zipped.size();
+			compress(zipped.data(), &zippedSize, &data[pos], std::min<size_t>(chunkSize, data.size() - pos));
+			u32 sz = (u32)zippedSize;
+			fwrite(&sz, sizeof(sz), 1, f);
+			fwrite(zipped.data(), zippedSize, 1, f);
+		}
+		fclose(f);
+	}
+
+	// Returns the version in the file header
+	int readVersion()
+	{
+		FILE *f = fopen(path.c_str(), "rb");
+		u8 header[8] {};
+		fread(header, sizeof(header), 1, f);
+		fclose(f);
+		return header[6];
+	}
+
+	void checkRead(const char *path)
+	{
+		RZipFile file;
+		ASSERT_TRUE(file.Open(path, false));
+		ASSERT_EQ(data.size(), file.Size());
+		std::vector<u8> out(data.size());
+		// Odd read sizes to cross chunk boundaries
+		size_t pos = 0;
+		while (pos < out.size())
+		{
+			size_t l = file.Read(&out[pos], std::min<size_t>(777777, out.size() - pos));
+			ASSERT_NE(0u, l);
+			pos += l;
+		}
+		u8 extra;
+		ASSERT_EQ(0u, file.Read(&extra, 1));
+		file.Close();
+		ASSERT_TRUE(data == out);
+	}
+
+	std::vector<u8> data;
+	std::string path;
+};
+
+TEST_F(RZipTest, ReadWrite)
+{
+	for (RZipFile::Codec codec : { RZipFile::Codec::Zlib, RZipFile::Codec::Zstd })
+	{
+		RZipFile file;
+		file.codec = codec;
+		ASSERT_TRUE(file.Open(path, true));
+		ASSERT_EQ(data.size(), file.Write(data.data(), data.size()));
+		file.Close();
+		ASSERT_EQ(codec == RZipFile::Codec::Zlib ? 1 : 2, readVersion());
+		checkRead(path.c_str());
+	}
+}
+
+// Savestates are readable by older versions unless zstd is enabled
+TEST_F(RZipTest, DefaultCodec)
+{
+	const bool zstd = config::ZstdSavestates;
+	config::ZstdSavestates.set(false);
+	ASSERT_EQ(RZipFile::Codec::Zlib, RZipFile::defaultCodec());
+	RZipFile file;
+	ASSERT_EQ(RZipFile::Codec::Zlib, file.codec);
+
+	config::ZstdSavestates.set(true);
+	ASSERT_EQ(RZipFile::Codec::Zstd, RZipFile::defaultCodec());
+	RZipFile zstdFile;
+	ASSERT_EQ(RZipFile::Codec::Zstd, zstdFile.codec);
+	config::ZstdSavestates.set(zstd);
+}
+
+TEST_F(RZipTest, ReadV1)
+{
+	writeV1(path.c_str());
+	checkRead(path.c_str());
+}
+
+TEST_F(RZipTest, Truncated)
+{
+	RZipFile file;
+	ASSERT_TRUE(file.Open(path, true));
+	ASSERT_EQ(data.size(), file.Write(data.data(), data.size()));
+	file.Close();
+	FILE *f = fopen(path.c_str(), "rb");
+	std::vector<u8> content(data.size() * 2);
+	content.resize(fread(content.data(), 1, content.size(), f));
+	fclose(f);
+	f = fopen(path.c_str(), "wb");
+	fwrite(content.data(), content.size() / 2, 1, f);
+	fclose(f);
+
+	ASSERT_TRUE(file.Open(path, false));
+	std::vector<u8> out(data.size());
+	size_t l = file.Read(out.data(), out.size());
+	ASSERT_LT(l, data.size());
+	ASSERT_EQ(0, memcmp(data.data(), out.data(), l));
+}
+
+TEST_F(RZipTest, DISABLED_Benchmark)
+{
+	for (RZipFile::Codec codec : { RZipFile::Codec::Zlib, RZipFile::Codec::Zstd })
+	{
+		RZipFile file;
+		file.codec = codec;
+		bool opened = false;
+		const double writeTime = benchmark::timeMillis([&]() {
+			opened = file.Open(path, true);
+			file.Write(data.data(), data.size());
+			file.Close();
+		});
+		ASSERT_TRUE(opened);
+		std::vector<u8> out(data.size());
+		const double readTime = benchmark::timeMillis([&]() {
+			opened = file.Open(path, false);
+			file.Read(out.data(), out.size());
+			file.Close();
+		});
+		ASSERT_TRUE(opened);
+		printf("Codec %d: write %.1f ms read %.1f ms\n", (int)codec, writeTime, readTime);
+	}
+}
@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "imgread/sectorcache.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+
+// Generated sectors, optionally slow to read
+struct TestTrack : TrackFile
+{
+	std::atomic<u32> reads { 0 };
+	std::chrono::microseconds delay { 0 };
+
+	bool Read(u32 FAD, u8 *dst, SectorFormat *sector_type, u8 *subcode, SubcodeFormat *subcode_type) override
+	{
+		reads++;
+		if (delay.count() != 0)
+			std::this_thread::sleep_for(delay);
+		for (int i = 0; i < 2048; i++)
+			dst[i] = (u8)(FAD * 7 + i);
+		*sector_type = SECFMT_2048_MODE1;
+		return true;
+	}
+};
+
+class SectorCacheTest : public ::testing::Test {
+protected:
+	static constexpr u32 StartFAD = 150;
+	static constexpr u32 EndFAD = 10000;
+
+	void SetUp() override
+	{
+		track = new TestTrack();
+		Track t;
+		t.StartFAD = StartFAD;
+		t.EndFAD = EndFAD;
+		t.file = track;
+		disc.tracks.push_back(t);
+		cache = std::unique_ptr<SectorCache>(new SectorCache(&disc));
+	}
+
+	void TearDown() override {
+		cache.reset();
+	}
+
+	bool read(u32 fad)
+	{
+		u8 data[2448];
+		SectorFormat format;
+		SubcodeFormat subcodeFormat;
+		if (!cache->read(fad, data, &format, nullptr, &subcodeFormat))
+			return false;
+		EXPECT_EQ(SECFMT_2048_MODE1, format);
+		for (int i = 0; i < 2048; i++)
+			if (data[i] != (u8)(fad * 7 + i))
+			{
+				ADD_FAILURE() << "Bad sector data FAD " << fad;
+				return false;
+			}
+		return true;
+	}
+
+	void waitPrefetch(u64 chunks)
+	{
+		for (int i = 0; i < 1000 && cache->getStats().prefetched < chunks; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	Disc disc;
+	TestTrack *track = nullptr;
+	std::unique_ptr<SectorCache> cache;
+};
+
+TEST_F(SectorCacheTest, Sequential)
+{
+	cache->prefetch(1000, 64);
+	waitPrefetch(5);
+	for (u32 fad = 1000; fad < 1064; fad++)
+		ASSERT_TRUE(read(fad));
+	SectorCache::Stats stats = cache->getStats();
+	ASSERT_EQ(64u, stats.hits);
+	ASSERT_EQ(0u, stats.misses);
+	// Nothing prefetched past the end of the read
+	ASSERT_LE(track->reads.load(), 64u + SectorCache::ReadAheadSectors);
+}
+
+TEST_F(SectorCacheTest, Random)
+{
+	std::mt19937 rng(5);
+	for (int i = 0; i < 5000; i++)
+	{
+		u32 fad = StartFAD + rng() % (EndFAD - StartFAD + 1);
+		ASSERT_TRUE(read(fad)) << "FAD " << fad;
+	}
+	ASSERT_FALSE(read(StartFAD - 1));
+	ASSERT_FALSE(read(EndFAD + 1));
+}
+
+// Sequential reads from two streams on slow storage
+TEST_F(SectorCacheTest, Streams)
+{
+	track->delay = std::chrono::microseconds(100);
+	for (u32 i = 0; i < 2000; i++)
+	{
+		ASSERT_TRUE(read(2000 + i));
+		if (i % 8 == 0)
+			ASSERT_TRUE(read(6000 + i / 8));
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	SectorCache::Stats stats = cache->getStats();
+	ASSERT_GT(stats.prefetched, 0u);
+	ASSERT_GT(stats.hits, stats.misses * 16);
+	printf("Sector cache: %.1f%% hits, %d chunks prefetched, read time %d ms, stall time %d ms\n",
+			stats.hits * 100.0 / (stats.hits + stats.misses), (int)stats.prefetched, (int)(stats.readTime / 1000), (int)(stats.stallTime / 1000));
+}
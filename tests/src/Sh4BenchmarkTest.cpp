@@ -0,0 +1,382 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/sh4_interpreter.h"
+#if FEAT_SHREC != DYNAREC_NONE
+#include "hw/sh4/dyna/ngen.h"
+#endif
+#include "benchmark.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+//
+// Guest instructions per second of the interpreter and dynarec on synthetic workloads.
+// Each workload is an endless loop incrementing r13 once per iteration.
+// Disabled by default. Run with: ctest -C Benchmark
+//
+
+constexpr u32 CodeStart = 0x8C020000;
+constexpr u32 SrcData = 0x8C100000;
+constexpr u32 DstData = 0x8C200000;
+constexpr u32 SqBase = 0xE0400000;		// written to 0x0C400000
+constexpr u32 SqTarget = 0x8C400000;
+// emulated time of each run
+constexpr int RunCycles = SH4_MAIN_CLOCK / 4;
+
+constexpr u16 Nop = 0x0009;
+constexpr u16 Rts = 0x000B;
+constexpr u16 Bt = 0x8900;
+constexpr u16 Bf = 0x8B00;
+constexpr u16 Bra = 0xA000;
+constexpr u16 Bsr = 0xB000;
+
+class Sh4BenchmarkTest : public ::testing::Test {
+protected:
+	// Assembles a program, resolving the displacement of branches
+	class Program
+	{
+	public:
+		Program& op(u16 op) {
+			code.push_back(op);
+			return *this;
+		}
+		u32 pc() const { return CodeStart + (u32)code.size() * 2; }
+
+		// Conditional branch to a previous address
+		Program& bcond(u16 op, u32 target) {
+			return this->op(op | (((target - pc() - 4) / 2) & 0xff));
+		}
+		// bra or bsr to a previous address
+		Program& branch(u16 op, u32 target) {
+			return this->op(op | (((target - pc() - 4) / 2) & 0xfff));
+		}
+		// Forward branch, bound later
+		size_t forward(u16 op) {
+			code.push_back(op);
+			return code.size() - 1;
+		}
+		void bind(size_t index)
+		{
+			const u32 disp = (pc() - (CodeStart + (u32)index * 2) - 4) / 2;
+			code[index] |= (code[index] & 0xf000) == 0x8000 ? disp & 0xff : disp & 0xfff;
+		}
+
+		void write() const
+		{
+			for (size_t i = 0; i < code.size(); i++)
+				_vmem_WriteMem16(CodeStart + (u32)i * 2, code[i]);
+		}
+
+	private:
+		std::vector<u16> code;
+	};
+
+	struct Workload
+	{
+		Program program;
+		// initializes the registers and memory
+		std::function<void()> setup;
+		// checks the guest memory once the loop has run at least once
+		std::function<void()> check;
+	};
+
+	struct Core
+	{
+		const char *name;
+		bool dynarec;
+		bool traces;
+	};
+
+	static Sh4BenchmarkTest *current;
+	static int schedId;
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		mem_map_default();
+		if (schedId == -1)
+			schedId = sh4_sched_register(0, &stopCpu);
+		asyncCompile = config::DynarecAsyncCompile;
+		traces = config::DynarecTraces;
+		config::DynarecAsyncCompile.set(false);
+		ctx = &p_sh4rcb->cntx;
+		current = this;
+	}
+	void TearDown() override
+	{
+		config::DynarecTraces.set(traces);
+		config::DynarecAsyncCompile.set(asyncCompile);
+		current = nullptr;
+	}
+
+	static int stopCpu(int tag, int cycles, int jitter)
+	{
+		current->stopped = true;
+		sh4_cpu.Stop();
+		return 0;
+	}
+
+	void prepare(const Workload& workload)
+	{
+		dc_reset(true);
+		workload.program.write();
+		memset(ctx->r, 0, sizeof(ctx->r));
+		workload.setup();
+		ctx->pc = CodeStart;
+	}
+
+	// Runs one iteration with the interpreter and returns the number of instructions executed
+	u32 countIterationOps(const Workload& workload)
+	{
+		prepare(workload);
+		sh4_if interp;
+		Get_Sh4Interpreter(&interp);
+		int start = 0;
+		for (int i = 0; i < 1000000 && ctx->r[13] < 2; i++)
+		{
+			const u32 iterations = ctx->r[13];
+			interp.Step();
+			if (iterations == 0 && ctx->r[13] == 1)
+				start = ctx->cycle_counter;
+		}
+		EXPECT_EQ(2u, ctx->r[13]);
+		return (start - ctx->cycle_counter) / CPU_RATIO;
+	}
+
+	void run(const char *name, const Workload& workload)
+	{
+		const u32 iterationOps = countIterationOps(workload);
+		ASSERT_NE(0u, iterationOps);
+		workload.check();
+
+		std::vector<Core> cores { { "interpreter", false, false } };
+#if FEAT_SHREC != DYNAREC_NONE
+		cores.push_back({ "dynarec", true, false });
+		cores.push_back({ "dynarec+traces", true, true });
+#endif
+		for (const Core& core : cores)
+		{
+			sh4_if cpu;
+			if (core.dynarec)
+			{
+#if FEAT_SHREC != DYNAREC_NONE
+				Get_Sh4Recompiler(&cpu);
+				config::DynarecTraces.set(core.traces);
+#endif
+			}
+			else {
+				Get_Sh4Interpreter(&cpu);
+			}
+			prepare(workload);
+			u64 blocks = 0;
+			u64 compileNanos = 0;
+#if FEAT_SHREC != DYNAREC_NONE
+			rdv_GetCompileStats(blocks, compileNanos);
+#endif
+			const u64 startBlocks = blocks;
+			const u64 startNanos = compileNanos;
+			stopped = false;
+			sh4_sched_request(schedId, RunCycles);
+			// the cpu may also be stopped at vblank
+			const double seconds = benchmark::timeMillis([&]() {
+				while (!stopped)
+					cpu.Run();
+			}) / 1000.0;
+#if FEAT_SHREC != DYNAREC_NONE
+			rdv_GetCompileStats(blocks, compileNanos);
+#endif
+			blocks -= startBlocks;
+			compileNanos -= startNanos;
+
+			const u32 iterations = ctx->r[13];
+			ASSERT_NE(0u, iterations);
+			workload.check();
+			const double mips = (double)iterations * iterationOps / seconds / 1000000.0;
+			if (core.dynarec)
+				printf("%-14s %-15s %8.1f MIPS  %3d blocks compiled, %6.1f us per block\n", name, core.name, mips,
+						(int)blocks, blocks == 0 ? 0.0 : compileNanos / 1000.0 / blocks);
+			else
+				printf("%-14s %-15s %8.1f MIPS\n", name, core.name, mips);
+		}
+	}
+
+	static void writeFloat(u32 addr, float f)
+	{
+		u32 v;
+		memcpy(&v, &f, sizeof(v));
+		_vmem_WriteMem32(addr, v);
+	}
+
+	static u16 Rm(int r) { return r << 4; }
+	static u16 Rn(int r) { return r << 8; }
+	static u16 Imm8(int i) { return (u8)i; }
+
+	static u16 movImm(int n, int imm) { return 0xE000 | Rn(n) | Imm8(imm); }
+	static u16 mov(int m, int n) { return 0x6003 | Rm(m) | Rn(n); }
+	static u16 add(int m, int n) { return 0x300C | Rm(m) | Rn(n); }
+	static u16 addImm(int n, int imm) { return 0x7000 | Rn(n) | Imm8(imm); }
+	static u16 sub(int m, int n) { return 0x3008 | Rm(m) | Rn(n); }
+	static u16 xorReg(int m, int n) { return 0x200A | Rm(m) | Rn(n); }
+	static u16 shll2(int n) { return 0x4008 | Rn(n); }
+	static u16 mull(int m, int n) { return 0x0007 | Rm(m) | Rn(n); }
+	static u16 stsMacl(int n) { return 0x001A | Rn(n); }
+	static u16 dt(int n) { return 0x4010 | Rn(n); }
+	static u16 tstImm(int imm) { return 0xC800 | Imm8(imm); }
+	static u16 movlLoadInc(int m, int n) { return 0x6006 | Rm(m) | Rn(n); }		// mov.l @Rm+,Rn
+	static u16 movlStore(int m, int n, int disp = 0) { return 0x1000 | Rn(n) | Rm(m) | (disp / 4); }	// mov.l Rm,@(disp,Rn)
+	static u16 pref(int n) { return 0x0083 | Rn(n); }
+	static u16 fmovLoadInc(int m, int n) { return 0xF009 | Rm(m) | Rn(n); }		// fmov.s @Rm+,FRn
+	static u16 fmovStoreDec(int m, int n) { return 0xF00B | Rm(m) | Rn(n); }	// fmov.s FRm,@-Rn
+	static u16 fadd(int m, int n) { return 0xF000 | Rm(m) | Rn(n); }
+	static u16 ftrv(int fvn) { return 0xF1FD | (fvn / 4) << 10; }
+	static u16 fipr(int fvm, int fvn) { return 0xF0ED | (fvn / 4) << 10 | (fvm / 4) << 8; }
+
+	Sh4Context *ctx = nullptr;
+	bool stopped = false;
+	bool asyncCompile = false;
+	bool traces = false;
+};
+
+Sh4BenchmarkTest *Sh4BenchmarkTest::current;
+int Sh4BenchmarkTest::schedId = -1;
+
+TEST_F(Sh4BenchmarkTest, DISABLED_Integer)
+{
+	Workload w;
+	Program& p = w.program;
+	const u32 outer = p.pc();
+	p.op(movImm(3, 100));
+	const u32 inner = p.pc();
+	p.op(add(1, 2)).op(xorReg(2, 4)).op(shll2(4)).op(mull(4, 1)).op(stsMacl(5)).op(sub(5, 6)).op(addImm(1, 3))
+		.op(dt(3)).bcond(Bf, inner);
+	p.op(addImm(13, 1)).branch(Bra, outer).op(Nop);
+	w.setup = [this]() {
+		ctx->r[1] = 1;
+		ctx->r[2] = 2;
+	};
+	w.check = []() {};
+	run("integer", w);
+}
+
+// 32 vertices transformed with ftrv and lit with fipr
+TEST_F(Sh4BenchmarkTest, DISABLED_FpuTransform)
+{
+	Workload w;
+	Program& p = w.program;
+	const u32 outer = p.pc();
+	p.op(mov(8, 1)).op(mov(9, 2)).op(movImm(3, 32));
+	const u32 inner = p.pc();
+	for (int i = 0; i < 4; i++)
+		p.op(fmovLoadInc(1, i));
+	p.op(ftrv(0)).op(fipr(4, 0)).op(fadd(3, 8));
+	for (int i = 3; i >= 0; i--)
+		p.op(fmovStoreDec(i, 2));
+	p.op(dt(3)).bcond(Bf, inner);
+	p.op(addImm(13, 1)).branch(Bra, outer).op(Nop);
+	w.setup = [this]() {
+		ctx->r[8] = SrcData;
+		ctx->r[9] = DstData + 32 * 16;
+		for (int i = 0; i < 32 * 4; i++)
+			writeFloat(SrcData + i * 4, (float)(i % 7) - 2.f);
+		// back bank matrix and light vector
+		for (int i = 0; i < 16; i++)
+			ctx->xffr[i] = i % 5 == 0 ? 0.5f : 0.125f;
+		for (int i = 4; i < 8; i++)
+			ctx->xffr[16 + i] = 0.25f;
+	};
+	w.check = []() {
+		// w of the first vertex: dot product of the transformed vertex with the light vector
+		ASSERT_NE(0u, _vmem_ReadMem32(DstData + 12));
+	};
+	run("fpu-transform", w);
+}
+
+// 1 KB copy
+TEST_F(Sh4BenchmarkTest, DISABLED_MemCopy)
+{
+	Workload w;
+	Program& p = w.program;
+	const u32 outer = p.pc();
+	p.op(mov(8, 1)).op(mov(9, 2)).op(movImm(3, 64));
+	const u32 inner = p.pc();
+	p.op(movlLoadInc(1, 0)).op(movlLoadInc(1, 4)).op(movlLoadInc(1, 5)).op(movlLoadInc(1, 6))
+		.op(movlStore(0, 2)).op(movlStore(4, 2, 4)).op(movlStore(5, 2, 8)).op(movlStore(6, 2, 12)).op(addImm(2, 16))
+		.op(dt(3)).bcond(Bf, inner);
+	p.op(addImm(13, 1)).branch(Bra, outer).op(Nop);
+	w.setup = [this]() {
+		ctx->r[8] = SrcData;
+		ctx->r[9] = DstData;
+		for (u32 i = 0; i < 1024; i += 4)
+			_vmem_WriteMem32(SrcData + i, i * 0x01010101);
+	};
+	w.check = []() {
+		for (u32 i = 0; i < 1024; i += 4)
+			ASSERT_EQ(i * 0x01010101, _vmem_ReadMem32(DstData + i));
+	};
+	run("memcpy", w);
+}
+
+// 2 KB written with 32-byte store queue bursts
+TEST_F(Sh4BenchmarkTest, DISABLED_StoreQueue)
+{
+	Workload w;
+	Program& p = w.program;
+	const u32 outer = p.pc();
+	p.op(mov(8, 1)).op(movImm(3, 64));
+	const u32 inner = p.pc();
+	p.op(movlStore(4, 1));
+	for (int i = 1; i < 8; i++)
+		p.op(movlStore(5, 1, i * 4));
+	p.op(pref(1)).op(addImm(1, 32)).op(addImm(4, 1)).op(dt(3)).bcond(Bf, inner);
+	p.op(addImm(13, 1)).branch(Bra, outer).op(Nop);
+	w.setup = [this]() {
+		_vmem_WriteMem32(0xFF000038, 3 << 2);	// QACR0: area 3
+		_vmem_WriteMem32(0xFF00003C, 3 << 2);	// QACR1
+		ctx->r[8] = SqBase;
+		ctx->r[4] = 0;
+		ctx->r[5] = 0x12345678;
+	};
+	w.check = []() {
+		ASSERT_EQ(0x12345678u, _vmem_ReadMem32(SqTarget + 4));
+		ASSERT_EQ(0x12345678u, _vmem_ReadMem32(SqTarget + 64 * 32 - 4));
+	};
+	run("store-queue", w);
+}
+
+// Data-dependent conditional branches and a subroutine call
+TEST_F(Sh4BenchmarkTest, DISABLED_Branches)
+{
+	Workload w;
+	Program& p = w.program;
+	const u32 outer = p.pc();
+	p.op(movImm(3, 64));
+	const u32 inner = p.pc();
+	p.op(mov(3, 0)).op(tstImm(1));
+	size_t skip1 = p.forward(Bt);
+	p.op(add(3, 4));
+	p.bind(skip1);
+	p.op(tstImm(2));
+	size_t skip2 = p.forward(Bf);
+	size_t call = p.forward(Bsr);
+	p.op(Nop);
+	p.bind(skip2);
+	p.op(xorReg(3, 6)).op(dt(3)).bcond(Bf, inner);
+	p.op(addImm(13, 1)).branch(Bra, outer).op(Nop);
+	p.bind(call);
+	p.op(addImm(7, 1)).op(Rts).op(Nop);
+	w.setup = []() {};
+	w.check = [this]() {
+		ASSERT_NE(0u, ctx->r[7]);
+	};
+	run("branches", w);
+}
@@ -0,0 +1,257 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/sh4/sh4_sched_queue.h"
+#include "benchmark.h"
+
+#include <cstdio>
+#include <random>
+
+static const u64 Inactive = ~0ull;
+
+// Previous scheduler implementation: the whole event list is scanned to find
+// the next event after each request and to find the expired events.
+class LinearSched
+{
+	std::vector<u64> ends;
+	int nextId = -1;
+
+	void ffts()
+	{
+		u64 best = Inactive;
+		nextId = -1;
+		for (size_t i = 0; i < ends.size(); i++)
+			if (ends[i] < best)
+			{
+				best = ends[i];
+				nextId = i;
+			}
+	}
+
+public:
+	void request(int id, u64 end)
+	{
+		if (id >= (int)ends.size())
+			ends.resize(id + 1, Inactive);
+		ends[id] = end;
+		ffts();
+	}
+	void cancel(int id)
+	{
+		ends[id] = Inactive;
+		ffts();
+	}
+	// Returns the number of expired events
+	int tick(u64 now)
+	{
+		int fired = 0;
+		for (u64& end : ends)
+			if (end <= now)
+			{
+				end = Inactive;
+				fired++;
+			}
+		ffts();
+		return fired;
+	}
+	int next() const {
+		return nextId;
+	}
+	u64 end(int id) const {
+		return ends[id];
+	}
+};
+
+// New implementation
+class HeapSched
+{
+	SchedQueue queue;
+	int nextId = -1;
+
+	void ffts() {
+		nextId = queue.empty() ? -1 : queue.topId();
+	}
+
+public:
+	void request(int id, u64 end)
+	{
+		queue.set(id, end);
+		ffts();
+	}
+	void cancel(int id)
+	{
+		queue.remove(id);
+		ffts();
+	}
+	int tick(u64 now)
+	{
+		int fired = 0;
+		int id = -1;
+		while ((id = queue.firstDue(now, id)) != -1)
+		{
+			queue.remove(id);
+			fired++;
+		}
+		ffts();
+		return fired;
+	}
+	int next() const {
+		return nextId;
+	}
+};
+
+class Sh4SchedTest : public ::testing::Test {
+protected:
+	struct TraceOp
+	{
+		enum { Request, Cancel, Tick } type;
+		int id;		// Tick: number of expired events
+		u64 end;	// Tick: current time
+	};
+
+	// Generates a trace of scheduler operations mimicking the periodic devices of the system:
+	// TMU channels, SPG, AICA, GD-ROM, maple, DMA, modem...
+	static std::vector<TraceOp> recordTrace(size_t events)
+	{
+		static const u32 periods[] = {
+			4535,		// AICA
+			50000,		// RTC
+			2000000,	// GD-ROM
+			3333333,	// maple
+			800,		// AICA DMA
+			10000, 37000, 500000,	// TMU
+			1500000,	// render end
+			13000,		// SPG line
+			1000000,	// modem
+			250000,		// BBA
+		};
+		constexpr int count = ARRAY_SIZE(periods);
+		std::mt19937 rng(1);
+		std::vector<TraceOp> trace;
+		LinearSched sched;
+		for (int id = 0; id < count; id++)
+		{
+			trace.push_back({ TraceOp::Request, id, periods[id] });
+			sched.request(id, periods[id]);
+		}
+		std::vector<int> expired;
+		while (trace.size() < events)
+		{
+			u64 now = sched.end(sched.next());
+			expired.clear();
+			for (int id = 0; id < count; id++)
+				if (sched.end(id) <= now)
+					expired.push_back(id);
+			trace.push_back({ TraceOp::Tick, (int)expired.size(), now });
+			sched.tick(now);
+
+			for (int id : expired)
+			{
+				u64 end = now + periods[id] - rng() % 448;
+				trace.push_back({ TraceOp::Request, id, end });
+				sched.request(id, end);
+				switch (rng() % 16)
+				{
+				case 0:
+					{
+						// trigger another device
+						int other = rng() % count;
+						end = now + 1 + rng() % 1000;
+						trace.push_back({ TraceOp::Request, other, end });
+						sched.request(other, end);
+					}
+					break;
+				case 1:
+					{
+						// stop a device and restart it later
+						int other = rng() % count;
+						trace.push_back({ TraceOp::Cancel, other, 0 });
+						sched.cancel(other);
+						end = now + periods[other] * 2;
+						trace.push_back({ TraceOp::Request, other, end });
+						sched.request(other, end);
+					}
+					break;
+				default:
+					break;
+				}
+			}
+		}
+		return trace;
+	}
+
+	// Returns the replay time in ms, or -1 if the scheduler doesn't behave as recorded
+	template<typename Sched>
+	static double replay(const std::vector<TraceOp>& trace, Sched& sched)
+	{
+		const benchmark::Clock::time_point start = benchmark::Clock::now();
+		for (const TraceOp& op : trace)
+		{
+			switch (op.type)
+			{
+			case TraceOp::Request:
+				sched.request(op.id, op.end);
+				break;
+			case TraceOp::Cancel:
+				sched.cancel(op.id);
+				break;
+			case TraceOp::Tick:
+				if (sched.tick(op.end) != op.id)
+					return -1;
+				break;
+			}
+		}
+		return benchmark::elapsedMillis(start);
+	}
+};
+
+TEST_F(Sh4SchedTest, Queue)
+{
+	SchedQueue queue;
+	ASSERT_TRUE(queue.empty());
+	queue.set(3, 100);
+	queue.set(1, 200);
+	queue.set(2, 100);
+	queue.set(0, 50);
+	ASSERT_EQ(4u, queue.size());
+	ASSERT_EQ(0, queue.topId());
+	ASSERT_EQ(50u, queue.topEnd());
+
+	queue.remove(0);
+	// ties are broken by id
+	ASSERT_EQ(2, queue.topId());
+	queue.set(2, 300);
+	ASSERT_EQ(3, queue.topId());
+	queue.set(1, 10);
+	ASSERT_EQ(1, queue.topId());
+	ASSERT_TRUE(queue.contains(2));
+	ASSERT_FALSE(queue.contains(0));
+	ASSERT_EQ(300u, queue.end(2));
+
+	// due events, in id order
+	ASSERT_EQ(1, queue.firstDue(100, -1));
+	ASSERT_EQ(3, queue.firstDue(100, 1));
+	ASSERT_EQ(-1, queue.firstDue(100, 3));
+	ASSERT_EQ(-1, queue.firstDue(5, -1));
+
+	queue.remove(1);
+	queue.remove(2);
+	queue.remove(3);
+	queue.remove(3);
+	ASSERT_TRUE(queue.empty());
+}
+
+TEST_F(Sh4SchedTest, Replay)
+{
+	std::vector<TraceOp> trace = recordTrace(2000000);
+
+	LinearSched linear;
+	double linearTime = replay(trace, linear);
+	ASSERT_GE(linearTime, 0.0);
+
+	HeapSched heap;
+	double heapTime = replay(trace, heap);
+	ASSERT_GE(heapTime, 0.0);
+	ASSERT_EQ(linear.next(), heap.next());
+
+	printf("Scheduler trace replay: %zu ops, linear scan %.2f ms, heap %.2f ms\n", trace.size(), linearTime, heapTime);
+}
@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/decoder.h"
+
+#include <cstdio>
+
+void AnalyseBlock(RuntimeBlockInfo* blk);
+
+constexpr u16 Nop = 0x0009;
+constexpr u16 Rts = 0x000B;
+constexpr u16 Bt = 0x8900;	// bt pc + 4
+
+// block addresses
+constexpr u32 A = 0x8C010000;
+constexpr u32 B = 0x8C010100;
+constexpr u32 C = 0x8C010200;
+
+class Sh4TraceTest : public ::testing::Test {
+protected:
+	struct TestBlock : RuntimeBlockInfo
+	{
+		u32 Relink() override { return 0; }
+		void Relocate(void *) override {}
+	};
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		mem_map_default();
+		dc_reset(true);
+	}
+
+	void write(u32 addr, std::initializer_list<u16> ops)
+	{
+		for (u16 op : ops)
+		{
+			_vmem_WriteMem16(addr, op);
+			addr += 2;
+		}
+	}
+
+	void decode(TestBlock& block, u32 pc, bool trace, bool optimize = false)
+	{
+		block.Init(pc, p_sh4rcb->cntx.fpscr);
+		block.trace = trace;
+		block.read_only = false;
+		ASSERT_TRUE(dec_DecodeBlock(&block, SH4_TIMESLICE / 2, true));
+		if (optimize)
+			AnalyseBlock(&block);
+	}
+
+	static u16 bra(u32 pc, u32 target) { return 0xA000 | (((target - pc - 4) / 2) & 0xfff); }
+	static u16 bsr(u32 pc, u32 target) { return 0xB000 | (((target - pc - 4) / 2) & 0xfff); }
+	static u16 movImm(int rn, int imm) { return 0xE000 | (rn << 8) | (u8)imm; }
+	static u16 addImm(int rn, int imm) { return 0x7000 | (rn << 8) | (u8)imm; }
+};
+
+TEST_F(Sh4TraceTest, FollowsStaticBranches)
+{
+	write(A, { movImm(1, 1), addImm(1, 1), bra(A + 4, B), Nop });
+	write(B, { addImm(1, 2), bsr(B + 2, C), Nop });
+	write(C, { addImm(1, 3), Bt, Nop });
+
+	TestBlock block;
+	decode(block, A, false);
+	ASSERT_EQ(8u, block.sh4_code_size);
+	ASSERT_TRUE(block.trace_ranges.empty());
+	ASSERT_EQ(BET_StaticJump, block.BlockType);
+	ASSERT_EQ(B, block.BranchBlock);
+
+	TestBlock trace;
+	decode(trace, A, true);
+	ASSERT_EQ(8u, trace.sh4_code_size);
+	ASSERT_EQ((size_t)2, trace.trace_ranges.size());
+	ASSERT_EQ(B, trace.trace_ranges[0].addr);
+	ASSERT_EQ(6u, trace.trace_ranges[0].size);
+	ASSERT_EQ(C, trace.trace_ranges[1].addr);
+	ASSERT_EQ(4u, trace.trace_ranges[1].size);
+	ASSERT_EQ(9u, trace.guest_opcodes);
+	ASSERT_EQ(BET_Cond_1, trace.BlockType);
+	ASSERT_EQ(C + 6, trace.BranchBlock);
+	ASSERT_EQ(C + 4, trace.NextBlock);
+}
+
+// Loops and conditional or dynamic branches end traces
+TEST_F(Sh4TraceTest, Stops)
+{
+	write(A, { addImm(1, 1), bra(A + 2, A), Nop });
+	TestBlock trace;
+	decode(trace, A, true);
+	ASSERT_TRUE(trace.trace_ranges.empty());
+	ASSERT_EQ(BET_StaticJump, trace.BlockType);
+
+	write(A, { addImm(1, 1), bra(A + 2, B), Nop });
+	write(B, { addImm(1, 1), bra(B + 2, A + 2), Nop });
+	decode(trace, A, true);
+	ASSERT_EQ((size_t)1, trace.trace_ranges.size());
+	ASSERT_EQ(A + 2, trace.BranchBlock);
+
+	write(B, { addImm(1, 1), Rts, Nop });
+	decode(trace, A, true);
+	ASSERT_EQ((size_t)1, trace.trace_ranges.size());
+	ASSERT_EQ(BET_DynamicRet, trace.BlockType);
+
+	// Limited number of code ranges
+	for (u32 i = 0; i < 8; i++)
+		write(A + i * 0x100, { addImm(1, 1), bra(A + i * 0x100 + 2, A + (i + 1) * 0x100), Nop });
+	decode(trace, A, true);
+	ASSERT_EQ((size_t)3, trace.trace_ranges.size());
+}
+
+// The optimizer sees the code of all the blocks of a trace
+TEST_F(Sh4TraceTest, Optimization)
+{
+	write(A, { movImm(1, 3), movImm(2, 0), bra(A + 4, B), Nop });
+	write(B, { addImm(1, 4), movImm(2, 1), bsr(B + 4, C), Nop });
+	write(C, { addImm(1, 5), addImm(2, 2), Rts, Nop });
+
+	size_t blockOps = 0;
+	for (u32 pc : { A, B, C })
+	{
+		TestBlock block;
+		decode(block, pc, false, true);
+		blockOps += block.oplist.size();
+	}
+	TestBlock trace;
+	decode(trace, A, true, true);
+	ASSERT_EQ((size_t)2, trace.trace_ranges.size());
+	printf("Separate blocks: %d ops, trace: %d ops\n", (int)blockOps, (int)trace.oplist.size());
+	ASSERT_LT(trace.oplist.size(), blockOps);
+}
@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/dyna/blockmanager.h"
+
+class SmcProtectTest : public ::testing::Test {
+protected:
+	struct TestBlock : RuntimeBlockInfo
+	{
+		u32 Relink() override { return 0; }
+		void Relocate(void *) override {}
+	};
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		mem_map_default();
+		dc_reset(true);
+	}
+
+	// Writes to the page until it isn't protected again. Returns the number of times it was.
+	int writeUntilUnprotected(u32 addr)
+	{
+		int reprotections = 0;
+		for (int i = 0; i < 100; i++)
+		{
+			bm_RamWriteAccess(addr);
+			EXPECT_FALSE(bm_IsRamPageProtected(addr));
+			bm_Periodical_1s();
+			if (!bm_IsRamPageProtected(addr))
+				break;
+			reprotections++;
+		}
+		return reprotections;
+	}
+
+	void initBlock(TestBlock& block, u32 pc, u32 size)
+	{
+		block.Init(pc, p_sh4rcb->cntx.fpscr);
+		block.sh4_code_size = size;
+		for (u32 i = 0; i < size; i += 2)
+			_vmem_WriteMem16(pc + i, 0x7001);	// add #1,r0
+	}
+};
+
+// Pages are protected again after being written to, until they're written too often
+TEST_F(SmcProtectTest, Reprotect)
+{
+	const u32 addr = 0x0CF00000;
+	ASSERT_TRUE(bm_IsRamPageProtected(addr));
+	const int reprotections = writeUntilUnprotected(addr);
+	ASSERT_GT(reprotections, 0);
+	ASSERT_LT(reprotections, 100);
+	bm_Periodical_1s();
+	ASSERT_FALSE(bm_IsRamPageProtected(addr));
+}
+
+TEST_F(SmcProtectTest, GatedChecks)
+{
+	const u32 pc = 0x8CE00000;
+	TestBlock block;
+	initBlock(block, pc, 16);
+	bm_RamWriteAccess(pc);
+	block.SetProtectedFlags();
+	ASSERT_FALSE(block.read_only);
+	ASSERT_TRUE(block.gated_checks);
+	ASSERT_FALSE(block.CodeChanged());
+
+	_vmem_WriteMem16(pc + 4, 0x0009);
+	ASSERT_TRUE(block.CodeChanged());
+	_vmem_WriteMem16(pc + 4, 0x7001);
+	ASSERT_FALSE(block.CodeChanged());
+
+	// Unchanged blocks are kept and skip their code checks
+	bm_Periodical_1s();
+	ASSERT_TRUE(bm_IsRamPageProtected(pc));
+	block.Discard();
+	bm_UnlockPage(pc);
+}
+
+// Code in rom, the BIOS/IP.BIN area and pages written too often is always checked
+TEST_F(SmcProtectTest, AlwaysChecked)
+{
+	TestBlock block;
+	initBlock(block, 0x8C008300, 16);
+	block.SetProtectedFlags();
+	ASSERT_FALSE(block.read_only);
+	ASSERT_FALSE(block.gated_checks);
+	block.Discard();
+
+	const u32 pc = 0x8CD00000;
+	writeUntilUnprotected(pc);
+	initBlock(block, pc, 16);
+	block.SetProtectedFlags();
+	ASSERT_FALSE(block.read_only);
+	ASSERT_FALSE(block.gated_checks);
+	block.Discard();
+}
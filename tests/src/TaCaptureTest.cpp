@@ -0,0 +1,165 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/ta_capture.h"
+#include "hw/pvr/Renderer_if.h"
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+Renderer* rend_norend();
+
+class TaCaptureTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+		savedRenderer = renderer;
+		norend.reset(rend_norend());
+		renderer = norend.get();
+		ctx.Alloc();
+		const char *tmpdir = getenv("TMPDIR");
+#ifdef _WIN32
+		if (tmpdir == nullptr)
+			tmpdir = getenv("TEMP");
+#endif
+		path = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/flycast_ta_capture_test.tacap";
+	}
+
+	void TearDown() override
+	{
+		renderer = savedRenderer;
+		_pvrrc = nullptr;
+		std::remove(path.c_str());
+	}
+
+	void add(const u32 *words, int count)
+	{
+		memcpy(ctx.tad.thd_data, words, count * sizeof(u32));
+		ctx.tad.thd_data += count * sizeof(u32);
+	}
+
+	void addList(u32 listType, int strips)
+	{
+		PCW pcw;
+		pcw.full = 0;
+		pcw.ParaType = ParamType_Polygon_or_Modifier_Volume;
+		pcw.ListType = listType;
+		pcw.Gouraud = 1;
+		const u32 poly[8] = { pcw.full, 0x80000000, 0x20000000 };
+		add(poly, 8);
+		for (int i = 0; i < strips * 8; i++)
+		{
+			PCW vpcw;
+			vpcw.full = 0;
+			vpcw.ParaType = ParamType_Vertex_Parameter;
+			vpcw.EndOfStrip = (i % 8) == 7;
+			u32 vtx[8] = { vpcw.full };
+			const float xyz[3] = { (float)(i * 7 % 640), (float)(i * 13 % 480), 1.f / (1 + (i * 31) % 97) };
+			memcpy(&vtx[1], xyz, sizeof(xyz));
+			vtx[6] = 0xff000000 | (i * 0x010203);
+			add(vtx, 8);
+		}
+		PCW eol;
+		eol.full = 0;
+		eol.ParaType = ParamType_End_Of_List;
+		const u32 end[8] = { eol.full };
+		add(end, 8);
+	}
+
+	void parse(TA_context& context)
+	{
+		_pvrrc = &context;
+		ASSERT_TRUE(renderer->Process(&context));
+	}
+
+	std::unique_ptr<Renderer> norend;
+	Renderer *savedRenderer = nullptr;
+	TA_context ctx;
+	std::string path;
+};
+
+TEST_F(TaCaptureTest, CaptureReplay)
+{
+	addList(ListType_Opaque, 20);
+	addList(ListType_Translucent, 30);
+	ASSERT_TRUE(tacapture::start(path, 2));
+	tacapture::capture(&ctx);
+	ASSERT_TRUE(tacapture::active);
+	tacapture::capture(&ctx);
+	// Stopped after 2 frames
+	ASSERT_FALSE(tacapture::active);
+
+	parse(ctx);
+	TA_context replayed;
+	replayed.Alloc();
+	tacapture::Reader reader;
+	ASSERT_TRUE(reader.open(path));
+	for (int frame = 0; frame < 2; frame++)
+	{
+		ASSERT_TRUE(reader.read(replayed));
+		parse(replayed);
+		ASSERT_EQ(ctx.rend.verts.used(), replayed.rend.verts.used());
+		ASSERT_EQ(0, memcmp(ctx.rend.verts.head(), replayed.rend.verts.head(), ctx.rend.verts.bytes()));
+		ASSERT_EQ(ctx.rend.idx.used(), replayed.rend.idx.used());
+		ASSERT_EQ(0, memcmp(ctx.rend.idx.head(), replayed.rend.idx.head(), ctx.rend.idx.bytes()));
+		ASSERT_EQ(ctx.rend.global_param_op.used(), replayed.rend.global_param_op.used());
+		ASSERT_EQ(ctx.rend.global_param_tr.used(), replayed.rend.global_param_tr.used());
+	}
+	ASSERT_FALSE(reader.read(replayed));
+
+	tacapture::ReplayStats stats;
+	ASSERT_TRUE(tacapture::replay(path, 3, stats));
+	ASSERT_EQ(6, stats.frames);
+	ASSERT_EQ((u64)ctx.rend.verts.used() * 6, stats.vertices);
+}
+
+TEST_F(TaCaptureTest, InvalidSizes)
+{
+	auto writeFile = [this](u32 size, u32 zippedSize, u32 dataSize) {
+		FILE *f = fopen(path.c_str(), "wb");
+		ASSERT_NE(nullptr, f);
+		const u32 header[] { 0x50434154, 1, size, zippedSize };
+		fwrite(header, sizeof(header), 1, f);
+		std::vector<u8> data(dataSize);
+		fwrite(data.data(), 1, data.size(), f);
+		fclose(f);
+	};
+	TA_context replayed;
+	replayed.Alloc();
+	tacapture::Reader reader;
+
+	// Uncompressed size too big
+	writeFile(0xffffffff, 16, 16);
+	ASSERT_TRUE(reader.open(path));
+	ASSERT_FALSE(reader.read(replayed));
+	// Compressed size too big
+	writeFile(1024, 0xfffffff0, 16);
+	ASSERT_TRUE(reader.open(path));
+	ASSERT_FALSE(reader.read(replayed));
+	// Compressed size bigger than the rest of the file
+	writeFile(1024, 4096, 16);
+	ASSERT_TRUE(reader.open(path));
+	ASSERT_FALSE(reader.read(replayed));
+	ASSERT_EQ(0, reader.frameNumber());
+}
+
+// Replay the capture file set in FLYCAST_TA_CAPTURE and print timings
+TEST_F(TaCaptureTest, DISABLED_Benchmark)
+{
+	const char *capture = getenv("FLYCAST_TA_CAPTURE");
+	if (capture == nullptr)
+		GTEST_SKIP() << "FLYCAST_TA_CAPTURE not set";
+	const char *loops = getenv("FLYCAST_TA_LOOPS");
+	tacapture::ReplayStats stats;
+	ASSERT_TRUE(tacapture::replay(capture, loops != nullptr ? atoi(loops) : 1, stats));
+	stats.print();
+}
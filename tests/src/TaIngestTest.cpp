@@ -0,0 +1,202 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/holly/sb.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/ta_ctx.h"
+#include "emulator.h"
+#include "benchmark.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+class TaIngestTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+		taStats = {};
+	}
+
+	void TearDown() override
+	{
+		if (ta_ctx != nullptr)
+			SetCurrentTARC(TACTX_NONE);
+	}
+
+	void listInit()
+	{
+		ta_vtx_ListInit();
+		ta_tad.Clear();
+		SB_ISTNRM = 0;
+		SB_ISTERR = 0;
+	}
+
+	void add(std::vector<SQBuffer>& stream, const u32 *words, int count)
+	{
+		for (int i = 0; i < count; i += 8)
+		{
+			stream.emplace_back();
+			memcpy(&stream.back(), &words[i], sizeof(SQBuffer));
+		}
+	}
+
+	// Random display lists of polygons, sprites and modifier volumes
+	std::vector<SQBuffer> buildStream(u32 seed, int lists)
+	{
+		std::vector<SQBuffer> stream;
+		std::mt19937 rng(seed);
+		const u32 listTypes[] = { ListType_Opaque, ListType_Opaque_Modifier_Volume, ListType_Translucent,
+				ListType_Translucent_Modifier_Volume, ListType_Punch_Through };
+		for (int l = 0; l < lists; l++)
+		{
+			const u32 listType = listTypes[rng() % 5];
+			const int objects = 1 + rng() % 20;
+			for (int o = 0; o < objects; o++)
+			{
+				PCW pcw;
+				pcw.full = 0;
+				pcw.ListType = listType;
+				u32 words[16] {};
+				if (listType == ListType_Opaque_Modifier_Volume || listType == ListType_Translucent_Modifier_Volume)
+				{
+					pcw.ParaType = ParamType_Polygon_or_Modifier_Volume;
+					words[0] = pcw.full;
+					add(stream, words, 8);
+					pcw.ParaType = ParamType_Vertex_Parameter;
+					const int triangles = 1 + rng() % 8;
+					for (int t = 0; t < triangles; t++)
+					{
+						pcw.EndOfStrip = t == triangles - 1;
+						words[0] = pcw.full;
+						add(stream, words, 16);
+					}
+				}
+				else if (rng() % 4 == 0)
+				{
+					pcw.ParaType = ParamType_Sprite;
+					pcw.Texture = rng() % 2;
+					words[0] = pcw.full;
+					add(stream, words, 8);
+					pcw.full = 0;
+					pcw.ParaType = ParamType_Vertex_Parameter;
+					pcw.EndOfStrip = 1;
+					words[0] = pcw.full;
+					add(stream, words, 16);
+				}
+				else
+				{
+					pcw.ParaType = ParamType_Polygon_or_Modifier_Volume;
+					pcw.Col_Type = rng() % 4;
+					pcw.Texture = rng() % 2;
+					pcw.Offset = rng() % 2;
+					pcw.Gouraud = 1;
+					words[0] = pcw.full;
+					add(stream, words, pcw.Col_Type >= 2 && pcw.Offset ? 16 : 8);
+					const int vertices = 3 + rng() % 16;
+					PCW vpcw;
+					vpcw.full = 0;
+					vpcw.ParaType = ParamType_Vertex_Parameter;
+					for (int v = 0; v < vertices; v++)
+					{
+						vpcw.EndOfStrip = v == vertices - 1;
+						words[0] = vpcw.full;
+						add(stream, words, pcw.Col_Type == 1 && pcw.Texture ? 16 : 8);
+					}
+				}
+			}
+			PCW eol;
+			eol.full = 0;
+			eol.ParaType = ParamType_End_Of_List;
+			const u32 words[8] = { eol.full };
+			add(stream, words, 8);
+		}
+		return stream;
+	}
+};
+
+// Batched transfers must store the same data and raise the same interrupts as store queue writes
+TEST_F(TaIngestTest, BatchedMatchesStoreQueues)
+{
+	const std::vector<SQBuffer> stream = buildStream(1, 50);
+	std::mt19937 rng(2);
+	std::vector<u32> chunks;
+	for (u32 size = 0; size < stream.size(); size += chunks.back())
+		chunks.push_back(std::min<u32>(1 + rng() % 200, stream.size() - size));
+
+	listInit();
+	std::vector<u32> refInterrupts;
+	u32 offset = 0;
+	for (u32 chunk : chunks)
+	{
+		for (u32 i = 0; i < chunk; i++)
+			ta_vtx_data32(&stream[offset + i]);
+		offset += chunk;
+		refInterrupts.push_back(SB_ISTNRM);
+	}
+	const std::vector<u8> refData(ta_tad.thd_root, ta_tad.thd_data);
+
+	listInit();
+	offset = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		ta_vtx_data(&stream[offset], chunks[i]);
+		offset += chunks[i];
+		ASSERT_EQ(refInterrupts[i], SB_ISTNRM) << "chunk " << i;
+	}
+	const std::vector<u8> data(ta_tad.thd_root, ta_tad.thd_data);
+	ASSERT_EQ(refData, data);
+
+	ASSERT_EQ(stream.size(), taStats.sqWrites);
+	ASSERT_EQ(stream.size() * sizeof(SQBuffer), taStats.dmaBytes);
+	ASSERT_EQ(chunks.size(), taStats.dmaTransfers);
+	ASSERT_EQ(0u, taStats.droppedBytes);
+}
+
+TEST_F(TaIngestTest, Overflow)
+{
+	const u32 blocks = TA_DATA_SIZE / sizeof(SQBuffer);
+	std::vector<SQBuffer> stream(blocks + 100);
+	PCW pcw;
+	pcw.full = 0;
+	pcw.ParaType = ParamType_Vertex_Parameter;
+	for (SQBuffer& sqb : stream)
+		memcpy(&sqb, &pcw, sizeof(pcw));
+	listInit();
+	ta_vtx_data(&stream[0], stream.size());
+	ASSERT_EQ((size_t)TA_DATA_SIZE, (size_t)(ta_tad.thd_data - ta_tad.thd_root));
+	ASSERT_NE(0u, SB_ISTERR & (1 << (holly_MATR_NOMEM & 0xff)));
+	ASSERT_EQ(100 * sizeof(SQBuffer), taStats.droppedBytes);
+}
+
+TEST_F(TaIngestTest, DISABLED_Benchmark)
+{
+	const std::vector<SQBuffer> stream = buildStream(3, 2000);
+	const int iterations = 10;
+	const double bytes = (double)stream.size() * sizeof(SQBuffer) * iterations;
+
+	const double sqTime = benchmark::timeMillis([&]() {
+		for (int i = 0; i < iterations; i++)
+		{
+			listInit();
+			for (const SQBuffer& sqb : stream)
+				ta_vtx_data32(&sqb);
+		}
+	});
+
+	const double dmaTime = benchmark::timeMillis([&]() {
+		for (int i = 0; i < iterations; i++)
+		{
+			listInit();
+			// 32 KB DMA transfers
+			for (size_t offset = 0; offset < stream.size(); offset += 1024)
+				ta_vtx_data(&stream[offset], std::min<size_t>(1024, stream.size() - offset));
+		}
+	});
+	printf("TA input %.1f MB: store queues %.1f MB/s, batched %.1f MB/s\n", bytes / iterations / 1024.0 / 1024.0,
+			benchmark::mbPerSec(bytes, sqTime), benchmark::mbPerSec(bytes, dmaTime));
+}
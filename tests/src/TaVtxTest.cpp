@@ -0,0 +1,305 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/ta_ctx.h"
+#include "hw/pvr/ta_vtx_simd.h"
+#include "hw/pvr/Renderer_if.h"
+#include "emulator.h"
+#include "benchmark.h"
+
+#include <cstdio>
+#include <random>
+
+// Previous scalar implementation
+static u8 f32_su8_tbl[65536];
+
+static u8 float_to_satu8(float val) {
+	return f32_su8_tbl[(u32&)val >> 16];
+}
+
+template<int Red, int Green, int Blue, int Alpha>
+struct ScalarConv
+{
+	static void floatColor(u8 *to, const float *argb)
+	{
+		to[Red] = float_to_satu8(argb[1]);
+		to[Green] = float_to_satu8(argb[2]);
+		to[Blue] = float_to_satu8(argb[3]);
+		to[Alpha] = float_to_satu8(argb[0]);
+	}
+	static void packedColor(u8 *to, u32 t)
+	{
+		to[Blue] = (u8)t; t >>= 8;
+		to[Green] = (u8)t; t >>= 8;
+		to[Red] = (u8)t; t >>= 8;
+		to[Alpha] = (u8)t;
+	}
+	static void intensityColor(u8 *to, const u8 *faceColor, float intensity)
+	{
+		u32 satint = float_to_satu8(intensity);
+		to[Red] = faceColor[Red] * satint / 256;
+		to[Green] = faceColor[Green] * satint / 256;
+		to[Blue] = faceColor[Blue] * satint / 256;
+		to[Alpha] = faceColor[Alpha];
+	}
+};
+
+static bool scalarVertexInvalid(const float *xyz)
+{
+	return std::isnan(xyz[0]) || fabsf(xyz[0]) > 3.4e37f
+			|| std::isnan(xyz[1]) || fabsf(xyz[1]) > 3.4e37f
+			|| std::isnan(xyz[2]) || xyz[2] < 0.f || xyz[2] > 3.4e37f;
+}
+
+static float fromBits(u32 bits)
+{
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+class TaVtxTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		for (u32 i = 0; i < ARRAY_SIZE(f32_su8_tbl); i++)
+			f32_su8_tbl[i] = float_to_satu8_math(fromBits(i << 16));
+	}
+
+	template<int Red, int Green, int Blue, int Alpha>
+	void checkFloatColor()
+	{
+		std::mt19937 rng(1);
+		for (u32 i = 0; i < 0x10000; i++)
+			for (u32 low : { 0u, 0x8000u, 0xffffu })
+			{
+				float argb[8];
+				for (float& f : argb)
+					f = fromBits(rng());
+				argb[i & 7] = fromBits((i << 16) | low);
+				u8 ref[8], simd[8];
+				ScalarConv<Red, Green, Blue, Alpha>::floatColor(ref, argb);
+				ScalarConv<Red, Green, Blue, Alpha>::floatColor(ref + 4, argb + 4);
+				VtxConv<Red, Green, Blue, Alpha>::floatColors(simd, argb);
+				ASSERT_EQ(0, memcmp(ref, simd, sizeof(ref))) << std::hex << ((i << 16) | low);
+				VtxConv<Red, Green, Blue, Alpha>::floatColor(simd, argb);
+				ASSERT_EQ(0, memcmp(ref, simd, 4)) << std::hex << ((i << 16) | low);
+			}
+	}
+
+	template<int Red, int Green, int Blue, int Alpha>
+	void checkPackedAndIntensity()
+	{
+		std::mt19937 rng(2);
+		for (int i = 0; i < 100000; i++)
+		{
+			u32 argb = rng();
+			u8 ref[4], simd[4];
+			ScalarConv<Red, Green, Blue, Alpha>::packedColor(ref, argb);
+			VtxConv<Red, Green, Blue, Alpha>::packedColor(simd, argb);
+			ASSERT_EQ(0, memcmp(ref, simd, sizeof(ref)));
+
+			alignas(4) u8 face[4];
+			u32 faceColor = rng();
+			memcpy(face, &faceColor, sizeof(face));
+			float intensity = (i & 1) ? fromBits(rng()) : (float)(rng() % 1400) / 1000.f - 0.2f;
+			ScalarConv<Red, Green, Blue, Alpha>::intensityColor(ref, face, intensity);
+			VtxConv<Red, Green, Blue, Alpha>::intensityColor(simd, face, intensity);
+			ASSERT_EQ(0, memcmp(ref, simd, sizeof(ref))) << intensity;
+		}
+	}
+};
+
+TEST_F(TaVtxTest, FloatColor)
+{
+	checkFloatColor<0, 1, 2, 3>();
+	checkFloatColor<2, 1, 0, 3>();
+}
+
+TEST_F(TaVtxTest, PackedAndIntensityColor)
+{
+	checkPackedAndIntensity<0, 1, 2, 3>();
+	checkPackedAndIntensity<2, 1, 0, 3>();
+}
+
+TEST_F(TaVtxTest, UV16)
+{
+	const u16 vu[2] = { 0x3f80, 0xbe00 };
+	float u, v;
+	uv16(vu, u, v);
+	ASSERT_EQ(1.f, v);
+	ASSERT_EQ(-0.125f, u);
+}
+
+TEST_F(TaVtxTest, InvalidVertex)
+{
+	const float values[] = { 0.f, -0.f, 1.f, -1.f, 640.f, 3.4e37f, -3.4e37f, 3.5e37f, -3.5e37f,
+			INFINITY, -INFINITY, NAN, -NAN, 1e-40f, -1e-40f };
+	for (float x : values)
+		for (float y : values)
+			for (float z : values)
+			{
+				const float xyzw[4] = { x, y, z, NAN };
+				ASSERT_EQ(scalarVertexInvalid(xyzw), isVertexInvalid(xyzw)) << x << " " << y << " " << z;
+			}
+}
+
+TEST_F(TaVtxTest, DISABLED_ConvBenchmark)
+{
+	std::mt19937 rng(3);
+	std::vector<float> colors(1024 * 8);
+	for (float& f : colors)
+		f = (float)(rng() % 1200) / 1000.f - 0.1f;
+	std::vector<u8> out(colors.size());
+	const int iterations = 2000;
+
+	const double scalar = benchmark::timeMillis([&]() {
+		for (int it = 0; it < iterations; it++)
+			for (size_t i = 0; i < colors.size(); i += 8)
+			{
+				ScalarConv<0, 1, 2, 3>::floatColor(&out[i], &colors[i]);
+				ScalarConv<0, 1, 2, 3>::floatColor(&out[i + 4], &colors[i + 4]);
+			}
+	});
+	u32 check = out[rng() % out.size()];
+
+	const double simd = benchmark::timeMillis([&]() {
+		for (int it = 0; it < iterations; it++)
+			for (size_t i = 0; i < colors.size(); i += 8)
+				VtxConv<0, 1, 2, 3>::floatColors(&out[i], &colors[i]);
+	});
+	check += out[rng() % out.size()];
+
+	const double colorCount = (double)iterations * colors.size() / 4;
+	printf("Float colors in Mcolors/s: scalar %.1f simd %.1f (%d)\n", benchmark::millionsPerSec(colorCount, scalar),
+			benchmark::millionsPerSec(colorCount, simd), check);
+}
+
+//
+// Throughput of ta_parse with synthetic display lists
+//
+class TaParseTest : public ::testing::Test {
+protected:
+	struct NullRenderer : Renderer
+	{
+		bool Init() override { return true; }
+		void Resize(int w, int h) override { }
+		void Term() override { }
+		bool Process(TA_context *ctx) override { return true; }
+		bool Render() override { return true; }
+	};
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+		savedRenderer = renderer;
+		renderer = &nullRenderer;
+		ctx.Alloc();
+	}
+
+	void TearDown() override
+	{
+		renderer = savedRenderer;
+	}
+
+	void add(const u32 *words, int count)
+	{
+		memcpy(ctx.tad.thd_data, words, count * sizeof(u32));
+		ctx.tad.thd_data += count * sizeof(u32);
+	}
+
+	// Opaque strips of 16 vertices with the given vertex format
+	void buildList(u32 colType, bool texture, bool uv16, bool twoHalves, int vertexCount)
+	{
+		ctx.Reset();
+		std::mt19937 rng(4);
+		PCW pcw;
+		pcw.full = 0;
+		pcw.ParaType = ParamType_Polygon_or_Modifier_Volume;
+		pcw.ListType = ListType_Opaque;
+		pcw.Col_Type = colType;
+		pcw.Texture = texture;
+		pcw.UV_16bit = uv16;
+		pcw.Gouraud = 1;
+		const float one = 1.f;
+		u32 poly[8] = { pcw.full, 0x80000000, 0x20000000, 0x00001000 };
+		for (int i = 4; i < 8; i++)
+			memcpy(&poly[i], &one, sizeof(one));
+		add(poly, 8);
+
+		for (int i = 0; i < vertexCount; i++)
+		{
+			PCW vpcw;
+			vpcw.full = 0;
+			vpcw.ParaType = ParamType_Vertex_Parameter;
+			vpcw.EndOfStrip = (i % 16) == 15;
+			u32 vtx[16];
+			vtx[0] = vpcw.full;
+			const float xyz[3] = { (float)(rng() % 640), (float)(rng() % 480), 0.001f + (float)(rng() % 1000) / 1000.f };
+			memcpy(&vtx[1], xyz, sizeof(xyz));
+			for (int j = 4; j < 16; j++)
+			{
+				float f = (float)(rng() % 1200) / 1000.f - 0.1f;
+				memcpy(&vtx[j], &f, sizeof(f));
+			}
+			add(vtx, twoHalves ? 16 : 8);
+		}
+		PCW eol;
+		eol.full = 0;
+		eol.ParaType = ParamType_End_Of_List;
+		u32 end[8] = { eol.full };
+		add(end, 8);
+	}
+
+	double measure(int vertexCount)
+	{
+		const int iterations = 50;
+		const double time = benchmark::timeMillis([&]() {
+			for (int i = 0; i < iterations; i++)
+			{
+				ctx.rend.Clear();
+				ta_parse(&ctx);
+			}
+		});
+		EXPECT_FALSE(ctx.rend.Overrun);
+		EXPECT_EQ(vertexCount + 4, ctx.rend.verts.used());
+		return benchmark::millionsPerSec((double)vertexCount * iterations, time);
+	}
+
+	NullRenderer nullRenderer;
+	Renderer *savedRenderer = nullptr;
+	TA_context ctx;
+};
+
+TEST_F(TaParseTest, DISABLED_Benchmark)
+{
+	struct Format {
+		const char *name;
+		u32 colType;
+		bool texture;
+		bool uv16;
+		bool twoHalves;
+	};
+	const Format formats[] = {
+		{ "packed", 0, false, false, false },
+		{ "float", 1, false, false, false },
+		{ "intensity", 2, false, false, false },
+		{ "packed tex", 0, true, false, false },
+		{ "packed tex uv16", 0, true, true, false },
+		{ "float tex", 1, true, false, true },
+		{ "float tex uv16", 1, true, true, true },
+		{ "intensity tex", 2, true, false, false },
+		{ "intensity tex uv16", 2, true, true, false },
+	};
+	const int vertexCount = 64 * 1024;
+	printf("ta_parse in Mvertices/s\n");
+	for (const Format& format : formats)
+	{
+		buildList(format.colType, format.texture, format.uv16, format.twoHalves, vertexCount);
+		printf("%-20s %7.1f\n", format.name, measure(vertexCount));
+	}
+}
@@ -0,0 +1,184 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "rend/TexCache.h"
+#include "benchmark.h"
+
+#include <cstdio>
+#include <random>
+
+// Reference scalar converters, one texel at a time
+template<typename Unpacker>
+struct ScalarPlanar
+{
+	using unpacked_type = typename Unpacker::unpacked_type;
+	static constexpr u32 xpp = 4;
+	static constexpr u32 ypp = 1;
+	static void Convert(PixelBuffer<unpacked_type> *pb, u8 *data)
+	{
+		u16 *p_in = (u16 *)data;
+		for (int i = 0; i < 4; i++)
+			pb->prel(i, Unpacker::unpack(p_in[i]));
+	}
+};
+
+template<typename Unpacker>
+struct ScalarTwiddle
+{
+	using unpacked_type = typename Unpacker::unpacked_type;
+	static constexpr u32 xpp = 2;
+	static constexpr u32 ypp = 2;
+	static void Convert(PixelBuffer<unpacked_type> *pb, u8 *data)
+	{
+		u16 *p_in = (u16 *)data;
+		pb->prel(0, 0, Unpacker::unpack(p_in[0]));
+		pb->prel(0, 1, Unpacker::unpack(p_in[1]));
+		pb->prel(1, 0, Unpacker::unpack(p_in[2]));
+		pb->prel(1, 1, Unpacker::unpack(p_in[3]));
+	}
+};
+
+class TexConvTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		std::mt19937 rng(7);
+		data.resize(256 * 8 + 1024 * 1024 * 2);
+		for (u8& b : data)
+			b = (u8)rng();
+		for (u32& c : palette16_ram)
+			c = rng() & 0xffff;
+		for (u32& c : palette32_ram)
+			c = rng();
+		palette_index = 0x100;
+		vq_codebook = &data[0];
+	}
+
+	template<typename Unpacker>
+	static void checkUnpacker()
+	{
+		for (u32 w = 0; w < 0x10000; w += 4)
+		{
+			const u16 words[4] = { (u16)w, (u16)(w + 1), (u16)(w + 2), (u16)(w + 3) };
+			u32x4 v = Unpacker::unpack(u32x4::load(words));
+			for (int i = 0; i < 4; i++)
+				ASSERT_EQ((u32)Unpacker::unpack(words[i]), v.lane(i)) << "word " << words[i];
+		}
+	}
+
+	template<typename Pixel>
+	void checkConvert(TexConv<Pixel> simd, TexConv<Pixel> ref, u32 width, u32 height)
+	{
+		PixelBuffer<Pixel> pb1;
+		pb1.init(width, height);
+		ConvertTexture(simd, pb1, &data[0], width, height);
+		PixelBuffer<Pixel> pb2;
+		pb2.init(width, height);
+		ref(&pb2, &data[0], width, height, 0, height);
+		ASSERT_EQ(0, memcmp(pb1.data(), pb2.data(), width * height * sizeof(Pixel))) << width << "x" << height;
+	}
+
+	template<typename Pixel>
+	double timeConvert(TexConv<Pixel> texconv, u32 width, u32 height, bool split)
+	{
+		PixelBuffer<Pixel> pb;
+		pb.init(width, height);
+		const int iterations = std::max(1u, (1u << 24) / (width * height));
+		const double time = benchmark::timeMillis([&]() {
+			for (int i = 0; i < iterations; i++)
+			{
+				if (split)
+					ConvertTexture(texconv, pb, &data[0], width, height);
+				else
+					texconv(&pb, &data[0], width, height, 0, height);
+			}
+		});
+		// Mpixels/s
+		return benchmark::millionsPerSec((double)width * height * iterations, time);
+	}
+
+	struct Format
+	{
+		const char *name;
+		TexConvFP conv16;
+		TexConvFP32 conv32;
+		TexConvFP8 conv8;
+		TexConvFP ref16;
+		TexConvFP32 ref32;
+	};
+
+	std::vector<u8> data;
+};
+
+TEST_F(TexConvTest, Unpackers)
+{
+	checkUnpacker<UnpackerNop<u16>>();
+	checkUnpacker<Unpacker1555>();
+	checkUnpacker<Unpacker4444>();
+	checkUnpacker<Unpacker565_32<RGBAPacker>>();
+	checkUnpacker<Unpacker1555_32<RGBAPacker>>();
+	checkUnpacker<Unpacker4444_32<RGBAPacker>>();
+	checkUnpacker<Unpacker565_32<BGRAPacker>>();
+	checkUnpacker<Unpacker1555_32<BGRAPacker>>();
+	checkUnpacker<Unpacker4444_32<BGRAPacker>>();
+}
+
+TEST_F(TexConvTest, Convert)
+{
+	for (u32 size = 8; size <= 1024; size *= 2)
+	{
+		checkConvert<u16>(opengl::tex1555_TW, texture_TW<ScalarTwiddle<Unpacker1555>>, size, size);
+		checkConvert<u16>(opengl::tex4444_VQ, texture_VQ<ScalarTwiddle<Unpacker4444>>, size, size);
+		checkConvert<u16>(tex565_PL, texture_PL<ScalarPlanar<UnpackerNop<u16>>>, size, size);
+		checkConvert<u32>(opengl::tex565_TW32, texture_TW<ScalarTwiddle<Unpacker565_32<RGBAPacker>>>, size, size / 2);
+		checkConvert<u32>(directx::tex1555_VQ32, texture_VQ<ScalarTwiddle<Unpacker1555_32<BGRAPacker>>>, size, size);
+		checkConvert<u32>(opengl::tex4444_PL32, texture_PL<ScalarPlanar<Unpacker4444_32<RGBAPacker>>>, size, size);
+	}
+	// Height not multiple of 8
+	checkConvert<u32>(opengl::tex565_PL32, texture_PL<ScalarPlanar<Unpacker565_32<RGBAPacker>>>, 640, 477);
+	// Palette and yuv textures are split in bands too
+	checkConvert<u16>(texPAL4_TW, texPAL4_TW, 1024, 1024);
+	checkConvert<u32>(texPAL8_VQ32, texPAL8_VQ32, 1024, 512);
+	checkConvert<u8>(texPAL8PT_TW, texPAL8PT_TW, 1024, 1024);
+	checkConvert<u32>(opengl::texYUV422_TW, opengl::texYUV422_TW, 512, 512);
+}
+
+TEST_F(TexConvTest, DISABLED_Benchmark)
+{
+	using namespace opengl;
+	const Format formats[] = {
+		{ "1555 TW", tex1555_TW, tex1555_TW32, nullptr, texture_TW<ScalarTwiddle<Unpacker1555>>, texture_TW<ScalarTwiddle<Unpacker1555_32<RGBAPacker>>> },
+		{ "565 TW", tex565_TW, tex565_TW32, nullptr, texture_TW<ScalarTwiddle<UnpackerNop<u16>>>, texture_TW<ScalarTwiddle<Unpacker565_32<RGBAPacker>>> },
+		{ "4444 TW", tex4444_TW, tex4444_TW32, nullptr, texture_TW<ScalarTwiddle<Unpacker4444>>, texture_TW<ScalarTwiddle<Unpacker4444_32<RGBAPacker>>> },
+		{ "1555 VQ", tex1555_VQ, tex1555_VQ32, nullptr, texture_VQ<ScalarTwiddle<Unpacker1555>>, texture_VQ<ScalarTwiddle<Unpacker1555_32<RGBAPacker>>> },
+		{ "565 VQ", tex565_VQ, tex565_VQ32, nullptr, texture_VQ<ScalarTwiddle<UnpackerNop<u16>>>, texture_VQ<ScalarTwiddle<Unpacker565_32<RGBAPacker>>> },
+		{ "4444 VQ", tex4444_VQ, tex4444_VQ32, nullptr, texture_VQ<ScalarTwiddle<Unpacker4444>>, texture_VQ<ScalarTwiddle<Unpacker4444_32<RGBAPacker>>> },
+		{ "1555 PL", tex1555_PL, tex1555_PL32, nullptr, texture_PL<ScalarPlanar<Unpacker1555>>, texture_PL<ScalarPlanar<Unpacker1555_32<RGBAPacker>>> },
+		{ "565 PL", tex565_PL, tex565_PL32, nullptr, texture_PL<ScalarPlanar<UnpackerNop<u16>>>, texture_PL<ScalarPlanar<Unpacker565_32<RGBAPacker>>> },
+		{ "4444 PL", tex4444_PL, tex4444_PL32, nullptr, texture_PL<ScalarPlanar<Unpacker4444>>, texture_PL<ScalarPlanar<Unpacker4444_32<RGBAPacker>>> },
+		{ "YUV TW", nullptr, texYUV422_TW, nullptr, nullptr, nullptr },
+		{ "YUV PL", nullptr, texYUV422_PL, nullptr, nullptr, nullptr },
+		{ "PAL4 TW", texPAL4_TW, texPAL4_TW32, texPAL4PT_TW, nullptr, nullptr },
+		{ "PAL8 TW", texPAL8_TW, texPAL8_TW32, texPAL8PT_TW, nullptr, nullptr },
+		{ "PAL4 VQ", texPAL4_VQ, texPAL4_VQ32, nullptr, nullptr, nullptr },
+		{ "PAL8 VQ", texPAL8_VQ, texPAL8_VQ32, nullptr, nullptr, nullptr },
+	};
+	printf("Texture conversion in Mpixels/s: scalar, simd, simd + threads\n");
+	for (const Format& format : formats)
+	{
+		for (u32 size = 64; size <= 1024; size *= 4)
+		{
+			printf("%-8s %4d  ", format.name, size);
+			if (format.conv16 != nullptr)
+				printf("16-bit %7.1f %7.1f %7.1f  ",
+						format.ref16 != nullptr ? timeConvert(format.ref16, size, size, false) : 0.0,
+						timeConvert(format.conv16, size, size, false), timeConvert(format.conv16, size, size, true));
+			if (format.conv32 != nullptr)
+				printf("32-bit %7.1f %7.1f %7.1f  ",
+						format.ref32 != nullptr ? timeConvert(format.ref32, size, size, false) : 0.0,
+						timeConvert(format.conv32, size, size, false), timeConvert(format.conv32, size, size, true));
+			if (format.conv8 != nullptr)
+				printf("8-bit %7.1f %7.1f", timeConvert(format.conv8, size, size, false), timeConvert(format.conv8, size, size, true));
+			printf("\n");
+		}
+	}
+}
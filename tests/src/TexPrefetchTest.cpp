@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/pvr_mem.h"
+#include "rend/TexPrefetch.h"
+
+#include <cstring>
+#include <memory>
+
+class TexPrefetchTest : public ::testing::Test {
+protected:
+	class TestTexture final : public BaseTextureCacheData
+	{
+	public:
+		std::string GetId() override { return ""; }
+		void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) override {}
+	};
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		upscale = config::TextureUpscale;
+		config::TextureUpscale.set(1);
+
+		// 8x8 planar RGB565 texture at 0x1000
+		tsp.full = 0;
+		tcw.full = 0;
+		tcw.TexAddr = 0x1000 >> 3;
+		tcw.ScanOrder = 1;
+		tcw.PixelFmt = Pixel565;
+		for (u32 i = 0; i < 8 * 8; i++)
+			*(u16 *)&vram[0x1000 + i * 2] = (u16)(i * 0x0841);
+	}
+
+	void TearDown() override
+	{
+		prefetcher.Terminate();
+		config::TextureUpscale.set(upscale);
+	}
+
+	std::unique_ptr<DecodedTexture> take()
+	{
+		TestTexture texture;
+		texture.tsp = tsp;
+		texture.tcw = tcw;
+		texture.Create();
+		return prefetcher.Take(&texture, texture.GetStride());
+	}
+
+	void decode(DecodedTexture& decoded)
+	{
+		TestTexture texture;
+		texture.tsp = tsp;
+		texture.tcw = tcw;
+		texture.Create();
+		texture.Decode(decoded, texture.GetStride(), false, TextureDecodeParams::current());
+	}
+
+	TexturePrefetcher prefetcher;
+	TSP tsp;
+	TCW tcw;
+	int upscale = 1;
+};
+
+TEST_F(TexPrefetchTest, Take)
+{
+	prefetcher.Prefetch({ { tsp, tcw } });
+	prefetcher.Flush();
+	std::unique_ptr<DecodedTexture> prefetched = take();
+	ASSERT_NE(nullptr, prefetched);
+
+	DecodedTexture decoded;
+	decode(decoded);
+	ASSERT_EQ(decoded.width, prefetched->width);
+	ASSERT_EQ(decoded.height, prefetched->height);
+	ASSERT_EQ(decoded.tex_type, prefetched->tex_type);
+	ASSERT_EQ(0, memcmp(decoded.data, prefetched->data, decoded.width * decoded.height * 2));
+
+	// Taken only once
+	ASSERT_EQ(nullptr, take());
+}
+
+TEST_F(TexPrefetchTest, Invalidated)
+{
+	prefetcher.Prefetch({ { tsp, tcw } });
+	prefetcher.Flush();
+	// The emulator writes to the texture after it has been decoded
+	vram[0x1000 + 6] ^= 0xff;
+	ASSERT_EQ(nullptr, take());
+}
+
+TEST_F(TexPrefetchTest, OptionsCapturedWhenQueued)
+{
+	prefetcher.Prefetch({ { tsp, tcw } });
+	config::TextureUpscale.set(2);
+	prefetcher.Flush();
+	// Outdated if the options are different when the texture is taken
+	ASSERT_EQ(nullptr, take());
+	config::TextureUpscale.set(1);
+
+	// Changing the options doesn't affect the queued textures
+	prefetcher.Prefetch({ { tsp, tcw } });
+	config::TextureUpscale.set(2);
+	prefetcher.Flush();
+	config::TextureUpscale.set(1);
+	std::unique_ptr<DecodedTexture> prefetched = take();
+	ASSERT_NE(nullptr, prefetched);
+	ASSERT_EQ(8u, prefetched->width);
+	ASSERT_EQ(8u, prefetched->height);
+}
@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_regs.h"
+#include "emulator.h"
+#include "benchmark.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Previous scalar implementation
+static void scalarBlock8x8(const u8* inuv, const u8* iny, u8* out, u32 x_size)
+{
+	u8* line_out_0=out+0;
+	u8* line_out_1=out+x_size*2;
+
+	for (int y=0;y<8;y+=2)
+	{
+		for (int x=0;x<8;x+=2)
+		{
+			u8 u=inuv[0];
+			u8 v=inuv[64];
+
+			line_out_0[0]=u;
+			line_out_0[1]=iny[0];
+			line_out_0[2]=v;
+			line_out_0[3]=iny[1];
+
+			line_out_1[0]=u;
+			line_out_1[1]=iny[8+0];
+			line_out_1[2]=v;
+			line_out_1[3]=iny[8+1];
+
+			inuv+=1;
+			iny+=2;
+
+			line_out_0+=4;
+			line_out_1+=4;
+		}
+		iny+=8;
+		inuv+=4;
+
+		line_out_0+=x_size*4-8*2;
+		line_out_1+=x_size*4-8*2;
+	}
+}
+
+static void scalarBlock384(const u8 *in, u8 *out, u32 x_size)
+{
+	const u8 *inuv = in;
+	const u8 *iny = in + 128;
+
+	scalarBlock8x8(inuv+ 0,iny+  0,out, x_size);
+	scalarBlock8x8(inuv+ 4,iny+64,out+8*2, x_size);
+	scalarBlock8x8(inuv+32,iny+128,out+x_size*8*2, x_size);
+	scalarBlock8x8(inuv+36,iny+192,out+x_size*8*2+8*2, x_size);
+}
+
+class YuvConvTest : public ::testing::Test {
+protected:
+	static constexpr u32 TexBase = 0x100000;
+	static constexpr u32 BlockSize = 384;
+
+	void SetUp() override
+	{
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+	}
+
+	// Starts the conversion of a texture of xBlocks * yBlocks macroblocks and returns random macroblock data
+	std::vector<u8> setupTexture(u32 xBlocks, u32 yBlocks, u32 textures, u32 seed)
+	{
+		TA_YUV_TEX_BASE = TexBase;
+		TA_YUV_TEX_CTRL.full = 0;
+		TA_YUV_TEX_CTRL.yuv_u_size = xBlocks - 1;
+		TA_YUV_TEX_CTRL.yuv_v_size = yBlocks - 1;
+		YUV_init();
+		memset(&vram[0], 0, VRAM_SIZE);
+
+		std::vector<u8> data(xBlocks * yBlocks * textures * BlockSize);
+		std::mt19937 rng(seed);
+		for (u8& b : data)
+			b = (u8)rng();
+		return data;
+	}
+
+	// VRAM contents expected after converting the given macroblocks with the scalar code
+	std::vector<u8> expectedVram(const std::vector<u8>& data, u32 xBlocks, u32 yBlocks)
+	{
+		std::vector<u8> reference(&vram[0], &vram[0] + VRAM_SIZE);
+		const u32 xSize = xBlocks * 16;
+		for (u32 i = 0; i < data.size() / BlockSize; i++)
+		{
+			const u32 block = i % (xBlocks * yBlocks);
+			const u32 dest = TexBase + block / xBlocks * 16 * xSize * 2 + block % xBlocks * 32;
+			scalarBlock384(&data[i * BlockSize], &reference[dest], xSize);
+		}
+		return reference;
+	}
+
+	void checkVram(const std::vector<u8>& reference)
+	{
+		if (memcmp(reference.data(), &vram[0], VRAM_SIZE) == 0)
+			return;
+		for (u32 i = 0; i < VRAM_SIZE; i++)
+			ASSERT_EQ(reference[i], vram[i]) << "VRAM offset " << std::hex << i;
+	}
+
+	static void write(const u8 *data, u32 size)
+	{
+		TAWrite(0x10800000, (const SQBuffer *)data, size / sizeof(SQBuffer));
+	}
+};
+
+// Whole textures written by DMA
+TEST_F(YuvConvTest, Dma)
+{
+	std::vector<u8> data = setupTexture(4, 3, 2, 1);
+	std::vector<u8> reference = expectedVram(data, 4, 3);
+	write(data.data(), data.size());
+	checkVram(reference);
+	ASSERT_EQ(0u, TA_YUV_TEX_CNT);
+}
+
+// Store queue writes and DMA transfers that don't end on a macroblock boundary
+TEST_F(YuvConvTest, PartialBlocks)
+{
+	std::vector<u8> data = setupTexture(5, 2, 3, 2);
+	std::vector<u8> reference = expectedVram(data, 5, 2);
+	std::mt19937 rng(3);
+	u32 offset = 0;
+	while (offset < data.size())
+	{
+		if (rng() % 2 == 0)
+		{
+			// double store queue write
+			SQBuffer sqb[2];
+			memcpy(&sqb[1], &data[offset], sizeof(SQBuffer));
+			TAWriteSQ(0x10800020, sqb);
+			offset += sizeof(SQBuffer);
+		}
+		else
+		{
+			u32 size = std::min<u32>((1 + rng() % 40) * sizeof(SQBuffer), data.size() - offset);
+			write(&data[offset], size);
+			offset += size;
+		}
+		if (offset % BlockSize == 0 && offset < data.size())
+			ASSERT_EQ(offset / BlockSize % 10, TA_YUV_TEX_CNT);
+	}
+	checkVram(reference);
+	ASSERT_EQ(0u, TA_YUV_TEX_CNT);
+}
+
+TEST_F(YuvConvTest, DISABLED_Benchmark)
+{
+	// 640x480 frame
+	std::vector<u8> data = setupTexture(40, 30, 1, 4);
+	const int frames = 200;
+	const double bulkTime = benchmark::timeMillis([&]() {
+		for (int i = 0; i < frames; i++)
+			write(data.data(), data.size());
+	});
+	const double sqTime = benchmark::timeMillis([&]() {
+		for (int i = 0; i < frames; i++)
+			for (u32 offset = 0; offset < data.size(); offset += sizeof(SQBuffer))
+				TAWriteSQ(0x10800000, (const SQBuffer *)&data[offset]);
+	});
+	std::vector<u8> out(640 * 480 * 2);
+	const double scalarTime = benchmark::timeMillis([&]() {
+		for (int i = 0; i < frames; i++)
+			for (u32 block = 0; block < 40 * 30; block++)
+				scalarBlock384(&data[block * BlockSize], &out[block / 40 * 16 * 640 * 2 + block % 40 * 32], 640);
+	});
+	printf("YUV %d frames 640x480: DMA %.1f ms, store queues %.1f ms, previous scalar conversion %.1f ms\n", frames, bulkTime, sqTime, scalarTime);
+}
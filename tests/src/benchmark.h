@@ -0,0 +1,37 @@
+#pragma once
+#include <chrono>
+
+//
+// Timing helpers of the DISABLED_Benchmark tests.
+// Run them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+//
+namespace benchmark
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds elapsed since start
+inline double elapsedMillis(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Runs f and returns its duration in milliseconds
+template<typename F>
+double timeMillis(F f)
+{
+	const Clock::time_point start = Clock::now();
+	f();
+	return elapsedMillis(start);
+}
+
+// Throughput in MB/s
+inline double mbPerSec(double bytes, double millis) {
+	return bytes / 1024.0 / 1024.0 * 1000.0 / millis;
+}
+
+// Millions of items per second
+inline double millionsPerSec(double count, double millis) {
+	return count / millis / 1000.0;
+}
+
+}